@@ -0,0 +1,126 @@
+/* asynAtomic.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * Fallback for asynAtomic.h on EPICS base versions without epicsAtomic.h.
+ * Every operation is serialized by one mutex.
+ */
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#include "asynAtomic.h"
+
+#if !(EPICS_VERSION>3 || (EPICS_VERSION==3 && EPICS_REVISION>=15))
+
+static epicsThreadOnceId atomicOnceId = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId atomicLock = 0;
+
+static void atomicInit(void *arg)
+{
+    atomicLock = epicsMutexMustCreate();
+}
+
+static void atomicLockTake(void)
+{
+    epicsThreadOnce(&atomicOnceId,atomicInit,0);
+    epicsMutexMustLock(atomicLock);
+}
+
+int asynAtomicGetInt(const int *p)
+{
+    int value;
+
+    atomicLockTake();
+    value = *p;
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+void asynAtomicSetInt(int *p,int value)
+{
+    atomicLockTake();
+    *p = value;
+    epicsMutexUnlock(atomicLock);
+}
+
+int asynAtomicIncrInt(int *p)
+{
+    int value;
+
+    atomicLockTake();
+    value = ++(*p);
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+int asynAtomicDecrInt(int *p)
+{
+    int value;
+
+    atomicLockTake();
+    value = --(*p);
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+int asynAtomicCmpAndSwapInt(int *p,int oldValue,int newValue)
+{
+    int value;
+
+    atomicLockTake();
+    value = *p;
+    if(value==oldValue) *p = newValue;
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+void *asynAtomicGetPtr(void * const *p)
+{
+    void *value;
+
+    atomicLockTake();
+    value = *p;
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+void asynAtomicSetPtr(void **p,void *value)
+{
+    atomicLockTake();
+    *p = value;
+    epicsMutexUnlock(atomicLock);
+}
+
+void *asynAtomicCmpAndSwapPtr(void **p,void *oldValue,void *newValue)
+{
+    void *value;
+
+    atomicLockTake();
+    value = *p;
+    if(value==oldValue) *p = newValue;
+    epicsMutexUnlock(atomicLock);
+    return value;
+}
+
+/* Taking and releasing the mutex orders the memory accesses on both sides */
+void asynAtomicReadMemoryBarrier(void)
+{
+    atomicLockTake();
+    epicsMutexUnlock(atomicLock);
+}
+
+void asynAtomicWriteMemoryBarrier(void)
+{
+    atomicLockTake();
+    epicsMutexUnlock(atomicLock);
+}
+
+#endif /* EPICS 3.14 */
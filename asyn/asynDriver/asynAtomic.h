@@ -0,0 +1,63 @@
+/*asynAtomic.h*/
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/*
+ * Atomic operations used internally by asynManager and asynPortDriver.
+ *
+ * EPICS base 3.15 and later provide epicsAtomic.h and these map directly
+ * onto it. For 3.14 the same operations are implemented in asynAtomic.c
+ * by serializing them with a single mutex, which is correct but slower.
+ * This header is private to the asyn library and is not installed.
+ */
+
+#ifndef INCasynAtomich
+#define INCasynAtomich
+
+#include <stddef.h>
+#include <epicsVersion.h>
+
+#if EPICS_VERSION>3 || (EPICS_VERSION==3 && EPICS_REVISION>=15)
+#include <epicsAtomic.h>
+
+#define asynAtomicGetInt(p)            epicsAtomicGetIntT(p)
+#define asynAtomicSetInt(p,v)          epicsAtomicSetIntT((p),(v))
+#define asynAtomicIncrInt(p)           epicsAtomicIncrIntT(p)
+#define asynAtomicDecrInt(p)           epicsAtomicDecrIntT(p)
+#define asynAtomicCmpAndSwapInt(p,o,n) epicsAtomicCmpAndSwapIntT((p),(o),(n))
+#define asynAtomicGetPtr(p)            epicsAtomicGetPtrT(p)
+#define asynAtomicSetPtr(p,v)          epicsAtomicSetPtrT((p),(v))
+#define asynAtomicCmpAndSwapPtr(p,o,n) epicsAtomicCmpAndSwapPtrT((p),(o),(n))
+#define asynAtomicReadMemoryBarrier()  epicsAtomicReadMemoryBarrier()
+#define asynAtomicWriteMemoryBarrier() epicsAtomicWriteMemoryBarrier()
+
+#else /* EPICS 3.14 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  asynAtomicGetInt(const int *p);
+void asynAtomicSetInt(int *p,int value);
+int  asynAtomicIncrInt(int *p);
+int  asynAtomicDecrInt(int *p);
+int  asynAtomicCmpAndSwapInt(int *p,int oldValue,int newValue);
+void *asynAtomicGetPtr(void * const *p);
+void asynAtomicSetPtr(void **p,void *value);
+void *asynAtomicCmpAndSwapPtr(void **p,void *oldValue,void *newValue);
+void asynAtomicReadMemoryBarrier(void);
+void asynAtomicWriteMemoryBarrier(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EPICS 3.14 */
+
+#endif /* INCasynAtomich */
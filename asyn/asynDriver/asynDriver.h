@@ -52,6 +52,22 @@ typedef enum {
     asynQueuePriorityConnect
 }asynQueuePriority;
 
+/* How portThread picks the next request of an ASYN_CANBLOCK port*/
+typedef enum {
+    asynQueuePolicyStrict,asynQueuePolicyAging,asynQueuePolicyFair,
+    asynQueuePolicyDeadline
+}asynQueuePolicy;
+
+#define ASYN_QUEUE_POLICY_STRINGS "strict","aging","fair","deadline"
+
+/* How a queued request may be merged with others for the same reason and
+ * drvUser on a port that enables merging.
+ * Read:  one processUser call answers all pending reads.
+ * Write: the newest pending write is the only one done.*/
+typedef enum {
+    asynQueueMergeNone,asynQueueMergeRead,asynQueueMergeWrite
+}asynQueueMerge;
+
 typedef struct asynUser {
     char          *errorMessage;
     int            errorMessageSize;
@@ -79,6 +95,9 @@ typedef struct asynInterface{
 /*registerPort attributes*/
 #define ASYN_MULTIDEVICE  0x0001
 #define ASYN_CANBLOCK     0x0002
+/*ASYN_MULTITHREAD requires ASYN_CANBLOCK and ASYN_MULTIDEVICE.
+ *Several threads call back for different addresses concurrently.*/
+#define ASYN_MULTITHREAD  0x0004
 
 /*standard values for asynUser.reason*/
 #define ASYN_REASON_SIGNAL -1
@@ -91,6 +110,37 @@ typedef struct asynInterface{
 typedef void (*userCallback)(asynUser *pasynUser);
 typedef void (*exceptionCallback)(asynUser *pasynUser,asynException exception);
 typedef void (*timeStampCallback)(void *userPvt, epicsTimeStamp *pTimeStamp);
+typedef void (*interruptFreeCallback)(void *pfreePvt);
+/* Called instead of processUser for a request that was answered by the
+ * processUser call of pprocessedUser*/
+typedef void (*queueMergeCallback)(asynUser *pasynUser,
+                                   asynUser *pprocessedUser);
+
+/* Latency histogram kept by asynManager for each queue priority of an
+ * ASYN_CANBLOCK port. bucket[0] counts latencies below 1 microsecond,
+ * bucket[i] those from 2^(i-1) to 2^i microseconds, and the last bucket
+ * everything longer.*/
+#define ASYN_LATENCY_BUCKETS 24
+typedef struct asynLatencyHistogram {
+    unsigned long count;
+    double        sum; /*seconds*/
+    double        max; /*seconds*/
+    unsigned long bucket[ASYN_LATENCY_BUCKETS];
+}asynLatencyHistogram;
+
+typedef struct asynQueueStatistics {
+    epicsTimeStamp       since; /*registerPort or resetQueueStatistics*/
+    /*queueRequest until the callback starts, indexed by asynQueuePriority*/
+    asynLatencyHistogram queueWait[asynQueuePriorityConnect+1];
+    /*time in processUser*/
+    asynLatencyHistogram service[asynQueuePriorityConnect+1];
+    int                  nQueued;
+    int                  queueHighWater;
+    unsigned long        numberTimeouts; /*queueRequest timeouts*/
+    unsigned long        numberCancels;  /*cancelRequest of queued requests*/
+    unsigned long        numberMerged;   /*requests answered by another*/
+    unsigned long        numberAborts;   /*asynCommon:abort of active callbacks*/
+}asynQueueStatistics;
 
 typedef struct interruptNode{
     ELLNODE node;
@@ -156,8 +206,13 @@ typedef struct asynManager {
     asynStatus (*freeInterruptNode)(asynUser *pasynUser,interruptNode *pnode);
     asynStatus (*addInterruptUser)(asynUser *pasynUser,
                                   interruptNode*pinterruptNode);
+    /* Returns without waiting for interruptStart/interruptEnd passes that
+     * already started. They may still call the removed user, so free what
+     * it uses with deferInterruptFree, not right after this returns.*/
     asynStatus (*removeInterruptUser)(asynUser *pasynUser,
                                   interruptNode*pinterruptNode);
+    /* The thread that called interruptStart must call interruptEnd.
+     * interruptEnd returns asynError if this thread has no pass to end.*/
     asynStatus (*interruptStart)(void *pasynPvt,ELLLIST **plist);
     asynStatus (*interruptEnd)(void *pasynPvt);
     /* Time stamp functions */
@@ -168,6 +223,34 @@ typedef struct asynManager {
     asynStatus (*setTimeStamp)(asynUser *pasynUser, const epicsTimeStamp *pTimeStamp);
 
     const char *(*strStatus)(asynStatus status);
+    /* registerPort with the number of port threads for ASYN_MULTITHREAD*/
+    asynStatus (*registerPortThreads)(const char *portName,
+                              int attributes,int autoConnect,
+                              unsigned int priority,unsigned int stackSize,
+                              int numberThreads);
+    /* ASYN_CANBLOCK ports registered later with priority 0 share threads*/
+    asynStatus (*setThreadPool)(int numberThreads);
+    /* Interrupt users by the reason and address they had when added.
+     * plist is the list returned by interruptStart.*/
+    interruptNode *(*interruptFirstMatch)(ELLLIST *plist,int reason,int addr);
+    interruptNode *(*interruptNextMatch)(interruptNode *pinterruptNode);
+    /* callback(pfreePvt) is called when no interruptStart/interruptEnd pass
+     * that may still call the removed user is active*/
+    asynStatus (*deferInterruptFree)(interruptNode *pinterruptNode,
+                              interruptFreeCallback callback,void *pfreePvt);
+    /* Queue latency of the port pasynUser is connected to*/
+    asynStatus (*getQueueStatistics)(asynUser *pasynUser,
+                              asynQueueStatistics *pasynQueueStatistics);
+    asynStatus (*resetQueueStatistics)(asynUser *pasynUser);
+    /* param <= 0 selects the default of the policy*/
+    asynStatus (*setQueuePolicy)(asynUser *pasynUser,
+                              asynQueuePolicy policy,double param);
+    /* Requests that callback answers if the port enables merging*/
+    asynStatus (*setQueueMerge)(asynUser *pasynUser,
+                              asynQueueMerge merge,queueMergeCallback callback);
+    asynStatus (*enableQueueMerge)(asynUser *pasynUser,int yesNo);
+    /* Interrupt the I/O of the callback active for the device*/
+    asynStatus (*abortRequest)(asynUser *pasynUser);
 }asynManager;
 epicsShareExtern asynManager *pasynManager;
 
@@ -178,6 +261,9 @@ typedef struct  asynCommon {
     void       (*report)(void *drvPvt,FILE *fp,int details);
     asynStatus (*connect)(void *drvPvt,asynUser *pasynUser);
     asynStatus (*disconnect)(void *drvPvt,asynUser *pasynUser);
+    /*abort is optional. It is called with asynManager locks held and
+     *must not block. yesNo=1 makes I/O return asynError until abort(...,0)*/
+    asynStatus (*abort)(void *drvPvt,asynUser *pasynUser,int yesNo);
 }asynCommon;
 
 /* asynLockPortNotify is for address change drivers */
@@ -209,6 +295,10 @@ typedef struct  asynLockPortNotify {
 #define ASYN_TRACEINFO_SOURCE 0x0004
 #define ASYN_TRACEINFO_THREAD 0x0008
 
+/* direction argument of asynTrace.captureIO */
+#define ASYN_CAPTURE_WRITE 0
+#define ASYN_CAPTURE_READ  1
+
 /* asynPrint and asynPrintIO are macros that act like
    int asynPrint(asynUser *pasynUser,int reason, const char *format, ... ); 
    int asynPrintIO(asynUser *pasynUser,int reason,
@@ -257,6 +347,12 @@ typedef struct asynTrace {
     int        (*vprintIOSource)(asynUser *pasynUser,int reason,
                     const char *buffer, size_t len,const char *file, int line, const char *pformat, va_list pvar) EPICS_PRINTF_STYLE(7,0);
 #endif
+    /* Binary capture of all data transferred. See asynTraceCapture.h */
+    asynStatus (*setTraceCaptureFile)(asynUser *pasynUser,FILE *fp);
+    FILE       *(*getTraceCaptureFile)(asynUser *pasynUser);
+    int        (*captureIO)(asynUser *pasynUser,int direction,
+                    asynStatus status,int eomReason,
+                    const char *buffer,size_t len);
 }asynTrace;
 epicsShareExtern asynTrace *pasynTrace;
 
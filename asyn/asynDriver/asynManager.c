@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <math.h>
 
 #include <ellLib.h>
 #include <errlog.h>
@@ -27,11 +28,14 @@
 #include <epicsThread.h>
 #include <epicsTime.h>
 #include <epicsTimer.h>
+#include <epicsExit.h>
 #include <cantProceed.h>
 #include <epicsAssert.h>
 
 #include <epicsExport.h>
 #include "asynDriver.h"
+#include "asynAtomic.h"
+#include "asynTraceCapture.h"
 
 #define BOOL int
 #ifndef TRUE
@@ -43,9 +47,21 @@
 #define ERROR_MESSAGE_SIZE 160
 #define NUMBER_QUEUE_PRIORITIES (asynQueuePriorityConnect + 1)
 #define DEFAULT_TRACE_TRUNCATE_SIZE 80
-#define DEFAULT_TRACE_BUFFER_SIZE 80
 #define DEFAULT_SECONDS_BETWEEN_PORT_CONNECT 20
 #define DEFAULT_AUTOCONNECT_TIMEOUT 0.5
+/*Least seconds between autoConnect attempts of a port or device*/
+#define AUTOCONNECT_RETRY_INTERVAL 2.0
+#define DEFAULT_NUMBER_THREADS 4
+/* Hash table sizes. Must be powers of 2*/
+#define PORT_HASH_SIZE 256
+#define DEVICE_HASH_MIN_SIZE 16
+#define INTERFACE_CHAIN_SIZE 32
+/* queueRequest timeouts. See timerWheelThread*/
+#define TIMER_WHEEL_TICK 0.01 /*seconds*/
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1<<TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_MAX_TICKS ((1u<<(TIMER_WHEEL_BITS*TIMER_WHEEL_LEVELS))-1)
 
 /* This is taken from dbDefs.h, which we don't want to include */
 /* Subtract member byte offset, returning pointer to parent object */
@@ -65,6 +81,7 @@ typedef struct tracePvt tracePvt;
 typedef struct userPvt userPvt;
 typedef struct port port;
 typedef struct device device;
+typedef struct timerWheel timerWheel;
 
 typedef enum {
     traceFileErrlog,traceFileStdout,traceFileStderr,traceFileFP
@@ -77,18 +94,92 @@ struct tracePvt {
     traceFileType type;
     FILE          *fp;
     size_t        traceTruncateSize;
-    size_t        traceBufferSize;
-    char          *traceBuffer;
+    FILE          *captureFp;
 };
 
+/* asynPrint and asynPrintIO do not write the trace file themselves.
+ * Each thread that traces has a traceRing to which it appends a
+ * traceRecord holding the formatted message and a copy of the I/O data.
+ * Only the owning thread writes head and only the thread holding
+ * asynBase.lockTraceDrain writes tail, so appending takes no lock.
+ * traceDrain writes the records of all rings to the trace files in
+ * sequence order. When a ring is full the record is dropped and counted.
+ * traceRings stay on asynBase.ptraceRingList. When a thread created by
+ * epicsThreadCreate exits, its ring is marked ownerExited. traceDrain frees
+ * the buffer of such a ring once it is empty and traceRingGet gives the ring
+ * to the next thread that traces, so the number of rings is bounded by the
+ * most threads ever tracing at the same time.*/
+#define TRACE_RING_SIZE 65536 /*must be a power of 2*/
+#define TRACE_MESSAGE_SIZE 1024
+#define TRACE_RECORD_MAX (TRACE_RING_SIZE/4)
+/*Most data bytes in a captureIO record*/
+#define TRACE_CAPTURE_SIZE (TRACE_RECORD_MAX - 256)
+#define TRACE_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct traceRecord {
+    int            length;   /*of header, message, I/O data and padding*/
+    int            seq;
+    tracePvt       *ptracePvt; /*0 for padding before the end of buffer*/
+    int            traceInfoMask;
+    int            traceIOMask;
+    epicsTimeStamp time;
+    const char     *portName;
+    int            addr;
+    int            reason;
+    const char     *file;
+    int            line;
+    unsigned int   threadPriority;
+    int            messageLength;
+    int            ioLength;
+    /* following for captureIO records*/
+    int            isCapture;
+    int            direction;
+    int            status;
+    int            eomReason;
+    size_t         transferLength;
+}traceRecord;
+
+typedef struct traceRing {
+    struct traceRing *pnext; /*For asynBase.ptraceRingList*/
+    int           head;
+    int           tail;
+    unsigned int  headNext; /*head after the record being appended*/
+    int           dropped;
+    int           droppedReported;
+    int           ownerExited;
+    epicsThreadId threadId;
+    char          threadName[32];
+    char          *buffer;
+    char          message[TRACE_MESSAGE_SIZE];
+}traceRing;
+
 #define nMemList 9
 static size_t memListSize[nMemList] =
     {16,32,64,128,256,512,1024,2048,4096};
+/* Number of nodes moved between a memCache and asynBase.memList at a time*/
+static int memCacheBatch[nMemList] =
+    {16,16,16,16,16,8,8,4,2};
 typedef struct memNode {
     ELLNODE node;
     void    *memory;
 }memNode;
 
+/* Each thread that calls memMalloc or memFree has a memCache so that most
+ * calls do not take any lock. A free list of a memCache is refilled from
+ * asynBase.memList when empty and gives memCacheBatch nodes back when it
+ * holds twice that many. When a thread created by epicsThreadCreate exits,
+ * its memCache gives all nodes back to asynBase.memList and is freed.
+ * Other threads keep their memCache until the process exits.*/
+typedef struct memCache {
+    ELLNODE node; /*For asynBase.memCacheList*/
+    ELLLIST freeList[nMemList];
+}memCache;
+
+typedef struct memStats {
+    int created; /*nodes allocated by malloc*/
+    int peak;    /*most nodes ever in use or on a memCache*/
+}memStats;
+
 /*
  * Ensure adequate alignment
  */
@@ -96,33 +187,120 @@ typedef struct memNode {
 
 typedef struct asynBase {
     ELLLIST           asynPortList;
+    port              *portHash[PORT_HASH_SIZE]; /*port.pnextHash*/
     ELLLIST           asynUserFreeList;
     ELLLIST           interruptNodeFree;
-    epicsTimerQueueId timerQueue;
     epicsMutexId      lock;
     epicsMutexId      lockTrace;
     tracePvt          trace;
+    /* following for the trace rings */
+    void              *ptraceRingList; /*traceRing.pnext*/
+    epicsThreadPrivateId traceRingId;
+    epicsMutexId      lockTraceDrain;
+    int               traceSeq;
+    int               traceWriterIdle;
+    epicsEventId      traceWriterWakeup;
+    char              *traceText;      /*Used only by traceDrain*/
+    size_t            traceTextSize;
+    epicsTimeStamp    traceDroppedTime;
+    /* following for memMalloc/memFree */
+    epicsMutexId      lockMem;
     ELLLIST           memList[nMemList];
+    memStats          memStats[nMemList];
+    ELLLIST           memCacheList;
+    epicsThreadPrivateId memCacheId;
+    /* following for interruptStart/interruptEnd*/
+    epicsThreadPrivateId interruptPassId;
     /* following for connectPort */
     epicsTimerQueueId connectPortTimerQueue;
     double            autoConnectTimeout;
+    /* following for setThreadPool */
+    int               threadPoolSize;
+    struct threadPool *pthreadPool;
+    /* following for queueRequest timeouts*/
+    ELLLIST           timerWheelList; /*Wheels are never removed*/
+    int               timerTick;
+    int               timerThreadIdle;
+    epicsEventId      timerThreadWakeup;
 }asynBase;
 static asynBase *pasynBase = 0;
 
+/* ASYN_CANBLOCK ports that use the thread pool have no port thread.
+ * signalPortThread puts the port on runnableList and a pool thread
+ * calls portProcess. A port is never on runnableList while a pool
+ * thread is processing it, so each port is still served by one thread
+ * at a time.*/
+typedef struct threadPool {
+    epicsMutexId   lock;
+    epicsEventId   notify;
+    ELLLIST        runnableList; /*port.poolNode*/
+    int            numberThreads;
+    int            numberBusy;
+    unsigned long  numberRuns;
+    double         busySeconds;
+    epicsTimeStamp startTime;
+}threadPool;
+
+/* interruptStart hands out an immutable copy of the callback list so that
+ * addInterruptUser and removeInterruptUser never wait for callbacks.
+ * They only drop the current snapshot. The next interruptStart builds a new
+ * one, so a burst of changes between passes costs a single copy.
+ * Each snapshot counts the passes that use it. A replaced snapshot stays on
+ * interruptBase.retiredList only until its own passes have ended, so there
+ * are never more retired snapshots than active passes. interruptEnd finds
+ * the snapshot of its pass from the interruptPass records that each thread
+ * keeps in asynBase.interruptPassId.
+ * Users with the same (reason,addr) are chained by pnextMatch, and the
+ * first of them is on the hash chain matchTable[hash].pnextKey. */
+typedef struct interruptSnapshotNode {
+    interruptNode nodePublic;
+    int           reason;
+    int           addr;
+    struct interruptSnapshotNode *pnextMatch;
+    struct interruptSnapshotNode *plastMatch; /*first of a key only*/
+    struct interruptSnapshotNode *pnextKey;   /*first of a key only*/
+}interruptSnapshotNode;
+
+typedef struct interruptSnapshot {
+    ELLLIST               list; /*MUST be first. interruptSnapshotNode*/
+    ELLNODE               retireNode; /*For interruptBase.retiredList*/
+    unsigned long         generation;
+    int                   numberActive; /*passes that use this snapshot*/
+    interruptSnapshotNode **matchTable;
+    unsigned int          matchTableSize; /*power of 2*/
+    interruptSnapshotNode *pnodes;
+}interruptSnapshot;
+
+/* deferInterruptFree calls callback(pfreePvt) once no snapshot older than
+ * generation has an active pass*/
+typedef struct interruptDeferred {
+    ELLNODE               node;
+    unsigned long         generation;
+    interruptFreeCallback callback;
+    void                  *pfreePvt;
+}interruptDeferred;
+
+typedef struct interruptPass {
+    struct interruptPass  *pprev; /*Older pass of the thread, or free list*/
+    struct interruptBase  *pinterruptBase;
+    interruptSnapshot     *psnapshot;
+}interruptPass;
+
 typedef struct interruptBase {
     ELLLIST      callbackList;
-    ELLLIST      addRemoveList;
-    BOOL         callbackActive;
-    BOOL         listModified;
+    interruptSnapshot *psnapshot; /*NULL after callbackList changed*/
+    unsigned long generation;     /*of the next snapshot*/
+    ELLLIST      retiredList;     /*interruptSnapshot.retireNode*/
+    ELLLIST      deferredList;    /*interruptDeferred in generation order*/
+    interruptPass *pfreePass;
     port         *pport;
     asynInterface *pasynInterface;
 }interruptBase;
 
 typedef struct interruptNodePvt {
-    ELLNODE  addRemoveNode;
     BOOL     isOnList;
-    BOOL     isOnAddRemoveList;
-    epicsEventId  callbackDone;
+    int      reason;
+    int      addr;
     interruptBase *pinterruptBase;
     interruptNode nodePublic;
 }interruptNodePvt;
@@ -133,6 +311,41 @@ typedef struct interfaceNode {
     interruptBase *pinterruptBase;
 }interfaceNode;
 
+/* For each interfaceType of a port, the nodes findInterface looks at.
+ * The chains are hashed by interfaceType in port.interfaceChainTable and
+ * are updated by registerInterface and interposeInterface, so findInterface
+ * does not have to walk interfaceList and interposeInterfaceList.
+ * Interposing replaces interfaceNode.pasynInterface so the chain stays valid.*/
+typedef struct interfaceChain {
+    struct interfaceChain *pnext;
+    const char    *interfaceType;
+    interfaceNode *pinterfaceNode; /*On port.interfaceList or 0*/
+    interfaceNode *pinterposeNode; /*On port.dpc.interposeInterfaceList or 0*/
+}interfaceChain;
+
+/* Queued requests for one device or port at one priority.
+ * A dpQueue is on port.readyList only while it has requests that might
+ * be runnable. When portThread finds the first request cannot run because
+ * the device is disabled, disconnected or blocked by another asynUser the
+ * dpQueue is parked, i.e. left off readyList, until something changes.*/
+typedef struct dpQueue {
+    ELLNODE         node;        /*For asynPort.readyList*/
+    ELLLIST         requestList; /*userPvt*/
+    BOOL            isReady;
+    double          deficit;     /*seconds. For queuePolicyFair*/
+    struct dpCommon *pdpCommon;
+}dpQueue;
+
+/* A queue policy picks the dpQueue whose first request portThread runs
+ * next. select removes it from its readyList, and charge, if not 0, is
+ * told how long the callback took. See queuePolicyTable.*/
+typedef struct queuePolicy {
+    asynQueuePolicy policy;
+    double          defaultParam;
+    dpQueue         *(*select)(port *pport);
+    void            (*charge)(port *pport,dpQueue *pdpQueue,double seconds);
+}queuePolicy;
+
 typedef struct dpCommon { /*device/port common fields*/
     BOOL           enabled;
     BOOL           connected;
@@ -148,6 +361,16 @@ typedef struct dpCommon { /*device/port common fields*/
     tracePvt       trace;
     port           *pport;
     device         *pdevice; /* 0 if port.dpc*/
+    /*The following are only used if port attributes&ASYN_CANBLOCK*/
+    /*asynQueuePriorityConnect requests are kept on port.connectQueue*/
+    dpQueue        queue[NUMBER_QUEUE_PRIORITIES-1];
+    ELLNODE        retryNode; /*For asynPort.autoConnectRetryList*/
+    BOOL           isOnRetryList;
+    BOOL           busy; /*a port thread is calling back for this device*/
+    userPvt        *pactiveUser; /*whose callback made it busy*/
+    epicsThreadId  activeThread; /*the thread calling back*/
+    BOOL           aborting; /*asynCommon:abort(...,1) was called*/
+    epicsMutexId   synchronousLock; /*device lock if ASYN_MULTITHREAD*/
 }dpCommon;
 
 typedef struct exceptionUser {
@@ -159,40 +382,68 @@ typedef struct exceptionUser {
 }exceptionUser;
 
 typedef enum {callbackIdle,callbackActive,callbackCanceled}callbackState;
+/* userPvt.queueState. queueIdle and queueListed are only set with
+ * asynManagerLock held. queueRequest without a timeout claims an idle
+ * request with a compare and swap to queueIncoming and then pushes it onto
+ * incomingList. cancelRequest changes a request that is not yet drained to
+ * queueCanceled, and queueIncomingDrain drops it.*/
+typedef enum {
+    queueIdle,       /*not queued*/
+    queueIncoming,   /*on incomingList, or about to be pushed onto it*/
+    queueCanceled,   /*as queueIncoming but canceled*/
+    queueListed      /*on a dpQueue, connectQueue or being merged*/
+}queueState;
+/* There is a userPvt for every asynUser, i.e. at least one per record,
+ * so the members are ordered to avoid padding. Only what every asynUser
+ * needs is created by createAsynUser.*/
 struct userPvt {
-    ELLNODE       node;        /*For asynPort.queueList*/
-    /* timer,...,state are for queueRequest callbacks*/
-    epicsTimerId  timer;
-    epicsEventId  callbackDone;
+    ELLNODE       node;        /*For dpQueue.requestList or asynPort.connectQueue*/
+    userPvt       *pnextIncoming; /*For asynPort.incomingList*/
+    port          *pport;
+    device        *pdevice;
+    exceptionUser *pexceptionUser;
+    /* processUser,...,state are for queueRequest callbacks*/
     userCallback  processUser;
     userCallback  timeoutUser;
     double        timeout;
+    ELLNODE       timerNode;   /*For a timerWheel slot or expiredList*/
+    ELLLIST       *ptimerList; /*The list timerNode is on or 0*/
+    epicsEventId  callbackDone; /*Created by the first cancelRequest that waits*/
+    epicsTimeStamp queueTime;  /*When queueRequest was called*/
+    unsigned long queueSequence; /*Port wide queue order. See queueAdd*/
+    unsigned int  timerExpire; /*timerWheel tick*/
     callbackState state;
+    asynQueuePriority priority;
     unsigned int  blockPortCount;
     unsigned int  blockDeviceCount;
-    BOOL          isBlockHolder;
-    port          *pport;
-    device        *pdevice;
-    exceptionUser *pexceptionUser;
     BOOL          freeAfterCallback;
-    BOOL          isQueued;
+    int           queueState; /*queueState. Atomic, see queueRequest*/
+    /* The following are for enableQueueMerge. See queueMerge*/
+    asynQueueMerge merge;
+    queueMergeCallback mergeCallback;
+    userPvt       *pnextMerged;
     asynUser      user;
 };
 
 struct device {
     ELLNODE   node;     /*For asynPort.deviceList*/
+    device    *pnextHash; /*For asynPort.deviceHash*/
     dpCommon  dpc;
     int       addr;
 };
 
 struct port {
     ELLNODE       node;  /*For asynBase.asynPortList*/
+    port          *pnextHash; /*For asynBase.portHash*/
     char          *portName;
     epicsMutexId  asynManagerLock; /*for asynManager*/
     epicsMutexId  synchronousLock; /*for synchronous drivers*/
     dpCommon      dpc;
     ELLLIST       deviceList;
+    device        **deviceHash; /*Indexed by addr. Grows with deviceList*/
+    int           deviceHashSize;
     ELLLIST       interfaceList;
+    interfaceChain *interfaceChainTable[INTERFACE_CHAIN_SIZE];
     int           attributes;
     /* The following are for autoConnect*/
     asynUser      *pasynUser;
@@ -200,10 +451,45 @@ struct port {
     asynLockPortNotify *pasynLockPortNotify;
     void          *lockPortNotifyPvt;
     /*The following are only initialized/used if attributes&ASYN_CANBLOCK*/
-    ELLLIST       queueList[NUMBER_QUEUE_PRIORITIES];
-    BOOL          queueStateChange;
+    ELLLIST       connectQueue; /*asynQueuePriorityConnect requests*/
+    ELLLIST       readyList[NUMBER_QUEUE_PRIORITIES-1]; /*dpQueue*/
+    const queuePolicy *pqueuePolicy;
+    double        queuePolicyParam;
+    BOOL          queueMergeEnabled;
+    ELLLIST       autoConnectRetryList; /*dpCommon parked until autoConnect*/
+    epicsTimeStamp lastAutoConnectRetry;
+    int           nQueued;
+    unsigned long queueSequence;      /*of the next request added at the end*/
+    unsigned long queueFrontSequence; /*of the last request added in front*/
+    asynQueueStatistics queueStatistics;
+    /* queueRequest without a timeout pushes onto incomingList without
+     * taking asynManagerLock. The holder of asynManagerLock moves the
+     * entries to the dpQueues. See queueIncomingDrain.*/
+    void          *incomingList[NUMBER_QUEUE_PRIORITIES];
+    int           wakeupPending;
     epicsEventId  notifyPortThread;
     epicsThreadId threadid;
+    int           numberThreads;
+    BOOL          connectActive; /*a port thread is emptying connectQueue*/
+    timerWheel    *ptimerWheel;
+    /* The following are for ASYN_MULTITHREAD. See synchronousLockTake*/
+    int           sharedCount;
+    int           sharedWaiting;
+    epicsEventId  exclusiveDone;
+    int           exclusiveCount;
+    epicsThreadId exclusiveOwner;
+    BOOL          exclusiveWaiting;
+    epicsEventId  sharedIdle;
+    /* The following are for ports that use asynBase.pthreadPool*/
+    BOOL          usesThreadPool;
+    ELLNODE       poolNode; /*For threadPool.runnableList*/
+    BOOL          poolRunnable;
+    BOOL          poolRunning;
+    BOOL          poolRerun; /*signaled while poolRunning*/
+    epicsTimeStamp poolRunnableTime;
+    unsigned long poolNumberWaits;
+    double        poolWaitSum;
+    double        poolWaitMax;
     userPvt       *pblockProcessHolder;
     /* following are for portConnect */
     asynUser      *pconnectUser;
@@ -218,10 +504,29 @@ struct port {
     double        secondsBetweenPortConnect;
 };
 
+/* Each ASYN_CANBLOCK port has a timerWheel for the queueRequest timeouts
+ * of its queued requests. It is protected by asynManagerLock. A request is
+ * armed by queueAdd and disarmed by queueRemove, both O(1), so no timer
+ * object is needed per asynUser. Level 0 has a slot for each of the next
+ * TIMER_WHEEL_SIZE ticks, and each higher level covers TIMER_WHEEL_SIZE
+ * times the span of the level below. When tick wraps past a slot of level 0
+ * the matching slot of the next level is cascaded down.
+ * timerWheelThread advances the wheels of the ports that have requests
+ * with a timeout, and calls timeoutUser for the requests that expire.*/
+struct timerWheel {
+    ELLNODE      node; /*For asynBase.timerWheelList*/
+    port         *pport;
+    unsigned int tick;
+    int          numberArmed;
+    ELLLIST      expiredList; /*userPvt.timerNode*/
+    ELLLIST      slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE]; /*userPvt.timerNode*/
+};
+
 typedef struct queueLockPortPvt {
     epicsEventId  queueLockPortEvent;
     epicsMutexId  queueLockPortMutex;
     unsigned int  queueLockPortCount;
+    dpCommon      *plockDpCommon; /*Locked without queueLockPortCallback*/
 }queueLockPortPvt;
 
 #define interruptNodeToPvt(pinterruptNode) \
@@ -247,12 +552,69 @@ static port *locatePort(const char *portName);
 static device *locateDevice(port *pport,int addr,BOOL allocNew);
 static interfaceNode *locateInterfaceNode(
             ELLLIST *plist,const char *interfaceType,BOOL allocNew);
+static interfaceChain *locateInterfaceChain(
+            port *pport,const char *interfaceType,BOOL allocNew);
+static interfaceNode *locateInterfaceChainNode(
+            port *pport,const char *interfaceType);
 static void exceptionOccurred(asynUser *pasynUser,asynException exception);
-static void queueTimeoutCallback(void *pvt);
+static void queueTimeoutCallback(port *pport,userPvt *puserPvt);
+/*timerArm,timerDisarm,timerWheelAdvance must be called with asynManagerLock held*/
+static void timerArm(port *pport,userPvt *puserPvt);
+static void timerDisarm(port *pport,userPvt *puserPvt);
+static void timerWheelAdvance(timerWheel *ptimerWheel,unsigned int tick);
+static timerWheel *timerWheelCreate(port *pport);
+static void timerWheelThread(void *arg);
+static traceRing *traceRingGet(void);
+static void traceWriterWakeup(void);
+static int traceDrain(void);
+static void traceWriterThread(void *arg);
+static void traceExit(void *arg);
+static void traceReport(FILE *fp);
+static void timerThreadWakeup(void);
+static unsigned int timerTicks(double timeout);
+static void latencyRecord(asynLatencyHistogram *phistogram,double seconds);
+static double latencyPercentile(const asynLatencyHistogram *phistogram,
+    double fraction);
+/*queueAdd ... queueNextRequest must be called with asynManagerLock held*/
+static void queueAdd(port *pport,userPvt *puserPvt,
+    asynQueuePriority priority,BOOL addToFront);
+static void queueRemove(port *pport,userPvt *puserPvt);
+static void queueMakeReady(port *pport,dpQueue *pdpQueue,BOOL addToFront);
+static void queueUnpark(port *pport,dpCommon *pdpCommon);
+static userPvt *queueNextRequest(port *pport,BOOL *callTimeoutUser);
+static BOOL queueHasReady(port *pport);
+static dpQueue *queueSelectStrict(port *pport);
+static dpQueue *queueSelectAging(port *pport);
+static dpQueue *queueSelectFair(port *pport);
+static void queueChargeFair(port *pport,dpQueue *pdpQueue,double seconds);
+static dpQueue *queueSelectDeadline(port *pport);
+static userPvt *queueMerge(port *pport,userPvt *puserPvt,
+    userPvt **ppmerged);
+/*Indexed by asynQueuePolicy*/
+static const queuePolicy queuePolicyTable[] = {
+    {asynQueuePolicyStrict,   0.0,   queueSelectStrict,   0},
+    {asynQueuePolicyAging,    0.1,   queueSelectAging,    0},
+    {asynQueuePolicyFair,     0.001, queueSelectFair,     queueChargeFair},
+    {asynQueuePolicyDeadline, 1.0,   queueSelectDeadline, 0}
+};
+static const char *queuePolicyName[] = {ASYN_QUEUE_POLICY_STRINGS};
+static void queueIncomingPush(port *pport,userPvt *puserPvt,int priority);
+/*queueIncomingDrain must be called with asynManagerLock held*/
+static void queueIncomingDrain(port *pport);
+static void signalPortThread(port *pport);
 /*autoConnectDevice must be called with asynManagerLock held*/
 static BOOL autoConnectDevice(port *pport,device *pdevice);
 static void connectAttempt(dpCommon *pdpCommon);
+static void synchronousLockTake(port *pport,dpCommon *pdpCommon);
+static void synchronousLockGive(port *pport,dpCommon *pdpCommon);
+static void abortStart(port *pport,dpCommon *pdpCommon);
+static void abortEnd(port *pport,dpCommon *pdpCommon);
+static void abortDevices(port *pport,dpCommon *pdpCommon);
 static void portThread(port *pport);
+static void portProcess(port *pport);
+static void threadPoolCreate(void);
+static void threadPoolSchedule(port *pport);
+static void threadPoolThread(threadPool *pthreadPool);
 /* functions for portConnect */
 static void initPortConnect(port *ppport);
 static void portConnectTimerCallback(void *pvt);
@@ -260,6 +622,8 @@ static void portConnectProcessCallback(asynUser *pasynUser);
     
 /* asynManager methods */
 static void report(FILE *fp,int details,const char*portName);
+static void memReport(FILE *fp);
+static void queueStatisticsReport(FILE *fp,port *pport,int details);
 static asynUser *createAsynUser(userCallback process, userCallback timeout);
 static asynUser *duplicateAsynUser(asynUser *pasynUser,
    userCallback queue, userCallback timeout);
@@ -291,6 +655,9 @@ static asynStatus getPortName(asynUser *pasynUser,const char **pportName);
 static asynStatus registerPort(const char *portName,
     int attributes,int autoConnect,
     unsigned int priority,unsigned int stackSize);
+static asynStatus registerPortThreads(const char *portName,
+    int attributes,int autoConnect,
+    unsigned int priority,unsigned int stackSize,int numberThreads);
 static asynStatus registerInterface(const char *portName,
     asynInterface *pasynInterface);
 static asynStatus exceptionConnect(asynUser *pasynUser);
@@ -303,6 +670,7 @@ static asynStatus isConnected(asynUser *pasynUser,int *yesNo);
 static asynStatus isEnabled(asynUser *pasynUser,int *yesNo);
 static asynStatus isAutoConnect(asynUser *pasynUser,int *yesNo);
 static asynStatus setAutoConnectTimeout(double timeout);
+static asynStatus setThreadPool(int numberThreads);
 static asynStatus waitConnect(asynUser *pasynUser, double timeout);
 static asynStatus registerInterruptSource(const char *portName,
     asynInterface *pasynInterface, void **pasynPvt);
@@ -316,6 +684,19 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
                                    interruptNode*pinterruptNode);
 static asynStatus interruptStart(void *pasynPvt,ELLLIST **plist);
 static asynStatus interruptEnd(void *pasynPvt);
+static interruptNode *interruptFirstMatch(ELLLIST *plist,int reason,int addr);
+static interruptNode *interruptNextMatch(interruptNode *pinterruptNode);
+static asynStatus deferInterruptFree(interruptNode *pinterruptNode,
+    interruptFreeCallback callback,void *pfreePvt);
+static asynStatus getQueueStatistics(asynUser *pasynUser,
+    asynQueueStatistics *pasynQueueStatistics);
+static asynStatus resetQueueStatistics(asynUser *pasynUser);
+static asynStatus setQueuePolicy(asynUser *pasynUser,
+    asynQueuePolicy policy,double param);
+static asynStatus setQueueMerge(asynUser *pasynUser,
+    asynQueueMerge merge,queueMergeCallback callback);
+static asynStatus enableQueueMerge(asynUser *pasynUser,int yesNo);
+static asynStatus abortRequest(asynUser *pasynUser);
 static void defaultTimeStampSource(void *userPvt, epicsTimeStamp *pTimeStamp);
 static asynStatus registerTimeStampSource(asynUser *pasynUser, void *userPvt, timeStampCallback callback);
 static asynStatus unregisterTimeStampSource(asynUser *pasynUser);
@@ -373,7 +754,18 @@ static asynManager manager = {
     updateTimeStamp,
     getTimeStamp,
     setTimeStamp,
-    strStatus
+    strStatus,
+    registerPortThreads,
+    setThreadPool,
+    interruptFirstMatch,
+    interruptNextMatch,
+    deferInterruptFree,
+    getQueueStatistics,
+    resetQueueStatistics,
+    setQueuePolicy,
+    setQueueMerge,
+    enableQueueMerge,
+    abortRequest
 };
 epicsShareDef asynManager *pasynManager = &manager;
 
@@ -390,6 +782,11 @@ static asynStatus setTraceFile(asynUser *pasynUser,FILE *fp);
 static FILE       *getTraceFile(asynUser *pasynUser);
 static asynStatus setTraceIOTruncateSize(asynUser *pasynUser,size_t size);
 static size_t     getTraceIOTruncateSize(asynUser *pasynUser);
+static asynStatus setTraceCaptureFile(asynUser *pasynUser,FILE *fp);
+static FILE       *getTraceCaptureFile(asynUser *pasynUser);
+static int        traceCaptureIO(asynUser *pasynUser,int direction,
+                      asynStatus status,int eomReason,
+                      const char *buffer,size_t len);
 static int        tracePrint(asynUser *pasynUser,
                       int reason, const char *pformat, ...);
 static int        tracePrintSource(asynUser *pasynUser,
@@ -426,27 +823,26 @@ static asynTrace asynTraceManager = {
     tracePrintIO,
     tracePrintIOSource,
     traceVprintIO,
-    traceVprintIOSource
+    traceVprintIOSource,
+    setTraceCaptureFile,
+    getTraceCaptureFile,
+    traceCaptureIO
 };
 epicsShareDef asynTrace *pasynTrace = &asynTraceManager;
 
 /*internal methods */
 static void tracePvtInit(tracePvt *ptracePvt)
 {
-    ptracePvt->traceBuffer = callocMustSucceed(
-        DEFAULT_TRACE_BUFFER_SIZE,sizeof(char),
-        "asynManager:tracePvtInit");
     ptracePvt->traceMask = ASYN_TRACE_ERROR;
     ptracePvt->traceInfoMask = ASYN_TRACEINFO_TIME;
     ptracePvt->traceTruncateSize = DEFAULT_TRACE_TRUNCATE_SIZE;
-    ptracePvt->traceBufferSize = DEFAULT_TRACE_BUFFER_SIZE;
     ptracePvt->type = traceFileStderr;
 }
 
 static void tracePvtFree(tracePvt *ptracePvt)
 {
     assert(ptracePvt->fp==0);
-    free(ptracePvt->traceBuffer);
+    assert(ptracePvt->captureFp==0);
 }
 
 static void asynInit(void)
@@ -458,20 +854,35 @@ static void asynInit(void)
     ellInit(&pasynBase->asynPortList);
     ellInit(&pasynBase->asynUserFreeList);
     ellInit(&pasynBase->interruptNodeFree);
-    pasynBase->timerQueue = epicsTimerQueueAllocate(
-        1,epicsThreadPriorityScanLow);
     pasynBase->lock = epicsMutexMustCreate();
     pasynBase->lockTrace = epicsMutexMustCreate();
     tracePvtInit(&pasynBase->trace);
+    pasynBase->traceRingId = epicsThreadPrivateCreate();
+    pasynBase->lockTraceDrain = epicsMutexMustCreate();
+    pasynBase->traceWriterWakeup = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("asynTrace",epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        traceWriterThread,0);
+    epicsAtExit(traceExit,0);
+    pasynBase->lockMem = epicsMutexMustCreate();
     for(i=0; i<nMemList; i++) ellInit(&pasynBase->memList[i]);
+    ellInit(&pasynBase->memCacheList);
+    pasynBase->memCacheId = epicsThreadPrivateCreate();
+    pasynBase->interruptPassId = epicsThreadPrivateCreate();
     pasynBase->connectPortTimerQueue = epicsTimerQueueAllocate(
         0,epicsThreadPriorityScanLow);
     pasynBase->autoConnectTimeout = DEFAULT_AUTOCONNECT_TIMEOUT;
+    ellInit(&pasynBase->timerWheelList);
+    pasynBase->timerThreadWakeup = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("asynTimer",epicsThreadPriorityScanLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        timerWheelThread,0);
 }
 
 static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
 {
     dpCommon *pdpCommon;
+    int      i;
 
     if(pdevice) {
         pdpCommon = &pdevice->dpc;
@@ -487,11 +898,19 @@ static void dpCommonInit(port *pport,device *pdevice,BOOL autoConnect)
     pdpCommon->pport = pport;
     pdpCommon->pdevice = pdevice;
     tracePvtInit(&pdpCommon->trace);
+    for(i=0; i<NUMBER_QUEUE_PRIORITIES-1; i++) {
+        ellInit(&pdpCommon->queue[i].requestList);
+        pdpCommon->queue[i].pdpCommon = pdpCommon;
+    }
+    if(pdevice && pport->numberThreads>1)
+        pdpCommon->synchronousLock = epicsMutexMustCreate();
 }
 
 static void dpCommonFree(dpCommon *pdpCommon)
 {
     tracePvtFree(&pdpCommon->trace);
+    if(pdpCommon->synchronousLock)
+        epicsMutexDestroy(pdpCommon->synchronousLock);
 }
 
 static dpCommon *findDpCommon(userPvt *puserPvt)
@@ -518,25 +937,51 @@ static port *locatePort(const char *portName)
 
     if(!pasynBase) asynInit();
     epicsMutexMustLock(pasynBase->lock);
-    pport = (port *)ellFirst(&pasynBase->asynPortList);
+    pport = pasynBase->portHash[epicsStrHash(portName,0)&(PORT_HASH_SIZE-1)];
     while(pport) {
         if(strcmp(pport->portName,portName)==0) break;
-        pport = (port *)ellNext(&pport->node);
+        pport = pport->pnextHash;
     }
     epicsMutexUnlock(pasynBase->lock);
     return pport;
 }
 
+/* Called with asynManagerLock held after pdevice was added to deviceList*/
+static void deviceHashAdd(port *pport,device *pdevice)
+{
+    int size = pport->deviceHashSize;
+
+    if(ellCount(&pport->deviceList)>size) {
+        device **pdeviceHash;
+
+        size = size ? 2*size : DEVICE_HASH_MIN_SIZE;
+        pdeviceHash = callocMustSucceed(size,sizeof(device *),
+            "asynManager:deviceHashAdd");
+        free(pport->deviceHash);
+        pport->deviceHash = pdeviceHash;
+        pport->deviceHashSize = size;
+        for(pdevice = (device *)ellFirst(&pport->deviceList); pdevice;
+        pdevice = (device *)ellNext(&pdevice->node)) {
+            pdevice->pnextHash = pdeviceHash[pdevice->addr&(size-1)];
+            pdeviceHash[pdevice->addr&(size-1)] = pdevice;
+        }
+        return;
+    }
+    pdevice->pnextHash = pport->deviceHash[pdevice->addr&(size-1)];
+    pport->deviceHash[pdevice->addr&(size-1)] = pdevice;
+}
+
 static device *locateDevice(port *pport,int addr,BOOL allocNew)
 {
     device *pdevice;
 
     assert(pport);
     if(!(pport->attributes&ASYN_MULTIDEVICE) || addr < 0) return(0);
-    pdevice = (device *)ellFirst(&pport->deviceList);
+    pdevice = pport->deviceHash ?
+        pport->deviceHash[addr&(pport->deviceHashSize-1)] : 0;
     while(pdevice) {
         if(pdevice->addr == addr) return pdevice;
-        pdevice = (device *)ellNext(&pdevice->node);
+        pdevice = pdevice->pnextHash;
     }
     if(!pdevice && allocNew) {
         pdevice = callocMustSucceed(1,sizeof(device),
@@ -544,6 +989,7 @@ static device *locateDevice(port *pport,int addr,BOOL allocNew)
         pdevice->addr = addr;
         dpCommonInit(pport,pdevice,pport->dpc.autoConnect);
         ellAdd(&pport->deviceList,&pdevice->node);
+        deviceHashAdd(pport,pdevice);
     }
     return pdevice;
 }
@@ -566,6 +1012,42 @@ static interfaceNode *locateInterfaceNode(
     }
     return pinterfaceNode;
 }
+
+/* Only registerInterface and interposeInterface allocate a chain.
+ * interfaceType must then be persistent, i.e. asynInterface.interfaceType*/
+static interfaceChain *locateInterfaceChain(
+            port *pport,const char *interfaceType,BOOL allocNew)
+{
+    interfaceChain **ppinterfaceChain = &pport->interfaceChainTable[
+        epicsStrHash(interfaceType,0)&(INTERFACE_CHAIN_SIZE-1)];
+    interfaceChain *pinterfaceChain;
+
+    for(pinterfaceChain = *ppinterfaceChain; pinterfaceChain;
+    pinterfaceChain = pinterfaceChain->pnext) {
+        if(strcmp(pinterfaceChain->interfaceType,interfaceType)==0)
+            return pinterfaceChain;
+    }
+    if(!allocNew) return 0;
+    pinterfaceChain = callocMustSucceed(1,sizeof(interfaceChain),
+        "asynManager::locateInterfaceChain");
+    pinterfaceChain->interfaceType = interfaceType;
+    pinterfaceChain->pnext = *ppinterfaceChain;
+    *ppinterfaceChain = pinterfaceChain;
+    return pinterfaceChain;
+}
+
+/* The node of the port that holds the interruptBase for interfaceType.
+ * The interface of the port itself is preferred to an interposed one*/
+static interfaceNode *locateInterfaceChainNode(
+            port *pport,const char *interfaceType)
+{
+    interfaceChain *pinterfaceChain;
+
+    pinterfaceChain = locateInterfaceChain(pport,interfaceType,FALSE);
+    if(!pinterfaceChain) return 0;
+    if(pinterfaceChain->pinterfaceNode) return pinterfaceChain->pinterfaceNode;
+    return pinterfaceChain->pinterposeNode;
+}
 
 /* While an exceptionActive exceptionCallbackAdd and exceptionCallbackRemove
    will wait to be notified that exceptionActive is no longer true.  */
@@ -591,10 +1073,20 @@ static void announceExceptionOccurred(port *pport, device *pdevice, asynExceptio
         ellDelete(&pdpCommon->exceptionNotifyList,&pexceptionUser->notifyNode);
     }
     pdpCommon->exceptionActive = FALSE;
-    pport->queueStateChange = TRUE;
+    if(pport->attributes&ASYN_CANBLOCK) {
+        queueUnpark(pport,pdpCommon);
+        if(!pdevice) {
+            device *pdeviceNext = (device *)ellFirst(&pport->deviceList);
+
+            while(pdeviceNext) {
+                queueUnpark(pport,&pdeviceNext->dpc);
+                pdeviceNext = (device *)ellNext(&pdeviceNext->node);
+            }
+        }
+    }
     epicsMutexUnlock(pport->asynManagerLock);
     if(pport->attributes&ASYN_CANBLOCK)
-        epicsEventSignal(pport->notifyPortThread);
+        signalPortThread(pport);
 }
 static void exceptionOccurred(asynUser *pasynUser,asynException exception)
 {
@@ -605,43 +1097,17 @@ static void exceptionOccurred(asynUser *pasynUser,asynException exception)
     announceExceptionOccurred(pport, pdevice, exception);
 }
 
-static void queueTimeoutCallback(void *pvt)
+/* Called by timerWheelThread with asynManagerLock held for a request
+ * that is on timerWheel.expiredList. It is still queued.*/
+static void queueTimeoutCallback(port *pport,userPvt *puserPvt)
 {
-    userPvt  *puserPvt = (userPvt *)pvt;
     asynUser *pasynUser = &puserPvt->user;
-    port     *pport = puserPvt->pport;
-    int      i;
 
-    epicsMutexMustLock(pport->asynManagerLock);
-    if(!puserPvt->isQueued) {
-        epicsMutexUnlock(pport->asynManagerLock);
-        asynPrint(pasynUser,ASYN_TRACE_FLOW,
-            "%s asynManager:queueTimeoutCallback but not queued\n",
-            pport->portName );
-        return;
-    }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if (puserPvt) break;
-    }
-    if(!puserPvt) {
-        epicsMutexUnlock(pport->asynManagerLock);
-        asynPrint(pasynUser,ASYN_TRACE_ERROR,
-            "%s asynManager:queueTimeoutCallback LOGIC ERROR\n",
-            pport->portName);
-        return;
-    }
+    queueRemove(pport,puserPvt);
+    pport->queueStatistics.numberTimeouts++;
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s asynManager:queueTimeoutCallback\n", pport->portName);
-    puserPvt->isQueued = FALSE;
-    pport->queueStateChange = TRUE;
+    puserPvt->queueState = queueIdle;
     if(puserPvt->timeoutUser) {
         puserPvt->state = callbackActive;
         epicsMutexUnlock(pport->asynManagerLock);
@@ -657,10 +1123,646 @@ static void queueTimeoutCallback(void *pvt)
             epicsMutexUnlock(pasynBase->lock);
         }
     }
-    epicsMutexUnlock(pport->asynManagerLock);
-    epicsEventSignal(pport->notifyPortThread);
 }
-
+
+/* Number of ticks that are at least timeout seconds from now*/
+static unsigned int timerTicks(double timeout)
+{
+    double ticks = timeout/TIMER_WHEEL_TICK + 2.0;
+
+    if(ticks>=(double)TIMER_WHEEL_MAX_TICKS) return TIMER_WHEEL_MAX_TICKS;
+    return (unsigned int)ticks;
+}
+
+static timerWheel *timerWheelCreate(port *pport)
+{
+    timerWheel *ptimerWheel;
+    int        level,i;
+
+    ptimerWheel = callocMustSucceed(1,sizeof(timerWheel),
+        "asynManager:timerWheelCreate");
+    ptimerWheel->pport = pport;
+    ptimerWheel->tick = (unsigned int)asynAtomicGetInt(&pasynBase->timerTick);
+    ellInit(&ptimerWheel->expiredList);
+    for(level=0; level<TIMER_WHEEL_LEVELS; level++)
+        for(i=0; i<TIMER_WHEEL_SIZE; i++)
+            ellInit(&ptimerWheel->slot[level][i]);
+    epicsMutexMustLock(pasynBase->lock);
+    ellAdd(&pasynBase->timerWheelList,&ptimerWheel->node);
+    epicsMutexUnlock(pasynBase->lock);
+    return ptimerWheel;
+}
+
+/* Put timerNode in the slot for timerExpire*/
+static void timerWheelInsert(timerWheel *ptimerWheel,userPvt *puserPvt)
+{
+    unsigned int delta = puserPvt->timerExpire - ptimerWheel->tick;
+    int          level = 0;
+
+    if((int)delta<=0) {
+        delta = 1;
+        puserPvt->timerExpire = ptimerWheel->tick + 1;
+    }
+    while(level<TIMER_WHEEL_LEVELS-1
+    && delta>=(1u<<(TIMER_WHEEL_BITS*(level+1)))) level++;
+    puserPvt->ptimerList = &ptimerWheel->slot[level][
+        (puserPvt->timerExpire>>(TIMER_WHEEL_BITS*level))&(TIMER_WHEEL_SIZE-1)];
+    ellAdd(puserPvt->ptimerList,&puserPvt->timerNode);
+}
+
+static void timerArm(port *pport,userPvt *puserPvt)
+{
+    timerWheel *ptimerWheel = pport->ptimerWheel;
+
+    if(puserPvt->timeout<=0.0 || puserPvt->ptimerList) return;
+    /*An idle wheel is not advanced by timerWheelThread*/
+    if(ptimerWheel->numberArmed==0)
+        ptimerWheel->tick = (unsigned int)asynAtomicGetInt(&pasynBase->timerTick);
+    ptimerWheel->numberArmed++;
+    timerWheelInsert(ptimerWheel,puserPvt);
+}
+
+static void timerDisarm(port *pport,userPvt *puserPvt)
+{
+    if(!puserPvt->ptimerList) return;
+    ellDelete(puserPvt->ptimerList,&puserPvt->timerNode);
+    puserPvt->ptimerList = 0;
+    pport->ptimerWheel->numberArmed--;
+}
+
+/* Advance to tick. Expired requests are moved to expiredList*/
+static void timerWheelAdvance(timerWheel *ptimerWheel,unsigned int tick)
+{
+    if(ptimerWheel->numberArmed==0) {
+        ptimerWheel->tick = tick;
+        return;
+    }
+    while(ptimerWheel->tick!=tick) {
+        unsigned int index;
+        int          level;
+        ELLNODE      *pnode;
+
+        ptimerWheel->tick++;
+        for(level=1; level<TIMER_WHEEL_LEVELS; level++) {
+            ELLLIST cascade;
+
+            if(((ptimerWheel->tick>>(TIMER_WHEEL_BITS*(level-1)))
+            &(TIMER_WHEEL_SIZE-1))!=0) break;
+            index = (ptimerWheel->tick>>(TIMER_WHEEL_BITS*level))
+                &(TIMER_WHEEL_SIZE-1);
+            ellInit(&cascade);
+            ellConcat(&cascade,&ptimerWheel->slot[level][index]);
+            while((pnode = ellGet(&cascade)))
+                timerWheelInsert(ptimerWheel,CONTAINER(pnode,userPvt,timerNode));
+        }
+        index = ptimerWheel->tick&(TIMER_WHEEL_SIZE-1);
+        while((pnode = ellGet(&ptimerWheel->slot[0][index]))) {
+            userPvt *puserPvt = CONTAINER(pnode,userPvt,timerNode);
+
+            puserPvt->ptimerList = &ptimerWheel->expiredList;
+            ellAdd(&ptimerWheel->expiredList,&puserPvt->timerNode);
+        }
+    }
+}
+
+/* Called by queueRequest after it armed a request*/
+static void timerThreadWakeup(void)
+{
+    if(asynAtomicCmpAndSwapInt(&pasynBase->timerThreadIdle,1,0)==1)
+        epicsEventSignal(pasynBase->timerThreadWakeup);
+}
+
+/* A single thread serves the timer wheels of all ports. Each time it wakes
+ * it advances asynBase.timerTick by the number of ticks that have passed,
+ * then, for each port that has armed requests, takes asynManagerLock,
+ * advances the wheel and calls timeoutUser for the expired requests.
+ * When no port has a timeout pending it waits until timerThreadWakeup
+ * is called.*/
+static void timerWheelThread(void *arg)
+{
+    epicsTimeStamp last;
+    unsigned int   tick = 0;
+
+    epicsTimeGetCurrent(&last);
+    while(1) {
+        epicsTimeStamp now;
+        double         elapsed;
+        timerWheel     *ptimerWheel;
+        int            numberWheels;
+        BOOL           active = FALSE;
+
+        asynAtomicSetInt(&pasynBase->timerThreadIdle,1);
+        epicsTimeGetCurrent(&now);
+        elapsed = epicsTimeDiffInSeconds(&now,&last);
+        if(elapsed<0.0) {
+            last = now;
+        } else if(elapsed>=TIMER_WHEEL_TICK) {
+            unsigned int ticks = (unsigned int)(elapsed/TIMER_WHEEL_TICK);
+
+            epicsTimeAddSeconds(&last,ticks*TIMER_WHEEL_TICK);
+            tick += ticks;
+            asynAtomicSetInt(&pasynBase->timerTick,(int)tick);
+        }
+        /*Wheels are only appended so the first numberWheels stay linked*/
+        epicsMutexMustLock(pasynBase->lock);
+        ptimerWheel = (timerWheel *)ellFirst(&pasynBase->timerWheelList);
+        numberWheels = ellCount(&pasynBase->timerWheelList);
+        epicsMutexUnlock(pasynBase->lock);
+        for( ; numberWheels>0;
+        numberWheels--, ptimerWheel = (timerWheel *)ellNext(&ptimerWheel->node)) {
+            port    *pport = ptimerWheel->pport;
+            ELLNODE *pnode;
+            BOOL    expired = FALSE;
+
+            if(asynAtomicGetInt(&ptimerWheel->numberArmed)==0) continue;
+            epicsMutexMustLock(pport->asynManagerLock);
+            timerWheelAdvance(ptimerWheel,tick);
+            while((pnode = ellFirst(&ptimerWheel->expiredList))) {
+                userPvt *puserPvt = CONTAINER(pnode,userPvt,timerNode);
+
+                expired = TRUE;
+                queueTimeoutCallback(pport,puserPvt);
+            }
+            if(ptimerWheel->numberArmed>0) active = TRUE;
+            epicsMutexUnlock(pport->asynManagerLock);
+            if(expired) signalPortThread(pport);
+        }
+        if(active) {
+            epicsEventWaitWithTimeout(pasynBase->timerThreadWakeup,
+                TIMER_WHEEL_TICK);
+        } else {
+            /*Nothing is armed so timerTick need not count the idle time*/
+            epicsEventMustWait(pasynBase->timerThreadWakeup);
+            epicsTimeGetCurrent(&last);
+        }
+    }
+}
+
+static void latencyRecord(asynLatencyHistogram *phistogram,double seconds)
+{
+    double microseconds;
+    int    bucket = 0;
+
+    /*The clock can step back*/
+    if(seconds<0.0) seconds = 0.0;
+    phistogram->count++;
+    phistogram->sum += seconds;
+    if(seconds>phistogram->max) phistogram->max = seconds;
+    microseconds = seconds*1e6;
+    if(microseconds>=1.0) {
+        frexp(microseconds,&bucket);
+        if(bucket>=ASYN_LATENCY_BUCKETS) bucket = ASYN_LATENCY_BUCKETS-1;
+    }
+    phistogram->bucket[bucket]++;
+}
+
+/* Upper bound of the bucket that holds the given fraction of the counts*/
+static double latencyPercentile(const asynLatencyHistogram *phistogram,
+    double fraction)
+{
+    double        limit = 1e-6;
+    unsigned long sum = 0;
+    int           i;
+
+    for(i=0; i<ASYN_LATENCY_BUCKETS-1; i++, limit *= 2.0) {
+        sum += phistogram->bucket[i];
+        if(sum>=fraction*phistogram->count) break;
+    }
+    return (limit<phistogram->max) ? limit : phistogram->max;
+}
+
+/* Each request gets a port wide sequence number in the order it is queued.
+ * A request added in front gets a number before all others. The strict
+ * and aging policies use it to run the requests of a priority in the order
+ * they were queued across all devices.*/
+static void queueAdd(port *pport,userPvt *puserPvt,
+    asynQueuePriority priority,BOOL addToFront)
+{
+    ELLLIST *plist;
+    dpQueue *pdpQueue = 0;
+
+    if(priority==asynQueuePriorityConnect) {
+        plist = &pport->connectQueue;
+    } else {
+        pdpQueue = &findDpCommon(puserPvt)->queue[priority];
+        plist = &pdpQueue->requestList;
+    }
+    if(addToFront) {
+        ellInsert(plist,0,&puserPvt->node);
+        puserPvt->queueSequence = --pport->queueFrontSequence;
+    } else {
+        ellAdd(plist,&puserPvt->node);
+        puserPvt->queueSequence = pport->queueSequence++;
+    }
+    puserPvt->priority = priority;
+    pport->nQueued++;
+    if(pport->nQueued>pport->queueStatistics.queueHighWater)
+        pport->queueStatistics.queueHighWater = pport->nQueued;
+    if(pport->ptimerWheel) timerArm(pport,puserPvt);
+    /* A new request also gives a parked dpQueue another chance */
+    if(pdpQueue) queueMakeReady(pport,pdpQueue,FALSE);
+}
+
+static void queueRemove(port *pport,userPvt *puserPvt)
+{
+    dpQueue *pdpQueue;
+
+    pport->nQueued--;
+    if(pport->ptimerWheel) timerDisarm(pport,puserPvt);
+    if(puserPvt->priority==asynQueuePriorityConnect) {
+        ellDelete(&pport->connectQueue,&puserPvt->node);
+        return;
+    }
+    pdpQueue = &findDpCommon(puserPvt)->queue[puserPvt->priority];
+    ellDelete(&pdpQueue->requestList,&puserPvt->node);
+    if(pdpQueue->isReady && ellCount(&pdpQueue->requestList)==0) {
+        ellDelete(&pport->readyList[puserPvt->priority],&pdpQueue->node);
+        pdpQueue->isReady = FALSE;
+    }
+}
+
+static void queueMakeReady(port *pport,dpQueue *pdpQueue,BOOL addToFront)
+{
+    ELLLIST *preadyList;
+
+    if(pdpQueue->isReady || ellCount(&pdpQueue->requestList)==0) return;
+    preadyList = &pport->readyList[pdpQueue - pdpQueue->pdpCommon->queue];
+    if(addToFront) {
+        ellInsert(preadyList,0,&pdpQueue->node);
+    } else {
+        ellAdd(preadyList,&pdpQueue->node);
+    }
+    pdpQueue->isReady = TRUE;
+}
+
+static void queueUnpark(port *pport,dpCommon *pdpCommon)
+{
+    int i;
+
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--)
+        queueMakeReady(pport,&pdpCommon->queue[i],FALSE);
+}
+
+/* Returns the next request to call, already removed from its dpQueue,
+ * or 0 if nothing can run. The queue policy picks the dpQueue. The
+ * requests of each device run in FIFO order. A device that another port
+ * thread is calling back for is busy and stays parked until it is done.
+ * asynManagerLock is released while autoConnectDevice tries to connect.*/
+static userPvt *queueNextRequest(port *pport,BOOL *callTimeoutUser)
+{
+    dpQueue  *pconnectTried = 0;
+
+    *callTimeoutUser = FALSE;
+    /*Another port thread has the whole port*/
+    if(pport->connectActive
+    || pport->exclusiveWaiting || pport->exclusiveOwner) return 0;
+    if(ellCount(&pport->autoConnectRetryList)>0) {
+        epicsTimeStamp now;
+
+        epicsTimeGetCurrent(&now);
+        if(epicsTimeDiffInSeconds(&now,&pport->lastAutoConnectRetry)
+           >=AUTOCONNECT_RETRY_INTERVAL) {
+            ELLNODE *pn;
+
+            pport->lastAutoConnectRetry = now;
+            while((pn = ellGet(&pport->autoConnectRetryList))) {
+                dpCommon *pdpCommon = CONTAINER(pn, dpCommon, retryNode);
+
+                pdpCommon->isOnRetryList = FALSE;
+                queueUnpark(pport,pdpCommon);
+            }
+        }
+    }
+    while(1) {
+        dpQueue  *pdpQueue = 0;
+        dpCommon *pdpCommon;
+        userPvt  *puserPvt;
+
+        puserPvt = pport->pblockProcessHolder;
+        if(puserPvt) {
+            /*Only the blockProcessCallback holder can run.
+             *Its dpQueue is left on readyList.*/
+            if(puserPvt->queueState!=queueListed
+            || puserPvt->priority==asynQueuePriorityConnect) return 0;
+            pdpQueue = &findDpCommon(puserPvt)->queue[puserPvt->priority];
+            if(ellFirst(&pdpQueue->requestList)!=&puserPvt->node) return 0;
+        } else {
+            pdpQueue = pport->pqueuePolicy->select(pport);
+            if(!pdpQueue) return 0;
+            pdpQueue->isReady = FALSE;
+            puserPvt = (userPvt *)ellFirst(&pdpQueue->requestList);
+        }
+        assert(puserPvt && puserPvt->queueState==queueListed);
+        pdpCommon = pdpQueue->pdpCommon;
+        /*The following leave pdpQueue parked*/
+        if(!pdpCommon->enabled || pdpCommon->busy) {
+            if(pport->pblockProcessHolder) return 0;
+            continue;
+        }
+        if(pdpCommon->pblockProcessHolder
+        && pdpCommon->pblockProcessHolder!=puserPvt) {
+            if(pport->pblockProcessHolder) return 0;
+            continue;
+        }
+        if(!pdpCommon->connected) {
+            if(pdpQueue!=pconnectTried) {
+                /*asynManagerLock may be released so look again afterwards*/
+                pconnectTried = pdpQueue;
+                autoConnectDevice(pport,pdpCommon->pdevice);
+                queueMakeReady(pport,pdpQueue,TRUE);
+                continue;
+            }
+            if(!puserPvt->timeoutUser) {
+                if(pdpCommon->autoConnect && !pdpCommon->isOnRetryList) {
+                    ellAdd(&pport->autoConnectRetryList,&pdpCommon->retryNode);
+                    pdpCommon->isOnRetryList = TRUE;
+                }
+                if(pport->pblockProcessHolder) return 0;
+                continue;
+            }
+            *callTimeoutUser = TRUE;
+        }
+        queueRemove(pport,puserPvt);
+        queueMakeReady(pport,pdpQueue,FALSE);
+        return puserPvt;
+    }
+}
+
+/* A request that setQueueMerge made mergeable takes with it the later
+ * requests on its dpQueue for the same reason and drvUser that directly
+ * follow it. The scan stops at the first request that can not be merged
+ * or is for another reason or drvUser, so requests run in queue order.
+ * A newer write must not move ahead of a write to another parameter.
+ * Returns the request to call back. The others are removed from the queue
+ * and linked through pnextMerged from *ppmerged. For reads the oldest
+ * request is called; for writes the newest.*/
+static userPvt *queueMerge(port *pport,userPvt *puserPvt,
+    userPvt **ppmerged)
+{
+    dpQueue *pdpQueue = &findDpCommon(puserPvt)->queue[puserPvt->priority];
+    userPvt *pmerged = 0;
+    userPvt **pptail = &pmerged;
+    userPvt *pnext = (userPvt *)ellFirst(&pdpQueue->requestList);
+
+    while(pnext) {
+        userPvt *pcandidate = pnext;
+
+        pnext = (userPvt *)ellNext(&pcandidate->node);
+        if(pcandidate->merge==asynQueueMergeNone
+        || pcandidate->blockPortCount>0 || pcandidate->blockDeviceCount>0)
+            break;
+        if(pcandidate->user.reason!=puserPvt->user.reason
+        || pcandidate->user.drvUser!=puserPvt->user.drvUser
+        || pcandidate->merge!=puserPvt->merge
+        || pcandidate->mergeCallback!=puserPvt->mergeCallback) break;
+        queueRemove(pport,pcandidate);
+        pcandidate->queueState = queueIdle;
+        pport->queueStatistics.numberMerged++;
+        if(puserPvt->merge==asynQueueMergeWrite) {
+            /*The older write is answered by the newer one*/
+            *pptail = puserPvt;
+            pptail = &puserPvt->pnextMerged;
+            puserPvt = pcandidate;
+        } else {
+            *pptail = pcandidate;
+            pptail = &pcandidate->pnextMerged;
+        }
+    }
+    *pptail = 0;
+    *ppmerged = pmerged;
+    return puserPvt;
+}
+
+static BOOL queueHasReady(port *pport)
+{
+    int i;
+
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--)
+        if(ellCount(&pport->readyList[i])>0) return TRUE;
+    return FALSE;
+}
+
+/* Returns the ready dpQueue of a priority whose first request was queued
+ * first, or 0. Only ready dpQueues are looked at, so parked devices cost
+ * nothing.*/
+static dpQueue *queueOldestReady(port *pport,int priority)
+{
+    dpQueue *pdpQueue = (dpQueue *)ellFirst(&pport->readyList[priority]);
+    dpQueue *poldest = pdpQueue;
+    unsigned long oldest;
+
+    if(!pdpQueue) return 0;
+    oldest = ((userPvt *)ellFirst(&pdpQueue->requestList))->queueSequence;
+    while((pdpQueue = (dpQueue *)ellNext(&pdpQueue->node))) {
+        unsigned long sequence =
+            ((userPvt *)ellFirst(&pdpQueue->requestList))->queueSequence;
+
+        if((long)(sequence - oldest)<0) {
+            poldest = pdpQueue;
+            oldest = sequence;
+        }
+    }
+    return poldest;
+}
+
+/* The policy of every port until setQueuePolicy: the highest priority
+ * first, and within a priority the requests of all devices in the order
+ * they were queued. Requests of a device that can not run are skipped.*/
+static dpQueue *queueSelectStrict(port *pport)
+{
+    dpQueue *pdpQueue;
+    int     i;
+
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
+        pdpQueue = queueOldestReady(pport,i);
+        if(pdpQueue) {
+            ellDelete(&pport->readyList[i],&pdpQueue->node);
+            return pdpQueue;
+        }
+    }
+    return 0;
+}
+
+/* Like strict, but the first request of a priority gains one priority
+ * level for every queuePolicyParam seconds it has waited, so a steady
+ * stream of high priority requests can not starve the low ones.*/
+static dpQueue *queueSelectAging(port *pport)
+{
+    epicsTimeStamp now;
+    double         bestLevel = -1.0;
+    int            best = -1;
+    dpQueue        *pbest = 0;
+    int            i;
+
+    epicsTimeGetCurrent(&now);
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
+        dpQueue *pdpQueue = queueOldestReady(pport,i);
+        userPvt *puserPvt;
+        double  level;
+
+        if(!pdpQueue) continue;
+        puserPvt = (userPvt *)ellFirst(&pdpQueue->requestList);
+        level = i + epicsTimeDiffInSeconds(&now,&puserPvt->queueTime)
+                    /pport->queuePolicyParam;
+        if(level>bestLevel) {
+            bestLevel = level;
+            best = i;
+            pbest = pdpQueue;
+        }
+    }
+    if(best<0) return 0;
+    ellDelete(&pport->readyList[best],&pbest->node);
+    return pbest;
+}
+
+/* Deficit round robin by callback time among the devices of a priority.
+ * Every device on readyList is owed queuePolicyParam seconds per round and
+ * runs while it is owed time, so a device with slow or many requests gets
+ * the same share of the port as the others. Only devices with queued
+ * requests are owed time, so an idle device does not save up credit.*/
+static dpQueue *queueSelectFair(port *pport)
+{
+    int i;
+
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
+        ELLLIST *preadyList = &pport->readyList[i];
+        dpQueue *pdpQueue;
+        double  maxDeficit;
+        double  rounds;
+
+        pdpQueue = (dpQueue *)ellFirst(preadyList);
+        if(!pdpQueue) continue;
+        maxDeficit = pdpQueue->deficit;
+        for( ; pdpQueue; pdpQueue = (dpQueue *)ellNext(&pdpQueue->node)) {
+            if(pdpQueue->deficit>0.0) {
+                ellDelete(preadyList,&pdpQueue->node);
+                return pdpQueue;
+            }
+            if(pdpQueue->deficit>maxDeficit) maxDeficit = pdpQueue->deficit;
+        }
+        /*All have used their share. Give as many rounds as it takes*/
+        rounds = floor(-maxDeficit/pport->queuePolicyParam) + 1.0;
+        for(pdpQueue = (dpQueue *)ellFirst(preadyList); pdpQueue;
+        pdpQueue = (dpQueue *)ellNext(&pdpQueue->node))
+            pdpQueue->deficit += rounds*pport->queuePolicyParam;
+        for(pdpQueue = (dpQueue *)ellFirst(preadyList); pdpQueue;
+        pdpQueue = (dpQueue *)ellNext(&pdpQueue->node)) {
+            if(pdpQueue->deficit>0.0) break;
+        }
+        assert(pdpQueue);
+        ellDelete(preadyList,&pdpQueue->node);
+        return pdpQueue;
+    }
+    return 0;
+}
+
+static void queueChargeFair(port *pport,dpQueue *pdpQueue,double seconds)
+{
+    pdpQueue->deficit -= seconds;
+}
+
+/* Earliest deadline first among the first requests of all ready devices.
+ * The deadline is the queueRequest timeout. Requests without a timeout
+ * get queuePolicyParam seconds at high priority, twice that at medium and
+ * four times at low. Requests of one device still run in FIFO order.*/
+static dpQueue *queueSelectDeadline(port *pport)
+{
+    dpQueue        *pbest = 0;
+    double         bestDeadline = 0.0;
+    epicsTimeStamp reference;
+    int            i;
+
+    for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
+        dpQueue *pdpQueue = (dpQueue *)ellFirst(&pport->readyList[i]);
+        double  allowance = pport->queuePolicyParam
+                            * (1<<(asynQueuePriorityHigh - i));
+
+        for( ; pdpQueue; pdpQueue = (dpQueue *)ellNext(&pdpQueue->node)) {
+            userPvt *puserPvt = (userPvt *)ellFirst(&pdpQueue->requestList);
+            double  deadline;
+
+            if(!pbest) reference = puserPvt->queueTime;
+            deadline = epicsTimeDiffInSeconds(&puserPvt->queueTime,&reference)
+                + ((puserPvt->timeout>0.0) ? puserPvt->timeout : allowance);
+            if(!pbest || deadline<bestDeadline) {
+                pbest = pdpQueue;
+                bestDeadline = deadline;
+            }
+        }
+    }
+    if(pbest) ellDelete(&pport->readyList[
+        pbest - pbest->pdpCommon->queue],&pbest->node);
+    return pbest;
+}
+
+static void queueIncomingPush(port *pport,userPvt *puserPvt,int priority)
+{
+    void **phead = &pport->incomingList[priority];
+    void *head;
+
+    do {
+        head = asynAtomicGetPtr(phead);
+        puserPvt->pnextIncoming = (userPvt *)head;
+    } while(asynAtomicCmpAndSwapPtr(phead,head,puserPvt)!=head);
+}
+
+/* incomingList is a LIFO stack. Detach each one in a single operation and
+ * queue the requests in the order queueRequest was called.*/
+static void queueIncomingDrain(port *pport)
+{
+    int i;
+
+    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
+        void    **phead = &pport->incomingList[i];
+        void    *head;
+        userPvt *puserPvt;
+        userPvt *pfifo = 0;
+
+        head = asynAtomicGetPtr(phead);
+        if(!head) continue;
+        while(asynAtomicCmpAndSwapPtr(phead,head,0)!=head)
+            head = asynAtomicGetPtr(phead);
+        puserPvt = (userPvt *)head;
+        while(puserPvt) {
+            userPvt *pnext = puserPvt->pnextIncoming;
+
+            puserPvt->pnextIncoming = pfifo;
+            pfifo = puserPvt;
+            puserPvt = pnext;
+        }
+        while((puserPvt = pfifo)) {
+            dpCommon *pdpCommon = findDpCommon(puserPvt);
+
+            pfifo = puserPvt->pnextIncoming;
+            puserPvt->pnextIncoming = 0;
+            if(asynAtomicCmpAndSwapInt(&puserPvt->queueState,
+                    queueIncoming,queueListed)!=queueIncoming) {
+                /*queueCanceled*/
+                asynAtomicSetInt(&puserPvt->queueState,queueIdle);
+                continue;
+            }
+            queueAdd(pport,puserPvt,(asynQueuePriority)i,
+                (puserPvt->blockPortCount>0
+                    && pport->pblockProcessHolder==puserPvt)
+                || (puserPvt->blockDeviceCount>0
+                    && pdpCommon->pblockProcessHolder==puserPvt));
+        }
+    }
+}
+
+/* Only the first caller after portThread wakes up signals the event,
+ * so a burst of requests costs a single wakeup.*/
+static void signalPortThread(port *pport)
+{
+    if(asynAtomicCmpAndSwapInt(&pport->wakeupPending,0,1)==0) {
+        if(pport->usesThreadPool) {
+            threadPoolSchedule(pport);
+        } else {
+            epicsEventSignal(pport->notifyPortThread);
+        }
+    }
+}
+
 /*autoConnectDevice must be called with asynManagerLock held*/
 static BOOL autoConnectDevice(port *pport,device *pdevice)
 {
@@ -671,7 +1773,8 @@ static BOOL autoConnectDevice(port *pport,device *pdevice)
 
         epicsTimeGetCurrent(&now);
         if(epicsTimeDiffInSeconds(
-             &now,&pport->dpc.lastConnectDisconnect) < 2.0) return FALSE;
+             &now,&pport->dpc.lastConnectDisconnect)
+           < AUTOCONNECT_RETRY_INTERVAL) return FALSE;
         epicsTimeGetCurrent(&pport->dpc.lastConnectDisconnect);
         pport->dpc.autoConnectActive = TRUE;
         epicsMutexUnlock(pport->asynManagerLock);
@@ -688,7 +1791,8 @@ static BOOL autoConnectDevice(port *pport,device *pdevice)
 
         epicsTimeGetCurrent(&now);
         if(epicsTimeDiffInSeconds(
-            &now,&pdevice->dpc.lastConnectDisconnect) < 2.0) return FALSE;
+            &now,&pdevice->dpc.lastConnectDisconnect)
+           < AUTOCONNECT_RETRY_INTERVAL) return FALSE;
         epicsTimeGetCurrent(&pdevice->dpc.lastConnectDisconnect);
         pdevice->dpc.autoConnectActive = TRUE;
         epicsMutexUnlock(pport->asynManagerLock);
@@ -710,13 +1814,15 @@ static void connectAttempt(dpCommon *pdpCommon)
     asynStatus     status;
     int            addr;
 
+    /*Port threads can connect different devices at the same time*/
+    if(pport->numberThreads>1) pasynUser = createAsynUser(0,0);
     addr = (pdevice ? pdevice->addr : -1);
     status = pasynManager->connectDevice(pasynUser,pport->portName,addr);
     if(status!=asynSuccess) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
             "%s %d autoConnect connectDevice failed.\n",
             pport->portName,addr);
-        return;
+        goto freeUser;
     }
     pasynInterface = pasynManager->findInterface(pasynUser,asynCommonType,TRUE);
     if(!pasynInterface) {
@@ -732,9 +1838,9 @@ static void connectAttempt(dpCommon *pdpCommon)
     pasynUser->errorMessage[0] = '\0';
     /* When we were called we were not connected, but we could have connected since that test? */
     if (!pdpCommon->connected) {
-        epicsMutexMustLock(pport->synchronousLock);
+        synchronousLockTake(pport,pdpCommon);
         status = pasynCommon->connect(drvPvt,pasynUser);
-        epicsMutexUnlock(pport->synchronousLock);
+        synchronousLockGive(pport,pdpCommon);
     }
     if(status!=asynSuccess) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -748,159 +1854,425 @@ disconnect:
             "%s %d autoConnect disconnect failed.\n",
             pport->portName,addr);
     }
+freeUser:
+    if(pasynUser!=pport->pasynUser) freeAsynUser(pasynUser);
 }
 
-static void portThread(port *pport)
+/* Callbacks and lockPort hold synchronousLock. On an ASYN_MULTITHREAD
+ * port a device request only takes the lock of its device, so that port
+ * threads can call back for different devices at the same time. Such
+ * shared holders are counted. The lock of the port itself is exclusive:
+ * it waits until no device lock is held and keeps new ones out until it
+ * is given back. Thus a callback that holds a device lock must not lock
+ * the whole port.*/
+static void synchronousLockTake(port *pport,dpCommon *pdpCommon)
 {
-    userPvt  *puserPvt;
-    asynUser *pasynUser;
-    double   timeout;
-    BOOL     callTimeoutUser = FALSE;
+    epicsThreadId self;
 
-    taskwdInsert(epicsThreadGetIdSelf(),0,0);
-    while(1) {
-        epicsEventMustWait(pport->notifyPortThread);
+    if(pport->numberThreads<=1) {
+        epicsMutexMustLock(pport->synchronousLock);
+        return;
+    }
+    self = epicsThreadGetIdSelf();
+    if(pdpCommon->pdevice) {
         epicsMutexMustLock(pport->asynManagerLock);
-        if(!pport->dpc.enabled) {
+        while(pport->exclusiveOwner && pport->exclusiveOwner!=self) {
+            pport->sharedWaiting++;
             epicsMutexUnlock(pport->asynManagerLock);
-            continue;
+            epicsEventMustWait(pport->exclusiveDone);
+            epicsMutexMustLock(pport->asynManagerLock);
+            pport->sharedWaiting--;
         }
-        /*Process ALL connect/disconnect requests first*/
-        while((puserPvt = (userPvt *)ellFirst(
-        &pport->queueList[asynQueuePriorityConnect]))) {
-            asynStatus status = asynSuccess;
-
-            assert(puserPvt->isQueued);
-            ellDelete(&pport->queueList[asynQueuePriorityConnect],
-               &puserPvt->node);
-            puserPvt->isQueued = FALSE;
-            pasynUser = userPvtToAsynUser(puserPvt);
-            pasynUser->errorMessage[0] = '\0';
-            asynPrint(pasynUser,ASYN_TRACE_FLOW,
-                "asynManager connect queueCallback port:%s\n",
-                 pport->portName);
-            puserPvt->state = callbackActive;
-            timeout = puserPvt->timeout;
+        /*exclusiveDone wakes one thread. Pass it on to the next*/
+        if(pport->sharedWaiting>0) epicsEventSignal(pport->exclusiveDone);
+        pport->sharedCount++;
+        epicsMutexUnlock(pport->asynManagerLock);
+        epicsMutexMustLock(pdpCommon->synchronousLock);
+        return;
+    }
+    epicsMutexMustLock(pport->synchronousLock);
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(pport->exclusiveOwner!=self) {
+        pport->exclusiveWaiting = TRUE;
+        while(pport->sharedCount>0) {
             epicsMutexUnlock(pport->asynManagerLock);
-            if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->lock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
-            puserPvt->processUser(pasynUser);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->unlock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
-            epicsMutexUnlock(pport->synchronousLock);
+            epicsEventMustWait(pport->sharedIdle);
             epicsMutexMustLock(pport->asynManagerLock);
-            if (puserPvt->state==callbackCanceled)
-                epicsEventSignal(puserPvt->callbackDone);
-            puserPvt->state = callbackIdle;
-            if(puserPvt->freeAfterCallback) {
-                puserPvt->freeAfterCallback = FALSE;
-                epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
-                epicsMutexUnlock(pasynBase->lock);
-            }
         }
-        if(!pport->dpc.connected) {
-            if(!autoConnectDevice(pport,0)) {
-                epicsMutexUnlock(pport->asynManagerLock);
-                continue; /*while (1); */
-            }
+        pport->exclusiveWaiting = FALSE;
+        pport->exclusiveOwner = self;
+    }
+    pport->exclusiveCount++;
+    epicsMutexUnlock(pport->asynManagerLock);
+}
+
+static void synchronousLockGive(port *pport,dpCommon *pdpCommon)
+{
+    BOOL released = FALSE;
+
+    if(pport->numberThreads<=1) {
+        epicsMutexUnlock(pport->synchronousLock);
+        return;
+    }
+    if(pdpCommon->pdevice) {
+        epicsMutexUnlock(pdpCommon->synchronousLock);
+        epicsMutexMustLock(pport->asynManagerLock);
+        pport->sharedCount--;
+        if(pport->sharedCount==0 && pport->exclusiveWaiting)
+            epicsEventSignal(pport->sharedIdle);
+        epicsMutexUnlock(pport->asynManagerLock);
+        return;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(--pport->exclusiveCount==0) {
+        pport->exclusiveOwner = 0;
+        if(pport->sharedWaiting>0) epicsEventSignal(pport->exclusiveDone);
+        released = TRUE;
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    epicsMutexUnlock(pport->synchronousLock);
+    /*The port threads did not start requests while it was held*/
+    if(released) signalPortThread(pport);
+}
+
+/* A callback blocked in I/O on a dead device would hold the device, and
+ * everything queued behind it, for its whole timeout. abortStart asks the
+ * driver to make that I/O return now. It is not done for the thread that
+ * is calling back, i.e. a callback that disables its own port. Called with
+ * asynManagerLock held, thus asynCommon:abort must not block. If abort
+ * succeeded abortEnd is called when the callback returns.*/
+static void abortStart(port *pport,dpCommon *pdpCommon)
+{
+    asynInterface *pasynInterface = pport->pcommonInterface;
+    asynCommon    *pasynCommon;
+    asynUser      *pasynUser;
+
+    if(!pdpCommon->busy || pdpCommon->aborting || !pasynInterface) return;
+    pasynCommon = (asynCommon *)pasynInterface->pinterface;
+    if(!pasynCommon->abort) return;
+    if(pdpCommon->activeThread==epicsThreadGetIdSelf()) return;
+    pasynUser = userPvtToAsynUser(pdpCommon->pactiveUser);
+    asynPrint(pasynUser,ASYN_TRACE_FLOW,"%s addr %d asynManager abort\n",
+        pport->portName,(pdpCommon->pdevice ? pdpCommon->pdevice->addr : -1));
+    if(pasynCommon->abort(pasynInterface->drvPvt,pasynUser,1)!=asynSuccess)
+        return;
+    pdpCommon->aborting = TRUE;
+    pport->queueStatistics.numberAborts++;
+}
+
+static void abortEnd(port *pport,dpCommon *pdpCommon)
+{
+    asynInterface *pasynInterface = pport->pcommonInterface;
+    asynCommon    *pasynCommon = (asynCommon *)pasynInterface->pinterface;
+
+    pdpCommon->aborting = FALSE;
+    pasynCommon->abort(pasynInterface->drvPvt,
+        userPvtToAsynUser(pdpCommon->pactiveUser),0);
+}
+
+/* For port.dpc every device of the port is aborted*/
+static void abortDevices(port *pport,dpCommon *pdpCommon)
+{
+    device *pdevice;
+
+    abortStart(pport,pdpCommon);
+    if(pdpCommon!=&pport->dpc) return;
+    for(pdevice = (device *)ellFirst(&pport->deviceList); pdevice;
+    pdevice = (device *)ellNext(&pdevice->node))
+        abortStart(pport,&pdevice->dpc);
+}
+
+static void portThread(port *pport)
+{
+    taskwdInsert(epicsThreadGetIdSelf(),0,0);
+    while(1) {
+        epicsEventMustWait(pport->notifyPortThread);
+        portProcess(pport);
+    }
+}
+
+static void threadPoolCreate(void)
+{
+    threadPool *pthreadPool;
+    int        i;
+
+    pthreadPool = callocMustSucceed(1,sizeof(threadPool),"asynManager");
+    pthreadPool->lock = epicsMutexMustCreate();
+    pthreadPool->notify = epicsEventMustCreate(epicsEventEmpty);
+    ellInit(&pthreadPool->runnableList);
+    epicsTimeGetCurrent(&pthreadPool->startTime);
+    for(i=0; i<pasynBase->threadPoolSize; i++) {
+        char threadName[40];
+
+        epicsSnprintf(threadName,sizeof(threadName),"asynPool_%d",i);
+        if(!epicsThreadCreate(threadName,epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            (EPICSTHREADFUNC)threadPoolThread,pthreadPool)) {
+            printf("asynManager threadPool epicsThreadCreate failed "
+                "for thread %d\n",i);
+            break;
         }
-        while(1) {
-            int i;
-            dpCommon *pdpCommon = 0;
-            asynStatus status = asynSuccess;
-
-            callTimeoutUser = FALSE;
-            pport->queueStateChange = FALSE;
-            for(i=asynQueuePriorityHigh; i>=asynQueuePriorityLow; i--) {
-                for(puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-                puserPvt; puserPvt = (userPvt *)ellNext(&puserPvt->node)) {
-                    pdpCommon = findDpCommon(puserPvt);
-                    assert(pdpCommon);
-
-                    if(!pdpCommon->enabled) continue;
-                    if(!pdpCommon->connected) {
-                        autoConnectDevice(pdpCommon->pport,
-                            pdpCommon->pdevice);
-                        if(pport->queueStateChange) {
-                            puserPvt = 0;
-                            break;
-                        }
-                    }
-                    if(!pdpCommon->connected && puserPvt->timeoutUser!=0) {
-                       callTimeoutUser = TRUE;
-                    }
-                    if((pport->pblockProcessHolder==NULL
-                        || pport->pblockProcessHolder==puserPvt)
-                    && (pdpCommon->pblockProcessHolder==NULL
-                        || pdpCommon->pblockProcessHolder==puserPvt)) {
-                        assert(puserPvt->isQueued);
-                        ellDelete(&pport->queueList[i],&puserPvt->node);
-                        puserPvt->isQueued = FALSE;
-                        break;
-                    }
-                }
-                if(puserPvt || pport->queueStateChange) break; /*for*/
+        pthreadPool->numberThreads++;
+    }
+    pasynBase->pthreadPool = pthreadPool;
+}
+
+static void threadPoolSchedule(port *pport)
+{
+    threadPool *pthreadPool = pasynBase->pthreadPool;
+
+    epicsMutexMustLock(pthreadPool->lock);
+    if(pport->poolRunning) {
+        pport->poolRerun = TRUE;
+    } else if(!pport->poolRunnable) {
+        pport->poolRunnable = TRUE;
+        epicsTimeGetCurrent(&pport->poolRunnableTime);
+        ellAdd(&pthreadPool->runnableList,&pport->poolNode);
+        epicsEventSignal(pthreadPool->notify);
+    }
+    epicsMutexUnlock(pthreadPool->lock);
+}
+
+static void threadPoolThread(threadPool *pthreadPool)
+{
+    taskwdInsert(epicsThreadGetIdSelf(),0,0);
+    while(1) {
+        ELLNODE        *pn;
+        port           *pport;
+        epicsTimeStamp start,end;
+        double         wait;
+
+        epicsEventMustWait(pthreadPool->notify);
+        epicsMutexMustLock(pthreadPool->lock);
+        while((pn = ellGet(&pthreadPool->runnableList))) {
+            pport = CONTAINER(pn, port, poolNode);
+            pport->poolRunnable = FALSE;
+            pport->poolRunning = TRUE;
+            epicsTimeGetCurrent(&start);
+            wait = epicsTimeDiffInSeconds(&start,&pport->poolRunnableTime);
+            pport->poolNumberWaits++;
+            pport->poolWaitSum += wait;
+            if(wait>pport->poolWaitMax) pport->poolWaitMax = wait;
+            pthreadPool->numberBusy++;
+            /*Let an idle pool thread take the next port*/
+            if(ellCount(&pthreadPool->runnableList)>0)
+                epicsEventSignal(pthreadPool->notify);
+            epicsMutexUnlock(pthreadPool->lock);
+            portProcess(pport);
+            epicsTimeGetCurrent(&end);
+            epicsMutexMustLock(pthreadPool->lock);
+            pthreadPool->numberBusy--;
+            pthreadPool->numberRuns++;
+            pthreadPool->busySeconds += epicsTimeDiffInSeconds(&end,&start);
+            pport->poolRunning = FALSE;
+            if(pport->poolRerun) {
+                pport->poolRerun = FALSE;
+                pport->poolRunnable = TRUE;
+                pport->poolRunnableTime = end;
+                ellAdd(&pthreadPool->runnableList,&pport->poolNode);
             }
-            if(!puserPvt) break; /*while(1)*/
-            pasynUser = userPvtToAsynUser(puserPvt);
-            pasynUser->errorMessage[0] = '\0';
-            asynPrint(pasynUser,ASYN_TRACE_FLOW,"asynManager::portThread port=%s callback\n",pport->portName);
-            puserPvt->state = callbackActive;
-            timeout = puserPvt->timeout;
+        }
+        epicsMutexUnlock(pthreadPool->lock);
+    }
+}
+
+/* Calls back for the requests that can run now. Called by a port thread
+ * or a threadPool thread after signalPortThread.*/
+static void portProcess(port *pport)
+{
+    userPvt  *puserPvt;
+    userPvt  *pmerged;
+    asynUser *pasynUser;
+    BOOL     callTimeoutUser = FALSE;
+
+    asynAtomicSetInt(&pport->wakeupPending,0);
+    epicsMutexMustLock(pport->asynManagerLock);
+    queueIncomingDrain(pport);
+    if(!pport->dpc.enabled) {
+        epicsMutexUnlock(pport->asynManagerLock);
+        return;
+    }
+    /*Process ALL connect/disconnect requests first*/
+    while(!pport->connectActive
+    && (puserPvt = (userPvt *)ellFirst(&pport->connectQueue))) {
+        asynStatus status = asynSuccess;
+        epicsTimeStamp start,end;
+
+        assert(puserPvt->queueState==queueListed);
+        queueRemove(pport,puserPvt);
+        puserPvt->queueState = queueIdle;
+        epicsTimeGetCurrent(&start);
+        latencyRecord(
+            &pport->queueStatistics.queueWait[asynQueuePriorityConnect],
+            epicsTimeDiffInSeconds(&start,&puserPvt->queueTime));
+        pasynUser = userPvtToAsynUser(puserPvt);
+        pasynUser->errorMessage[0] = '\0';
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,
+            "asynManager connect queueCallback port:%s\n",
+             pport->portName);
+        puserPvt->state = callbackActive;
+        pport->connectActive = TRUE;
+        epicsMutexUnlock(pport->asynManagerLock);
+        synchronousLockTake(pport,&pport->dpc);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->lock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        puserPvt->processUser(pasynUser);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->unlock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        synchronousLockGive(pport,&pport->dpc);
+        epicsTimeGetCurrent(&end);
+        epicsMutexMustLock(pport->asynManagerLock);
+        latencyRecord(
+            &pport->queueStatistics.service[asynQueuePriorityConnect],
+            epicsTimeDiffInSeconds(&end,&start));
+        pport->connectActive = FALSE;
+        if (puserPvt->state==callbackCanceled)
+            epicsEventSignal(puserPvt->callbackDone);
+        puserPvt->state = callbackIdle;
+        if(puserPvt->freeAfterCallback) {
+            puserPvt->freeAfterCallback = FALSE;
+            epicsMutexMustLock(pasynBase->lock);
+            ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+            epicsMutexUnlock(pasynBase->lock);
+        }
+    }
+    if(!pport->dpc.connected) {
+        if(!autoConnectDevice(pport,0)) {
             epicsMutexUnlock(pport->asynManagerLock);
-            if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-            epicsMutexMustLock(pport->synchronousLock);
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->lock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }
-            if(callTimeoutUser) {
-                puserPvt->timeoutUser(pasynUser);
-            } else {
-                puserPvt->processUser(pasynUser);
-            }
-            if(pport->pasynLockPortNotify) {
-                status = pport->pasynLockPortNotify->unlock(
-                   pport->lockPortNotifyPvt,pasynUser);
-                if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
-                        "%s queueCallback pasynLockPortNotify:lock error %s\n",
-                         pport->portName,pasynUser->errorMessage);
-            }    
-            epicsMutexUnlock(pport->synchronousLock);
-            epicsMutexMustLock(pport->asynManagerLock);
-            if(puserPvt->blockPortCount>0)
-                pport->pblockProcessHolder = puserPvt;
-            if(puserPvt->blockDeviceCount>0)
-                pdpCommon->pblockProcessHolder = puserPvt;
-            if(puserPvt->state==callbackCanceled)
-                epicsEventSignal(puserPvt->callbackDone);
-            puserPvt->state = callbackIdle;
-            if(puserPvt->freeAfterCallback) {
-                puserPvt->freeAfterCallback = FALSE;
+            return;
+        }
+    }
+    while(1) {
+        dpCommon *pdpCommon;
+        dpCommon *plockDpCommon;
+        userPvt  *pnext;
+        BOOL     moreReady;
+        asynStatus status = asynSuccess;
+        asynQueuePriority priority;
+        epicsTimeStamp start,end;
+
+        queueIncomingDrain(pport);
+        puserPvt = queueNextRequest(pport,&callTimeoutUser);
+        if(!puserPvt) break; /*while(1)*/
+        puserPvt->queueState = queueIdle;
+        pmerged = 0;
+        if(pport->queueMergeEnabled && !callTimeoutUser
+        && puserPvt->merge!=asynQueueMergeNone
+        && puserPvt->blockPortCount==0 && puserPvt->blockDeviceCount==0)
+            puserPvt = queueMerge(pport,puserPvt,&pmerged);
+        /*The callback can queue the asynUser again at another priority*/
+        priority = puserPvt->priority;
+        epicsTimeGetCurrent(&start);
+        latencyRecord(&pport->queueStatistics.queueWait[priority],
+            epicsTimeDiffInSeconds(&start,&puserPvt->queueTime));
+        if(callTimeoutUser) pport->queueStatistics.numberTimeouts++;
+        pdpCommon = findDpCommon(puserPvt);
+        pdpCommon->busy = TRUE;
+        pdpCommon->pactiveUser = puserPvt;
+        pdpCommon->activeThread = epicsThreadGetIdSelf();
+        /*Become the holder before the callback so that no other port
+         *thread starts a request while it runs*/
+        if(puserPvt->blockPortCount>0)
+            pport->pblockProcessHolder = puserPvt;
+        if(puserPvt->blockDeviceCount>0)
+            pdpCommon->pblockProcessHolder = puserPvt;
+        /*The holder of blockProcessCallback for all devices runs alone*/
+        plockDpCommon = (pport->pblockProcessHolder==puserPvt)
+            ? &pport->dpc : pdpCommon;
+        pasynUser = userPvtToAsynUser(puserPvt);
+        pasynUser->errorMessage[0] = '\0';
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,"asynManager::portThread port=%s callback\n",pport->portName);
+        puserPvt->state = callbackActive;
+        for(pnext=pmerged; pnext; pnext=pnext->pnextMerged)
+            pnext->state = callbackActive;
+        moreReady = (pport->numberThreads>1 && queueHasReady(pport));
+        epicsMutexUnlock(pport->asynManagerLock);
+        /*Let an idle port thread take the next request*/
+        if(moreReady) signalPortThread(pport);
+        synchronousLockTake(pport,plockDpCommon);
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->lock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }
+        if(callTimeoutUser) {
+            puserPvt->timeoutUser(pasynUser);
+        } else {
+            puserPvt->processUser(pasynUser);
+            /*Only queueMerge changes pnextMerged and the device is busy*/
+            for(pnext=pmerged; pnext; pnext=pnext->pnextMerged)
+                pnext->mergeCallback(&pnext->user,pasynUser);
+        }
+        if(pport->pasynLockPortNotify) {
+            status = pport->pasynLockPortNotify->unlock(
+               pport->lockPortNotifyPvt,pasynUser);
+            if(status!=asynSuccess) asynPrint(pasynUser,ASYN_TRACE_ERROR,
+                    "%s queueCallback pasynLockPortNotify:lock error %s\n",
+                     pport->portName,pasynUser->errorMessage);
+        }    
+        synchronousLockGive(pport,plockDpCommon);
+        epicsTimeGetCurrent(&end);
+        epicsMutexMustLock(pport->asynManagerLock);
+        if(!callTimeoutUser) {
+            double seconds = epicsTimeDiffInSeconds(&end,&start);
+
+            latencyRecord(&pport->queueStatistics.service[priority],seconds);
+            if(pport->pqueuePolicy->charge)
+                pport->pqueuePolicy->charge(pport,
+                    &pdpCommon->queue[priority],seconds);
+        }
+        while((pnext = pmerged)) {
+            pmerged = pnext->pnextMerged;
+            if(pnext->state==callbackCanceled)
+                epicsEventSignal(pnext->callbackDone);
+            pnext->state = callbackIdle;
+            if(pnext->freeAfterCallback) {
+                pnext->freeAfterCallback = FALSE;
                 epicsMutexMustLock(pasynBase->lock);
-                ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+                ellAdd(&pasynBase->asynUserFreeList,&pnext->node);
                 epicsMutexUnlock(pasynBase->lock);
             }
-            if(pport->queueStateChange) break;
         }
-        epicsMutexUnlock(pport->asynManagerLock);
+        if(pdpCommon->aborting) abortEnd(pport,pdpCommon);
+        pdpCommon->pactiveUser = 0;
+        pdpCommon->busy = FALSE;
+        queueUnpark(pport,pdpCommon);
+        if(puserPvt->blockPortCount>0)
+            pport->pblockProcessHolder = puserPvt;
+        if(puserPvt->blockDeviceCount>0)
+            pdpCommon->pblockProcessHolder = puserPvt;
+        queueIncomingDrain(pport);
+        if(puserPvt->queueState==queueListed
+        && (puserPvt->blockPortCount>0 || puserPvt->blockDeviceCount>0)) {
+            /*Queued again before it became the holder*/
+            queueRemove(pport,puserPvt);
+            queueAdd(pport,puserPvt,puserPvt->priority,TRUE);
+        }
+        if(puserPvt->state==callbackCanceled)
+            epicsEventSignal(puserPvt->callbackDone);
+        puserPvt->state = callbackIdle;
+        if(puserPvt->freeAfterCallback) {
+            puserPvt->freeAfterCallback = FALSE;
+            epicsMutexMustLock(pasynBase->lock);
+            ellAdd(&pasynBase->asynUserFreeList,&puserPvt->node);
+            epicsMutexUnlock(pasynBase->lock);
+        }
+        /*Connect requests go first. Whoever queued them signaled*/
+        if(ellCount(&pport->connectQueue)>0) break;
     }
+    epicsMutexUnlock(pport->asynManagerLock);
 }
 static void queueLockPortCallback(asynUser *pasynUser)
 {
@@ -925,6 +2297,55 @@ static void queueLockPortCallback(asynUser *pasynUser)
     epicsEventSignal(plockPortPvt->queueLockPortEvent);
 }
 
+/* If nothing is queued for the port and the device is connected, not busy
+ * and not blocked by blockProcessCallback, the port thread would call
+ * queueLockPortCallback as soon as it is queued. The calling thread then
+ * takes the device itself, exactly as the port thread would. Requests
+ * queued meanwhile stay parked until queueUnlockPortGive.
+ * Returns FALSE if queueLockPort must queue a request.*/
+static BOOL queueLockPortTake(port *pport,userPvt *puserPvt,
+    queueLockPortPvt *plockPortPvt)
+{
+    dpCommon *pdpCommon = findDpCommon(puserPvt);
+    BOOL     idle;
+
+    epicsMutexMustLock(pport->asynManagerLock);
+    queueIncomingDrain(pport);
+    idle = (pport->nQueued==0 && !pport->connectActive
+        && !pport->exclusiveWaiting && !pport->exclusiveOwner
+        && !pport->pblockProcessHolder && !pdpCommon->pblockProcessHolder
+        && pport->dpc.enabled && pport->dpc.connected
+        && pdpCommon->enabled && pdpCommon->connected && !pdpCommon->busy);
+    if(idle) {
+        pdpCommon->busy = TRUE;
+        pdpCommon->pactiveUser = puserPvt;
+        pdpCommon->activeThread = epicsThreadGetIdSelf();
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    if(!idle) return FALSE;
+    synchronousLockTake(pport,pdpCommon);
+    plockPortPvt->plockDpCommon = pdpCommon;
+    return TRUE;
+}
+
+static void queueUnlockPortGive(port *pport,queueLockPortPvt *plockPortPvt)
+{
+    dpCommon *pdpCommon = plockPortPvt->plockDpCommon;
+    BOOL     wakeup;
+
+    plockPortPvt->plockDpCommon = 0;
+    synchronousLockGive(pport,pdpCommon);
+    epicsMutexMustLock(pport->asynManagerLock);
+    if(pdpCommon->aborting) abortEnd(pport,pdpCommon);
+    pdpCommon->pactiveUser = 0;
+    pdpCommon->busy = FALSE;
+    queueUnpark(pport,pdpCommon);
+    queueIncomingDrain(pport);
+    wakeup = (pport->nQueued>0);
+    epicsMutexUnlock(pport->asynManagerLock);
+    if(wakeup) signalPortThread(pport);
+}
+
 
 /* asynManager methods */
 static void reportPrintInterfaceList(FILE *fp,ELLLIST *plist,const char *title)
@@ -959,7 +2380,6 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
     FILE *fp = pprintPortArgs->fp;
     int  details = pprintPortArgs->details;
     int  showDevices = 1;
-    int           i;
     dpCommon *pdpc;
     interfaceNode *pinterfaceNode;
     asynCommon    *pasynCommon = 0;
@@ -970,8 +2390,7 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
         showDevices = 0;
         details = -details;
     }
-    for(i=asynQueuePriorityLow; i<=asynQueuePriorityConnect; i++) 
-        nQueued += ellCount(&pport->queueList[i]);
+    nQueued = pport->nQueued;
     pdpc = &pport->dpc;
     fprintf(fp,"%s multiDevice:%s canBlock:%s autoConnect:%s\n",
         pport->portName,
@@ -995,6 +2414,25 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
             ellCount(&pport->deviceList),
             nQueued,
             (pport->pblockProcessHolder ? "Yes" : "No"));
+        if(pport->numberThreads>1)
+            fprintf(fp,"    numberThreads %d deviceLocksHeld %d\n",
+                pport->numberThreads,pport->sharedCount);
+        if(pport->usesThreadPool) {
+            threadPool *pthreadPool = pasynBase->pthreadPool;
+            unsigned long numberWaits;
+            double        waitSum,waitMax;
+
+            epicsMutexMustLock(pthreadPool->lock);
+            numberWaits = pport->poolNumberWaits;
+            waitSum = pport->poolWaitSum;
+            waitMax = pport->poolWaitMax;
+            epicsMutexUnlock(pthreadPool->lock);
+            fprintf(fp,"    threadPool runs %lu queueWait average %.6f "
+                "max %.6f seconds\n",numberWaits,
+                (numberWaits>0) ? waitSum/numberWaits : 0.0,waitMax);
+        }
+        if(pport->attributes&ASYN_CANBLOCK)
+            queueStatisticsReport(fp,pport,details);
         fprintf(fp,"    asynManagerLock:%s synchronousLock:%s\n",
             ((mgrStatus==epicsMutexLockOK) ? "No" : "Yes"),
             ((syncStatus==epicsMutexLockOK) ? "No" : "Yes"));
@@ -1064,6 +2502,70 @@ static void reportPrintPort(printPortArgs *pprintPortArgs)
     epicsEventSignal(done);
 }
 
+static void queueStatisticsReport(FILE *fp,port *pport,int details)
+{
+    static const char *priorityName[NUMBER_QUEUE_PRIORITIES] = {
+        "low","medium","high","connect"};
+    asynQueueStatistics *pstats;
+    epicsTimeStamp      now;
+    int                 i;
+
+    /*Too big for the stack of reportPrintPort*/
+    pstats = mallocMustSucceed(sizeof(asynQueueStatistics),"asynManager");
+    epicsMutexMustLock(pport->asynManagerLock);
+    *pstats = pport->queueStatistics;
+    pstats->nQueued = pport->nQueued;
+    epicsMutexUnlock(pport->asynManagerLock);
+    epicsTimeGetCurrent(&now);
+    fprintf(fp,"    queue policy %s",
+        queuePolicyName[pport->pqueuePolicy->policy]);
+    if(pport->pqueuePolicy->policy!=asynQueuePolicyStrict)
+        fprintf(fp," %g",pport->queuePolicyParam);
+    fprintf(fp," highWater %d timeouts %lu cancels %lu",
+        pstats->queueHighWater,pstats->numberTimeouts,pstats->numberCancels);
+    if(pport->queueMergeEnabled)
+        fprintf(fp," merged %lu",pstats->numberMerged);
+    if(pstats->numberAborts>0)
+        fprintf(fp," aborts %lu",pstats->numberAborts);
+    fprintf(fp," in %.1f seconds\n",
+        epicsTimeDiffInSeconds(&now,&pstats->since));
+    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
+        asynLatencyHistogram *pwait = &pstats->queueWait[i];
+        asynLatencyHistogram *pservice = &pstats->service[i];
+        int                  j;
+
+        if(pwait->count==0) continue;
+        fprintf(fp,"    %s queueWait n %lu average %.6f p99 %.6f max %.6f\n",
+            priorityName[i],pwait->count,pwait->sum/pwait->count,
+            latencyPercentile(pwait,0.99),pwait->max);
+        if(pservice->count>0)
+            fprintf(fp,"    %s service n %lu average %.6f p99 %.6f max %.6f\n",
+                priorityName[i],pservice->count,
+                pservice->sum/pservice->count,
+                latencyPercentile(pservice,0.99),pservice->max);
+        if(details<3) continue;
+        /*Bucket upper limits in microseconds*/
+        for(j=0; j<2; j++) {
+            asynLatencyHistogram *phistogram = j ? pservice : pwait;
+            unsigned long        limit = 1;
+            int                  k;
+
+            if(phistogram->count==0) continue;
+            fprintf(fp,"        %s",j ? "service" : "queueWait");
+            for(k=0; k<ASYN_LATENCY_BUCKETS; k++, limit *= 2) {
+                if(phistogram->bucket[k]==0) continue;
+                if(k<ASYN_LATENCY_BUCKETS-1) {
+                    fprintf(fp," <%luus:%lu",limit,phistogram->bucket[k]);
+                } else {
+                    fprintf(fp," >=%luus:%lu",limit/2,phistogram->bucket[k]);
+                }
+            }
+            fprintf(fp,"\n");
+        }
+    }
+    free(pstats);
+}
+
 static void report(FILE *fp,int details,const char *portName)
 {
     port *pport;
@@ -1075,6 +2577,27 @@ static void report(FILE *fp,int details,const char *portName)
 
 
     if(!pasynBase) asynInit();
+    if(!portName && details>=1) {
+        memReport(fp);
+        traceReport(fp);
+    }
+    if(!portName && pasynBase->pthreadPool) {
+        threadPool     *pthreadPool = pasynBase->pthreadPool;
+        epicsTimeStamp now;
+        double         elapsed;
+
+        epicsTimeGetCurrent(&now);
+        epicsMutexMustLock(pthreadPool->lock);
+        elapsed = epicsTimeDiffInSeconds(&now,&pthreadPool->startTime)
+                  * pthreadPool->numberThreads;
+        fprintf(fp,"asynManager threadPool numberThreads %d busy %d "
+            "runnable %d utilization %.1f%% runs %lu\n",
+            pthreadPool->numberThreads,pthreadPool->numberBusy,
+            ellCount(&pthreadPool->runnableList),
+            (elapsed>0.0) ? 100.0*pthreadPool->busySeconds/elapsed : 0.0,
+            pthreadPool->numberRuns);
+        epicsMutexUnlock(pthreadPool->lock);
+    }
     if (portName) {
         pport = locatePort(portName);
         if(!pport) {
@@ -1115,9 +2638,6 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
         epicsMutexUnlock(pasynBase->lock);
         nbytes = sizeof(userPvt) + ERROR_MESSAGE_SIZE + 1;
         puserPvt = callocMustSucceed(1,nbytes,"asynCommon:registerDriver");
-        puserPvt->timer = epicsTimerQueueCreateTimer(
-            pasynBase->timerQueue,queueTimeoutCallback,puserPvt);
-        puserPvt->callbackDone = epicsEventMustCreate(epicsEventEmpty);
         pasynUser = userPvtToAsynUser(puserPvt);
         pasynUser->errorMessage = (char *)(puserPvt +1);
         pasynUser->errorMessageSize = ERROR_MESSAGE_SIZE;
@@ -1134,7 +2654,9 @@ static asynUser *createAsynUser(userCallback process, userCallback timeout)
     assert(puserPvt->blockDeviceCount==0);
     assert(puserPvt->freeAfterCallback==FALSE);
     assert(puserPvt->pexceptionUser==0);
-    puserPvt->isQueued = FALSE;
+    puserPvt->queueState = queueIdle;
+    puserPvt->merge = asynQueueMergeNone;
+    puserPvt->mergeCallback = 0;
     pasynUser->errorMessage[0] = 0;
     pasynUser->timeout = 0.0;
     pasynUser->userPvt = 0;
@@ -1184,12 +2706,86 @@ static asynStatus freeAsynUser(asynUser *pasynUser)
     return asynSuccess;
 }
 
+static void memCacheThreadExit(void *arg)
+{
+    memCache *pmemCache = (memCache *)arg;
+    int      ind;
+
+    epicsThreadPrivateSet(pasynBase->memCacheId,0);
+    epicsMutexMustLock(pasynBase->lockMem);
+    for(ind=0; ind<nMemList; ind++)
+        ellConcat(&pasynBase->memList[ind],&pmemCache->freeList[ind]);
+    ellDelete(&pasynBase->memCacheList,&pmemCache->node);
+    epicsMutexUnlock(pasynBase->lockMem);
+    free(pmemCache);
+}
+
+static memCache *memCacheGet(void)
+{
+    memCache *pmemCache = epicsThreadPrivateGet(pasynBase->memCacheId);
+    int      ind;
+
+    if(pmemCache) return pmemCache;
+    pmemCache = callocMustSucceed(1,sizeof(memCache),"asynManager::memCacheGet");
+    for(ind=0; ind<nMemList; ind++) ellInit(&pmemCache->freeList[ind]);
+    epicsMutexMustLock(pasynBase->lockMem);
+    ellAdd(&pasynBase->memCacheList,&pmemCache->node);
+    epicsMutexUnlock(pasynBase->lockMem);
+    epicsThreadPrivateSet(pasynBase->memCacheId,pmemCache);
+    epicsAtThreadExit(memCacheThreadExit,pmemCache);
+    return pmemCache;
+}
+
+static void memCacheRefill(memCache *pmemCache,int ind)
+{
+    ELLLIST  *pmemList = &pasynBase->memList[ind];
+    ELLLIST  *pfreeList = &pmemCache->freeList[ind];
+    memStats *pmemStats = &pasynBase->memStats[ind];
+    memNode  *pmemNode;
+    int      n;
+
+    epicsMutexMustLock(pasynBase->lockMem);
+    for(n=0; n<memCacheBatch[ind]; n++) {
+        pmemNode = (memNode *)ellGet(pmemList);
+        if(!pmemNode) break;
+        ellAdd(pfreeList,&pmemNode->node);
+    }
+    if(n==0) {
+        /* Note: pmemNode->memory must be multiple of 16 in order to hold any data type */
+        pmemNode = mallocMustSucceed(NODESIZE + memListSize[ind],
+             "asynManager::memMalloc");
+        pmemNode->memory = (char *)pmemNode + NODESIZE;
+        ellAdd(pfreeList,&pmemNode->node);
+        pmemStats->created++;
+    }
+    n = pmemStats->created - ellCount(pmemList);
+    if(n>pmemStats->peak) pmemStats->peak = n;
+    epicsMutexUnlock(pasynBase->lockMem);
+}
+
+static void memCacheFlush(memCache *pmemCache,int ind)
+{
+    ELLLIST  *pmemList = &pasynBase->memList[ind];
+    ELLLIST  *pfreeList = &pmemCache->freeList[ind];
+    ELLNODE  *pnode;
+    int      n;
+
+    epicsMutexMustLock(pasynBase->lockMem);
+    for(n=0; n<memCacheBatch[ind]; n++) {
+        pnode = ellGet(pfreeList);
+        if(!pnode) break;
+        ellAdd(pmemList,pnode);
+    }
+    epicsMutexUnlock(pasynBase->lockMem);
+}
+
 static void *memMalloc(size_t size)
 {
     int ind;
-    ELLLIST *pmemList;
+    ELLLIST *pfreeList;
+    memCache *pmemCache;
     memNode *pmemNode;
-    
+
     if(!pasynBase) asynInit();
     for(ind=0; ind<nMemList; ind++) {
         if(size<=memListSize[ind]) break;
@@ -1197,27 +2793,20 @@ static void *memMalloc(size_t size)
     if(ind>=nMemList) {
         return mallocMustSucceed(size,"asynManager::memMalloc");
     }
-    pmemList = &pasynBase->memList[ind];
-    epicsMutexMustLock(pasynBase->lock);
-    pmemNode = (memNode *)ellFirst(pmemList);
-    if(pmemNode) {
-         ellDelete(pmemList,&pmemNode->node);
-     } else {
-        /* Note: pmemNode->memory must be multiple of 16 in order to hold any data type */
-        pmemNode = mallocMustSucceed(NODESIZE + memListSize[ind],
-             "asynManager::memMalloc");
-        pmemNode->memory = (char *)pmemNode + NODESIZE;
-     }
-     epicsMutexUnlock(pasynBase->lock);
-     return pmemNode->memory;
+    pmemCache = memCacheGet();
+    pfreeList = &pmemCache->freeList[ind];
+    if(ellCount(pfreeList)==0) memCacheRefill(pmemCache,ind);
+    pmemNode = (memNode *)ellGet(pfreeList);
+    return pmemNode->memory;
 }
 
 static void memFree(void *pmem,size_t size)
 {
     int ind;
-    ELLLIST *pmemList;
+    ELLLIST *pfreeList;
+    memCache *pmemCache;
     memNode *pmemNode;
-    
+
     assert(size>0);
     if(!pasynBase) asynInit();
     if(size>memListSize[nMemList-1]) {
@@ -1228,14 +2817,40 @@ static void memFree(void *pmem,size_t size)
         if(size<=memListSize[ind]) break;
     }
     assert(ind<nMemList);
-    pmemList = &pasynBase->memList[ind];
     pmemNode = (memNode *)((char *)pmem - NODESIZE);
     assert(pmemNode->memory==pmem);
-    epicsMutexMustLock(pasynBase->lock);
-    ellAdd(pmemList,&pmemNode->node);
-    epicsMutexUnlock(pasynBase->lock);
+    pmemCache = memCacheGet();
+    pfreeList = &pmemCache->freeList[ind];
+    ellAdd(pfreeList,&pmemNode->node);
+    if(ellCount(pfreeList)>2*memCacheBatch[ind]) memCacheFlush(pmemCache,ind);
 }
-
+
+/* The free lists of the memCaches of other threads are counted while their
+ * owners keep using them without a lock, so live and cached are approximate.
+ * Their sum and peak are exact.*/
+static void memReport(FILE *fp)
+{
+    int ind;
+
+    epicsMutexMustLock(pasynBase->lockMem);
+    fprintf(fp,"asynManager memMalloc threads %d\n",
+        ellCount(&pasynBase->memCacheList));
+    for(ind=0; ind<nMemList; ind++) {
+        memStats *pmemStats = &pasynBase->memStats[ind];
+        memCache *pmemCache;
+        int      cached = ellCount(&pasynBase->memList[ind]);
+
+        if(pmemStats->created==0) continue;
+        for(pmemCache = (memCache *)ellFirst(&pasynBase->memCacheList);
+        pmemCache; pmemCache = (memCache *)ellNext(&pmemCache->node))
+            cached += ellCount(&pmemCache->freeList[ind]);
+        fprintf(fp,"    size %4lu live ~%d peak %d cached ~%d\n",
+            (unsigned long)memListSize[ind],pmemStats->created - cached,
+            pmemStats->peak,cached);
+    }
+    epicsMutexUnlock(pasynBase->lockMem);
+}
+
 static asynStatus isMultiDevice(asynUser *pasynUser,
     const char *portName,int *yesNo)
 {
@@ -1290,7 +2905,7 @@ static asynStatus disconnect(asynUser *pasynUser)
         return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    if(puserPvt->isQueued) {
+    if(puserPvt->queueState!=queueIdle) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "asynManager::disconnect request queued");
         status = asynError; goto unlock;
@@ -1395,6 +3010,7 @@ static asynInterface *findInterface(asynUser *pasynUser,
     port          *pport = puserPvt->pport;
     device        *pdevice = puserPvt->pdevice;
     interfaceNode *pinterfaceNode;
+    interfaceChain *pinterfaceChain;
 
     if(!pasynBase) asynInit();
     if(!pport) {
@@ -1402,19 +3018,18 @@ static asynInterface *findInterface(asynUser *pasynUser,
                 "asynManager:findInterface: not connected");
         return 0;
     }
-    if(interposeInterfaceOK) {
-        if(pdevice) {
-            pinterfaceNode = locateInterfaceNode(
-                &pdevice->dpc.interposeInterfaceList, interfaceType,FALSE);
-            if(pinterfaceNode) return(pinterfaceNode->pasynInterface);
-        }
+    if(interposeInterfaceOK && pdevice
+    && ellCount(&pdevice->dpc.interposeInterfaceList)>0) {
         pinterfaceNode = locateInterfaceNode(
-            &pport->dpc.interposeInterfaceList, interfaceType,FALSE);
+            &pdevice->dpc.interposeInterfaceList, interfaceType,FALSE);
         if(pinterfaceNode) return(pinterfaceNode->pasynInterface);
     }
-    pinterfaceNode = locateInterfaceNode(
-        &pport->interfaceList,interfaceType,FALSE);
-    if(pinterfaceNode) return(pinterfaceNode->pasynInterface);
+    pinterfaceChain = locateInterfaceChain(pport,interfaceType,FALSE);
+    if(!pinterfaceChain) return 0;
+    if(interposeInterfaceOK && pinterfaceChain->pinterposeNode)
+        return(pinterfaceChain->pinterposeNode->pasynInterface);
+    if(pinterfaceChain->pinterfaceNode)
+        return(pinterfaceChain->pinterfaceNode->pasynInterface);
     return 0;
 }
 
@@ -1444,6 +3059,40 @@ static asynStatus queueRequest(asynUser *pasynUser,
     && (addr==-1 || pasynUser->reason==ASYN_REASON_QUEUE_EVEN_IF_NOT_CONNECTED)) {
         checkPortConnect = FALSE;
     }
+    if((pport->attributes&ASYN_CANBLOCK) && timeout<=0.0) {
+        /* Requests without a timeout do not need asynManagerLock*/
+        if(!pport->dpc.enabled) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "port %s disabled",pport->portName);
+            return asynDisabled;
+        }
+        if(checkPortConnect && !pport->dpc.connected) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "port %s not connected",pport->portName);
+            return asynDisconnected;
+        }
+        if(asynAtomicCmpAndSwapInt(&puserPvt->queueState,
+                queueIdle,queueIncoming)!=queueIdle) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                    "asynManager::queueRequest is already queued");
+            return asynError;
+        }
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,
+            "%s addr %d queueRequest priority %d\n",
+            pport->portName,addr,priority);
+        puserPvt->timeout = 0.0;
+        epicsTimeGetCurrent(&puserPvt->queueTime);
+        queueIncomingPush(pport,puserPvt,priority);
+        if(asynAtomicGetInt(&puserPvt->queueState)==queueCanceled) {
+            /*cancelRequest ran before the push. Drop it now.*/
+            epicsMutexMustLock(pport->asynManagerLock);
+            queueIncomingDrain(pport);
+            epicsMutexUnlock(pport->asynManagerLock);
+            return asynSuccess;
+        }
+        signalPortThread(pport);
+        return asynSuccess;
+    }
     epicsMutexMustLock(pport->asynManagerLock);
     if(!pport->dpc.enabled) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -1488,7 +3137,7 @@ static asynStatus queueRequest(asynUser *pasynUser,
         epicsMutexUnlock(pport->synchronousLock);
         return asynSuccess;
     }
-    if(puserPvt->isQueued) {
+    if(puserPvt->queueState!=queueIdle) {
         epicsMutexUnlock(pport->asynManagerLock);
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "asynManager::queueRequest is already queued");
@@ -1501,6 +3150,8 @@ static asynStatus queueRequest(asynUser *pasynUser,
             "timeout callback was passed to createAsynUser");
         return asynError;
     }
+    /* Keep FIFO order with requests queued without asynManagerLock*/
+    queueIncomingDrain(pport);
     if(puserPvt->blockPortCount>0 || puserPvt->blockDeviceCount>0) {
         if(pport->pblockProcessHolder
         && pport->pblockProcessHolder==puserPvt) addToFront = TRUE;
@@ -1511,26 +3162,27 @@ static asynStatus queueRequest(asynUser *pasynUser,
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d from lockHolder\n",
             pport->portName,addr,priority);
-        ellInsert(&pport->queueList[priority],0,&puserPvt->node);
     } else {
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s addr %d queueRequest priority %d not lockHolder\n",
             pport->portName,addr,priority);
-        /*Add to end of list*/
-        ellAdd(&pport->queueList[priority],&puserPvt->node);
     }
-    pport->queueStateChange = TRUE;
-    puserPvt->isQueued = TRUE;
     if(timeout<=0.0) {
         puserPvt->timeout = 0.0;
     } else {
+        /*queueAdd arms the timerWheel*/
         puserPvt->timeout = timeout;
+        puserPvt->timerExpire = (unsigned int)asynAtomicGetInt(
+            &pasynBase->timerTick) + timerTicks(timeout);
         asynPrint(pasynUser,ASYN_TRACE_FLOW,
             "%s schedule queueRequest timeout\n",puserPvt->pport->portName);
-        epicsTimerStartDelay(puserPvt->timer,puserPvt->timeout);
     }
+    epicsTimeGetCurrent(&puserPvt->queueTime);
+    queueAdd(pport,puserPvt,priority,addToFront);
+    asynAtomicSetInt(&puserPvt->queueState,queueListed);
     epicsMutexUnlock(pport->asynManagerLock);
-    epicsEventSignal(pport->notifyPortThread);
+    if(timeout>0.0) timerThreadWakeup();
+    signalPortThread(pport);
     return asynSuccess;
 }
 
@@ -1539,9 +3191,7 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     port     *pport = puserPvt->pport;
     device   *pdevice = puserPvt->pdevice;
-    double   timeout;
     int      addr = (pdevice ? pdevice->addr : -1);
-    int      i;
     *wasQueued = 0; /*Initialize to not removed*/
     if(!pport) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -1549,12 +3199,33 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
         return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    if(!puserPvt->isQueued) {
+    /*Requests pushed before this are now on a dpQueue*/
+    queueIncomingDrain(pport);
+    if(asynAtomicCmpAndSwapInt(&puserPvt->queueState,
+            queueIncoming,queueCanceled)==queueIncoming) {
+        /*queueRequest claimed it but had not pushed it yet. Whichever of
+         *this drain or the one in queueRequest runs after the push drops it*/
+        queueIncomingDrain(pport);
+        pport->queueStatistics.numberCancels++;
+        *wasQueued = 1;
+        asynPrint(pasynUser,ASYN_TRACE_FLOW,
+                 "%s addr %d asynManager:cancelRequest before queued\n",
+                  pport->portName,addr);
+        epicsMutexUnlock(pport->asynManagerLock);
+        return asynSuccess;
+    }
+    if(puserPvt->queueState!=queueListed) {
         if(puserPvt->state==callbackActive) {
             asynPrint(pasynUser,ASYN_TRACE_FLOW,
                 "%s addr %d asynManager:cancelRequest wait for callback\n",
                  pport->portName,addr);
+            /*Whoever sees callbackCanceled signals with asynManagerLock held*/
+            if(!puserPvt->callbackDone)
+                puserPvt->callbackDone = epicsEventMustCreate(epicsEventEmpty);
             puserPvt->state = callbackCanceled;
+            /*Do not wait for I/O that the driver can abort*/
+            if(findDpCommon(puserPvt)->pactiveUser==puserPvt)
+                abortStart(pport,findDpCommon(puserPvt));
             epicsMutexUnlock(pport->asynManagerLock);
             epicsEventMustWait(puserPvt->callbackDone);
         } else {
@@ -1565,34 +3236,15 @@ static asynStatus cancelRequest(asynUser *pasynUser,int *wasQueued)
         }
         return asynSuccess;
     }
-    for(i=asynQueuePriorityConnect; i>=asynQueuePriorityLow; i--) {
-        puserPvt = (userPvt *)ellFirst(&pport->queueList[i]);
-        while(puserPvt) {
-            if(pasynUser == &puserPvt->user) {
-                ellDelete(&pport->queueList[i],&puserPvt->node);
-                *wasQueued = 1;
-                break;
-            }
-            puserPvt = (userPvt *)ellNext(&puserPvt->node);
-        }
-        if(puserPvt) break;
-    }
-    if(!puserPvt) {
-        asynPrint(pasynUser,ASYN_TRACE_ERROR,
-            "%s addr %d asynManager:cancelRequest LOGIC ERROR\n",
-            pport->portName, addr);
-        epicsMutexUnlock(pport->asynManagerLock);
-        return asynError;
-    }
+    queueRemove(pport,puserPvt);
+    pport->queueStatistics.numberCancels++;
+    *wasQueued = 1;
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
              "%s addr %d asynManager:cancelRequest\n",
               pport->portName,addr);
-    puserPvt->isQueued = FALSE;
-    pport->queueStateChange = TRUE;
-    timeout = puserPvt->timeout;
+    asynAtomicSetInt(&puserPvt->queueState,queueIdle);
     epicsMutexUnlock(pport->asynManagerLock);
-    if(puserPvt->timer && timeout>0.0) epicsTimerCancel(puserPvt->timer);
-    epicsEventSignal(pport->notifyPortThread);
+    signalPortThread(pport);
     return asynSuccess;
 }
 
@@ -1615,7 +3267,7 @@ static asynStatus blockProcessCallback(asynUser *pasynUser, int allDevices)
         return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    if(puserPvt->isQueued) {
+    if(puserPvt->queueState!=queueIdle) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "asynManager::blockProcessCallback is queued");
         epicsMutexUnlock(pport->asynManagerLock);
@@ -1647,7 +3299,7 @@ static asynStatus unblockProcessCallback(asynUser *pasynUser, int allDevices)
         return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    if(puserPvt->isQueued) {
+    if(puserPvt->queueState!=queueIdle) {
         epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
                 "asynManager::unblockProcessCallback is queued");
         epicsMutexUnlock(pport->asynManagerLock);
@@ -1672,11 +3324,12 @@ static asynStatus unblockProcessCallback(asynUser *pasynUser, int allDevices)
 
         if (pdpCommon->pblockProcessHolder==puserPvt) {
             pdpCommon->pblockProcessHolder = 0;
+            queueUnpark(pport,pdpCommon);
             wasOwner = TRUE;
         }
     }
     epicsMutexUnlock(pport->asynManagerLock);
-    if(wasOwner) epicsEventSignal(pport->notifyPortThread);
+    if(wasOwner) signalPortThread(pport);
     return asynSuccess;
 }
 
@@ -1691,7 +3344,7 @@ static asynStatus lockPort(asynUser *pasynUser)
         return asynError;
     }
     asynPrint(pasynUser,ASYN_TRACE_FLOW,"%s lockPort\n", pport->portName);
-    epicsMutexMustLock(pport->synchronousLock);
+    synchronousLockTake(pport,findDpCommon(puserPvt));
     if(pport->pasynLockPortNotify) {
         pport->pasynLockPortNotify->lock(
            pport->lockPortNotifyPvt,pasynUser);
@@ -1715,11 +3368,11 @@ static asynStatus unlockPort(asynUser *pasynUser)
         status = pport->pasynLockPortNotify->unlock(
            pport->lockPortNotifyPvt,pasynUser);
         if(status!=asynSuccess) {
-            epicsMutexUnlock(pport->synchronousLock);
+            synchronousLockGive(pport,findDpCommon(puserPvt));
             return status;
         }
     }
-    epicsMutexUnlock(pport->synchronousLock);
+    synchronousLockGive(pport,findDpCommon(puserPvt));
     return asynSuccess;
 }
 
@@ -1757,6 +3410,11 @@ static asynStatus queueLockPort(asynUser *pasynUser)
             plockPortPvt->queueLockPortCount++;
             return status;
         }
+        if (queueLockPortTake(pport, puserPvt, plockPortPvt)) {
+            asynPrint(pasynUser,ASYN_TRACE_FLOW, "%s asynManager::queueLockPort port idle, locked without queueing\n", pport->portName);
+            plockPortPvt->queueLockPortCount++;
+            goto notify;
+        }
         pasynUserCopy = pasynManager->duplicateAsynUser(pasynUser, queueLockPortCallback, 0);
         if (!pasynUserCopy){
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -1790,6 +3448,7 @@ static asynStatus queueLockPort(asynUser *pasynUser)
         /* Synchronous driver */
         epicsMutexMustLock(pport->synchronousLock);
     }
+notify:
     if(pport->pasynLockPortNotify) {
         status = pport->pasynLockPortNotify->lock(
            pport->lockPortNotifyPvt,pasynUser);
@@ -1833,6 +3492,11 @@ static asynStatus queueUnlockPort(asynUser *pasynUser)
             plockPortPvt->queueLockPortCount--;
             return status;
         }
+        if (plockPortPvt->plockDpCommon) {
+            queueUnlockPortGive(pport, plockPortPvt);
+            plockPortPvt->queueLockPortCount--;
+            return status;
+        }
         epicsMutexUnlock(plockPortPvt->queueLockPortMutex);
         /* Wait for event from the port thread in the queueLockPortCallback function which signals it has freed mutex */
         asynPrint(pasynUser,ASYN_TRACE_FLOW, "%s asynManager::queueUnlockPort waiting for event\n", pport->portName);
@@ -1897,6 +3561,14 @@ static asynStatus getPortName(asynUser *pasynUser,const char **pportName)
 static asynStatus registerPort(const char *portName,
     int attributes,int autoConnect,
     unsigned int priority,unsigned int stackSize)
+{
+    return registerPortThreads(portName,attributes,autoConnect,
+        priority,stackSize,0);
+}
+
+static asynStatus registerPortThreads(const char *portName,
+    int attributes,int autoConnect,
+    unsigned int priority,unsigned int stackSize,int numberThreads)
 {
     port    *pport = locatePort(portName);
     int     i;
@@ -1906,11 +3578,24 @@ static asynStatus registerPort(const char *portName,
         printf("asynCommon:registerDriver %s already registered\n",portName);
         return asynError;
     }
+    if(numberThreads>1) attributes |= ASYN_MULTITHREAD;
+    if((attributes&ASYN_MULTITHREAD)
+    && (!(attributes&ASYN_CANBLOCK) || !(attributes&ASYN_MULTIDEVICE))) {
+        printf("asynCommon:registerDriver %s ASYN_MULTITHREAD requires "
+            "ASYN_CANBLOCK and ASYN_MULTIDEVICE\n",portName);
+        attributes &= ~ASYN_MULTITHREAD;
+    }
+    if(!(attributes&ASYN_MULTITHREAD)) {
+        numberThreads = 1;
+    } else if(numberThreads<=1) {
+        numberThreads = DEFAULT_NUMBER_THREADS;
+    }
     len = sizeof(port) + strlen(portName) + 1;
     pport = callocMustSucceed(len,sizeof(char),"asynCommon:registerDriver");
     pport->portName = (char *)(pport + 1);
     strcpy(pport->portName,portName);
     pport->attributes = attributes;
+    pport->numberThreads = numberThreads;
     pport->asynManagerLock = epicsMutexMustCreate();
     pport->synchronousLock = epicsMutexMustCreate();
     pport->queueLockPortId = epicsThreadPrivateCreate();
@@ -1920,17 +3605,46 @@ static asynStatus registerPort(const char *portName,
     ellInit(&pport->deviceList);
     ellInit(&pport->interfaceList);
     if((attributes&ASYN_CANBLOCK)) {
-        for(i=0; i<NUMBER_QUEUE_PRIORITIES; i++) ellInit(&pport->queueList[i]);
+        ellInit(&pport->connectQueue);
+        for(i=0; i<NUMBER_QUEUE_PRIORITIES-1; i++) ellInit(&pport->readyList[i]);
+        pport->pqueuePolicy = &queuePolicyTable[asynQueuePolicyStrict];
+        ellInit(&pport->autoConnectRetryList);
+        if(numberThreads==1 && priority==0 && pasynBase->threadPoolSize>0) {
+            epicsMutexMustLock(pasynBase->lock);
+            if(!pasynBase->pthreadPool) threadPoolCreate();
+            epicsMutexUnlock(pasynBase->lock);
+            if(pasynBase->pthreadPool->numberThreads>0) {
+                pport->usesThreadPool = TRUE;
+                goto addPort;
+            }
+        }
         pport->notifyPortThread = epicsEventMustCreate(epicsEventEmpty);
         priority = priority ? priority : epicsThreadPriorityMedium;
         stackSize = stackSize ?
                        stackSize :
                        epicsThreadGetStackSize(epicsThreadStackMedium);
+        if(numberThreads>1) {
+            pport->exclusiveDone = epicsEventMustCreate(epicsEventEmpty);
+            pport->sharedIdle = epicsEventMustCreate(epicsEventEmpty);
+        }
         pport->threadid = epicsThreadCreate(portName,priority,stackSize,        
              (EPICSTHREADFUNC)portThread,pport);
+        for(i=1; pport->threadid && i<numberThreads; i++) {
+            char threadName[80];
+
+            epicsSnprintf(threadName,sizeof(threadName),"%s_%d",portName,i);
+            if(!epicsThreadCreate(threadName,priority,stackSize,
+                 (EPICSTHREADFUNC)portThread,pport)) {
+                printf("asynCommon:registerDriver %s epicsThreadCreate failed "
+                    "for thread %d\n",portName,i);
+                break;
+            }
+        }
         if(!pport->threadid){
             printf("asynCommon:registerDriver %s epicsThreadCreate failed \n",
                 portName);
+            if(pport->exclusiveDone) epicsEventDestroy(pport->exclusiveDone);
+            if(pport->sharedIdle) epicsEventDestroy(pport->sharedIdle);
             epicsEventDestroy(pport->notifyPortThread);
             freeAsynUser(pport->pasynUser);
             dpCommonFree(&pport->dpc);
@@ -1940,8 +3654,18 @@ static asynStatus registerPort(const char *portName,
             return asynError;
         }
     }
+addPort:
+    epicsTimeGetCurrent(&pport->queueStatistics.since);
+    if((attributes&ASYN_CANBLOCK)) pport->ptimerWheel = timerWheelCreate(pport);
     epicsMutexMustLock(pasynBase->lock);
     ellAdd(&pasynBase->asynPortList,&pport->node);
+    {
+        port **ppport = &pasynBase->portHash[
+            epicsStrHash(pport->portName,0)&(PORT_HASH_SIZE-1)];
+
+        pport->pnextHash = *ppport;
+        *ppport = pport;
+    }
     epicsMutexUnlock(pasynBase->lock);
     return asynSuccess;
 }
@@ -1951,6 +3675,7 @@ static asynStatus registerInterface(const char *portName,
 {
     port          *pport = locatePort(portName);
     interfaceNode *pinterfaceNode;
+    interfaceChain *pinterfaceChain;
 
     if(!pport) {
        printf("asynManager:registerInterface portName %s not registered\n",
@@ -1965,15 +3690,19 @@ static asynStatus registerInterface(const char *portName,
         epicsMutexUnlock(pport->asynManagerLock);
         return asynSuccess;
     }
-    pinterfaceNode = locateInterfaceNode(
-        &pport->interfaceList,pasynInterface->interfaceType,TRUE);
-    if(pinterfaceNode->pasynInterface) {
+    pinterfaceChain = locateInterfaceChain(
+        pport,pasynInterface->interfaceType,TRUE);
+    if(pinterfaceChain->pinterfaceNode) {
         printf("interface %s already registered for port %s\n",
             pasynInterface->interfaceType,pport->portName);
         epicsMutexUnlock(pport->asynManagerLock);
         return asynError;
     }
+    pinterfaceNode = callocMustSucceed(1,sizeof(interfaceNode),
+        "asynManager::registerInterface");
     pinterfaceNode->pasynInterface = pasynInterface;
+    ellAdd(&pport->interfaceList,&pinterfaceNode->node);
+    pinterfaceChain->pinterfaceNode = pinterfaceNode;
     epicsMutexUnlock(pport->asynManagerLock);
     if(strcmp(pasynInterface->interfaceType,asynCommonType)==0) {
         initPortConnect(pport);
@@ -2040,7 +3769,7 @@ static asynStatus interposeInterface(const char *portName, int addr,
     port          *pport = locatePort(portName);
     device        *pdevice;
     interfaceNode *pinterfaceNode;
-    interfaceNode *pinterfaceNodePort;
+    interfaceChain *pinterfaceChain;
     asynInterface *pPrev = 0;
     dpCommon      *pdpCommon = 0;
 
@@ -2051,17 +3780,18 @@ static asynStatus interposeInterface(const char *portName, int addr,
         if(pdevice) pdpCommon = &pdevice->dpc;
     }
     if(!pdpCommon) pdpCommon = &pport->dpc;
+    pinterfaceChain = locateInterfaceChain(
+        pport,pasynInterface->interfaceType,TRUE);
     pinterfaceNode = locateInterfaceNode(&pdpCommon->interposeInterfaceList,
         pasynInterface->interfaceType,TRUE);
     if(pinterfaceNode->pasynInterface) {
         pPrev = pinterfaceNode->pasynInterface;
-    } else {
-        pinterfaceNodePort = locateInterfaceNode(&pport->interfaceList,
-            pasynInterface->interfaceType,FALSE);
-        if(pinterfaceNodePort) pPrev = pinterfaceNodePort->pasynInterface;
+    } else if(pinterfaceChain->pinterfaceNode) {
+        pPrev = pinterfaceChain->pinterfaceNode->pasynInterface;
     }
     if(ppPrev) *ppPrev = pPrev;
     pinterfaceNode->pasynInterface = pasynInterface;
+    if(pdpCommon==&pport->dpc) pinterfaceChain->pinterposeNode = pinterfaceNode;
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2078,6 +3808,11 @@ static asynStatus enable(asynUser *pasynUser,int yesNo)
         return asynError;
     }
     pdpCommon->enabled = (yesNo ? 1 : 0);
+    if(!yesNo && (pport->attributes&ASYN_CANBLOCK)) {
+        epicsMutexMustLock(pport->asynManagerLock);
+        abortDevices(pport,pdpCommon);
+        epicsMutexUnlock(pport->asynManagerLock);
+    }
     exceptionOccurred(pasynUser,asynExceptionEnable);
     return asynSuccess;
 }
@@ -2149,6 +3884,22 @@ static asynStatus setAutoConnectTimeout(double timeout)
     return asynSuccess;
 }
 
+static asynStatus setThreadPool(int numberThreads)
+{
+    asynStatus status = asynSuccess;
+
+    if(!pasynBase) asynInit();
+    epicsMutexMustLock(pasynBase->lock);
+    if(pasynBase->pthreadPool) {
+        printf("asynManager:setThreadPool the thread pool is already in use\n");
+        status = asynError;
+    } else {
+        pasynBase->threadPoolSize = numberThreads;
+    }
+    epicsMutexUnlock(pasynBase->lock);
+    return status;
+}
+
 static asynStatus registerInterruptSource(const char *portName,
     asynInterface *pasynInterface, void **pasynPvt)
 {
@@ -2162,12 +3913,8 @@ static asynStatus registerInterruptSource(const char *portName,
        return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    pinterfaceNode = locateInterfaceNode(
-        &pport->interfaceList,pasynInterface->interfaceType,FALSE);
-    if(!pinterfaceNode) 
-         pinterfaceNode = locateInterfaceNode(
-             &pport->dpc.interposeInterfaceList,
-             pasynInterface->interfaceType,FALSE);
+    pinterfaceNode = locateInterfaceChainNode(
+        pport,pasynInterface->interfaceType);
     if(!pinterfaceNode) {
         epicsMutexUnlock(pport->asynManagerLock);
         printf("%s asynManager:registerInterruptSource interface "
@@ -2184,7 +3931,8 @@ static asynStatus registerInterruptSource(const char *portName,
         "asynManager:registerInterruptSource");
     pinterfaceNode->pinterruptBase = pinterruptBase;
     ellInit(&pinterruptBase->callbackList);
-    ellInit(&pinterruptBase->addRemoveList);
+    ellInit(&pinterruptBase->retiredList);
+    ellInit(&pinterruptBase->deferredList);
     pinterruptBase->pasynInterface = pinterfaceNode->pasynInterface;
     pinterruptBase->pport = pport;
     *pasynPvt = pinterruptBase;
@@ -2205,11 +3953,7 @@ static asynStatus getInterruptPvt(asynUser *pasynUser,
         return asynError;
     }
     epicsMutexMustLock(pport->asynManagerLock);
-    pinterfaceNode = locateInterfaceNode(
-        &pport->interfaceList,interfaceType,FALSE);
-    if(!pinterfaceNode) 
-         pinterfaceNode = locateInterfaceNode(
-             &pport->dpc.interposeInterfaceList,interfaceType,FALSE);
+    pinterfaceNode = locateInterfaceChainNode(pport,interfaceType);
     if(!pinterfaceNode) {
         epicsMutexUnlock(pport->asynManagerLock);
         epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
@@ -2242,14 +3986,12 @@ static interruptNode *createInterruptNode(void *pasynPvt)
         ellDelete(&pasynBase->interruptNodeFree,&pinterruptNode->node);
         epicsMutexUnlock(pasynBase->lock);
         pinterruptNodePvt->isOnList = 0;
-        pinterruptNodePvt->isOnAddRemoveList = 0;
         memset(&pinterruptNodePvt->nodePublic,0,sizeof(interruptNode));
     } else {
         epicsMutexUnlock(pasynBase->lock);
         pinterruptNodePvt = (interruptNodePvt *)
             callocMustSucceed(1,sizeof(interruptNodePvt),
                 "asynManager:createInterruptNode");
-        pinterruptNodePvt->callbackDone = epicsEventMustCreate(epicsEventEmpty);
     }
     pinterruptNodePvt->pinterruptBase = pinterruptBase;
     return(&pinterruptNodePvt->nodePublic);
@@ -2274,13 +4016,100 @@ static asynStatus freeInterruptNode(asynUser *pasynUser,interruptNode *pinterrup
     epicsMutexUnlock(pasynBase->lock);
     return asynSuccess;
 }
-
+
+static unsigned int interruptKeyHash(int reason,int addr)
+{
+    unsigned int hash = (unsigned int)reason*2654435761u;
+
+    hash ^= (unsigned int)addr + 0x9e3779b9u + (hash<<6) + (hash>>2);
+    return hash;
+}
+
+/* Caller must own asynManagerLock*/
+static interruptSnapshot *interruptSnapshotBuild(interruptBase *pinterruptBase)
+{
+    interruptSnapshot     *psnapshot;
+    interruptSnapshotNode *psnapshotNode;
+    interruptNode         *pinterruptNode;
+    int                   numberNodes = ellCount(&pinterruptBase->callbackList);
+    unsigned int          size = 1;
+    char                  *pmem;
+
+    while(size<(unsigned int)numberNodes) size <<= 1;
+    pmem = callocMustSucceed(1,sizeof(interruptSnapshot)
+        + size*sizeof(interruptSnapshotNode *)
+        + numberNodes*sizeof(interruptSnapshotNode),
+        "asynManager:interruptSnapshotBuild");
+    psnapshot = (interruptSnapshot *)pmem;
+    psnapshot->matchTable = (interruptSnapshotNode **)
+        (pmem + sizeof(interruptSnapshot));
+    psnapshot->matchTableSize = size;
+    psnapshot->pnodes = (interruptSnapshotNode *)
+        (pmem + sizeof(interruptSnapshot)
+        + size*sizeof(interruptSnapshotNode *));
+    psnapshot->generation = pinterruptBase->generation++;
+    ellInit(&psnapshot->list);
+    psnapshotNode = psnapshot->pnodes;
+    pinterruptNode = (interruptNode *)ellFirst(&pinterruptBase->callbackList);
+    while(pinterruptNode) {
+        interruptNodePvt      *pinterruptNodePvt = interruptNodeToPvt(pinterruptNode);
+        interruptSnapshotNode **ppkey;
+
+        psnapshotNode->nodePublic.drvPvt = pinterruptNode->drvPvt;
+        psnapshotNode->reason = pinterruptNodePvt->reason;
+        psnapshotNode->addr = pinterruptNodePvt->addr;
+        ellAdd(&psnapshot->list,&psnapshotNode->nodePublic.node);
+        ppkey = &psnapshot->matchTable[interruptKeyHash(psnapshotNode->reason,
+            psnapshotNode->addr) & (size-1)];
+        while(*ppkey && ((*ppkey)->reason!=psnapshotNode->reason
+        || (*ppkey)->addr!=psnapshotNode->addr)) ppkey = &(*ppkey)->pnextKey;
+        if(*ppkey) {
+            (*ppkey)->plastMatch->pnextMatch = psnapshotNode;
+            (*ppkey)->plastMatch = psnapshotNode;
+        } else {
+            *ppkey = psnapshotNode;
+            psnapshotNode->plastMatch = psnapshotNode;
+        }
+        psnapshotNode++;
+        pinterruptNode = (interruptNode *)ellNext(&pinterruptNode->node);
+    }
+    return psnapshot;
+}
+
+/* Caller must own asynManagerLock. The snapshot may be in use by passes that
+ * are still active, so it is retired rather than freed*/
+static void interruptSnapshotRetire(interruptBase *pinterruptBase)
+{
+    interruptSnapshot *psnapshot = pinterruptBase->psnapshot;
+
+    if(!psnapshot) return;
+    pinterruptBase->psnapshot = 0;
+    if(psnapshot->numberActive>0) {
+        ellAdd(&pinterruptBase->retiredList,&psnapshot->retireNode);
+    } else {
+        free(psnapshot);
+    }
+}
+
+/* Caller must own asynManagerLock. Returns the oldest snapshot that has an
+ * active pass, or 0. retiredList is in generation order.*/
+static interruptSnapshot *interruptOldestActive(interruptBase *pinterruptBase)
+{
+    ELLNODE *pnode = ellFirst(&pinterruptBase->retiredList);
+
+    if(pnode) return CONTAINER(pnode,interruptSnapshot,retireNode);
+    if(pinterruptBase->psnapshot && pinterruptBase->psnapshot->numberActive>0)
+        return pinterruptBase->psnapshot;
+    return 0;
+}
+
 static asynStatus addInterruptUser(asynUser *pasynUser,
                                    interruptNode*pinterruptNode)
 {
     interruptNodePvt *pinterruptNodePvt = interruptNodeToPvt(pinterruptNode);
     interruptBase    *pinterruptBase = pinterruptNodePvt->pinterruptBase;
     port             *pport = pinterruptBase->pport;
+    userPvt          *puserPvt = asynUserToUserPvt(pasynUser);
     
     epicsMutexMustLock(pport->asynManagerLock);
     if(pinterruptNodePvt->isOnList) {
@@ -2289,22 +4118,14 @@ static asynStatus addInterruptUser(asynUser *pasynUser,
             "asynManager:addInterruptUser already on list");
         return asynError;
     }
-    while(pinterruptBase->callbackActive) {
-        if(pinterruptNodePvt->isOnAddRemoveList) {
-            epicsMutexUnlock(pport->asynManagerLock);
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                "asynManager:addInterruptUser already on addRemove list");
-            return asynError;
-        }
-        ellAdd(&pinterruptBase->addRemoveList,&pinterruptNodePvt->addRemoveNode);
-        pinterruptNodePvt->isOnAddRemoveList = TRUE;
-        pinterruptBase->listModified = TRUE;
-        epicsMutexUnlock(pport->asynManagerLock);
-        epicsEventMustWait(pinterruptNodePvt->callbackDone);
-        epicsMutexMustLock(pport->asynManagerLock);
-    }
+    /* Index the user by the reason and address it has right now*/
+    pinterruptNodePvt->reason = pasynUser->reason;
+    pinterruptNodePvt->addr = -1;
+    if((pport->attributes&ASYN_MULTIDEVICE) && puserPvt->pdevice)
+        pinterruptNodePvt->addr = puserPvt->pdevice->addr;
     ellAdd(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = TRUE;
+    interruptSnapshotRetire(pinterruptBase);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2323,36 +4144,36 @@ static asynStatus removeInterruptUser(asynUser *pasynUser,
             "asynManager:removeInterruptUser not on list");
         return asynError;
     }
-    while(pinterruptBase->callbackActive) {
-        if(pinterruptNodePvt->isOnAddRemoveList) {
-            epicsMutexUnlock(pport->asynManagerLock);
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                "asynManager:removeInterruptUser already on addRemove list");
-            return asynError;
-        }
-        ellAdd(&pinterruptBase->addRemoveList,&pinterruptNodePvt->addRemoveNode);
-        pinterruptNodePvt->isOnAddRemoveList = TRUE;
-        pinterruptBase->listModified = TRUE;
-        epicsMutexUnlock(pport->asynManagerLock);
-        epicsEventMustWait(pinterruptNodePvt->callbackDone);
-        epicsMutexMustLock(pport->asynManagerLock);
-    }
     ellDelete(&pinterruptBase->callbackList,&pinterruptNode->node);
     pinterruptNodePvt->isOnList = FALSE;
+    interruptSnapshotRetire(pinterruptBase);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
-
+
 static asynStatus interruptStart(void *pasynPvt,ELLLIST **plist)
 {
     interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
     port *pport = pinterruptBase->pport;
+    interruptPass  *pinterruptPass;
 
     epicsMutexMustLock(pport->asynManagerLock);
-    pinterruptBase->callbackActive = TRUE;
-    pinterruptBase->listModified = FALSE;
+    if(!pinterruptBase->psnapshot)
+        pinterruptBase->psnapshot = interruptSnapshotBuild(pinterruptBase);
+    pinterruptBase->psnapshot->numberActive++;
+    pinterruptPass = pinterruptBase->pfreePass;
+    if(pinterruptPass) {
+        pinterruptBase->pfreePass = pinterruptPass->pprev;
+    } else {
+        pinterruptPass = callocMustSucceed(1,sizeof(interruptPass),
+            "asynManager:interruptStart");
+    }
+    pinterruptPass->pinterruptBase = pinterruptBase;
+    pinterruptPass->psnapshot = pinterruptBase->psnapshot;
+    *plist = &pinterruptBase->psnapshot->list;
     epicsMutexUnlock(pport->asynManagerLock);
-    *plist = (&pinterruptBase->callbackList);
+    pinterruptPass->pprev = epicsThreadPrivateGet(pasynBase->interruptPassId);
+    epicsThreadPrivateSet(pasynBase->interruptPassId,pinterruptPass);
     return asynSuccess;
 }
 
@@ -2360,22 +4181,258 @@ static asynStatus interruptEnd(void *pasynPvt)
 {
     interruptBase  *pinterruptBase = (interruptBase *)pasynPvt;
     port *pport = pinterruptBase->pport;
-    interruptNodePvt *pinterruptNodePvt;
+    interruptPass  *pinterruptPass;
+    interruptPass  **ppnext = 0;
+    interruptSnapshot *psnapshot;
+    interruptSnapshot *poldest;
+    interruptDeferred *pinterruptDeferred;
+    ELLLIST        doneList;
+
+    /*The passes of a thread are nested, so this is normally the first one*/
+    pinterruptPass = epicsThreadPrivateGet(pasynBase->interruptPassId);
+    while(pinterruptPass && pinterruptPass->pinterruptBase!=pinterruptBase) {
+        ppnext = &pinterruptPass->pprev;
+        pinterruptPass = pinterruptPass->pprev;
+    }
+    if(!pinterruptPass) {
+        /*Only the thread that called interruptStart knows which snapshot
+         *its pass uses. Guessing could free a snapshot in use.*/
+        printf("%s asynManager:interruptEnd without interruptStart "
+            "by this thread\n",pport->portName);
+        return asynError;
+    }
+    if(ppnext) *ppnext = pinterruptPass->pprev;
+    else epicsThreadPrivateSet(pasynBase->interruptPassId,
+             pinterruptPass->pprev);
+    ellInit(&doneList);
+    epicsMutexMustLock(pport->asynManagerLock);
+    psnapshot = pinterruptPass->psnapshot;
+    pinterruptPass->pprev = pinterruptBase->pfreePass;
+    pinterruptBase->pfreePass = pinterruptPass;
+    if(psnapshot->numberActive>0
+    && --psnapshot->numberActive==0 && psnapshot!=pinterruptBase->psnapshot) {
+        ellDelete(&pinterruptBase->retiredList,&psnapshot->retireNode);
+        free(psnapshot);
+    }
+    poldest = interruptOldestActive(pinterruptBase);
+    while((pinterruptDeferred =
+        (interruptDeferred *)ellFirst(&pinterruptBase->deferredList))) {
+        if(poldest && (long)(poldest->generation
+                             - pinterruptDeferred->generation)<0) break;
+        ellDelete(&pinterruptBase->deferredList,&pinterruptDeferred->node);
+        ellAdd(&doneList,&pinterruptDeferred->node);
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    while((pinterruptDeferred = (interruptDeferred *)ellFirst(&doneList))) {
+        ellDelete(&doneList,&pinterruptDeferred->node);
+        pinterruptDeferred->callback(pinterruptDeferred->pfreePvt);
+        free(pinterruptDeferred);
+    }
+    return asynSuccess;
+}
+
+static asynStatus deferInterruptFree(interruptNode *pinterruptNode,
+    interruptFreeCallback callback,void *pfreePvt)
+{
+    interruptNodePvt  *pinterruptNodePvt = interruptNodeToPvt(pinterruptNode);
+    interruptBase     *pinterruptBase = pinterruptNodePvt->pinterruptBase;
+    port              *pport = pinterruptBase->pport;
+    interruptDeferred *pinterruptDeferred;
+    interruptSnapshot *poldest;
+    unsigned long     generation;
 
     epicsMutexMustLock(pport->asynManagerLock);
-    pinterruptBase->callbackActive = FALSE;
-    if(!pinterruptBase->listModified) {
+    /*A snapshot built since removeInterruptUser does not contain the user*/
+    generation = pinterruptBase->psnapshot
+        ? pinterruptBase->psnapshot->generation : pinterruptBase->generation;
+    poldest = interruptOldestActive(pinterruptBase);
+    if(!poldest || (long)(poldest->generation - generation)>=0) {
         epicsMutexUnlock(pport->asynManagerLock);
+        callback(pfreePvt);
         return asynSuccess;
     }
-    while((pinterruptNodePvt = (interruptNodePvt *)ellFirst(
-    &pinterruptBase->addRemoveList))){
+    pinterruptDeferred = callocMustSucceed(1,sizeof(interruptDeferred),
+        "asynManager:deferInterruptFree");
+    pinterruptDeferred->generation = generation;
+    pinterruptDeferred->callback = callback;
+    pinterruptDeferred->pfreePvt = pfreePvt;
+    ellAdd(&pinterruptBase->deferredList,&pinterruptDeferred->node);
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static interruptNode *interruptFirstMatch(ELLLIST *plist,int reason,int addr)
+{
+    interruptSnapshot     *psnapshot = (interruptSnapshot *)plist;
+    interruptSnapshotNode *psnapshotNode;
+
+    psnapshotNode = psnapshot->matchTable[interruptKeyHash(reason,addr)
+        & (psnapshot->matchTableSize-1)];
+    while(psnapshotNode) {
+        if(psnapshotNode->reason==reason && psnapshotNode->addr==addr)
+            return &psnapshotNode->nodePublic;
+        psnapshotNode = psnapshotNode->pnextKey;
+    }
+    return 0;
+}
+
+static interruptNode *interruptNextMatch(interruptNode *pinterruptNode)
+{
+    interruptSnapshotNode *psnapshotNode = (interruptSnapshotNode *)pinterruptNode;
+
+    return psnapshotNode->pnextMatch ? &psnapshotNode->pnextMatch->nodePublic : 0;
+}
+
+static asynStatus getQueueStatistics(asynUser *pasynUser,
+    asynQueueStatistics *pasynQueueStatistics)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:getQueueStatistics not connected");
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    *pasynQueueStatistics = pport->queueStatistics;
+    pasynQueueStatistics->nQueued = pport->nQueued;
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus resetQueueStatistics(asynUser *pasynUser)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:resetQueueStatistics not connected");
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    memset(&pport->queueStatistics,0,sizeof(asynQueueStatistics));
+    pport->queueStatistics.queueHighWater = pport->nQueued;
+    epicsTimeGetCurrent(&pport->queueStatistics.since);
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus setQueuePolicy(asynUser *pasynUser,
+    asynQueuePolicy policy,double param)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+    device  *pdevice;
+    int     i;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueuePolicy not connected");
+        return asynError;
+    }
+    if(!(pport->attributes&ASYN_CANBLOCK)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueuePolicy port %s is synchronous",
+            pport->portName);
+        return asynError;
+    }
+    if(policy<asynQueuePolicyStrict || policy>asynQueuePolicyDeadline) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueuePolicy illegal policy %d",(int)policy);
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    pport->pqueuePolicy = &queuePolicyTable[policy];
+    pport->queuePolicyParam = (param>0.0)
+        ? param : pport->pqueuePolicy->defaultParam;
+    /*Start fair from scratch*/
+    for(i=0; i<NUMBER_QUEUE_PRIORITIES-1; i++)
+        pport->dpc.queue[i].deficit = 0.0;
+    for(pdevice = (device *)ellFirst(&pport->deviceList); pdevice;
+    pdevice = (device *)ellNext(&pdevice->node)) {
+        for(i=0; i<NUMBER_QUEUE_PRIORITIES-1; i++)
+            pdevice->dpc.queue[i].deficit = 0.0;
+    }
+    epicsMutexUnlock(pport->asynManagerLock);
+    signalPortThread(pport);
+    return asynSuccess;
+}
+
+static asynStatus setQueueMerge(asynUser *pasynUser,
+    asynQueueMerge merge,queueMergeCallback callback)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(merge<asynQueueMergeNone || merge>asynQueueMergeWrite) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueueMerge illegal merge %d",(int)merge);
+        return asynError;
+    }
+    if(merge!=asynQueueMergeNone && !callback) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueueMerge no callback");
+        return asynError;
+    }
+    if(pport) epicsMutexMustLock(pport->asynManagerLock);
+    if(puserPvt->queueState!=queueIdle) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:setQueueMerge is queued");
+        if(pport) epicsMutexUnlock(pport->asynManagerLock);
+        return asynError;
+    }
+    puserPvt->merge = merge;
+    puserPvt->mergeCallback = (merge==asynQueueMergeNone) ? 0 : callback;
+    if(pport) epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
+
+static asynStatus enableQueueMerge(asynUser *pasynUser,int yesNo)
+{
+    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
+    port    *pport = puserPvt->pport;
+
+    if(!pport) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:enableQueueMerge not connected");
+        return asynError;
+    }
+    if(!(pport->attributes&ASYN_CANBLOCK)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:enableQueueMerge port %s is synchronous",
+            pport->portName);
+        return asynError;
+    }
+    epicsMutexMustLock(pport->asynManagerLock);
+    pport->queueMergeEnabled = (yesNo ? TRUE : FALSE);
+    epicsMutexUnlock(pport->asynManagerLock);
+    return asynSuccess;
+}
 
-        ellDelete(&pinterruptBase->addRemoveList,
-            &pinterruptNodePvt->addRemoveNode);
-        pinterruptNodePvt->isOnAddRemoveList = FALSE;
-        epicsEventSignal(pinterruptNodePvt->callbackDone);
+static asynStatus abortRequest(asynUser *pasynUser)
+{
+    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
+    port     *pport = puserPvt->pport;
+    dpCommon *pdpCommon = findDpCommon(puserPvt);
+    asynInterface *pasynInterface;
+
+    if(!pport || !pdpCommon) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:abortRequest not connected");
+        return asynError;
+    }
+    pasynInterface = pport->pcommonInterface;
+    if(!(pport->attributes&ASYN_CANBLOCK) || !pasynInterface
+    || !((asynCommon *)pasynInterface->pinterface)->abort) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "asynManager:abortRequest port %s can not abort I/O",
+            pport->portName);
+        return asynError;
     }
+    epicsMutexMustLock(pport->asynManagerLock);
+    abortDevices(pport,pdpCommon);
     epicsMutexUnlock(pport->asynManagerLock);
     return asynSuccess;
 }
@@ -2482,6 +4539,8 @@ static asynStatus setTimeStamp(asynUser *pasynUser, const epicsTimeStamp *pTimeS
 static asynStatus traceLock(asynUser *pasynUser)
 {
     if(!pasynBase) asynInit();
+    /*Output queued before traceLock must appear before what the caller writes*/
+    traceDrain();
     epicsMutexMustLock(pasynBase->lockTrace);
     return asynSuccess;
 }
@@ -2624,6 +4683,8 @@ static asynStatus setTraceFile(asynUser *pasynUser,FILE *fp)
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     tracePvt *ptracePvt  = findTracePvt(puserPvt);
 
+    /*Queued records go to the file that was selected when they were queued*/
+    traceDrain();
     epicsMutexMustLock(pasynBase->lockTrace);
     if(ptracePvt->type==traceFileFP) {
         int status;
@@ -2649,10 +4710,8 @@ static asynStatus setTraceFile(asynUser *pasynUser,FILE *fp)
     return asynSuccess;
 }
 
-static FILE *getTraceFile(asynUser *pasynUser)
+static FILE *tracePvtFile(tracePvt *ptracePvt)
 {
-    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
-    tracePvt *ptracePvt  = findTracePvt(puserPvt);
     FILE     *fp = 0;
 
     switch(ptracePvt->type) {
@@ -2664,18 +4723,19 @@ static FILE *getTraceFile(asynUser *pasynUser)
     return fp;
 }
 
+static FILE *getTraceFile(asynUser *pasynUser)
+{
+    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
+
+    return tracePvtFile(findTracePvt(puserPvt));
+}
+
 static asynStatus setTraceIOTruncateSize(asynUser *pasynUser,size_t size)
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     tracePvt *ptracePvt  = findTracePvt(puserPvt);
 
     epicsMutexMustLock(pasynBase->lockTrace);
-    if(size>ptracePvt->traceBufferSize) {
-        free(ptracePvt->traceBuffer);
-        ptracePvt->traceBuffer = callocMustSucceed(size,sizeof(char),
-            "asynTrace:setTraceIOTruncateSize");
-        ptracePvt->traceBufferSize = size;
-    }
     ptracePvt->traceTruncateSize = size;
     if(puserPvt->pport) exceptionOccurred(pasynUser,asynExceptionTraceIOTruncateSize);
     epicsMutexUnlock(pasynBase->lockTrace);
@@ -2690,72 +4750,514 @@ static size_t getTraceIOTruncateSize(asynUser *pasynUser)
     return ptracePvt->traceTruncateSize;
 }
 
-static size_t printThread(FILE *fp)
+static asynStatus setTraceCaptureFile(asynUser *pasynUser,FILE *fp)
 {
-    size_t nout = 0;
-    unsigned int threadPriority = epicsThreadGetPrioritySelf();
-    epicsThreadId threadId = epicsThreadGetIdSelf();
+    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
+    tracePvt *ptracePvt  = findTracePvt(puserPvt);
+    asynStatus status = asynSuccess;
+
+    /*Transfers captured before the call go to the old file*/
+    traceDrain();
+    epicsMutexMustLock(pasynBase->lockTrace);
+    if(ptracePvt->captureFp) {
+        errno = 0;
+        if(fclose(ptracePvt->captureFp)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                "asynManager:setTraceCaptureFile fclose error %s",
+                strerror(errno));
+            status = asynError;
+        }
+        ptracePvt->captureFp = 0;
+    }
     if(fp) {
-        nout = fprintf(fp,"[%s,%p,%d] ",epicsThreadGetNameSelf(),
-                       (void*)threadId,threadPriority);
-    } else {
-        nout = errlogPrintf("[%s,%p,%d] ",epicsThreadGetNameSelf(),
-                            (void*)threadId,threadPriority);
+        asynCaptureFileHeader header;
+
+        header.magic = ASYN_CAPTURE_MAGIC;
+        header.versionMajor = ASYN_CAPTURE_VERSION_MAJOR;
+        header.versionMinor = ASYN_CAPTURE_VERSION_MINOR;
+        header.snapLength = (epicsUInt32)TRACE_CAPTURE_SIZE;
+        header.reserved = 0;
+        fwrite(&header,sizeof(header),1,fp);
+        fflush(fp);
+        ptracePvt->captureFp = fp;
     }
-    return nout;
+    epicsMutexUnlock(pasynBase->lockTrace);
+    return status;
 }
-
-static size_t printTime(FILE *fp)
+
+static FILE *getTraceCaptureFile(asynUser *pasynUser)
 {
-    epicsTimeStamp now;
-    char nowText[40];
-    size_t rtn;
+    userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
+    tracePvt *ptracePvt  = findTracePvt(puserPvt);
+
+    return ptracePvt->captureFp;
+}
 
-    rtn = epicsTimeGetCurrent(&now);
-    if(rtn) {
-        printf("epicsTimeGetCurrent failed\n");
+static void traceRingThreadExit(void *arg)
+{
+    traceRing *ptraceRing = (traceRing *)arg;
+
+    epicsThreadPrivateSet(pasynBase->traceRingId,0);
+    asynAtomicSetInt(&ptraceRing->ownerExited,1);
+    traceWriterWakeup();
+}
+
+/*Returns a ring whose owner exited and whose records were all written*/
+static traceRing *traceRingReuse(void)
+{
+    traceRing *ptraceRing;
+
+    epicsMutexMustLock(pasynBase->lockTraceDrain);
+    ptraceRing = asynAtomicGetPtr(&pasynBase->ptraceRingList);
+    for( ; ptraceRing; ptraceRing=ptraceRing->pnext) {
+        if(!asynAtomicGetInt(&ptraceRing->ownerExited)) continue;
+        if(asynAtomicGetInt(&ptraceRing->head)!=ptraceRing->tail) continue;
+        if(asynAtomicGetInt(&ptraceRing->dropped)
+           !=ptraceRing->droppedReported) continue;
+        memset(ptraceRing->threadName,0,sizeof(ptraceRing->threadName));
+        ptraceRing->threadId = epicsThreadGetIdSelf();
+        strncpy(ptraceRing->threadName,epicsThreadGetNameSelf(),
+            sizeof(ptraceRing->threadName)-1);
+        if(!ptraceRing->buffer)
+            ptraceRing->buffer = mallocMustSucceed(TRACE_RING_SIZE,
+                "asynManager::traceRingGet");
+        asynAtomicSetInt(&ptraceRing->ownerExited,0);
+        break;
+    }
+    epicsMutexUnlock(pasynBase->lockTraceDrain);
+    return ptraceRing;
+}
+
+static traceRing *traceRingGet(void)
+{
+    traceRing *ptraceRing = epicsThreadPrivateGet(pasynBase->traceRingId);
+    void      *pnext;
+
+    if(ptraceRing) return ptraceRing;
+    ptraceRing = traceRingReuse();
+    if(!ptraceRing) {
+        ptraceRing = callocMustSucceed(1,sizeof(traceRing),
+            "asynManager::traceRingGet");
+        ptraceRing->buffer = mallocMustSucceed(TRACE_RING_SIZE,
+            "asynManager::traceRingGet");
+        ptraceRing->threadId = epicsThreadGetIdSelf();
+        strncpy(ptraceRing->threadName,epicsThreadGetNameSelf(),
+            sizeof(ptraceRing->threadName)-1);
+        do {
+            pnext = asynAtomicGetPtr(&pasynBase->ptraceRingList);
+            ptraceRing->pnext = pnext;
+        } while(asynAtomicCmpAndSwapPtr(&pasynBase->ptraceRingList,
+                    pnext,ptraceRing)!=pnext);
+    }
+    epicsThreadPrivateSet(pasynBase->traceRingId,ptraceRing);
+    epicsAtThreadExit(traceRingThreadExit,ptraceRing);
+    return ptraceRing;
+}
+
+static void traceWriterWakeup(void)
+{
+    if(asynAtomicGetInt(&pasynBase->traceWriterIdle)
+    && asynAtomicCmpAndSwapInt(&pasynBase->traceWriterIdle,1,0)==1)
+        epicsEventSignal(pasynBase->traceWriterWakeup);
+}
+
+/* Returns space for a record of length bytes in the ring of the calling
+ * thread, or 0 after counting a drop if the ring is full.
+ * traceRecordCommit makes the record visible to traceDrain.*/
+static traceRecord *traceRecordAlloc(traceRing *ptraceRing,size_t length)
+{
+    traceRecord  *ptraceRecord;
+    unsigned int head,tail;
+    size_t       offset,pad;
+
+    head = (unsigned int)ptraceRing->head;
+    tail = (unsigned int)asynAtomicGetInt(&ptraceRing->tail);
+    offset = head & (TRACE_RING_SIZE-1);
+    /*A record never wraps. The space before the end of buffer is skipped*/
+    pad = (TRACE_RING_SIZE - offset < length) ? TRACE_RING_SIZE - offset : 0;
+    if(pad + length > TRACE_RING_SIZE - (head - tail)) {
+        asynAtomicIncrInt(&ptraceRing->dropped);
+        traceWriterWakeup();
         return 0;
     }
-    nowText[0] = 0;
-    epicsTimeToStrftime(nowText,sizeof(nowText),
-         "%Y/%m/%d %H:%M:%S.%03f",&now);
+    if(pad>=sizeof(traceRecord)) {
+        ptraceRecord = (traceRecord *)(ptraceRing->buffer + offset);
+        ptraceRecord->length = (int)pad;
+        ptraceRecord->ptracePvt = 0;
+    }
+    if(pad) offset = 0;
+    ptraceRing->headNext = head + (unsigned int)(pad + length);
+    ptraceRecord = (traceRecord *)(ptraceRing->buffer + offset);
+    ptraceRecord->length = (int)length;
+    ptraceRecord->seq = asynAtomicIncrInt(&pasynBase->traceSeq);
+    return ptraceRecord;
+}
+
+static void traceRecordCommit(traceRing *ptraceRing)
+{
+    asynAtomicSetInt(&ptraceRing->head,(int)ptraceRing->headNext);
+    traceWriterWakeup();
+}
+
+/* Called by asynPrint and asynPrintIO after the traceMask test.
+ * Only the message is formatted here; the prefix and the I/O data are
+ * formatted by traceDrain. Returns the number of bytes queued.*/
+static int traceQueue(asynUser *pasynUser,tracePvt *ptracePvt,
+    const char *buffer,size_t len,const char *file,int line,
+    const char *pformat,va_list pvar)
+{
+    userPvt      *puserPvt = asynUserToUserPvt(pasynUser);
+    port         *pport = puserPvt->pport;
+    traceRing    *ptraceRing = traceRingGet();
+    traceRecord  *ptraceRecord;
+    int          traceInfoMask = ptracePvt->traceInfoMask;
+    int          traceIOMask = 0;
+    int          messageLength;
+    size_t       ioLength = 0;
+    size_t       length;
+
+    messageLength = epicsVsnprintf(ptraceRing->message,TRACE_MESSAGE_SIZE,
+        pformat,pvar);
+    if(messageLength<0 || messageLength>=TRACE_MESSAGE_SIZE) {
+        /*Truncated. Keep the newline so the next record starts a line*/
+        messageLength = TRACE_MESSAGE_SIZE - 1;
+        ptraceRing->message[messageLength-1] = '\n';
+    }
+    if(buffer) {
+        traceIOMask = ptracePvt->traceIOMask;
+        ioLength = ptracePvt->traceTruncateSize;
+        if(ioLength==0) traceIOMask &= ~ASYN_TRACEIO_HEX;
+        if(len<ioLength) ioLength = len;
+        if(!(traceIOMask&
+        (ASYN_TRACEIO_ASCII|ASYN_TRACEIO_ESCAPE|ASYN_TRACEIO_HEX)))
+            ioLength = 0;
+    }
+    length = TRACE_ALIGN(sizeof(traceRecord) + messageLength + ioLength);
+    if(length>TRACE_RECORD_MAX) {
+        ioLength -= length - TRACE_RECORD_MAX;
+        length = TRACE_RECORD_MAX;
+    }
+    ptraceRecord = traceRecordAlloc(ptraceRing,length);
+    if(!ptraceRecord) return 0;
+    ptraceRecord->ptracePvt = ptracePvt;
+    ptraceRecord->isCapture = 0;
+    ptraceRecord->traceInfoMask = traceInfoMask;
+    ptraceRecord->traceIOMask = traceIOMask;
+    if(traceInfoMask&ASYN_TRACEINFO_TIME)
+        epicsTimeGetCurrent(&ptraceRecord->time);
+    ptraceRecord->portName = 0;
+    if(pport) {
+        ptraceRecord->portName = pport->portName;
+        getAddr(pasynUser,&ptraceRecord->addr);
+        ptraceRecord->reason = pasynUser->reason;
+    }
+    ptraceRecord->file = file;
+    ptraceRecord->line = line;
+    if(traceInfoMask&ASYN_TRACEINFO_THREAD)
+        ptraceRecord->threadPriority = epicsThreadGetPrioritySelf();
+    ptraceRecord->messageLength = messageLength;
+    ptraceRecord->ioLength = (int)ioLength;
+    memcpy(ptraceRecord + 1,ptraceRing->message,messageLength);
+    if(ioLength>0)
+        memcpy((char *)(ptraceRecord + 1) + messageLength,buffer,ioLength);
+    traceRecordCommit(ptraceRing);
+    return messageLength + (int)ioLength;
+}
+
+/* A device without a capture file uses the one of its port and a port
+ * without one uses the global one.*/
+static tracePvt *findCaptureTracePvt(userPvt *puserPvt)
+{
+    port   *pport = puserPvt->pport;
+    device *pdevice = puserPvt->pdevice;
+
+    if(pport) {
+        if(pdevice && (pport->attributes&ASYN_MULTIDEVICE)
+        && pdevice->dpc.trace.captureFp)
+            return &pdevice->dpc.trace;
+        if(pport->dpc.trace.captureFp) return &pport->dpc.trace;
+    }
+    if(pasynBase->trace.captureFp) return &pasynBase->trace;
+    return 0;
+}
+
+/* Called by asynOctetBase for every read and write. Like asynPrintIO the
+ * data is only copied to the ring of the calling thread; traceDrain
+ * writes it to the capture file. Returns the number of bytes queued.*/
+static int traceCaptureIO(asynUser *pasynUser,int direction,
+    asynStatus status,int eomReason,const char *buffer,size_t len)
+{
+    userPvt     *puserPvt = asynUserToUserPvt(pasynUser);
+    port        *pport = puserPvt->pport;
+    tracePvt    *ptracePvt = findCaptureTracePvt(puserPvt);
+    traceRing   *ptraceRing;
+    traceRecord *ptraceRecord;
+    size_t      ioLength;
+
+    if(!ptracePvt) return 0;
+    ptraceRing = traceRingGet();
+    ioLength = (len<TRACE_CAPTURE_SIZE) ? len : TRACE_CAPTURE_SIZE;
+    ptraceRecord = traceRecordAlloc(ptraceRing,
+        TRACE_ALIGN(sizeof(traceRecord) + ioLength));
+    if(!ptraceRecord) return 0;
+    ptraceRecord->ptracePvt = ptracePvt;
+    ptraceRecord->isCapture = 1;
+    epicsTimeGetCurrent(&ptraceRecord->time);
+    ptraceRecord->portName = 0;
+    ptraceRecord->addr = -1;
+    ptraceRecord->reason = pasynUser->reason;
+    if(pport) {
+        ptraceRecord->portName = pport->portName;
+        getAddr(pasynUser,&ptraceRecord->addr);
+    }
+    ptraceRecord->direction = direction;
+    ptraceRecord->status = status;
+    ptraceRecord->eomReason = eomReason;
+    ptraceRecord->transferLength = len;
+    ptraceRecord->ioLength = (int)ioLength;
+    if(ioLength>0) memcpy(ptraceRecord + 1,buffer,ioLength);
+    traceRecordCommit(ptraceRing);
+    return (int)ioLength;
+}
+
+/*Returns the oldest record of ptraceRing or 0 if it is empty*/
+static traceRecord *traceRingNext(traceRing *ptraceRing)
+{
+    unsigned int head = (unsigned int)asynAtomicGetInt(&ptraceRing->head);
+    unsigned int tail = (unsigned int)ptraceRing->tail;
+    traceRecord  *ptraceRecord = 0;
+
+    while(tail!=head) {
+        size_t offset = tail & (TRACE_RING_SIZE-1);
+
+        if(TRACE_RING_SIZE - offset < sizeof(traceRecord)) {
+            tail += (unsigned int)(TRACE_RING_SIZE - offset);
+            continue;
+        }
+        ptraceRecord = (traceRecord *)(ptraceRing->buffer + offset);
+        if(ptraceRecord->ptracePvt) break;
+        tail += ptraceRecord->length;
+        ptraceRecord = 0;
+    }
+    if(tail!=(unsigned int)ptraceRing->tail)
+        asynAtomicSetInt(&ptraceRing->tail,(int)tail);
+    return ptraceRecord;
+}
+
+/*errlog truncates long messages so they are given to it in pieces*/
+#define TRACE_ERRLOG_CHUNK 200
+static void traceWriteText(FILE *fp,const char *text,size_t n)
+{
     if(fp) {
-        return fprintf(fp,"%s ",nowText);
-    } else {
-        return errlogPrintf("%s ",nowText);
+        fwrite(text,1,n,fp);
+        return;
+    }
+    while(n>0) {
+        size_t chunk = (n>TRACE_ERRLOG_CHUNK) ? TRACE_ERRLOG_CHUNK : n;
+
+        errlogPrintf("%.*s",(int)chunk,text);
+        text += chunk;
+        n -= chunk;
     }
 }
 
-static size_t printPort(FILE *fp, asynUser *pasynUser)
+/*Must be called with lockTraceDrain and lockTrace held*/
+static FILE *traceWriteCapture(traceRecord *ptraceRecord)
 {
-    userPvt *puserPvt = asynUserToUserPvt(pasynUser);
-    port    *pport = puserPvt->pport;
-    int addr;
-    size_t nout = 0;
-    
-    if(!pport) {
-        return nout;
+    FILE                    *fp = ptraceRecord->ptracePvt->captureFp;
+    asynCaptureRecordHeader header;
+    size_t                  portNameLength = 0;
+
+    /*The capture file was closed after the record was queued*/
+    if(!fp) return 0;
+    if(ptraceRecord->portName) portNameLength = strlen(ptraceRecord->portName);
+    header.recordLength = (epicsUInt32)(sizeof(header) + portNameLength
+                                        + ptraceRecord->ioLength);
+    header.secPastEpoch = ptraceRecord->time.secPastEpoch
+                          + POSIX_TIME_AT_EPICS_EPOCH;
+    header.nsec = ptraceRecord->time.nsec;
+    header.addr = ptraceRecord->addr;
+    header.reason = ptraceRecord->reason;
+    header.direction = (epicsUInt16)ptraceRecord->direction;
+    header.status = (epicsUInt16)ptraceRecord->status;
+    header.eomReason = ptraceRecord->eomReason;
+    header.length = (epicsUInt32)ptraceRecord->transferLength;
+    header.capturedLength = ptraceRecord->ioLength;
+    header.portNameLength = (epicsUInt16)portNameLength;
+    header.reserved = 0;
+    fwrite(&header,sizeof(header),1,fp);
+    fwrite(ptraceRecord->portName,1,portNameLength,fp);
+    fwrite(ptraceRecord + 1,1,ptraceRecord->ioLength,fp);
+    return fp;
+}
+
+/*Writes a record in the same format that asynPrint always had.
+ *Must be called with lockTraceDrain and lockTrace held*/
+static FILE *traceWriteRecord(traceRing *ptraceRing,traceRecord *ptraceRecord)
+{
+    FILE       *fp = tracePvtFile(ptraceRecord->ptracePvt);
+    int        traceInfoMask = ptraceRecord->traceInfoMask;
+    int        traceIOMask = ptraceRecord->traceIOMask;
+    const char *message = (const char *)(ptraceRecord + 1);
+    const char *data = message + ptraceRecord->messageLength;
+    size_t     nBytes = ptraceRecord->ioLength;
+    size_t     size,n = 0;
+    char       *text;
+
+    if(ptraceRecord->isCapture) return traceWriteCapture(ptraceRecord);
+    size = 256 + ptraceRecord->messageLength + 7*nBytes;
+    if(ptraceRecord->portName) size += strlen(ptraceRecord->portName);
+    if(ptraceRecord->file) size += strlen(ptraceRecord->file);
+    if(size>pasynBase->traceTextSize) {
+        free(pasynBase->traceText);
+        pasynBase->traceText = mallocMustSucceed(size,
+            "asynManager::traceWriteRecord");
+        pasynBase->traceTextSize = size;
+    }
+    text = pasynBase->traceText;
+    if(traceInfoMask&ASYN_TRACEINFO_TIME) {
+        char nowText[40];
+
+        nowText[0] = 0;
+        epicsTimeToStrftime(nowText,sizeof(nowText),
+             "%Y/%m/%d %H:%M:%S.%03f",&ptraceRecord->time);
+        n += sprintf(text + n,"%s ",nowText);
+    }
+    if((traceInfoMask&ASYN_TRACEINFO_PORT) && ptraceRecord->portName) {
+        n += sprintf(text + n,"[%s,%d,%d] ",ptraceRecord->portName,
+            ptraceRecord->addr,ptraceRecord->reason);
+    }
+    if(traceInfoMask&ASYN_TRACEINFO_SOURCE) {
+        n += sprintf(text + n,"[%s:%d] ",ptraceRecord->file,ptraceRecord->line);
+    }
+    if(traceInfoMask&ASYN_TRACEINFO_THREAD) {
+        n += sprintf(text + n,"[%s,%p,%d] ",ptraceRing->threadName,
+            (void *)ptraceRing->threadId,ptraceRecord->threadPriority);
+    }
+    memcpy(text + n,message,ptraceRecord->messageLength);
+    n += ptraceRecord->messageLength;
+    if((traceIOMask&ASYN_TRACEIO_ASCII) && (nBytes>0)) {
+        memcpy(text + n,data,nBytes);
+        n += nBytes;
+        text[n++] = '\n';
     }
-    
-    getAddr(pasynUser, &addr);
-    if(fp) {
-        nout = fprintf(fp,"[%s,%d,%d] ",pport->portName, addr, pasynUser->reason);
-    } else {
-        nout = errlogPrintf("[%s,%d,%d] ",pport->portName, addr, pasynUser->reason);
+    if((traceIOMask&ASYN_TRACEIO_ESCAPE) && (nBytes>0)) {
+        n += epicsStrSnPrintEscaped(text + n,4*nBytes + 1,data,nBytes);
+        text[n++] = '\n';
     }
-    return nout;
+    if(traceIOMask&ASYN_TRACEIO_HEX) {
+        size_t i;
+
+        for(i=0; i<nBytes; i++) {
+            if(i%20 == 0) text[n++] = '\n';
+            n += sprintf(text + n,"%2.2x ",(unsigned char)data[i]);
+        }
+        text[n++] = '\n';
+    }
+    traceWriteText(fp,text,n);
+    return fp;
 }
 
-static size_t printSource(FILE *fp, const char *file, int line)
+/* Writes the records that were queued when traceDrain was called, oldest
+ * first. Records are ordered by traceRecord.seq, which is taken just before
+ * a record is appended, so records of different threads written at almost
+ * the same time may appear in either order. Returns the number written.*/
+static int traceDrain(void)
 {
-    int      nout = 0;
+    traceRing *ptraceRingList;
+    traceRing *ptraceRing;
+    FILE      *fpLast = 0;
+    int       lastSeq;
+    int       nRecords = 0;
+    epicsTimeStamp now;
 
-    if(fp) {
-        nout = fprintf(fp,"[%s:%d] ", file, line);
-    } else {
-        nout = errlogPrintf("[%s:%d] ", file, line);
+    if(!pasynBase) return 0;
+    epicsMutexMustLock(pasynBase->lockTraceDrain);
+    lastSeq = asynAtomicGetInt(&pasynBase->traceSeq);
+    ptraceRingList = asynAtomicGetPtr(&pasynBase->ptraceRingList);
+    while(1) {
+        traceRing   *pnextRing = 0;
+        traceRecord *pnextRecord = 0;
+        FILE        *fp;
+
+        for(ptraceRing=ptraceRingList; ptraceRing;
+        ptraceRing=ptraceRing->pnext) {
+            traceRecord *ptraceRecord = traceRingNext(ptraceRing);
+
+            if(!ptraceRecord) continue;
+            if((int)((unsigned int)ptraceRecord->seq - lastSeq)>0) continue;
+            if(!pnextRecord || (int)((unsigned int)ptraceRecord->seq
+                                     - pnextRecord->seq)<0) {
+                pnextRing = ptraceRing;
+                pnextRecord = ptraceRecord;
+            }
+        }
+        if(!pnextRecord) break;
+        if(nRecords==0) epicsMutexMustLock(pasynBase->lockTrace);
+        fp = traceWriteRecord(pnextRing,pnextRecord);
+        if(fpLast && fpLast!=fp) fflush(fpLast);
+        fpLast = fp;
+        asynAtomicSetInt(&pnextRing->tail,
+            (int)((unsigned int)pnextRing->tail + pnextRecord->length));
+        nRecords++;
+    }
+    if(fpLast) fflush(fpLast);
+    if(nRecords>0) epicsMutexUnlock(pasynBase->lockTrace);
+    /*Drops are reported at most once a second*/
+    epicsTimeGetCurrent(&now);
+    if(epicsTimeDiffInSeconds(&now,&pasynBase->traceDroppedTime)>=1.0) {
+        pasynBase->traceDroppedTime = now;
+        for(ptraceRing=ptraceRingList; ptraceRing;
+        ptraceRing=ptraceRing->pnext) {
+            int dropped = asynAtomicGetInt(&ptraceRing->dropped);
+
+            if(dropped==ptraceRing->droppedReported) continue;
+            errlogPrintf("asynTrace: thread %s dropped %d messages\n",
+                ptraceRing->threadName,dropped - ptraceRing->droppedReported);
+            ptraceRing->droppedReported = dropped;
+        }
     }
-    return nout;
+    for(ptraceRing=ptraceRingList; ptraceRing; ptraceRing=ptraceRing->pnext) {
+        if(!ptraceRing->buffer
+        || !asynAtomicGetInt(&ptraceRing->ownerExited)
+        || asynAtomicGetInt(&ptraceRing->head)!=ptraceRing->tail) continue;
+        free(ptraceRing->buffer);
+        ptraceRing->buffer = 0;
+    }
+    epicsMutexUnlock(pasynBase->lockTraceDrain);
+    return nRecords;
+}
+
+static void traceWriterThread(void *arg)
+{
+    while(1) {
+        asynAtomicSetInt(&pasynBase->traceWriterIdle,1);
+        if(traceDrain()>0) continue;
+        epicsEventWait(pasynBase->traceWriterWakeup);
+    }
+}
+
+static void traceExit(void *arg)
+{
+    traceDrain();
+}
+
+static void traceReport(FILE *fp)
+{
+    traceRing *ptraceRing;
+    int       nRings = 0;
+    int       queued = 0;
+    int       dropped = 0;
+
+    ptraceRing = asynAtomicGetPtr(&pasynBase->ptraceRingList);
+    for( ; ptraceRing; ptraceRing=ptraceRing->pnext) {
+        if(!asynAtomicGetInt(&ptraceRing->ownerExited)) nRings++;
+        queued += asynAtomicGetInt(&ptraceRing->head)
+                  - asynAtomicGetInt(&ptraceRing->tail);
+        dropped += asynAtomicGetInt(&ptraceRing->dropped);
+    }
+    fprintf(fp,"asynManager trace threads %d bytes queued %d dropped %d\n",
+        nRings,queued,dropped);
 }
 
 static int tracePrint(asynUser *pasynUser,int reason, const char *pformat, ...)
@@ -2789,26 +5291,11 @@ static int traceVprintSource(asynUser *pasynUser,int reason, const char *file, i
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     tracePvt *ptracePvt  = findTracePvt(puserPvt);
-    int      nout = 0;
-    FILE     *fp;
 
     if(!(reason & ptracePvt->traceMask)) return 0;
-    epicsMutexMustLock(pasynBase->lockTrace);
-    fp = getTraceFile(pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_TIME) nout += (int)printTime(fp);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_PORT) nout += (int)printPort(fp, pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_SOURCE) nout += (int)printSource(fp, file, line);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_THREAD) nout += (int)printThread(fp);
-    if(fp) {
-        nout += vfprintf(fp,pformat,pvar);
-    } else {
-        nout += errlogVprintf(pformat,pvar);
-    }
-    fflush(fp);
-    epicsMutexUnlock(pasynBase->lockTrace);
-    return nout;
+    return traceQueue(pasynUser,ptracePvt,0,0,file,line,pformat,pvar);
 }
-
+
 static int tracePrintIO(asynUser *pasynUser,int reason,
     const char *buffer, size_t len,const char *pformat, ...)
 {
@@ -2844,73 +5331,9 @@ static int traceVprintIOSource(asynUser *pasynUser,int reason,
 {
     userPvt  *puserPvt = asynUserToUserPvt(pasynUser);
     tracePvt *ptracePvt  = findTracePvt(puserPvt);
-    int      nout = 0;
-    FILE     *fp;
-    int traceMask,traceIOMask;
-    size_t traceTruncateSize,nBytes;
-
-    traceMask = ptracePvt->traceMask;
-    traceIOMask = ptracePvt->traceIOMask;
-    traceTruncateSize = ptracePvt->traceTruncateSize;
-    if(!(reason&traceMask)) return 0;
-    epicsMutexMustLock(pasynBase->lockTrace);
-    fp = getTraceFile(pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_TIME) nout += (int)printTime(fp);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_PORT) nout += (int)printPort(fp, pasynUser);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_SOURCE) nout += (int)printSource(fp, file, line);
-    if (ptracePvt->traceInfoMask & ASYN_TRACEINFO_THREAD) nout += (int)printThread(fp);
-    if(fp) {
-        nout += vfprintf(fp,pformat,pvar);
-    } else {
-        nout += errlogVprintf(pformat,pvar);
-    }
-    nBytes = (len<traceTruncateSize) ? len : traceTruncateSize;
-    if((traceIOMask&ASYN_TRACEIO_ASCII) && (nBytes>0)) {
-       if(fp) {
-           nout += fprintf(fp,"%.*s\n",(int)nBytes,buffer);
-       } else {
-           nout += errlogPrintf("%.*s\n",(int)nBytes,buffer);
-       }
-    }
-    if(traceIOMask&ASYN_TRACEIO_ESCAPE) {
-        if(nBytes>0) {
-            if(fp) {
-                nout += epicsStrPrintEscaped(fp,buffer,nBytes);
-                nout += fprintf(fp,"\n");
-            } else {
-                nout += epicsStrSnPrintEscaped(ptracePvt->traceBuffer,
-                                               ptracePvt->traceBufferSize,
-                                               buffer,
-                                               nBytes);
-                errlogPrintf("%s\n",ptracePvt->traceBuffer);
-            }
-        }
-    }
-    if((traceIOMask&ASYN_TRACEIO_HEX) && (traceTruncateSize>0)) {
-        size_t i;
-        for(i=0; i<nBytes; i++) {
-            if(i%20 == 0) {
-                if(fp) {
-                    nout += fprintf(fp,"\n");
-                } else {
-                    nout += errlogPrintf("\n");
-                }
-            }
-            if(fp) {
-                nout += fprintf(fp,"%2.2x ",(unsigned char)buffer[i]);
-            } else {
-                nout += errlogPrintf("%2.2x ",(unsigned char)buffer[i]);
-            }
-        }
-        if(fp) {
-            nout += fprintf(fp,"\n");
-        } else {
-            nout += errlogPrintf("\n");
-        }
-    }
-    fflush(fp);
-    epicsMutexUnlock(pasynBase->lockTrace);
-    return nout;
+
+    if(!(reason & ptracePvt->traceMask)) return 0;
+    return traceQueue(pasynUser,ptracePvt,buffer,len,file,line,pformat,pvar);
 }
 
 /*
@@ -0,0 +1,52 @@
+/* asynTraceCapture.h */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Format of the files written by asynTrace.setTraceCaptureFile and read
+ * by asynCaptureDecode.
+ * A file starts with an asynCaptureFileHeader. Each record that follows is
+ * an asynCaptureRecordHeader, then portNameLength bytes of port name (not
+ * null terminated), then capturedLength bytes of data. Integers are in the
+ * byte order of the IOC that wrote the file; a reader that finds magic
+ * byte swapped must swap all integers.
+ */
+
+#ifndef asynTraceCaptureH
+#define asynTraceCaptureH
+
+#include <epicsTypes.h>
+
+#define ASYN_CAPTURE_MAGIC 0x43595341 /* "ASYC" when written little endian */
+#define ASYN_CAPTURE_VERSION_MAJOR 1
+#define ASYN_CAPTURE_VERSION_MINOR 0
+
+typedef struct asynCaptureFileHeader {
+    epicsUInt32 magic;
+    epicsUInt16 versionMajor;
+    epicsUInt16 versionMinor;
+    epicsUInt32 snapLength;     /* most data bytes saved for one transfer */
+    epicsUInt32 reserved;
+}asynCaptureFileHeader;
+
+typedef struct asynCaptureRecordHeader {
+    epicsUInt32 recordLength;   /* header, port name and data */
+    epicsUInt32 secPastEpoch;   /* seconds since 1970-01-01 00:00:00 UTC */
+    epicsUInt32 nsec;
+    epicsInt32  addr;           /* -1 if not a multiDevice port */
+    epicsInt32  reason;         /* asynUser.reason */
+    epicsUInt16 direction;      /* ASYN_CAPTURE_WRITE or ASYN_CAPTURE_READ */
+    epicsUInt16 status;         /* asynStatus of the transfer */
+    epicsInt32  eomReason;      /* for reads */
+    epicsUInt32 length;         /* bytes transferred */
+    epicsUInt32 capturedLength; /* bytes saved, at most snapLength */
+    epicsUInt16 portNameLength;
+    epicsUInt16 reserved;
+}asynCaptureRecordHeader;
+
+#endif /*asynTraceCaptureH*/
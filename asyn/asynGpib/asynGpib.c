@@ -99,6 +99,7 @@ static void srqPoll(asynUser *pasynUser);
 static void report(void *drvPvt,FILE *fd,int details);
 static asynStatus connect(void *drvPvt,asynUser *pasynUser);
 static asynStatus disconnect(void *drvPvt,asynUser *pasynUser);
+static asynStatus abortIt(void *drvPvt,asynUser *pasynUser,int yesNo);
 /*asynOctet methods */
 static asynStatus writeIt(void *drvPvt,asynUser *pasynUser,
     const char *data,size_t maxchars,size_t *nbytesTransfered);
@@ -125,7 +126,7 @@ static void *registerPort(
 static void srqHappened(void *pgpibvt);
 
 static asynCommon common = {
-   report,connect,disconnect
+   report,connect,disconnect,abortIt
 };
 
 static asynOctet octet = {
@@ -386,6 +387,13 @@ static asynStatus disconnect(void *drvPvt,asynUser *pasynUser)
     GETgpibPvtasynGpibPort
     return(pasynGpibPort->disconnect(pgpibPvt->asynGpibPortPvt,pasynUser));
 }
+
+static asynStatus abortIt(void *drvPvt,asynUser *pasynUser,int yesNo)
+{
+    GETgpibPvtasynGpibPort
+    if(!pasynGpibPort->abort) return asynError;
+    return(pasynGpibPort->abort(pgpibPvt->asynGpibPortPvt,pasynUser,yesNo));
+}
 
 /*asynOctet methods */
 static asynStatus writeIt(void *drvPvt,asynUser *pasynUser,
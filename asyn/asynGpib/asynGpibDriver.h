@@ -91,6 +91,8 @@ struct asynGpibPort {
     asynStatus (*serialPollBegin) (void *drvPvt);
     asynStatus (*serialPoll) (void *drvPvt, int addr, double timeout,int *status);
     asynStatus (*serialPollEnd) (void *drvPvt);
+    /*asynCommon:abort. May be 0*/
+    asynStatus (*abort) (void *drvPvt,asynUser *pasynUser,int yesNo);
 };
 
 #ifdef __cplusplus
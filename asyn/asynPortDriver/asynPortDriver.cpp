@@ -12,6 +12,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <ctype.h>
 
 #include <epicsString.h>
 #include <epicsMutex.h>
@@ -26,26 +27,155 @@
 
 #define epicsExportSharedSymbols
 #include <shareLib.h>
-#include "paramVal.h"
 #include "paramErrors.h"
 #include "asynParamType.h"
-#include "ParamListInvalidIndex.h"
-#include "ParamValWrongType.h"
-#include "ParamValNotDefined.h"
 #include "asynPortDriver.h"
+#include "asynAtomic.h"
 
 static const char *driverName = "asynPortDriver";
 
+/** Names and types of the parameters of a driver, and where their values are stored.
+  * The paramLists of all addresses share one schema as long as they create the same
+  * parameters in the same order, which is the usual case, so every name is stored and
+  * hashed only once. A list that creates a different parameter gets its own copy.
+  * Names are compared ignoring case, like paramVal::nameEquals. */
+class paramSchema {
+public:
+    paramSchema(int nVals);
+    paramSchema(const paramSchema *pFrom, int nCopy);
+    ~paramSchema();
+    int find(const char *name);
+    int add(const char *name, asynParamType type);
+    bool matches(int index, const char *name, asynParamType type);
+    const char *getName(int index) { return this->names[index]; }
+    asynParamType getType(int index) { return this->types[index]; }
+    int getSlot(int index) { return this->slots[index]; }
+    int nParams;            /**< Number of parameters in the schema */
+
+private:
+    static unsigned int hash(const char *name);
+    void insert(int index);
+    int nVals;
+    char **names;
+    asynParamType *types;
+    int *slots;             /**< Position of the value in the array of values of its type */
+    int nSlots[asynParamGenericPointer+1];
+    int *table;             /**< Hash table of parameter number + 1, 0 if unused */
+    unsigned int tableSize;
+};
+
+/** Constructor for an empty paramSchema.
+  * \param[in] nVals Maximum number of parameters. */
+paramSchema::paramSchema(int nVals)
+    : nParams(0), nVals(nVals)
+{
+    for (tableSize = 16; tableSize < 2*(unsigned int)nVals; tableSize *= 2);
+    names = (char **) callocMustSucceed(nVals, sizeof(char *), "paramSchema");
+    types = (asynParamType *) callocMustSucceed(nVals, sizeof(asynParamType), "paramSchema");
+    slots = (int *) callocMustSucceed(nVals, sizeof(int), "paramSchema");
+    table = (int *) callocMustSucceed(tableSize, sizeof(int), "paramSchema");
+    memset(nSlots, 0, sizeof(nSlots));
+}
+
+/** Constructor for a paramSchema with the first parameters of another one.
+  * \param[in] pFrom The schema to copy.
+  * \param[in] nCopy The number of parameters to copy. */
+paramSchema::paramSchema(const paramSchema *pFrom, int nCopy)
+    : nParams(0), nVals(pFrom->nVals), tableSize(pFrom->tableSize)
+{
+    names = (char **) callocMustSucceed(nVals, sizeof(char *), "paramSchema");
+    types = (asynParamType *) callocMustSucceed(nVals, sizeof(asynParamType), "paramSchema");
+    slots = (int *) callocMustSucceed(nVals, sizeof(int), "paramSchema");
+    table = (int *) callocMustSucceed(tableSize, sizeof(int), "paramSchema");
+    memset(nSlots, 0, sizeof(nSlots));
+    for (nParams = 0; nParams < nCopy; nParams++) {
+        names[nParams] = epicsStrDup(pFrom->names[nParams]);
+        types[nParams] = pFrom->types[nParams];
+        slots[nParams] = nSlots[types[nParams]]++;
+        insert(nParams);
+    }
+}
+
+paramSchema::~paramSchema()
+{
+    int i;
+
+    for (i = 0; i < nParams; i++)
+        free(names[i]);
+    free(names);
+    free(types);
+    free(slots);
+    free(table);
+}
+
+/** FNV-1a hash of the name converted to lower case */
+unsigned int paramSchema::hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    for (; *name; name++) {
+        h ^= (unsigned char)tolower((unsigned char)*name);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void paramSchema::insert(int index)
+{
+    unsigned int i;
+
+    for (i = hash(names[index]) & (tableSize-1); table[i]; i = (i+1) & (tableSize-1));
+    table[i] = index + 1;
+}
+
+/** Returns the parameter number of the name, or -1 if it is not in the schema */
+int paramSchema::find(const char *name)
+{
+    unsigned int i;
+
+    for (i = hash(name) & (tableSize-1); table[i]; i = (i+1) & (tableSize-1)) {
+        if (epicsStrCaseCmp(names[table[i]-1], name) == 0) return table[i] - 1;
+    }
+    return -1;
+}
+
+/** Adds a parameter that find() did not find.
+  * \return The parameter number, or -1 if the schema is full. */
+int paramSchema::add(const char *name, asynParamType type)
+{
+    if (nParams >= nVals) return -1;
+    names[nParams] = epicsStrDup(name);
+    types[nParams] = type;
+    slots[nParams] = nSlots[type]++;
+    insert(nParams);
+    return nParams++;
+}
+
+/** Returns true if parameter index has this name and type */
+bool paramSchema::matches(int index, const char *name, asynParamType type)
+{
+    return (index < nParams) && (types[index] == type) &&
+           (epicsStrCaseCmp(names[index], name) == 0);
+}
+
 /** Class to support parameter library (also called parameter list);
   * set and get values indexed by parameter number (pasynUser->reason)
   * and do asyn callbacks when parameters change.
   * The parameter class supports 3 types of parameters: int, double
-  * and dynamic-length strings. */
+  * and dynamic-length strings.
+  * The names and types are kept in a paramSchema. The status of each parameter is in one
+  * array, and the values are in one array per type in the order given by the schema.
+  *
+  * Only one thread may change the list at a time, normally because it holds the driver lock
+  * or the lock of its address.
+  * The get methods may be called without the lock. Each parameter has a sequence number
+  * that is odd while the parameter is being changed; a reader copies the value and status and
+  * tries again if the sequence number changed. Arrays and strings that are replaced are kept
+  * until the list is deleted, so a reader never touches freed memory. */
 class paramList {
 public:
-    paramList(int nVals, class asynPortDriver *pPort);
+    paramList(int nVals, class asynPortDriver *pPort, paramSchema *pSchema);
     ~paramList();
-    paramVal* getParameter(int index);
     asynStatus createParam(const char *name, asynParamType type, int *index);
     asynStatus findParam(const char *name, int *index);
     asynStatus getName(int index, const char **name);
@@ -71,59 +201,272 @@ public:
     void report(FILE *fp, int details);
 
 private:
+    /** Status of a parameter */
+    struct paramState {
+        asynStatus status;
+        int alarmStatus;
+        int alarmSeverity;
+        bool defined;
+        int sequence;       /**< Odd while the parameter is being changed */
+    };
+    /** Value of an asynParamUInt32Digital parameter */
+    struct uint32Val {
+        epicsUInt32 value;
+        epicsUInt32 risingMask;
+        epicsUInt32 fallingMask;
+        epicsUInt32 callbackMask;
+    };
+    /** Value of an asynParamOctet parameter */
+    struct octetVal {
+        char *value;
+        size_t size;        /**< Size of the buffer that value points to */
+    };
+    /** Memory that a reader could still be using */
+    struct retiredBlock {
+        retiredBlock *next;
+        void *pBlock;
+    };
     asynStatus setFlag(int index);
+    void callCallback(int index, int addr, asynStatus *status);
     asynStatus int32Callback(int command, int addr);
     asynStatus uint32Callback(int command, int addr, epicsUInt32 interruptMask);
     asynStatus float64Callback(int command, int addr);
     asynStatus octetCallback(int command, int addr);
-    void registerParameterChange(paramVal *param, int index);
-    int nextParam;
+    asynParamType getType(int index);
+    asynParamType readType(int index);
+    void changeState(int index);
+    void writeBegin(int index);
+    void writeEnd(int index);
+    int readBegin(int index);
+    bool readRetry(int index, int sequence);
+    void retire(void *pBlock);
+    int nParams;
     int nVals;
-    int nFlags;
     asynPortDriver *pasynPortDriver;
-    int *flags;
-    paramVal **vals;
+    paramSchema *pSchema;
+    bool ownSchema;
+    epicsUInt32 *dirtyBits;     /**< One bit per parameter that changed since the last callCallbacks */
+    int *dirtyWords;            /**< Index of each word of dirtyBits that is not 0 */
+    int nDirtyWords;
+    paramState *states;
+    epicsInt32 *int32Vals;
+    uint32Val *uint32Vals;
+    epicsFloat64 *float64Vals;
+    octetVal *octetVals;
+    retiredBlock *retired;
+    int nInt32Vals;
+    int nUInt32Vals;
+    int nFloat64Vals;
+    int nOctetVals;
+};
+
+
+/** Class to visit only the interrupt clients registered for one reason and address,
+  * using the index that asynManager keeps with the client list.
+  * If the port is not a multi-device then clients have address -1, which matches address 0.
+  * \param[in] pclientList The list returned by pasynManager->interruptStart(). */
+class interruptClientIterator {
+public:
+    interruptClientIterator(ELLLIST *pclientList, int reason, int address)
+        : pclientList(pclientList), reason(reason), address(address)
+    {
+        pnode = pasynManager->interruptFirstMatch(pclientList, reason, address);
+        if (!pnode) nextAddress();
+    }
+    /** Returns the next client, or NULL when there are no more */
+    interruptNode *next()
+    {
+        interruptNode *pcurrent = pnode;
+
+        if (!pcurrent) return NULL;
+        pnode = pasynManager->interruptNextMatch(pcurrent);
+        if (!pnode) nextAddress();
+        return pcurrent;
+    }
+private:
+    void nextAddress()
+    {
+        if (address != 0) return;
+        address = -1;
+        pnode = pasynManager->interruptFirstMatch(pclientList, reason, address);
+    }
+    ELLLIST *pclientList;
+    int reason;
+    int address;
+    interruptNode *pnode;
 };
 
+/** Grows an array of values so that it has at least nNeeded elements; new elements are 0
+  * \return The old array, which the caller must not free while readers could be using it. */
+template <typename valueType>
+static valueType *growValues(valueType *&values, int &nAllocated, int nNeeded)
+{
+    valueType *oldValues = values;
+    valueType *newValues;
+    int n;
+
+    if (nNeeded <= nAllocated) return NULL;
+    for (n = nAllocated ? 2*nAllocated : 8; n < nNeeded; n *= 2);
+    newValues = (valueType *) callocMustSucceed(n, sizeof(valueType), "paramList");
+    if (nAllocated > 0) memcpy(newValues, values, nAllocated*sizeof(valueType));
+    asynAtomicWriteMemoryBarrier();
+    values = newValues;
+    nAllocated = n;
+    return oldValues;
+}
+
 /** Constructor for paramList class.
   * \param[in] nValues Number of parameters in the list.
-  * \param[in] pPort Pointer to asynPortDriver port for this paramList. */
-paramList::paramList(int nValues, asynPortDriver *pPort)
-    : nextParam(0), nVals(nValues), nFlags(0), pasynPortDriver(pPort)
-{
-    char eName[6];
-    sprintf(eName, "empty");
-    vals = (paramVal **) calloc(nVals, sizeof(paramVal));
-    for (int ii=0; ii<nVals; ii++){
-        vals[ii] = new paramVal(eName);
-    }
-    flags = (int *) calloc(nVals, sizeof(int));
+  * \param[in] pPort Pointer to asynPortDriver port for this paramList.
+  * \param[in] pSchema Pointer to the schema shared by all paramLists of pPort. */
+paramList::paramList(int nValues, asynPortDriver *pPort, paramSchema *pSchema)
+    : nParams(0), nVals(nValues), pasynPortDriver(pPort), pSchema(pSchema),
+      ownSchema(false), nDirtyWords(0), int32Vals(0), uint32Vals(0), float64Vals(0), octetVals(0),
+      retired(0), nInt32Vals(0), nUInt32Vals(0), nFloat64Vals(0), nOctetVals(0)
+{
+    dirtyBits = (epicsUInt32 *) calloc((nVals+31)/32, sizeof(epicsUInt32));
+    /* Room for words that are set again by the callbacks in callCallbacks */
+    dirtyWords = (int *) calloc(2*((nVals+31)/32), sizeof(int));
+    states = (paramState *) calloc(nVals, sizeof(paramState));
 }
 
 /** Destructor for paramList class; frees resources allocated in constructor */
 paramList::~paramList()
 {
+    retiredBlock *pRetired;
     int i;
 
-    for (i = 0; i < this->nVals; i++)
-        delete this->vals[i];
-
-    free(vals);
-    free(flags);
-}
-
+    for (i = 0; i < this->nOctetVals; i++)
+        free(this->octetVals[i].value);
+    while ((pRetired = this->retired)) {
+        this->retired = pRetired->next;
+        free(pRetired->pBlock);
+        free(pRetired);
+    }
+    if (this->ownSchema)
+        delete this->pSchema;
+    free(int32Vals);
+    free(uint32Vals);
+    free(float64Vals);
+    free(octetVals);
+    free(states);
+    free(dirtyWords);
+    free(dirtyBits);
+}
+
+/** Marks a parameter as changed so callCallbacks will do its callbacks */
 asynStatus paramList::setFlag(int index)
 {
-    int i;
+    epicsUInt32 *pWord;
 
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    /* See if we have already set the flag for this parameter */
-    for (i=0; i<this->nFlags; i++) if (this->flags[i] == index) break;
-    /* If not found add a flag */
-    if (i == this->nFlags) this->flags[this->nFlags++] = index;
+    pWord = &this->dirtyBits[index/32];
+    if (*pWord == 0) this->dirtyWords[this->nDirtyWords++] = index/32;
+    *pWord |= 1u << (index%32);
     return asynSuccess;
 }
 
+/** Returns the number of the lowest bit that is set in a word that is not 0 */
+static int lowestBit(epicsUInt32 word)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(word);
+#else
+    int bit = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/* Times readBegin looks again before it yields, and then before it sleeps */
+#define READ_SPIN_TRIES 100
+
+static int compareInt(const void *p1, const void *p2)
+{
+    return *(const int *)p1 - *(const int *)p2;
+}
+
+/** Called before changing the value or status of a parameter */
+void paramList::writeBegin(int index)
+{
+    this->states[index].sequence++;
+    asynAtomicWriteMemoryBarrier();
+}
+
+/** Called after changing the value or status of a parameter */
+void paramList::writeEnd(int index)
+{
+    asynAtomicWriteMemoryBarrier();
+    this->states[index].sequence++;
+}
+
+/** Called before copying the value or status of a parameter.
+  * \return The sequence number to pass to readRetry */
+int paramList::readBegin(int index)
+{
+    int sequence;
+    int tries = 0;
+
+    while ((sequence = asynAtomicGetInt(&this->states[index].sequence)) & 1) {
+        /* The writer may hold only the lock of its address, and this thread may hold the lock
+         * of another one, so do not wait by taking the lock. A write is short, so spin first,
+         * then yield, and sleep only if the writer does not get to run, e.g. because it has
+         * a lower priority than this thread. */
+        tries++;
+        if (tries <= READ_SPIN_TRIES) continue;
+        epicsThreadSleep((tries <= 2*READ_SPIN_TRIES) ? 0.0 : epicsThreadSleepQuantum());
+    }
+    asynAtomicReadMemoryBarrier();
+    return sequence;
+}
+
+/** Called after copying the value or status of a parameter.
+  * \return true if the parameter changed while it was copied and the copy must be done again */
+bool paramList::readRetry(int index, int sequence)
+{
+    asynAtomicReadMemoryBarrier();
+    return asynAtomicGetInt(&this->states[index].sequence) != sequence;
+}
+
+/** Frees memory that readers could still be using when the list is deleted */
+void paramList::retire(void *pBlock)
+{
+    retiredBlock *pRetired;
+
+    if (!pBlock) return;
+    pRetired = (retiredBlock *) callocMustSucceed(1, sizeof(retiredBlock), "paramList");
+    pRetired->pBlock = pBlock;
+    pRetired->next = this->retired;
+    this->retired = pRetired;
+}
+
+/** Returns the type of a parameter; asynParamNotDefined if index has not been created in this list */
+asynParamType paramList::getType(int index)
+{
+    return (index < this->nParams) ? this->pSchema->getType(index) : asynParamNotDefined;
+}
+
+/** getType for readers that do not hold the lock */
+asynParamType paramList::readType(int index)
+{
+    if (index >= asynAtomicGetInt(&this->nParams)) return asynParamNotDefined;
+    asynAtomicReadMemoryBarrier();
+    return this->pSchema->getType(index);
+}
+
+/** Records that the status of a parameter changed */
+void paramList::changeState(int index)
+{
+    /* We need to do callbacks on all bits if the status has changed */
+    if (getType(index) == asynParamUInt32Digital)
+        this->uint32Vals[this->pSchema->getSlot(index)].callbackMask = 0xFFFFFFFF;
+    setFlag(index);
+}
+
 /** Adds a new parameter to the parameter library.
   * \param[in] name The name of this parameter
   * \param[in] type The type of this parameter
@@ -132,11 +475,41 @@ asynStatus paramList::setFlag(int index)
   * adding this parameter would exceed the size of the parameter list. */
 asynStatus paramList::createParam(const char *name, asynParamType type, int *index)
 {
+    int slot;
+
     if (this->findParam(name, index) == asynSuccess) return asynParamAlreadyExists;
-    *index = this->nextParam++;
-    if (*index < 0 || *index >= this->nVals) return asynParamBadIndex;
-    delete this->vals[*index];
-    this->vals[*index] = new paramVal(name, type);
+    *index = this->nParams;
+    if (*index >= this->nVals) return asynParamBadIndex;
+    if (!this->pSchema->matches(*index, name, type)) {
+        if (*index < this->pSchema->nParams) {
+            /* Other lists have a different parameter with this number */
+            paramSchema *pNewSchema = new paramSchema(this->pSchema, *index);
+            asynAtomicWriteMemoryBarrier();
+            this->pSchema = pNewSchema;
+            this->ownSchema = true;
+        }
+        this->pSchema->add(name, type);
+    }
+    slot = this->pSchema->getSlot(*index);
+    switch (type) {
+        case asynParamInt32:
+            retire(growValues(this->int32Vals, this->nInt32Vals, slot+1));
+            break;
+        case asynParamUInt32Digital:
+            retire(growValues(this->uint32Vals, this->nUInt32Vals, slot+1));
+            break;
+        case asynParamFloat64:
+            retire(growValues(this->float64Vals, this->nFloat64Vals, slot+1));
+            break;
+        case asynParamOctet:
+            retire(growValues(this->octetVals, this->nOctetVals, slot+1));
+            break;
+        default:
+            break;
+    }
+    /* Readers see the parameter only after its schema entry and value */
+    asynAtomicWriteMemoryBarrier();
+    asynAtomicSetInt(&this->nParams, this->nParams + 1);
     return asynSuccess;
 }
 
@@ -146,19 +519,15 @@ asynStatus paramList::createParam(const char *name, asynParamType type, int *ind
   * \return Returns asynParamNotFound if name is not found in the parameter list. */
 asynStatus paramList::findParam(const char *name, int *index)
 {
-    for (*index=0; *index<this->nVals; (*index)++) {
-        if (this->vals[*index]->nameEquals(name)) return asynSuccess;
-    }
-    *index=-1;
-    return asynParamNotFound;
-}
-
-void paramList::registerParameterChange(paramVal *param,int index)
-{
-    if(param->hasValueChanged()){
-        setFlag(index);
-        param->resetValueChanged();
+    *index = -1;
+    if (!name) return asynParamNotFound;
+    *index = this->pSchema->find(name);
+    /* The schema may have more parameters than this list */
+    if (*index < 0 || *index >= this->nParams) {
+        *index = -1;
+        return asynParamNotFound;
     }
+    return asynSuccess;
 }
 
 /** Sets the value for an integer in the parameter library.
@@ -167,17 +536,18 @@ void paramList::registerParameterChange(paramVal *param,int index)
   * \return Returns asynParamBadIndex if the index is not valid or asynParamWrongType if the parametertype is not asynParamInt32. */
 asynStatus paramList::setInteger(int index, int value)
 {
-    try{
-        getParameter(index)->setInteger(value);
-        registerParameterChange(getParameter(index), index);
-    }
-    catch (ParamValWrongType&) {
-        return asynParamWrongType;
-    }
-    catch (ParamListInvalidIndex&){
-        return asynParamBadIndex;
-    }
+    epicsInt32 *pValue;
 
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (getType(index) != asynParamInt32) return asynParamWrongType;
+    pValue = &this->int32Vals[this->pSchema->getSlot(index)];
+    if (!this->states[index].defined || (*pValue != value)) {
+        writeBegin(index);
+        this->states[index].defined = true;
+        *pValue = value;
+        writeEnd(index);
+        setFlag(index);
+    }
     return asynSuccess;
 }
 
@@ -189,17 +559,29 @@ asynStatus paramList::setInteger(int index, int value)
   * \return Returns asynParamBadIndex if the index is not valid or asynParamWrongType if the parameter type is not asynParamUInt32Digital. */
 asynStatus paramList::setUInt32(int index, epicsUInt32 value, epicsUInt32 valueMask, epicsUInt32 interruptMask)
 {
-    try {
-        getParameter(index)->setUInt32(value, valueMask, interruptMask);
-        registerParameterChange(getParameter(index), index);
-    }
-    catch (ParamValWrongType&) {
-        return asynParamWrongType;
+    uint32Val *pValue;
+    epicsUInt32 oldValue;
+
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (getType(index) != asynParamUInt32Digital) return asynParamWrongType;
+    pValue = &this->uint32Vals[this->pSchema->getSlot(index)];
+    writeBegin(index);
+    this->states[index].defined = true;
+    oldValue = pValue->value;
+    /* Set any bits that are set in the value and the mask */
+    pValue->value |= (value & valueMask);
+    /* Clear bits that are clear in the value and set in the mask */
+    pValue->value &= (value | ~valueMask);
+    writeEnd(index);
+    if (pValue->value != oldValue) {
+        /* Set the bits in the callback mask that have changed */
+        pValue->callbackMask |= (pValue->value ^ oldValue);
+        setFlag(index);
     }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
+    if (interruptMask) {
+        pValue->callbackMask |= interruptMask;
+        setFlag(index);
     }
-
     return asynSuccess;
 }
 
@@ -209,17 +591,17 @@ asynStatus paramList::setUInt32(int index, epicsUInt32 value, epicsUInt32 valueM
   * \return Returns asynParamBadIndex if the index is not valid or asynParamWrongType if the parameter type is not asynParamFloat64. */
 asynStatus paramList::setDouble(int index, double value)
 {
-    try
-    {
-        getParameter(index)->setDouble(value);
-        registerParameterChange(getParameter(index), index);
-    }
-    catch (ParamValWrongType&)
-    {
-        return asynParamWrongType;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
+    epicsFloat64 *pValue;
+
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (getType(index) != asynParamFloat64) return asynParamWrongType;
+    pValue = &this->float64Vals[this->pSchema->getSlot(index)];
+    if (!this->states[index].defined || (*pValue != value)) {
+        writeBegin(index);
+        this->states[index].defined = true;
+        *pValue = value;
+        writeEnd(index);
+        setFlag(index);
     }
     return asynSuccess;
 }
@@ -230,16 +612,28 @@ asynStatus paramList::setDouble(int index, double value)
   * \return Returns asynParamBadIndex if the index is not valid or asynParamWrongType if the parameter type is not asynParamOctet. */
 asynStatus paramList::setString(int index, const char *value)
 {
+    octetVal *pValue;
+    size_t size;
+    char *oldValue = NULL;
+
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    try {
-        getParameter(index)->setString(value);
-        registerParameterChange(getParameter(index), index);
-    }
-    catch (ParamValWrongType&){
-        return asynParamWrongType;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
+    if ((getType(index) != asynParamOctet) || (value == NULL)) return asynParamWrongType;
+    pValue = &this->octetVals[this->pSchema->getSlot(index)];
+    if (!this->states[index].defined || strcmp(pValue->value, value)) {
+        size = strlen(value) + 1;
+        writeBegin(index);
+        this->states[index].defined = true;
+        if (size > pValue->size) {
+            /* Readers may be copying the old string */
+            oldValue = pValue->value;
+            if (size < 2*pValue->size) size = 2*pValue->size;
+            pValue->value = (char *) callocMustSucceed(size, 1, "paramList::setString");
+            pValue->size = size;
+        }
+        strcpy(pValue->value, value);
+        writeEnd(index);
+        retire(oldValue);
+        setFlag(index);
     }
     return asynSuccess;
 }
@@ -252,22 +646,17 @@ asynStatus paramList::setString(int index, const char *value)
 asynStatus paramList::getInteger(int index, int *value)
 {
     asynStatus status;
+    int sequence;
+
     *value = 0;
-    
-    try {
-        paramVal *pVal = getParameter(index);
-        *value = pVal->getInteger();
-        status = pVal->getStatus();
-    }
-    catch (ParamValWrongType&){
-        return asynParamWrongType;
-    }
-    catch (ParamValNotDefined&){
-        return asynParamUndefined;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
-    }
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (readType(index) != asynParamInt32) return asynParamWrongType;
+    do {
+        sequence = readBegin(index);
+        if (!this->states[index].defined) return asynParamUndefined;
+        *value = this->int32Vals[this->pSchema->getSlot(index)];
+        status = this->states[index].status;
+    } while (readRetry(index, sequence));
     return status;
 }
 
@@ -280,22 +669,17 @@ asynStatus paramList::getInteger(int index, int *value)
 asynStatus paramList::getUInt32(int index, epicsUInt32 *value, epicsUInt32 mask)
 {
     asynStatus status;
+    int sequence;
+
     *value = 0;
-    
-    try {
-        paramVal *pVal = getParameter(index);
-        *value = pVal->getUInt32(mask);
-        status = pVal->getStatus();
-    }
-    catch (ParamValWrongType&){
-        return asynParamWrongType;
-    }
-    catch (ParamValNotDefined&){
-        return asynParamUndefined;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
-    }
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (readType(index) != asynParamUInt32Digital) return asynParamWrongType;
+    do {
+        sequence = readBegin(index);
+        if (!this->states[index].defined) return asynParamUndefined;
+        *value = this->uint32Vals[this->pSchema->getSlot(index)].value & mask;
+        status = this->states[index].status;
+    } while (readRetry(index, sequence));
     return status;
 }
 
@@ -307,22 +691,17 @@ asynStatus paramList::getUInt32(int index, epicsUInt32 *value, epicsUInt32 mask)
 asynStatus paramList::getDouble(int index, double *value)
 {
     asynStatus status;
+    int sequence;
+
     *value = 0.;
-    
-    try {
-        paramVal *pVal = getParameter(index);
-        *value = pVal->getDouble();
-        status = pVal->getStatus();
-    }
-    catch (ParamValWrongType&){
-        return asynParamWrongType;
-    }
-    catch (ParamValNotDefined&){
-        return asynParamUndefined;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
-    }
+    if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+    if (readType(index) != asynParamFloat64) return asynParamWrongType;
+    do {
+        sequence = readBegin(index);
+        if (!this->states[index].defined) return asynParamUndefined;
+        *value = this->float64Vals[this->pSchema->getSlot(index)];
+        status = this->states[index].status;
+    } while (readRetry(index, sequence));
     return status;
 }
 
@@ -333,7 +712,7 @@ asynStatus paramList::getDouble(int index, double *value)
 asynStatus paramList::getStatus(int index, asynStatus *status)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    *status = this->vals[index]->getStatus();
+    *status = this->states[index].status;
     return asynSuccess;
 }
 
@@ -344,8 +723,12 @@ asynStatus paramList::getStatus(int index, asynStatus *status)
 asynStatus paramList::setStatus(int index, asynStatus status)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    this->vals[index]->setStatus(status);
-    registerParameterChange(getParameter(index), index);
+    if (this->states[index].status != status) {
+        writeBegin(index);
+        this->states[index].status = status;
+        writeEnd(index);
+        changeState(index);
+    }
     return asynSuccess;
 }
 
@@ -356,7 +739,7 @@ asynStatus paramList::setStatus(int index, asynStatus status)
 asynStatus paramList::getAlarmStatus(int index,  int *alarmStatus)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    *alarmStatus = this->vals[index]->getAlarmStatus();
+    *alarmStatus = this->states[index].alarmStatus;
     return asynSuccess;
 }
 
@@ -367,8 +750,12 @@ asynStatus paramList::getAlarmStatus(int index,  int *alarmStatus)
 asynStatus paramList::setAlarmStatus(int index, int alarmStatus)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    this->vals[index]->setAlarmStatus(alarmStatus);
-    registerParameterChange(getParameter(index), index);
+    if (this->states[index].alarmStatus != alarmStatus) {
+        writeBegin(index);
+        this->states[index].alarmStatus = alarmStatus;
+        writeEnd(index);
+        changeState(index);
+    }
     return asynSuccess;
 }
 
@@ -379,7 +766,7 @@ asynStatus paramList::setAlarmStatus(int index, int alarmStatus)
 asynStatus paramList::getAlarmSeverity(int index,  int *alarmSeverity)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    *alarmSeverity = this->vals[index]->getAlarmSeverity();
+    *alarmSeverity = this->states[index].alarmSeverity;
     return asynSuccess;
 }
 
@@ -390,8 +777,12 @@ asynStatus paramList::getAlarmSeverity(int index,  int *alarmSeverity)
 asynStatus paramList::setAlarmSeverity(int index, int alarmSeverity)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    this->vals[index]->setAlarmSeverity(alarmSeverity);
-    registerParameterChange(getParameter(index), index);
+    if (this->states[index].alarmSeverity != alarmSeverity) {
+        writeBegin(index);
+        this->states[index].alarmSeverity = alarmSeverity;
+        writeEnd(index);
+        changeState(index);
+    }
     return asynSuccess;
 }
 
@@ -403,18 +794,21 @@ asynStatus paramList::setAlarmSeverity(int index, int alarmSeverity)
   * or asynParamWrongType if the parameter type is not asynParamUInt32Digital */
 asynStatus paramList::setUInt32Interrupt(int index, epicsUInt32 mask, interruptReason reason)
 {
+    uint32Val *pValue;
+
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    if (this->vals[index]->type != asynParamUInt32Digital) return asynParamWrongType;
+    if (getType(index) != asynParamUInt32Digital) return asynParamWrongType;
+    pValue = &this->uint32Vals[this->pSchema->getSlot(index)];
     switch (reason) {
       case interruptOnZeroToOne:
-        this->vals[index]->uInt32RisingMask = mask;
+        pValue->risingMask = mask;
         break;
       case interruptOnOneToZero:
-        this->vals[index]->uInt32FallingMask = mask;
+        pValue->fallingMask = mask;
         break;
       case interruptOnBoth:
-        this->vals[index]->uInt32RisingMask = mask;
-        this->vals[index]->uInt32FallingMask = mask;
+        pValue->risingMask = mask;
+        pValue->fallingMask = mask;
         break;
     }
     return asynSuccess;
@@ -427,10 +821,13 @@ asynStatus paramList::setUInt32Interrupt(int index, epicsUInt32 mask, interruptR
   * or asynParamWrongType if the parameter type is not asynParamUInt32Digital */
 asynStatus paramList::clearUInt32Interrupt(int index, epicsUInt32 mask)
 {
+    uint32Val *pValue;
+
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    if (this->vals[index]->type != asynParamUInt32Digital) return asynParamWrongType;
-    this->vals[index]->uInt32RisingMask &= ~mask;
-    this->vals[index]->uInt32FallingMask &= ~mask;
+    if (getType(index) != asynParamUInt32Digital) return asynParamWrongType;
+    pValue = &this->uint32Vals[this->pSchema->getSlot(index)];
+    pValue->risingMask &= ~mask;
+    pValue->fallingMask &= ~mask;
     return asynSuccess;
 }
 
@@ -442,17 +839,20 @@ asynStatus paramList::clearUInt32Interrupt(int index, epicsUInt32 mask)
   * or asynParamWrongType if the parameter type is not asynParamUInt32Digital */
 asynStatus paramList::getUInt32Interrupt(int index, epicsUInt32 *mask, interruptReason reason)
 {
+    uint32Val *pValue;
+
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    if (this->vals[index]->type != asynParamUInt32Digital) return asynParamWrongType;
+    if (getType(index) != asynParamUInt32Digital) return asynParamWrongType;
+    pValue = &this->uint32Vals[this->pSchema->getSlot(index)];
     switch (reason) {
       case interruptOnZeroToOne:
-        *mask = this->vals[index]->uInt32RisingMask;
+        *mask = pValue->risingMask;
         break;
       case interruptOnOneToZero:
-        *mask = this->vals[index]->uInt32FallingMask;
+        *mask = pValue->fallingMask;
         break;
       case interruptOnBoth:
-        *mask = this->vals[index]->uInt32RisingMask | this->vals[index]->uInt32FallingMask;
+        *mask = pValue->risingMask | pValue->fallingMask;
         break;
     }
     return asynSuccess;
@@ -467,23 +867,23 @@ asynStatus paramList::getUInt32Interrupt(int index, epicsUInt32 *mask, interrupt
 asynStatus paramList::getString(int index, int maxChars, char *value)
 {
     asynStatus status=asynSuccess;
-    
-    try {
-        if (maxChars > 0) {
-            paramVal *pVal = getParameter(index);
-            status = pVal->getStatus();
-            strncpy(value, pVal->getString(), maxChars-1);
-            value[maxChars-1] = '\0';
-        }
-    }
-    catch (ParamValWrongType&){
-        return asynParamWrongType;
-    }
-    catch (ParamValNotDefined&){
-        return asynParamUndefined;
-    }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
+    octetVal octet;
+    size_t nChars;
+    int sequence;
+
+    if (maxChars > 0) {
+        if (index < 0 || index >= this->nVals) return asynParamBadIndex;
+        if (readType(index) != asynParamOctet) return asynParamWrongType;
+        do {
+            sequence = readBegin(index);
+            if (!this->states[index].defined) return asynParamUndefined;
+            status = this->states[index].status;
+            octet = this->octetVals[this->pSchema->getSlot(index)];
+            /* The string may be changing, so do not read past the end of its buffer */
+            nChars = (octet.size < (size_t)maxChars) ? octet.size : maxChars-1;
+            strncpy(value, octet.value, nChars);
+        } while (readRetry(index, sequence));
+        value[maxChars-1] = '\0';
     }
     return status;
 }
@@ -495,7 +895,12 @@ asynStatus paramList::getString(int index, int maxChars, char *value)
 asynStatus paramList::getName(int index, const char **value)
 {
     if (index < 0 || index >= this->nVals) return asynParamBadIndex;
-    *value = (const char *)this->vals[index]->getName();
+    if (index < asynAtomicGetInt(&this->nParams)) {
+        asynAtomicReadMemoryBarrier();
+        *value = this->pSchema->getName(index);
+    } else {
+        *value = "empty";
+    }
     return asynSuccess;
 }
 
@@ -507,10 +912,9 @@ asynStatus paramList::int32Callback(int command, int addr)
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsInt32 value;
-    int alarmStatus;
-    int alarmSeverity;
+    int alarmStatus=0;
+    int alarmSeverity=0;
     asynStatus status;
 
     /* Pass int32 interrupts */
@@ -519,25 +923,18 @@ asynStatus paramList::int32Callback(int command, int addr)
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->int32InterruptPvt) return(asynParamNotFound);
     pasynManager->interruptStart(pInterfaces->int32InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynInt32Interrupt *pInterrupt = (asynInt32Interrupt *) pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientIterator clients(pclientList, command, addr);
+    while ((pnode = clients.next())) {
+        asynInt32Interrupt *pInterrupt = (asynInt32Interrupt *)pnode->drvPvt;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value);
     }
     pasynManager->interruptEnd(pInterfaces->int32InterruptPvt);
     return(asynSuccess);
@@ -551,10 +948,9 @@ asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interrup
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsUInt32 value;
-    int alarmStatus;
-    int alarmSeverity;
+    int alarmStatus=0;
+    int alarmSeverity=0;
     asynStatus status;
 
     /* Pass UInt32Digital interrupts */
@@ -563,15 +959,10 @@ asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interrup
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->uInt32DigitalInterruptPvt) return(asynParamNotFound);
     pasynManager->interruptStart(pInterfaces->uInt32DigitalInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynUInt32DigitalInterrupt *pInterrupt = (asynUInt32DigitalInterrupt *) pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr) &&
-            (pInterrupt->mask & interruptMask)) {
+    interruptClientIterator clients(pclientList, command, addr);
+    while ((pnode = clients.next())) {
+        asynUInt32DigitalInterrupt *pInterrupt = (asynUInt32DigitalInterrupt *)pnode->drvPvt;
+        if (pInterrupt->mask & interruptMask) {
             /* Set the status for the callback */
             pInterrupt->pasynUser->auxStatus = status;
             pInterrupt->pasynUser->alarmStatus = alarmStatus;
@@ -582,7 +973,6 @@ asynStatus paramList::uint32Callback(int command, int addr, epicsUInt32 interrup
                                  pInterrupt->pasynUser,
                                  pInterrupt->mask & value);
         }
-        pnode = (interruptNode *)ellNext(&pnode->node);
     }
     pasynManager->interruptEnd(pInterfaces->uInt32DigitalInterruptPvt);
     return(asynSuccess);
@@ -596,10 +986,9 @@ asynStatus paramList::float64Callback(int command, int addr)
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     epicsFloat64 value;
-    int alarmStatus;
-    int alarmSeverity;
+    int alarmStatus=0;
+    int alarmSeverity=0;
     asynStatus status;
 
     /* Pass float64 interrupts */
@@ -608,25 +997,18 @@ asynStatus paramList::float64Callback(int command, int addr)
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->float64InterruptPvt) return(asynParamNotFound);
     pasynManager->interruptStart(pInterfaces->float64InterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientIterator clients(pclientList, command, addr);
+    while ((pnode = clients.next())) {
+        asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *)pnode->drvPvt;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value);
     }
     pasynManager->interruptEnd(pInterfaces->float64InterruptPvt);
     return(asynSuccess);
@@ -640,38 +1022,30 @@ asynStatus paramList::octetCallback(int command, int addr)
     asynStandardInterfaces *pInterfaces = this->pasynPortDriver->getAsynStdInterfaces();
     epicsTimeStamp timeStamp;
     this->pasynPortDriver->getTimeStamp(&timeStamp);
-    int address;
     char *value;
-    int alarmStatus;
-    int alarmSeverity;
-    asynStatus status;
+    int alarmStatus=0;
+    int alarmSeverity=0;
+    asynStatus status=asynSuccess;
 
     /* Pass octet interrupts */
-    value = getParameter(command)->getString();
+    value = this->octetVals[this->pSchema->getSlot(command)].value;
     getStatus(command, &status);
     getAlarmStatus(command, &alarmStatus);
     getAlarmSeverity(command, &alarmSeverity);
     if (!pInterfaces->octetInterruptPvt) return(asynParamNotFound);
     pasynManager->interruptStart(pInterfaces->octetInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
-        asynOctetInterrupt *pInterrupt = (asynOctetInterrupt *) pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &address);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (address == -1) address = 0;
-        if ((command == pInterrupt->pasynUser->reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, strlen(value)+1, ASYN_EOM_END);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+    interruptClientIterator clients(pclientList, command, addr);
+    while ((pnode = clients.next())) {
+        asynOctetInterrupt *pInterrupt = (asynOctetInterrupt *)pnode->drvPvt;
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value, strlen(value)+1, ASYN_EOM_END);
     }
     pasynManager->interruptEnd(pInterfaces->octetInterruptPvt);
     return(asynSuccess);
@@ -686,42 +1060,59 @@ asynStatus paramList::octetCallback(int command, int addr)
   */
 asynStatus paramList::callCallbacks(int addr)
 {
-    int i, index;
+    int i, word, nWords;
+    epicsUInt32 bits;
     asynStatus status = asynSuccess;
 
     if (!interruptAccept) return(asynSuccess);
 
-    try {
-        for (i = 0; i < this->nFlags; i++)
-        {
-            index = this->flags[i];
-            if (!getParameter(index)->isDefined()) continue;
-            switch(getParameter(index)->type) {
-                case asynParamInt32:
-                    status = int32Callback(index, addr);
-                    break;
-                case asynParamUInt32Digital:
-                    status = uint32Callback(index, addr, this->vals[index]->uInt32CallbackMask);
-                    this->vals[index]->uInt32CallbackMask = 0;
-                    break;
-                case asynParamFloat64:
-                    status = float64Callback(index, addr);
-                    break;
-                case asynParamOctet:
-                    status = octetCallback(index, addr);
-                    break;
-                default:
-                    break;
-            }
+    /* Do the callbacks in order of parameter number.
+     * If a callback sets a parameter that has already been done it is added
+     * after the first nWords entries and is left for the next call. */
+    nWords = this->nDirtyWords;
+    qsort(this->dirtyWords, nWords, sizeof(int), compareInt);
+    for (i = 0; i < nWords; i++)
+    {
+        word = this->dirtyWords[i];
+        bits = this->dirtyBits[word];
+        this->dirtyBits[word] = 0;
+        while (bits) {
+            int bit = lowestBit(bits);
+            bits &= bits - 1;
+            callCallback(word*32 + bit, addr, &status);
         }
     }
-    catch (ParamListInvalidIndex&) {
-        return asynParamBadIndex;
-    }
-    this->nFlags=0;
+    this->nDirtyWords -= nWords;
+    memmove(this->dirtyWords, this->dirtyWords + nWords, this->nDirtyWords*sizeof(int));
     return(status);
 }
 
+/** Does the callbacks for one parameter if it is defined */
+void paramList::callCallback(int index, int addr, asynStatus *status)
+{
+    uint32Val *pValue;
+
+    if (!this->states[index].defined) return;
+    switch(getType(index)) {
+        case asynParamInt32:
+            *status = int32Callback(index, addr);
+            break;
+        case asynParamUInt32Digital:
+            pValue = &this->uint32Vals[this->pSchema->getSlot(index)];
+            *status = uint32Callback(index, addr, pValue->callbackMask);
+            pValue->callbackMask = 0;
+            break;
+        case asynParamFloat64:
+            *status = float64Callback(index, addr);
+            break;
+        case asynParamOctet:
+            *status = octetCallback(index, addr);
+            break;
+        default:
+            break;
+    }
+}
+
 asynStatus paramList::callCallbacks()
 {
     return(callCallbacks(0));
@@ -734,27 +1125,70 @@ asynStatus paramList::callCallbacks()
  */
 void paramList::report(FILE *fp, int details)
 {
-    int i;
+    int i, slot;
+    const char *name;
+    paramState *pState;
 
     fprintf(fp, "Number of parameters is: %d\n", this->nVals );
     for (i=0; i<this->nVals; i++)
     {
-        this->vals[i]->report(i, fp, details);
+        getName(i, &name);
+        pState = &this->states[i];
+        slot = (i < this->nParams) ? this->pSchema->getSlot(i) : 0;
+        switch (getType(i))
+        {
+            case asynParamInt32:
+                if (pState->defined)
+                    fprintf(fp, "Parameter %d type=asynInt32, name=%s, value=%d, status=%d\n",
+                        i, name, this->int32Vals[slot], pState->status);
+                else
+                    fprintf(fp, "Parameter %d type=asynInt32, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamUInt32Digital:
+                if (pState->defined)
+                    fprintf(fp, "Parameter %d type=asynUInt32Digital, name=%s, value=0x%x, status=%d, risingMask=0x%x, fallingMask=0x%x, callbackMask=0x%x\n",
+                        i, name, this->uint32Vals[slot].value, pState->status,
+                        this->uint32Vals[slot].risingMask, this->uint32Vals[slot].fallingMask,
+                        this->uint32Vals[slot].callbackMask);
+                else
+                    fprintf(fp, "Parameter %d type=asynUInt32Digital, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamFloat64:
+                if (pState->defined)
+                    fprintf(fp, "Parameter %d type=asynFloat64, name=%s, value=%f, status=%d\n",
+                        i, name, this->float64Vals[slot], pState->status);
+                else
+                    fprintf(fp, "Parameter %d type=asynFloat64, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamOctet:
+                if (pState->defined)
+                    fprintf(fp, "Parameter %d type=string, name=%s, value=%s, status=%d\n",
+                        i, name, this->octetVals[slot].value, pState->status);
+                else
+                    fprintf(fp, "Parameter %d type=string, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamInt8Array:
+                fprintf(fp, "Parameter %d type=asynInt8Array, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamInt16Array:
+                fprintf(fp, "Parameter %d type=asynInt16Array, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamInt32Array:
+                fprintf(fp, "Parameter %d type=asynInt32Array, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamFloat32Array:
+                fprintf(fp, "Parameter %d type=asynFloat32Array, name=%s, value is undefined\n", i, name);
+                break;
+            case asynParamFloat64Array:
+                fprintf(fp, "Parameter %d type=asynFloat64Array, name=%s, value is undefined\n", i, name);
+                break;
+            default:
+                fprintf(fp, "Parameter %d is undefined, name=%s\n", i, name);
+                break;
+        }
     }
 }
 
-/** Get a parameter from the list by index
- *  \param[in] index The index of the desired parameter in the list
- *  \return The parameter associated with the input index
- *  \throws ParamListInvalidIndex if the index is outside the list
- *  boundaries
- */
-paramVal* paramList::getParameter(int index)
-{
-    if (index < 0 || index >= this->nVals) throw ParamListInvalidIndex("paramList::getParameter invalid index");
-    return this->vals[index];
-}
-
 
 /* I thought this would be a temporary fix until EPICS supported PINI after interruptAccept, which would then be used
  * for input records that need callbacks after output records that also have PINI and that could affect them. But this
@@ -772,6 +1206,14 @@ void asynPortDriver::callbackTask()
     int addr;
     
     while(!interruptAccept) epicsThreadSleep(0.1);
+    if (this->lockPerAddr) {
+        for (addr=0; addr<this->maxAddr; addr++) {
+            lockAddress(addr);
+            callParamCallbacks(addr, addr);
+            unlockAddress(addr);
+        }
+        return;
+    }
     epicsMutexLock(this->mutexId);
     for (addr=0; addr<this->maxAddr; addr++) {
         callParamCallbacks(addr, addr);
@@ -784,22 +1226,75 @@ void asynPortDriver::callbackTask()
   * This function is called whenever asyn clients call the functions on the asyn interfaces.
   * Drivers with their own background threads must call lock() to protect conflicts with
   * asyn clients.  They can call unlock() to permit asyn clients to run during times that the driver
-  * thread is idle or is performing compute bound work that does not access memory also accessible by other threads. */
+  * thread is idle or is performing compute bound work that does not access memory also accessible by other threads.
+  * If ASYN_LOCK_PER_ADDR was set in the constructor this also waits until no thread holds the lock
+  * of an address. New lockAddress() calls wait while lock() is held or being taken. */
 asynStatus asynPortDriver::lock()
 {
     int status;
     status = epicsMutexLock(this->mutexId);
     if (status) return(asynError);
-    else return(asynSuccess);
+    if (this->addrMutexIds) {
+        asynAtomicIncrInt(&this->lockWaiting);
+        while (asynAtomicGetInt(&this->addrLockCount) > 0) {
+            epicsEventMustWait(this->addrUnlockedEvent);
+        }
+        asynAtomicDecrInt(&this->lockWaiting);
+        if (this->lockDepth++ == 0) asynAtomicSetPtr(&this->lockOwner, epicsThreadGetIdSelf());
+    }
+    return(asynSuccess);
 }
 
 /** Unlocks the driver; called when an asyn client or driver is done accessing common memory. */
 asynStatus asynPortDriver::unlock()
 {
+    if (this->addrMutexIds && (--this->lockDepth == 0)) asynAtomicSetPtr(&this->lockOwner, 0);
     epicsMutexUnlock(this->mutexId);
     return(asynSuccess);
 }
 
+/** Locks one address of the driver.
+  * If ASYN_LOCK_PER_ADDR was set in the constructor then each address has its own lock, and the
+  * C functions for the asynInt32, asynUInt32Digital, asynFloat64, asynOctet read/write/flush,
+  * array, asynGenericPointer and asynEnum methods call the driver with only the lock of pasynUser's
+  * address held. Threads that work on different addresses can then set parameters and call
+  * callParamCallbacks(addr, addr) concurrently. The parameter list of an address, and any
+  * driver data for that address, must only be changed with the lock of that address or with lock().
+  * lockAddress() briefly takes the lock of the driver before the lock of the address, and lock()
+  * waits until no address is locked, see the lock order in asynPortDriver.h.
+  * A thread that holds the lock of an address must therefore not call lock() or lock another
+  * address. A thread that holds lock() may lock addresses and call lock() again, but must unlock
+  * them before it calls the matching unlock(). Drivers that call unlock() while
+  * waiting for I/O must call unlockAddress() instead in the methods called with the address lock.
+  * If ASYN_LOCK_PER_ADDR was not set, or addr is not a valid address, this calls lock().
+  * \param[in] addr The asyn address to lock. */
+asynStatus asynPortDriver::lockAddress(int addr)
+{
+    int status;
+    if (!this->addrMutexIds || (addr < 0) || (addr >= this->maxAddr)) return lock();
+    /* The holder of lock() keeps every other thread out, so it is not counted */
+    if (asynAtomicGetPtr(&this->lockOwner) != (void *)epicsThreadGetIdSelf()) {
+        status = epicsMutexLock(this->mutexId);
+        if (status) return(asynError);
+        asynAtomicIncrInt(&this->addrLockCount);
+        epicsMutexUnlock(this->mutexId);
+    }
+    epicsMutexMustLock(this->addrMutexIds[addr]);
+    return(asynSuccess);
+}
+
+/** Unlocks one address of the driver that was locked with lockAddress().
+  * \param[in] addr The asyn address to unlock. */
+asynStatus asynPortDriver::unlockAddress(int addr)
+{
+    if (!this->addrMutexIds || (addr < 0) || (addr >= this->maxAddr)) return unlock();
+    epicsMutexUnlock(this->addrMutexIds[addr]);
+    if (asynAtomicGetPtr(&this->lockOwner) == (void *)epicsThreadGetIdSelf()) return(asynSuccess);
+    if ((asynAtomicDecrInt(&this->addrLockCount) == 0) && asynAtomicGetInt(&this->lockWaiting))
+        epicsEventSignal(this->addrUnlockedEvent);
+    return(asynSuccess);
+}
+
 /** Returns the asynStdInterfaces structure used by asynPortDriver. */
 asynStandardInterfaces* asynPortDriver::getAsynStdInterfaces()
 {
@@ -903,7 +1398,7 @@ void asynPortDriver::reportSetParamErrors(asynStatus status, int index, int list
     }
     if (status == asynParamWrongType) {
         const char *paramName;
-        getParamName(index, &paramName);
+        getParamName(list, index, &paramName);
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
             "%s:%s: port=%s error setting parameter %d %s, in list %d, wrong type\n",
             driverName, functionName, portName, index, paramName, list);
@@ -1268,14 +1763,14 @@ void asynPortDriver::reportGetParamErrors(asynStatus status, int index, int list
     }
     if (status == asynParamWrongType) {
         const char *paramName;
-        getParamName(index, &paramName);
+        getParamName(list, index, &paramName);
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
             "%s:%s: port=%s error getting parameter %d %s, in list %d, wrong type\n",
             driverName, functionName, portName, index, paramName, list);
     }
     if (status == asynParamUndefined) {
         const char *paramName;
-        getParamName(index, &paramName);
+        getParamName(list, index, &paramName);
         asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
             "%s:%s: port=%s error getting parameter %d %s, in list %d, value undefined\n",
             driverName, functionName, portName, index, paramName, list);
@@ -1445,31 +1940,23 @@ asynStatus asynPortDriver::doCallbacksArray(epicsType *value, size_t nElements,
     int alarmStatus;
     int alarmSeverity;
     epicsTimeStamp timeStamp; getTimeStamp(&timeStamp);
-    int addr;
 
     pasynManager->interruptStart(interruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
-    while (pnode) {
+    interruptClientIterator clients(pclientList, reason, address);
+    while ((pnode = clients.next())) {
         interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 value, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             value, nElements);
     }
     pasynManager->interruptEnd(interruptPvt);
     return(asynSuccess);
@@ -1524,16 +2011,33 @@ asynStatus asynPortDriver::getAddress(asynUser *pasynUser, int *address)
 }
 
 
+/* Returns the address whose lock a call from an asyn client needs, or -1 for the whole driver.
+ * An invalid address is returned as is; lockAddress() then locks the whole driver and the
+ * method reports the error. */
+static int callerAddress(asynPortDriver *pPvt, asynUser *pasynUser)
+{
+    int addr;
+
+    if (!pPvt->lockPerAddr) return -1;
+    pasynManager->getAddr(pasynUser, &addr);
+    /* If this is not a multi-device then address is -1, change to 0 */
+    if (addr == -1) addr = 0;
+    return addr;
+}
+
 /* asynInt32 interface methods */
 extern "C" {static asynStatus readInt32(void *drvPvt, asynUser *pasynUser, 
                             epicsInt32 *value)
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    /* The parameter library can be read without the lock */
+    if (pPvt->lockFreeReads) return(pPvt->readInt32(pasynUser, value));
+    pPvt->lockAddress(addr);
     status = pPvt->readInt32(pasynUser, value);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1576,10 +2080,11 @@ extern "C" {static asynStatus writeInt32(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeInt32(pasynUser, value);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1623,10 +2128,11 @@ extern "C" {static asynStatus getBounds(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->getBounds(pasynUser, low, high);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1657,10 +2163,13 @@ extern "C" {static asynStatus readUInt32Digital(void *drvPvt, asynUser *pasynUse
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    /* The parameter library can be read without the lock */
+    if (pPvt->lockFreeReads) return(pPvt->readUInt32Digital(pasynUser, value, mask));
+    pPvt->lockAddress(addr);
     status = pPvt->readUInt32Digital(pasynUser, value, mask);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1704,10 +2213,11 @@ extern "C" {static asynStatus writeUInt32Digital(void *drvPvt, asynUser *pasynUs
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeUInt32Digital(pasynUser, value, mask);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1751,10 +2261,11 @@ extern "C" {static asynStatus setInterruptUInt32Digital(void *drvPvt, asynUser *
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->setInterruptUInt32Digital(pasynUser, mask, reason);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1794,10 +2305,11 @@ extern "C" {static asynStatus clearInterruptUInt32Digital(void *drvPvt, asynUser
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->clearInterruptUInt32Digital(pasynUser, mask);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1836,10 +2348,11 @@ extern "C" {static asynStatus getInterruptUInt32Digital(void *drvPvt, asynUser *
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->getInterruptUInt32Digital(pasynUser, mask, reason);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1881,10 +2394,13 @@ extern "C" {static asynStatus readFloat64(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    /* The parameter library can be read without the lock */
+    if (pPvt->lockFreeReads) return(pPvt->readFloat64(pasynUser, value));
+    pPvt->lockAddress(addr);
     status = pPvt->readFloat64(pasynUser, value);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1932,10 +2448,11 @@ extern "C" {static asynStatus writeFloat64(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeFloat64(pasynUser, value);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -1982,10 +2499,13 @@ extern "C" {static asynStatus readOctet(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    /* The parameter library can be read without the lock */
+    if (pPvt->lockFreeReads) return(pPvt->readOctet(pasynUser, value, maxChars, nActual, eomReason));
+    pPvt->lockAddress(addr);
     status = pPvt->readOctet(pasynUser, value, maxChars, nActual, eomReason);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -2035,10 +2555,11 @@ extern "C" {static asynStatus writeOctet(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeOctet(pasynUser, value, maxChars, nActual);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -2085,10 +2606,11 @@ extern "C" {static asynStatus flushOctet(void *drvPvt, asynUser *pasynUser)
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->flushOctet(pasynUser);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -2234,10 +2756,11 @@ extern "C" {static asynStatus readInt8Array(void *drvPvt, asynUser *pasynUser, e
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readInt8Array(pasynUser, value, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -2259,10 +2782,11 @@ extern "C" {static asynStatus writeInt8Array(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeInt8Array(pasynUser, value, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2297,10 +2821,11 @@ extern "C" {static asynStatus readInt16Array(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readInt16Array(pasynUser, value, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2322,10 +2847,11 @@ extern "C" {static asynStatus writeInt16Array(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeInt16Array(pasynUser, value, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2360,10 +2886,11 @@ extern "C" {static asynStatus readInt32Array(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
      
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readInt32Array(pasynUser, value, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);
 }}
 
@@ -2385,10 +2912,11 @@ extern "C" {static asynStatus writeInt32Array(void *drvPvt, asynUser *pasynUser,
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeInt32Array(pasynUser, value, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2423,10 +2951,11 @@ extern "C" {static asynStatus readFloat32Array(void *drvPvt, asynUser *pasynUser
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readFloat32Array(pasynUser, value, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2448,10 +2977,11 @@ extern "C" {static asynStatus writeFloat32Array(void *drvPvt, asynUser *pasynUse
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeFloat32Array(pasynUser, value, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2486,10 +3016,11 @@ extern "C" {static asynStatus readFloat64Array(void *drvPvt, asynUser *pasynUser
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readFloat64Array(pasynUser, value, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2511,10 +3042,11 @@ extern "C" {static asynStatus writeFloat64Array(void *drvPvt, asynUser *pasynUse
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeFloat64Array(pasynUser, value, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2547,10 +3079,11 @@ extern "C" {static asynStatus readGenericPointer(void *drvPvt, asynUser *pasynUs
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status =pPvt->readGenericPointer(pasynUser, genericPointer);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2570,10 +3103,11 @@ extern "C" {static asynStatus writeGenericPointer(void *drvPvt, asynUser *pasynU
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeGenericPointer(pasynUser, genericPointer);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2602,31 +3136,23 @@ asynStatus asynPortDriver::doCallbacksGenericPointer(void *genericPointer, int r
     asynStatus status;
     int alarmStatus;
     int alarmSeverity;
-    int addr;
 
     getParamStatus(address, reason, &status);
     getParamAlarmStatus(address, reason, &alarmStatus);
     getParamAlarmSeverity(address, reason, &alarmSeverity);
     pasynManager->interruptStart(this->asynStdInterfaces.genericPointerInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
+    interruptClientIterator clients(pclientList, reason, address);
+    while ((pnode = clients.next())) {
         asynGenericPointerInterrupt *pInterrupt = (asynGenericPointerInterrupt *)pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            /* Set the status for the callback */
-            pInterrupt->pasynUser->auxStatus = status;
-            pInterrupt->pasynUser->alarmStatus = alarmStatus;
-            pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
-            /* Set the timestamp for the callback */
-            pInterrupt->pasynUser->timestamp = timeStamp;
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 genericPointer);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+        /* Set the status for the callback */
+        pInterrupt->pasynUser->auxStatus = status;
+        pInterrupt->pasynUser->alarmStatus = alarmStatus;
+        pInterrupt->pasynUser->alarmSeverity = alarmSeverity;
+        /* Set the timestamp for the callback */
+        pInterrupt->pasynUser->timestamp = timeStamp;
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             genericPointer);
     }
     pasynManager->interruptEnd(this->asynStdInterfaces.genericPointerInterruptPvt);
     return(asynSuccess);
@@ -2690,10 +3216,11 @@ extern "C" {static asynStatus readEnum(void *drvPvt, asynUser *pasynUser, char *
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
  
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->readEnum(pasynUser, strings, values, severities, nElements, nIn);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2717,10 +3244,11 @@ extern "C" {static asynStatus writeEnum(void *drvPvt, asynUser *pasynUser, char
 {
     asynPortDriver *pPvt = (asynPortDriver *)drvPvt;
     asynStatus status;
+    int addr = callerAddress(pPvt, pasynUser);
     
-    pPvt->lock();
+    pPvt->lockAddress(addr);
     status = pPvt->writeEnum(pasynUser, strings, values, severities, nElements);
-    pPvt->unlock();
+    pPvt->unlockAddress(addr);
     return(status);    
 }}
 
@@ -2751,22 +3279,14 @@ asynStatus asynPortDriver::doCallbacksEnum(char *strings[], int values[], int se
 {
     ELLLIST *pclientList;
     interruptNode *pnode;
-    int addr;
 
     pasynManager->interruptStart(this->asynStdInterfaces.enumInterruptPvt, &pclientList);
-    pnode = (interruptNode *)ellFirst(pclientList);
-    while (pnode) {
+    interruptClientIterator clients(pclientList, reason, address);
+    while ((pnode = clients.next())) {
         asynEnumInterrupt *pInterrupt = (asynEnumInterrupt *)pnode->drvPvt;
-        pasynManager->getAddr(pInterrupt->pasynUser, &addr);
-        /* If this is not a multi-device then address is -1, change to 0 */
-        if (addr == -1) addr = 0;
-        if ((pInterrupt->pasynUser->reason == reason) &&
-            (address == addr)) {
-            pInterrupt->callback(pInterrupt->userPvt,
-                                 pInterrupt->pasynUser,
-                                 strings, values, severities, nElements);
-        }
-        pnode = (interruptNode *)ellNext(&pnode->node);
+        pInterrupt->callback(pInterrupt->userPvt,
+                             pInterrupt->pasynUser,
+                             strings, values, severities, nElements);
     }
     pasynManager->interruptEnd(this->asynStdInterfaces.enumInterruptPvt);
     return(asynSuccess);
@@ -3129,6 +3649,16 @@ static asynDrvUser ifaceDrvUser = {
   * \param[in] interruptMask Bit mask definining the asyn interfaces that can generate interrupts (callbacks).
                The bit mask values are defined in asynPortDriver.h, e.g. asynInt8ArrayMask.
   * \param[in] asynFlags Flags when creating the asyn port driver; includes ASYN_CANBLOCK and ASYN_MULTIDEVICE.
+               If ASYN_LOCKFREE_READS is set then the C functions for the asynInt32, asynUInt32Digital,
+               asynFloat64 and asynOctet read methods call readInt32() etc. without taking the lock.
+               The base class methods only read the parameter library, which is safe without the lock.
+               A derived class that sets this flag must call lock() itself in any of these methods
+               it reimplements that need it.
+               A read sees the value and status of a parameter as they were after some set call,
+               not necessarily after all the calls a driver makes while it holds the lock.
+               If ASYN_LOCK_PER_ADDR is set then each address has its own lock, and the C functions
+               for the interfaces that read and write values call the driver with only the lock of
+               pasynUser's address held, see lockAddress().
   * \param[in] autoConnect The autoConnect flag for the asyn port driver. 
                1 if the driver should autoconnect.
   * \param[in] priority The thread priority for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
@@ -3136,9 +3666,13 @@ static asynDrvUser ifaceDrvUser = {
   * \param[in] stackSize The stack size for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
                If it is 0 then the default value of epicsThreadGetStackSize(epicsThreadStackMedium)
                will be assigned by asynManager.
+  * \param[in] numThreads The number of port threads if ASYN_CANBLOCK and ASYN_MULTIDEVICE are set in asynFlags.
+               If it is greater than 1 then ASYN_MULTITHREAD is set, and the threads call the driver for
+               different addresses concurrently. If it is 0 and ASYN_MULTITHREAD is set in asynFlags
+               then asynManager chooses the number. Defaults to 0.
   */
 asynPortDriver::asynPortDriver(const char *portNameIn, int maxAddrIn, int paramTableSize, int interfaceMask, int interruptMask,
-                               int asynFlags, int autoConnect, int priority, int stackSize)
+                               int asynFlags, int autoConnect, int priority, int stackSize, int numThreads)
 {
     asynStatus status;
     static const char *functionName = "asynPortDriver";
@@ -3154,6 +3688,15 @@ asynPortDriver::asynPortDriver(const char *portNameIn, int maxAddrIn, int paramT
     this->maxAddr = maxAddrIn;
     /* If maxAddr > 1 then set the ASYN_MULTIDEVICE flag even if the caller neglected to set it */
     if (this->maxAddr > 1) asynFlags |= ASYN_MULTIDEVICE;
+    this->lockFreeReads = (asynFlags & ASYN_LOCKFREE_READS) ? 1 : 0;
+    this->lockPerAddr = (asynFlags & ASYN_LOCK_PER_ADDR) ? 1 : 0;
+    asynFlags &= ~(ASYN_LOCKFREE_READS | ASYN_LOCK_PER_ADDR);
+    this->addrMutexIds = NULL;
+    this->addrUnlockedEvent = NULL;
+    this->addrLockCount = 0;
+    this->lockWaiting = 0;
+    this->lockOwner = 0;
+    this->lockDepth = 0;
     interfaceMask |= asynCommonMask;  /* Always need the asynCommon interface */
 
     /* Create the epicsMutex for locking access to data structures from other threads */
@@ -3162,17 +3705,29 @@ asynPortDriver::asynPortDriver(const char *portNameIn, int maxAddrIn, int paramT
         printf("%s::%s ERROR: epicsMutexCreate failure\n", driverName, functionName);
         return;
     }
+    if (this->lockPerAddr) {
+        this->addrUnlockedEvent = epicsEventMustCreate(epicsEventEmpty);
+        this->addrMutexIds = (epicsMutexId *)calloc(this->maxAddr, sizeof(epicsMutexId));
+        for (addr=0; addr<this->maxAddr; addr++) {
+            this->addrMutexIds[addr] = epicsMutexCreate();
+            if (!this->addrMutexIds[addr]) {
+                printf("%s::%s ERROR: epicsMutexCreate failure\n", driverName, functionName);
+                return;
+            }
+        }
+    }
     
     inputEosOctet = epicsStrDup("");
     inputEosLenOctet = 0;
     outputEosOctet = epicsStrDup("");
     outputEosLenOctet = 0;
 
-    status = pasynManager->registerPort(portName,
+    status = pasynManager->registerPortThreads(portName,
                                         asynFlags,    /* multidevice and canblock flags */
                                         autoConnect,  /* autoconnect flag */
                                         priority,     /* priority */
-                                        stackSize);   /* stack size */
+                                        stackSize,    /* stack size */
+                                        numThreads);  /* number of port threads */
     if (status != asynSuccess) {
         printf("%s:%s: ERROR: Can't register port\n", driverName, functionName);
     }
@@ -3184,10 +3739,10 @@ asynPortDriver::asynPortDriver(const char *portNameIn, int maxAddrIn, int paramT
     asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
         "%s:%s: creating port %s maxAddr=%d, paramTableSize=%d\n"
         "    interfaceMask=0x%X, interruptMask=0x%X\n"
-        "    asynFlags=0x%X, autoConnect=%d, priority=%d, stackSize=%d\n",
+        "    asynFlags=0x%X, autoConnect=%d, priority=%d, stackSize=%d, numThreads=%d\n",
         driverName, functionName, this->portName, this->maxAddr, paramTableSize, 
         interfaceMask, interruptMask, 
-        asynFlags, autoConnect, priority, stackSize);
+        asynFlags, autoConnect, priority, stackSize, numThreads);
 
      /* Set addresses of asyn interfaces */
     if (interfaceMask & asynCommonMask)         pInterfaces->common.pinterface        = (void *)&ifaceCommon;
@@ -3228,10 +3783,11 @@ asynPortDriver::asynPortDriver(const char *portNameIn, int maxAddrIn, int paramT
     }
 
     /* Allocate space for the parameter objects */
+    this->pSchema = new paramSchema(paramTableSize);
     this->params = (paramList **) calloc(maxAddr, sizeof(paramList *));    
     /* Initialize the parameter library */
     for (addr=0; addr<maxAddr; addr++) {
-        this->params[addr] = new paramList(paramTableSize, this);
+        this->params[addr] = new paramList(paramTableSize, this, this->pSchema);
     }
 
     /* Connect to our device for asynTrace */
@@ -3262,10 +3818,18 @@ asynPortDriver::~asynPortDriver()
     int addr;
 
     epicsMutexDestroy(this->mutexId);
+    if (this->addrMutexIds) {
+        for (addr=0; addr<this->maxAddr; addr++) {
+            if (this->addrMutexIds[addr]) epicsMutexDestroy(this->addrMutexIds[addr]);
+        }
+        free(this->addrMutexIds);
+    }
+    if (this->addrUnlockedEvent) epicsEventDestroy(this->addrUnlockedEvent);
     for (addr=0; addr<this->maxAddr; addr++) {
         delete this->params[addr];
     }
     free(this->params);
+    delete this->pSchema;
 
     pasynManager->freeAsynUser(this->pasynUserSelf);
     free(this->inputEosOctet);
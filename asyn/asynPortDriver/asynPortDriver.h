@@ -3,11 +3,13 @@
 
 #include <epicsTypes.h>
 #include <epicsMutex.h>
+#include <epicsEvent.h>
 
 #include <asynStandardInterfaces.h>
 #include "paramVal.h"
 
 class paramList;
+class paramSchema;
 
 epicsShareFunc void* findAsynPortDriver(const char *portName);
 typedef void (*userTimeStampFunction)(void *userPvt, epicsTimeStamp *pTimeStamp);
@@ -30,6 +32,21 @@ typedef void (*userTimeStampFunction)(void *userPvt, epicsTimeStamp *pTimeStamp)
 #define asynGenericPointerMask  0x00001000
 #define asynEnumMask            0x00002000
 
+/** asynFlags bit for the asynPortDriver constructor. It is not passed to asynManager.
+  * The readInt32, readUInt32Digital, readFloat64 and readOctet methods are called without
+  * the driver lock, see asynPortDriver::asynPortDriver */
+#define ASYN_LOCKFREE_READS     0x00010000
+
+/** asynFlags bit for the asynPortDriver constructor. It is not passed to asynManager.
+  * Each address has its own lock, see asynPortDriver::lockAddress.
+  * Lock order: the lock of the driver (mutexId) is always taken before the lock of an address.
+  * lockAddress() takes mutexId only to count itself in addrLockCount and then takes the lock of
+  * the address. lock() takes mutexId and then waits until addrLockCount is 0, so while it is held
+  * no address is locked by another thread. Hence a thread that holds the lock of an address must
+  * not call lock() or lockAddress() for another address. A thread that holds lock() may call
+  * lockAddress(), which it does not count, and must call unlockAddress() before unlock(). */
+#define ASYN_LOCK_PER_ADDR      0x00020000
+
 
 
 /** Base class for asyn port drivers; handles most of the bookkeeping for writing an asyn port driver
@@ -37,7 +54,8 @@ typedef void (*userTimeStampFunction)(void *userPvt, epicsTimeStamp *pTimeStamp)
 class epicsShareClass asynPortDriver {
 public:
     asynPortDriver(const char *portName, int maxAddr, int paramTableSize, int interfaceMask, int interruptMask,
-                   int asynFlags, int autoConnect, int priority, int stackSize);
+                   int asynFlags, int autoConnect, int priority, int stackSize,
+                   int numThreads=0);
     virtual ~asynPortDriver();
     virtual asynStatus lock();
     virtual asynStatus unlock();
@@ -161,10 +179,15 @@ public:
     virtual asynStatus setTimeStamp(const epicsTimeStamp *pTimeStamp);
     asynStandardInterfaces *getAsynStdInterfaces();
     virtual void reportParams(FILE *fp, int details);
+    /* Added after the existing virtual functions to keep their vtable slots */
+    virtual asynStatus lockAddress(int addr);
+    virtual asynStatus unlockAddress(int addr);
 
     char *portName;         /**< The name of this asyn port */
 
     int maxAddr;            /**< The maximum asyn address (addr) supported by this driver */
+    int lockFreeReads;      /**< 1 if ASYN_LOCKFREE_READS was set in asynFlags */
+    int lockPerAddr;        /**< 1 if ASYN_LOCK_PER_ADDR was set in asynFlags */
     void callbackTask();
 
 protected:
@@ -173,7 +196,14 @@ protected:
 
 private:
     paramList **params;
+    paramSchema *pSchema;
     epicsMutexId mutexId;
+    epicsMutexId *addrMutexIds; /**< One lock per address if lockPerAddr, else NULL */
+    epicsEventId addrUnlockedEvent; /**< Wakes lock() when addrLockCount drops to 0 */
+    int addrLockCount;          /**< Threads in or waiting for lockAddress(). Atomic */
+    int lockWaiting;            /**< lock() is waiting for addrLockCount to drop to 0. Atomic */
+    void *lockOwner;            /**< Thread that holds lock() if addrMutexIds, else 0. Atomic */
+    int lockDepth;              /**< Nesting of lock() by lockOwner */
     char *inputEosOctet;
     int inputEosLenOctet;
     char *outputEosOctet;
@@ -0,0 +1,117 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * asynPortDriverTest.cpp
+ *
+ * Tests of the asynPortDriver parameter library: set and get of each type,
+ * undefined values, wrong types, bad indices and the parameter status.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <asynPortDriver.h>
+#include "../paramErrors.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define MAX_ADDR 3
+#define NUM_PARAMS 20
+#define STRING_SIZE 100
+
+class testDriver : public asynPortDriver {
+public:
+    testDriver(const char *portName, int maxAddr, int asynFlags)
+        : asynPortDriver(portName, maxAddr, NUM_PARAMS,
+                         asynInt32Mask | asynUInt32DigitalMask | asynFloat64Mask |
+                         asynOctetMask | asynDrvUserMask,
+                         asynInt32Mask | asynFloat64Mask,
+                         ASYN_MULTIDEVICE | asynFlags, 1, 0, 0) {}
+};
+
+testDriver *pDriver;
+int intIndex, doubleIndex, uintIndex, stringIndex;
+
+void createTests()
+{
+    testDiag("createParam");
+    testOk(pDriver->createParam("INT", asynParamInt32, &intIndex) == asynSuccess,
+           "createParam INT in all lists");
+    pDriver->createParam("DOUBLE", asynParamFloat64, &doubleIndex);
+    pDriver->createParam("UINT", asynParamUInt32Digital, &uintIndex);
+    pDriver->createParam("STRING", asynParamOctet, &stringIndex);
+    testOk(intIndex == 0 && doubleIndex == 1 && uintIndex == 2 && stringIndex == 3,
+           "Parameters are numbered in order of creation");
+}
+
+void typeTests()
+{
+    int intValue;
+    epicsUInt32 uintValue;
+    double doubleValue;
+    char stringValue[STRING_SIZE];
+    asynStatus status;
+
+    testDiag("Undefined parameters");
+    testOk(pDriver->getIntegerParam(0, intIndex, &intValue) == asynParamUndefined,
+           "getIntegerParam before the first set returns asynParamUndefined");
+    testOk(pDriver->getUIntDigitalParam(0, uintIndex, &uintValue, 0xFFFFFFFF) == asynParamUndefined,
+           "getUIntDigitalParam before the first set returns asynParamUndefined");
+    testOk(pDriver->getDoubleParam(0, doubleIndex, &doubleValue) == asynParamUndefined,
+           "getDoubleParam before the first set returns asynParamUndefined");
+    testOk(pDriver->getStringParam(0, stringIndex, STRING_SIZE, stringValue) == asynParamUndefined,
+           "getStringParam before the first set returns asynParamUndefined");
+
+    testDiag("Set and get of each type");
+    pDriver->setIntegerParam(0, intIndex, -12);
+    testOk(pDriver->getIntegerParam(0, intIndex, &intValue) == asynSuccess && intValue == -12,
+           "getIntegerParam returns the value that was set");
+    pDriver->setUIntDigitalParam(0, uintIndex, 0xFF00FF00, 0xFFFFFFFF);
+    pDriver->setUIntDigitalParam(0, uintIndex, 0x000000FF, 0x0000FFFF);
+    testOk(pDriver->getUIntDigitalParam(0, uintIndex, &uintValue, 0xFFFFFFFF) == asynSuccess &&
+           uintValue == 0xFF0000FF, "setUIntDigitalParam changes only the bits in valueMask");
+    testOk(pDriver->getUIntDigitalParam(0, uintIndex, &uintValue, 0x0000FFFF) == asynSuccess &&
+           uintValue == 0x000000FF, "getUIntDigitalParam applies the mask");
+    pDriver->setDoubleParam(0, doubleIndex, 3.25);
+    testOk(pDriver->getDoubleParam(0, doubleIndex, &doubleValue) == asynSuccess && doubleValue == 3.25,
+           "getDoubleParam returns the value that was set");
+    pDriver->setStringParam(0, stringIndex, "abcdef");
+    testOk(pDriver->getStringParam(0, stringIndex, STRING_SIZE, stringValue) == asynSuccess &&
+           strcmp(stringValue, "abcdef") == 0, "getStringParam returns the value that was set");
+    testOk(pDriver->getStringParam(0, stringIndex, 4, stringValue) == asynSuccess &&
+           strcmp(stringValue, "abc") == 0, "getStringParam truncates to maxChars");
+    testOk(pDriver->getIntegerParam(1, intIndex, &intValue) == asynParamUndefined,
+           "The same parameter in list 1 is still undefined");
+    pDriver->setIntegerParam(1, intIndex, 7);
+    pDriver->getIntegerParam(0, intIndex, &intValue);
+    testOk(intValue == -12, "Setting list 1 does not change list 0");
+
+    testDiag("Wrong type and bad index");
+    testOk(pDriver->setIntegerParam(0, doubleIndex, 1) == asynParamWrongType,
+           "setIntegerParam of a Float64 parameter returns asynParamWrongType");
+    testOk(pDriver->getDoubleParam(0, stringIndex, &doubleValue) == asynParamWrongType,
+           "getDoubleParam of an Octet parameter returns asynParamWrongType");
+    testOk(pDriver->getIntegerParam(0, NUM_PARAMS, &intValue) == asynParamBadIndex,
+           "getIntegerParam of an index beyond the list returns asynParamBadIndex");
+
+    testDiag("Parameter status");
+    pDriver->setParamStatus(0, doubleIndex, asynTimeout);
+    testOk(pDriver->getParamStatus(0, doubleIndex, &status) == asynSuccess && status == asynTimeout,
+           "getParamStatus returns the status that was set");
+    pDriver->setParamStatus(0, doubleIndex, asynSuccess);
+}
+
+MAIN(asynPortDriverTest)
+{
+    int totalTests = 2 + 16;
+    testPlan(totalTests);
+    pDriver = new testDriver("PORTDRIVERTEST", MAX_ADDR, 0);
+    createTests();
+    typeTests();
+    return testDone();
+}
@@ -0,0 +1,74 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramCallbackBench.cpp
+ *
+ * Measures the cost of changing nUpdate parameters with setIntegerParam and
+ * then calling callParamCallbacks, as a driver does in each poll cycle.
+ * The parameters are changed in reverse order of parameter number.
+ * Usage: paramCallbackBench [nCycles]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsTime.h>
+#include <asynPortDriver.h>
+
+#define NUM_PARAMS 5000
+
+class callbackBenchDriver : public asynPortDriver {
+public:
+    callbackBenchDriver(const char *portName, int nParams)
+        : asynPortDriver(portName, 1, nParams, asynInt32Mask | asynDrvUserMask,
+                         asynInt32Mask, 0, 1, 0, 0) {}
+};
+
+static void bench(callbackBenchDriver *pDriver, int nUpdate, int nCycles)
+{
+    epicsTimeStamp start, end;
+    double setTime = 0., callbackTime = 0.;
+    int cycle, i;
+
+    for (cycle = 0; cycle < nCycles; cycle++) {
+        epicsTimeGetCurrent(&start);
+        for (i = nUpdate-1; i >= 0; i--)
+            pDriver->setIntegerParam(i, cycle);
+        epicsTimeGetCurrent(&end);
+        setTime += epicsTimeDiffInSeconds(&end, &start);
+        pDriver->callParamCallbacks();
+        epicsTimeGetCurrent(&start);
+        callbackTime += epicsTimeDiffInSeconds(&start, &end);
+    }
+    printf("%6d updates: setIntegerParam %8.3f us/param, callParamCallbacks %8.3f us/param, "
+           "cycle %9.3f us\n",
+           nUpdate, setTime*1e6/((double)nUpdate*nCycles),
+           callbackTime*1e6/((double)nUpdate*nCycles),
+           (setTime + callbackTime)*1e6/nCycles);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int nUpdate[] = {10, 100, 500, 1000, 2000, 5000};
+    callbackBenchDriver *pDriver;
+    char name[32];
+    int nCycles = 100;
+    unsigned int i;
+    int index;
+
+    if (argc > 1) nCycles = atoi(argv[1]);
+    if (nCycles < 1) nCycles = 1;
+    pDriver = new callbackBenchDriver("CALLBACKBENCH", NUM_PARAMS);
+    for (i = 0; i < NUM_PARAMS; i++) {
+        sprintf(name, "PARAM_NUMBER_%d", i);
+        pDriver->createParam(name, asynParamInt32, &index);
+    }
+    for (i = 0; i < sizeof(nUpdate)/sizeof(nUpdate[0]); i++)
+        bench(pDriver, nUpdate[i], nCycles);
+    return 0;
+}
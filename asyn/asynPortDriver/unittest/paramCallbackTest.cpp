@@ -0,0 +1,255 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramCallbackTest.cpp
+ *
+ * Tests of callParamCallbacks and the bitset of changed parameters: only
+ * changed parameters are called back, in order of parameter number, across
+ * the 32 bit words of the bitset, and a parameter that a callback sets is
+ * called back once, in the same pass or by the next callParamCallbacks.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <asynPortDriver.h>
+#include "../paramErrors.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+/* callParamCallbacks does nothing until interruptAccept is set by iocInit */
+#ifndef EPICS_LIBCOM_ONLY
+    #include <dbAccess.h>
+#endif
+
+#define MAX_ADDR 2
+/* More than three words of the bitset */
+#define NUM_PARAMS 100
+#define DOUBLE_INDEX 1
+#define MAX_CALLS 20
+
+class callbackDriver : public asynPortDriver {
+public:
+    callbackDriver(const char *portName)
+        : asynPortDriver(portName, MAX_ADDR, NUM_PARAMS,
+                         asynInt32Mask | asynFloat64Mask | asynDrvUserMask,
+                         asynInt32Mask | asynFloat64Mask,
+                         ASYN_MULTIDEVICE, 1, 0, 0) {}
+};
+
+callbackDriver *pDriver;
+
+/* Reasons and addresses of the callbacks in the order they were called */
+int calledReason[MAX_CALLS];
+int calledAddr[MAX_CALLS];
+int numCalled;
+/* When the callback of setTrigger is called it sets setTarget, -1 for none */
+int setTrigger = -1;
+int setTarget = -1;
+
+void recordCallback(asynUser *pasynUser, void *userPvt)
+{
+    if (numCalled < MAX_CALLS) {
+        calledReason[numCalled] = pasynUser->reason;
+        calledAddr[numCalled] = (int)(size_t)userPvt;
+    }
+    numCalled++;
+    if (pasynUser->reason == setTrigger && setTarget >= 0) {
+        pDriver->setIntegerParam(setTarget, numCalled);
+        setTarget = -1;
+    }
+}
+
+extern "C" {
+static void int32Callback(void *userPvt, asynUser *pasynUser, epicsInt32 value)
+{
+    recordCallback(pasynUser, userPvt);
+}
+
+static void float64Callback(void *userPvt, asynUser *pasynUser, epicsFloat64 value)
+{
+    recordCallback(pasynUser, userPvt);
+}
+}
+
+bool calledInOrder(const int *reasons, int numReasons)
+{
+    if (numCalled != numReasons) return false;
+    return memcmp(calledReason, reasons, numReasons*sizeof(int)) == 0;
+}
+
+void createParams()
+{
+    asynUser *pasynUser;
+    asynInterface *pInterface;
+    void *interruptPvt;
+    char name[32];
+    int index, addr, i;
+
+    for (i = 0; i < NUM_PARAMS; i++) {
+        if (i == DOUBLE_INDEX) {
+            pDriver->createParam("DOUBLE", asynParamFloat64, &index);
+        } else {
+            sprintf(name, "INT_%d", i);
+            pDriver->createParam(name, asynParamInt32, &index);
+        }
+    }
+    for (addr = 0; addr < MAX_ADDR; addr++) {
+        for (i = 0; i < NUM_PARAMS; i++) {
+            pasynUser = pasynManager->createAsynUser(0, 0);
+            pasynManager->connectDevice(pasynUser, "PARAMCALLBACKTEST", addr);
+            pasynUser->reason = i;
+            if (i == DOUBLE_INDEX) {
+                pInterface = pasynManager->findInterface(pasynUser, asynFloat64Type, 1);
+                ((asynFloat64 *)pInterface->pinterface)->registerInterruptUser(pInterface->drvPvt,
+                    pasynUser, float64Callback, (void *)(size_t)addr, &interruptPvt);
+            } else {
+                pInterface = pasynManager->findInterface(pasynUser, asynInt32Type, 1);
+                ((asynInt32 *)pInterface->pinterface)->registerInterruptUser(pInterface->drvPvt,
+                    pasynUser, int32Callback, (void *)(size_t)addr, &interruptPvt);
+            }
+        }
+    }
+}
+
+void orderTests()
+{
+    int i;
+
+    testDiag("Order of callbacks");
+    for (i = 0; i < NUM_PARAMS; i++) {
+        if (i == DOUBLE_INDEX) pDriver->setDoubleParam(i, 0.5);
+        else pDriver->setIntegerParam(i, 0);
+    }
+    pDriver->callParamCallbacks();
+    testOk(numCalled == NUM_PARAMS, "First call does the callbacks of all defined parameters");
+
+    numCalled = 0;
+    pDriver->setIntegerParam(99, 1);
+    pDriver->setIntegerParam(64, 1);
+    pDriver->setIntegerParam(63, 1);
+    pDriver->setIntegerParam(32, 1);
+    pDriver->setDoubleParam(DOUBLE_INDEX, 4.5);
+    pDriver->setIntegerParam(31, 1);
+    pDriver->setIntegerParam(0, 1);
+    pDriver->callParamCallbacks();
+    {
+        int expected[] = {0, DOUBLE_INDEX, 31, 32, 63, 64, 99};
+        testOk(calledInOrder(expected, 7),
+               "Changed parameters in several words are called back in order of number");
+    }
+    numCalled = 0;
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 0, "No callbacks when no parameter changed");
+
+    numCalled = 0;
+    pDriver->setIntegerParam(40, 0);
+    pDriver->setIntegerParam(50, 0);
+    pDriver->setDoubleParam(DOUBLE_INDEX, 4.5);
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 0, "Setting the values that parameters already have does no callbacks");
+
+    numCalled = 0;
+    pDriver->setParamStatus(70, asynError);
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 1 && calledReason[0] == 70,
+           "Changing the status of a parameter does its callback");
+    pDriver->setParamStatus(70, asynSuccess);
+    pDriver->callParamCallbacks();
+}
+
+void setInCallbackTests()
+{
+    testDiag("Parameters set by a callback");
+    numCalled = 0;
+    pDriver->setIntegerParam(10, 2);
+    pDriver->setIntegerParam(20, 2);
+    pDriver->setIntegerParam(85, 2);
+    setTrigger = 10;
+    setTarget = 80;
+    pDriver->callParamCallbacks();
+    {
+        int expected[] = {10, 20, 80, 85};
+        testOk(calledInOrder(expected, 4),
+               "A parameter that a callback sets in a word that has changes is called back in the same pass");
+    }
+
+    numCalled = 0;
+    pDriver->setIntegerParam(10, 3);
+    pDriver->setIntegerParam(20, 3);
+    setTrigger = 10;
+    setTarget = 90;
+    pDriver->callParamCallbacks();
+    pDriver->callParamCallbacks();
+    {
+        int expected[] = {10, 20, 90};
+        testOk(calledInOrder(expected, 3),
+               "A parameter that a callback sets in a word without changes is called back once");
+    }
+
+    numCalled = 0;
+    pDriver->setIntegerParam(12, 3);
+    pDriver->setIntegerParam(14, 3);
+    setTrigger = 14;
+    setTarget = 13;
+    pDriver->callParamCallbacks();
+    {
+        int expected[] = {12, 14};
+        testOk(calledInOrder(expected, 2),
+               "A parameter that a callback sets before its own number is not called back");
+    }
+    numCalled = 0;
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 1 && calledReason[0] == 13,
+           "It is called back by the next callParamCallbacks");
+
+    numCalled = 0;
+    pDriver->setIntegerParam(66, 4);
+    setTrigger = 66;
+    setTarget = 3;
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 1 && calledReason[0] == 66,
+           "A parameter that a callback sets in an earlier word is not called back");
+    numCalled = 0;
+    pDriver->callParamCallbacks();
+    testOk(numCalled == 1 && calledReason[0] == 3,
+           "It is called back by the next callParamCallbacks");
+}
+
+void listTests()
+{
+    testDiag("Lists");
+    numCalled = 0;
+    pDriver->setIntegerParam(1, 33, 5);
+    pDriver->setIntegerParam(1, 90, 5);
+    pDriver->callParamCallbacks(0, 0);
+    testOk(numCalled == 0, "Changes in list 1 are not called back for list 0");
+
+    numCalled = 0;
+    pDriver->callParamCallbacks(1, 1);
+    testOk(numCalled == 2 && calledReason[0] == 33 && calledReason[1] == 90 &&
+           calledAddr[0] == 1 && calledAddr[1] == 1,
+           "They are called back for address 1 by callParamCallbacks(1, 1)");
+}
+
+MAIN(paramCallbackTest)
+{
+    testPlan(5 + 6 + 2);
+#ifndef EPICS_LIBCOM_ONLY
+    interruptAccept = 1;
+#endif
+    pDriver = new callbackDriver("PARAMCALLBACKTEST");
+    createParams();
+    /* Holding the lock keeps other threads from calling back the changes */
+    pDriver->lock();
+    orderTests();
+    setInCallbackTests();
+    listTests();
+    pDriver->unlock();
+    return testDone();
+}
@@ -0,0 +1,214 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramLockFreeTest.cpp
+ *
+ * Tests of ASYN_LOCKFREE_READS: the read methods of the standard interfaces
+ * do not wait for the lock of the driver, and reads that overlap a writer
+ * never return a string that is half written or an older integer.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <asynPortDriver.h>
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define NUM_PARAMS 4
+#define COUNTER_INDEX 0
+#define STRING_INDEX 1
+#define DOUBLE_INDEX 2
+#define MIN_LOCKFREE_READS 100000
+#define MIN_WRITER_CYCLES 10000
+#define STRING_SIZE 100
+#define READ_TIMEOUT 2.0
+#define BLOCKED_TIMEOUT 0.2
+
+class lockFreeDriver : public asynPortDriver {
+public:
+    lockFreeDriver(const char *portName, int asynFlags)
+        : asynPortDriver(portName, 1, NUM_PARAMS,
+                         asynInt32Mask | asynFloat64Mask | asynOctetMask | asynDrvUserMask,
+                         asynInt32Mask | asynFloat64Mask | asynOctetMask,
+                         asynFlags, 1, 0, 0)
+    {
+        int index;
+        createParam("COUNTER", asynParamInt32, &index);
+        createParam("STRING", asynParamOctet, &index);
+        createParam("DOUBLE", asynParamFloat64, &index);
+        setIntegerParam(COUNTER_INDEX, 0);
+        setStringParam(STRING_INDEX, "");
+        setDoubleParam(DOUBLE_INDEX, 1.5);
+    }
+};
+
+typedef struct portClient {
+    asynUser *pasynUser;
+    asynInterface *pInt32Interface;
+    asynInterface *pFloat64Interface;
+    asynInterface *pOctetInterface;
+} portClient;
+
+void connectClient(portClient *pclient, const char *portName)
+{
+    pclient->pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pclient->pasynUser, portName, 0);
+    pclient->pInt32Interface = pasynManager->findInterface(pclient->pasynUser, asynInt32Type, 1);
+    pclient->pFloat64Interface = pasynManager->findInterface(pclient->pasynUser, asynFloat64Type, 1);
+    pclient->pOctetInterface = pasynManager->findInterface(pclient->pasynUser, asynOctetType, 1);
+}
+
+lockFreeDriver *pLockFreeDriver;
+portClient blockedClient;
+epicsEventId readDone;
+
+extern "C" {
+/* Does one read of each type through the C interfaces */
+static void readerThread(void *arg)
+{
+    portClient *pclient = &blockedClient;
+    asynUser *pasynUser = pclient->pasynUser;
+    epicsInt32 intValue;
+    epicsFloat64 doubleValue;
+    char value[STRING_SIZE];
+    size_t nRead;
+    int eomReason;
+
+    pasynUser->reason = COUNTER_INDEX;
+    ((asynInt32 *)pclient->pInt32Interface->pinterface)->read(
+        pclient->pInt32Interface->drvPvt, pasynUser, &intValue);
+    pasynUser->reason = DOUBLE_INDEX;
+    ((asynFloat64 *)pclient->pFloat64Interface->pinterface)->read(
+        pclient->pFloat64Interface->drvPvt, pasynUser, &doubleValue);
+    pasynUser->reason = STRING_INDEX;
+    ((asynOctet *)pclient->pOctetInterface->pinterface)->read(
+        pclient->pOctetInterface->drvPvt, pasynUser, value, sizeof(value), &nRead, &eomReason);
+    epicsEventSignal(readDone);
+}
+}
+
+/* Returns true if readerThread finished while another thread held lock() */
+bool readWhileLocked(asynPortDriver *pDriver, const char *portName, double timeout)
+{
+    epicsEventWaitStatus status;
+
+    connectClient(&blockedClient, portName);
+    pDriver->lock();
+    epicsThreadCreate("lockFreeReader", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), readerThread, 0);
+    status = epicsEventWaitWithTimeout(readDone, timeout);
+    pDriver->unlock();
+    /* Let a blocked reader finish before its client is freed */
+    if (status != epicsEventWaitOK) epicsEventMustWait(readDone);
+    pasynManager->freeAsynUser(blockedClient.pasynUser);
+    return status == epicsEventWaitOK;
+}
+
+void lockTests()
+{
+    lockFreeDriver *pLockedDriver;
+
+    testDiag("Reads and lock()");
+    readDone = epicsEventMustCreate(epicsEventEmpty);
+    pLockFreeDriver = new lockFreeDriver("LOCKFREETEST", ASYN_LOCKFREE_READS);
+    testOk(pLockFreeDriver->lockFreeReads == 1, "ASYN_LOCKFREE_READS enables lock-free reads");
+    testOk(readWhileLocked(pLockFreeDriver, "LOCKFREETEST", READ_TIMEOUT),
+           "Int32, Float64 and Octet reads finish while another thread holds lock()");
+    pLockedDriver = new lockFreeDriver("LOCKEDTEST", 0);
+    testOk(pLockedDriver->lockFreeReads == 0, "Without the flag reads are locked");
+    testOk(!readWhileLocked(pLockedDriver, "LOCKEDTEST", BLOCKED_TIMEOUT),
+           "Without the flag reads wait for lock()");
+}
+
+epicsEventId writerDone;
+volatile int stopWriter;
+volatile int writerCycles;
+
+extern "C" {
+static void lockFreeWriter(void *arg)
+{
+    char value[STRING_SIZE];
+    int n;
+
+    for (writerCycles = 1; !stopWriter; writerCycles++) {
+        /* Strings of one repeated character, whose length changes on each cycle */
+        n = writerCycles % (STRING_SIZE - 1);
+        memset(value, 'a' + writerCycles % 26, n);
+        value[n] = 0;
+        pLockFreeDriver->lock();
+        pLockFreeDriver->setIntegerParam(COUNTER_INDEX, writerCycles);
+        pLockFreeDriver->setStringParam(STRING_INDEX, value);
+        pLockFreeDriver->callParamCallbacks();
+        pLockFreeDriver->unlock();
+    }
+    epicsEventSignal(writerDone);
+}
+}
+
+void overlapTests()
+{
+    portClient client;
+    asynUser *pasynUser;
+    asynInt32 *pInt32;
+    asynOctet *pOctet;
+    char value[STRING_SIZE];
+    epicsInt32 intValue, lastValue = 0;
+    size_t nRead;
+    int eomReason, numReads, k, length;
+    int nTorn = 0, nDecreasing = 0, nChanged = 0;
+
+    testDiag("Reads that overlap a writer");
+    connectClient(&client, "LOCKFREETEST");
+    pasynUser = client.pasynUser;
+    pInt32 = (asynInt32 *)client.pInt32Interface->pinterface;
+    pOctet = (asynOctet *)client.pOctetInterface->pinterface;
+
+    writerDone = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("lockFreeWriter", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), lockFreeWriter, 0);
+    /* Keep reading until the writer has done many cycles, so that reads overlap writes */
+    for (numReads = 0; numReads < MIN_LOCKFREE_READS || writerCycles < MIN_WRITER_CYCLES;
+         numReads++) {
+        pasynUser->reason = COUNTER_INDEX;
+        if (pInt32->read(client.pInt32Interface->drvPvt, pasynUser, &intValue) == asynSuccess) {
+            if (intValue < lastValue) nDecreasing++;
+            if (intValue != lastValue) nChanged++;
+            lastValue = intValue;
+        }
+        pasynUser->reason = STRING_INDEX;
+        if (pOctet->read(client.pOctetInterface->drvPvt, pasynUser, value, sizeof(value),
+                         &nRead, &eomReason) == asynSuccess) {
+            length = (int)strlen(value);
+            for (k = 1; k < length; k++) {
+                if (value[k] != value[0]) {
+                    nTorn++;
+                    break;
+                }
+            }
+        }
+    }
+    stopWriter = 1;
+    epicsEventMustWait(writerDone);
+    testDiag("%d reads, %d writer cycles, value changed %d times", numReads,
+             (int)writerCycles, nChanged);
+    testOk(nChanged > 1, "Reads saw the values of several writer cycles");
+    testOk(nTorn == 0, "No string read while it was being written is mixed");
+    testOk(nDecreasing == 0, "Successive integer reads never go back");
+    pasynManager->freeAsynUser(pasynUser);
+}
+
+MAIN(paramLockFreeTest)
+{
+    testPlan(4 + 3);
+    lockTests();
+    overlapTests();
+    return testDone();
+}
@@ -0,0 +1,276 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramLockPerAddrTest.cpp
+ *
+ * Tests of ASYN_LOCK_PER_ADDR: threads that hold the locks of different
+ * addresses run at the same time, lock() waits until no other thread holds
+ * an address and keeps them out while it is held, and writers of different
+ * addresses that call callParamCallbacks(addr, addr) concurrently only call
+ * back their own values.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <asynPortDriver.h>
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+/* callParamCallbacks does nothing until interruptAccept is set by iocInit */
+#ifndef EPICS_LIBCOM_ONLY
+    #include <dbAccess.h>
+#endif
+
+#define MAX_ADDR 4
+#define NUM_PARAMS 8
+#define MIN_WRITER_CYCLES 2000
+#define MIN_CHECKS 200
+/* The values of address addr are addr*VALUE_STEP + the cycle of its writer */
+#define VALUE_STEP 1000000
+#define WAIT_TIMEOUT 2.0
+#define BLOCKED_TIMEOUT 0.2
+
+class perAddrDriver : public asynPortDriver {
+public:
+    perAddrDriver(const char *portName)
+        : asynPortDriver(portName, MAX_ADDR, NUM_PARAMS,
+                         asynInt32Mask | asynDrvUserMask, asynInt32Mask,
+                         ASYN_MULTIDEVICE | ASYN_LOCK_PER_ADDR, 1, 0, 0)
+    {
+        char name[32];
+        int index, i;
+        for (i = 0; i < NUM_PARAMS; i++) {
+            sprintf(name, "VALUE_%d", i);
+            createParam(name, asynParamInt32, &index);
+        }
+    }
+};
+
+perAddrDriver *pDriver;
+
+/* A thread that takes a lock, signals locked and keeps the lock until release */
+typedef struct lockHolder {
+    int addr;           /* -1 for lock() */
+    epicsEventId locked;
+    epicsEventId release;
+    epicsEventId done;
+} lockHolder;
+
+extern "C" {
+static void lockHolderThread(void *arg)
+{
+    lockHolder *pholder = (lockHolder *)arg;
+
+    if (pholder->addr < 0) pDriver->lock();
+    else pDriver->lockAddress(pholder->addr);
+    epicsEventSignal(pholder->locked);
+    epicsEventMustWait(pholder->release);
+    if (pholder->addr < 0) pDriver->unlock();
+    else pDriver->unlockAddress(pholder->addr);
+    epicsEventSignal(pholder->done);
+}
+}
+
+void startHolder(lockHolder *pholder, int addr)
+{
+    pholder->addr = addr;
+    pholder->locked = epicsEventMustCreate(epicsEventEmpty);
+    pholder->release = epicsEventMustCreate(epicsEventEmpty);
+    pholder->done = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("lockHolder", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall), lockHolderThread, pholder);
+}
+
+bool holderLocked(lockHolder *pholder, double timeout)
+{
+    return epicsEventWaitWithTimeout(pholder->locked, timeout) == epicsEventWaitOK;
+}
+
+void stopHolder(lockHolder *pholder)
+{
+    epicsEventSignal(pholder->release);
+    epicsEventMustWait(pholder->done);
+    epicsEventDestroy(pholder->locked);
+    epicsEventDestroy(pholder->release);
+    epicsEventDestroy(pholder->done);
+}
+
+void exclusionTests()
+{
+    lockHolder holder1, holder2, portHolder;
+    asynUser *pasynUser;
+    asynInterface *pInterface;
+    asynStatus status;
+    bool blocked, locked;
+
+    testDiag("Exclusion");
+    testOk(pDriver->lockPerAddr == 1, "ASYN_LOCK_PER_ADDR enables the locks of the addresses");
+
+    startHolder(&holder1, 1);
+    holderLocked(&holder1, WAIT_TIMEOUT);
+    startHolder(&holder2, 2);
+    testOk(holderLocked(&holder2, WAIT_TIMEOUT),
+           "A thread locks address 2 while another thread holds address 1");
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "PARAMLOCKPERADDRTEST", 3);
+    pInterface = pasynManager->findInterface(pasynUser, asynInt32Type, 1);
+    pasynUser->reason = 0;
+    testOk(((asynInt32 *)pInterface->pinterface)->write(pInterface->drvPvt, pasynUser, 5)
+               == asynSuccess, "A write to address 3 completes while addresses 1 and 2 are held");
+    pasynManager->freeAsynUser(pasynUser);
+
+    startHolder(&portHolder, -1);
+    blocked = !holderLocked(&portHolder, BLOCKED_TIMEOUT);
+    testOk(blocked, "lock() waits while other threads hold addresses");
+    stopHolder(&holder1);
+    blocked = !holderLocked(&portHolder, BLOCKED_TIMEOUT);
+    testOk(blocked, "lock() still waits while one address is held");
+    stopHolder(&holder2);
+    testOk(holderLocked(&portHolder, WAIT_TIMEOUT),
+           "lock() gets the driver when no address is held");
+
+    startHolder(&holder1, 1);
+    blocked = !holderLocked(&holder1, BLOCKED_TIMEOUT);
+    testOk(blocked, "lockAddress() waits while another thread holds lock()");
+    stopHolder(&portHolder);
+    locked = holderLocked(&holder1, WAIT_TIMEOUT);
+    testOk(locked, "lockAddress() gets the address after unlock()");
+    stopHolder(&holder1);
+
+    pDriver->lock();
+    status = pDriver->lockAddress(2);
+    if (status == asynSuccess) pDriver->unlockAddress(2);
+    pDriver->unlock();
+    testOk(status == asynSuccess, "The thread that holds lock() may lock an address");
+}
+
+volatile int stopThreads;
+volatile int writerCycles[MAX_ADDR];
+int numChecks;
+int numInconsistent;
+epicsEventId threadDone;
+/* Counts of the callbacks of each address, only changed by its own writer */
+int numCallbacks[MAX_ADDR];
+int numForeign[MAX_ADDR];
+
+extern "C" {
+static void int32Callback(void *userPvt, asynUser *pasynUser, epicsInt32 value)
+{
+    int addr = (int)(size_t)userPvt;
+
+    numCallbacks[addr]++;
+    if (value / VALUE_STEP != addr) numForeign[addr]++;
+}
+
+/* Sets all parameters of its address on each cycle and calls them back */
+static void addrWriter(void *arg)
+{
+    int addr = (int)(size_t)arg;
+    int cycle, i;
+
+    for (cycle = 1; !stopThreads; cycle++) {
+        pDriver->lockAddress(addr);
+        for (i = 0; i < NUM_PARAMS; i++)
+            pDriver->setIntegerParam(addr, i, addr*VALUE_STEP + cycle);
+        pDriver->callParamCallbacks(addr, addr);
+        pDriver->unlockAddress(addr);
+        writerCycles[addr] = cycle;
+    }
+    epicsEventSignal(threadDone);
+}
+
+/* With lock() held all parameters of each address must be from one cycle */
+static void lockChecker(void *arg)
+{
+    int addr, i, first, value;
+
+    while (!stopThreads) {
+        pDriver->lock();
+        for (addr = 0; addr < MAX_ADDR; addr++) {
+            pDriver->getIntegerParam(addr, 0, &first);
+            for (i = 1; i < NUM_PARAMS; i++) {
+                pDriver->getIntegerParam(addr, i, &value);
+                if (value != first) {
+                    numInconsistent++;
+                    break;
+                }
+            }
+        }
+        numChecks++;
+        pDriver->unlock();
+        epicsThreadSleep(0.0);
+    }
+    epicsEventSignal(threadDone);
+}
+}
+
+void writerTests()
+{
+    asynUser *pasynUser;
+    asynInterface *pInterface;
+    void *interruptPvt;
+    int addr, i, minCycles;
+    bool allCalled = true, noneForeign = true;
+
+    testDiag("Concurrent writers of different addresses");
+    for (addr = 0; addr < MAX_ADDR; addr++) {
+        for (i = 0; i < NUM_PARAMS; i++) {
+            pDriver->setIntegerParam(addr, i, addr*VALUE_STEP);
+            pasynUser = pasynManager->createAsynUser(0, 0);
+            pasynManager->connectDevice(pasynUser, "PARAMLOCKPERADDRTEST", addr);
+            pasynUser->reason = i;
+            pInterface = pasynManager->findInterface(pasynUser, asynInt32Type, 1);
+            ((asynInt32 *)pInterface->pinterface)->registerInterruptUser(pInterface->drvPvt,
+                pasynUser, int32Callback, (void *)(size_t)addr, &interruptPvt);
+        }
+        pDriver->callParamCallbacks(addr, addr);
+        numCallbacks[addr] = 0;
+    }
+
+    threadDone = epicsEventMustCreate(epicsEventEmpty);
+    for (addr = 0; addr < MAX_ADDR; addr++)
+        epicsThreadCreate("addrWriter", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          addrWriter, (void *)(size_t)addr);
+    epicsThreadCreate("lockChecker", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), lockChecker, 0);
+    do {
+        epicsThreadSleep(0.1);
+        minCycles = writerCycles[0];
+        for (addr = 1; addr < MAX_ADDR; addr++)
+            if (writerCycles[addr] < minCycles) minCycles = writerCycles[addr];
+    } while (minCycles < MIN_WRITER_CYCLES || numChecks < MIN_CHECKS);
+    stopThreads = 1;
+    for (i = 0; i < MAX_ADDR + 1; i++) epicsEventMustWait(threadDone);
+
+    for (addr = 0; addr < MAX_ADDR; addr++) {
+        testDiag("Address %d: %d cycles, %d callbacks", addr,
+                 (int)writerCycles[addr], numCallbacks[addr]);
+        if (numCallbacks[addr] != writerCycles[addr]*NUM_PARAMS) allCalled = false;
+        if (numForeign[addr] != 0) noneForeign = false;
+    }
+    testDiag("lock() checked all addresses %d times", numChecks);
+    testOk(allCalled, "Every change of each address is called back once");
+    testOk(noneForeign, "The callbacks of each address only get the values of its writer");
+    testOk(numInconsistent == 0, "lock() never sees an address in the middle of a cycle");
+}
+
+MAIN(paramLockPerAddrTest)
+{
+    testPlan(9 + 3);
+#ifndef EPICS_LIBCOM_ONLY
+    interruptAccept = 1;
+#endif
+    pDriver = new perAddrDriver("PARAMLOCKPERADDRTEST");
+    exclusionTests();
+    writerTests();
+    return testDone();
+}
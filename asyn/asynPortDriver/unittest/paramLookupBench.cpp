@@ -0,0 +1,86 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramLookupBench.cpp
+ *
+ * Measures the cost of createParam and of drvUserCreate, which looks up the
+ * drvInfo string with findParam, as a function of the number of parameters.
+ * Every parameter is looked up once for every address, as records do at iocInit.
+ * Usage: paramLookupBench [maxAddr]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsTime.h>
+#include <asynPortDriver.h>
+
+class lookupBenchDriver : public asynPortDriver {
+public:
+    lookupBenchDriver(const char *portName, int maxAddr, int nParams)
+        : asynPortDriver(portName, maxAddr, nParams, asynInt32Mask | asynDrvUserMask,
+                         asynInt32Mask, 0, 1, 0, 0) {}
+};
+
+static void bench(int nParams, int maxAddr)
+{
+    char portName[32], name[32];
+    lookupBenchDriver *pDriver;
+    asynUser **pasynUsers;
+    epicsTimeStamp start, end;
+    double createTime, lookupTime;
+    const char *typeName;
+    size_t size;
+    int addr, i, index, nErrors = 0;
+
+    sprintf(portName, "LOOKUP%d", nParams);
+    pDriver = new lookupBenchDriver(portName, maxAddr, nParams);
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < nParams; i++) {
+        sprintf(name, "PARAM_NUMBER_%d", i);
+        if (pDriver->createParam(name, asynParamInt32, &index)) nErrors++;
+    }
+    epicsTimeGetCurrent(&end);
+    createTime = epicsTimeDiffInSeconds(&end, &start);
+
+    pasynUsers = (asynUser **)calloc(maxAddr, sizeof(asynUser *));
+    for (addr = 0; addr < maxAddr; addr++) {
+        pasynUsers[addr] = pasynManager->createAsynUser(0, 0);
+        pasynManager->connectDevice(pasynUsers[addr], portName, addr);
+    }
+    epicsTimeGetCurrent(&start);
+    for (addr = 0; addr < maxAddr; addr++) {
+        for (i = 0; i < nParams; i++) {
+            sprintf(name, "PARAM_NUMBER_%d", i);
+            if (pDriver->drvUserCreate(pasynUsers[addr], name, &typeName, &size)
+             || (pasynUsers[addr]->reason != i)) nErrors++;
+        }
+    }
+    epicsTimeGetCurrent(&end);
+    lookupTime = epicsTimeDiffInSeconds(&end, &start);
+
+    printf("%6d params %3d addresses: createParam %8.3f us/param, drvUserCreate %8.3f us/call, "
+           "total %8.3f ms, errors %d\n",
+           nParams, maxAddr, createTime*1e6/nParams,
+           lookupTime*1e6/((double)nParams*maxAddr),
+           (createTime + lookupTime)*1e3, nErrors);
+    free(pasynUsers);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int nParams[] = {10, 100, 500, 1000, 2000, 5000};
+    int maxAddr = 16;
+    unsigned int i;
+
+    if (argc > 1) maxAddr = atoi(argv[1]);
+    if (maxAddr < 1) maxAddr = 1;
+    for (i = 0; i < sizeof(nParams)/sizeof(nParams[0]); i++)
+        bench(nParams[i], maxAddr);
+    return 0;
+}
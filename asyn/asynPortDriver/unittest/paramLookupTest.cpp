@@ -0,0 +1,128 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramLookupTest.cpp
+ *
+ * Tests of the parameter name index of asynPortDriver: createParam, findParam
+ * and drvUserCreate on enough names to fill many hash buckets, and the errors
+ * for a name that exists and for a full parameter table.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <asynPortDriver.h>
+#include "../paramErrors.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define MAX_ADDR 2
+#define NUM_PARAMS 200
+#define NAME_SIZE 32
+
+class lookupDriver : public asynPortDriver {
+public:
+    lookupDriver(const char *portName)
+        : asynPortDriver(portName, MAX_ADDR, NUM_PARAMS,
+                         asynInt32Mask | asynDrvUserMask, 0,
+                         ASYN_MULTIDEVICE, 1, 0, 0) {}
+};
+
+lookupDriver *pDriver;
+
+void paramName(char *name, int i)
+{
+    /* PARAM_1, PARAM_10 and PARAM_100 share their leading characters */
+    sprintf(name, "PARAM_%d", i);
+}
+
+void createTests()
+{
+    char name[NAME_SIZE];
+    int index, i;
+    bool allCreated = true;
+
+    testDiag("createParam");
+    /* The last slot is left for the full table test */
+    for (i = 0; i < NUM_PARAMS - 1; i++) {
+        paramName(name, i);
+        if (pDriver->createParam(name, asynParamInt32, &index) != asynSuccess || index != i)
+            allCreated = false;
+    }
+    testOk(allCreated, "%d parameters are created and numbered in order of creation",
+           NUM_PARAMS - 1);
+    testOk(pDriver->createParam("PARAM_7", asynParamInt32, &index) == asynError,
+           "createParam of an existing name fails");
+    testOk(pDriver->createParam(1, "param_7", asynParamInt32, &index) == asynError,
+           "createParam of an existing name in other case fails");
+    testOk(pDriver->createParam("LAST", asynParamInt32, &index) == asynSuccess &&
+           index == NUM_PARAMS - 1, "The failed createParam calls did not use a parameter number");
+    testOk(pDriver->createParam("TOO_MANY", asynParamInt32, &index) == asynError,
+           "createParam fails when the table is full");
+    testOk(pDriver->findParam(0, "TOO_MANY", &index) == asynParamNotFound,
+           "The parameter that did not fit is not found");
+}
+
+void findTests()
+{
+    char name[NAME_SIZE];
+    const char *pName;
+    int index, list, i;
+    bool allFound = true, allNamed = true;
+
+    testDiag("findParam");
+    for (list = 0; list < MAX_ADDR; list++) {
+        for (i = 0; i < NUM_PARAMS - 1; i++) {
+            paramName(name, i);
+            if (pDriver->findParam(list, name, &index) != asynSuccess || index != i)
+                allFound = false;
+            if (pDriver->getParamName(list, i, &pName) != asynSuccess || strcmp(pName, name) != 0)
+                allNamed = false;
+        }
+    }
+    testOk(allFound, "findParam finds every name in every list with its number");
+    testOk(allNamed, "getParamName returns the name of every number");
+    testOk(pDriver->findParam(1, "param_123", &index) == asynSuccess && index == 123,
+           "findParam ignores case");
+    testOk(pDriver->findParam("PARAM_1", &index) == asynSuccess && index == 1 &&
+           pDriver->findParam("PARAM_10", &index) == asynSuccess && index == 10 &&
+           pDriver->findParam("PARAM_100", &index) == asynSuccess && index == 100,
+           "Names that are prefixes of each other are told apart");
+    testOk(pDriver->findParam(0, "PARAM_", &index) == asynParamNotFound && index == -1,
+           "findParam of an unknown name returns asynParamNotFound and -1");
+    testOk(pDriver->findParam(0, "PARAM_1000", &index) == asynParamNotFound,
+           "findParam of a longer unknown name returns asynParamNotFound");
+}
+
+void drvUserTests()
+{
+    asynUser *pasynUser;
+    asynInterface *pInterface;
+    asynDrvUser *pDrvUser;
+
+    testDiag("drvUserCreate");
+    pasynUser = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUser, "PARAMLOOKUPTEST", 1);
+    pInterface = pasynManager->findInterface(pasynUser, asynDrvUserType, 1);
+    pDrvUser = (asynDrvUser *)pInterface->pinterface;
+    testOk(pDrvUser->create(pInterface->drvPvt, pasynUser, "Param_42", 0, 0) == asynSuccess &&
+           pasynUser->reason == 42, "drvUserCreate sets reason to the parameter number");
+    testOk(pDrvUser->create(pInterface->drvPvt, pasynUser, "NO_SUCH_PARAM", 0, 0) != asynSuccess,
+           "drvUserCreate of an unknown name fails");
+    pasynManager->freeAsynUser(pasynUser);
+}
+
+MAIN(paramLookupTest)
+{
+    testPlan(6 + 6 + 2);
+    pDriver = new lookupDriver("PARAMLOOKUPTEST");
+    createTests();
+    findTests();
+    drvUserTests();
+    return testDone();
+}
@@ -0,0 +1,173 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramReadBench.cpp
+ *
+ * Measures contention between records reading parameters and the driver updating them.
+ * One thread repeatedly takes the driver lock, changes all parameters and calls
+ * callParamCallbacks, as a polling thread does.  nReaders threads call pasynInt32->read
+ * and pasynFloat64->read through the asyn interfaces, as records do.
+ * This is done once without and once with ASYN_LOCKFREE_READS.
+ * Usage: paramReadBench [nReaders] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <asynPortDriver.h>
+
+#define NUM_PARAMS 200
+
+class readBenchDriver : public asynPortDriver {
+public:
+    readBenchDriver(const char *portName, int asynFlags)
+        : asynPortDriver(portName, 1, NUM_PARAMS,
+                         asynInt32Mask | asynFloat64Mask | asynDrvUserMask,
+                         asynInt32Mask | asynFloat64Mask, asynFlags, 1, 0, 0) {}
+};
+
+typedef struct benchTimes {
+    double sum;
+    double max;
+    long count;
+} benchTimes;
+
+typedef struct benchThread {
+    readBenchDriver *pDriver;
+    const char *portName;
+    volatile int *pStop;
+    epicsEventId done;
+    benchTimes lockWait;        /* Update thread only */
+    benchTimes lockHold;        /* Update thread only */
+    benchTimes read;            /* Reader threads only */
+} benchThread;
+
+static void addTime(benchTimes *pTimes, double time)
+{
+    pTimes->sum += time;
+    if (time > pTimes->max) pTimes->max = time;
+    pTimes->count++;
+}
+
+static void updateThread(void *arg)
+{
+    benchThread *pThread = (benchThread *)arg;
+    readBenchDriver *pDriver = pThread->pDriver;
+    epicsTimeStamp start, locked, unlocked;
+    int cycle, i;
+
+    for (cycle = 0; !*pThread->pStop; cycle++) {
+        epicsTimeGetCurrent(&start);
+        pDriver->lock();
+        epicsTimeGetCurrent(&locked);
+        for (i = 0; i < NUM_PARAMS; i += 2) {
+            pDriver->setIntegerParam(i, cycle);
+            pDriver->setDoubleParam(i+1, cycle);
+        }
+        pDriver->callParamCallbacks();
+        pDriver->unlock();
+        epicsTimeGetCurrent(&unlocked);
+        addTime(&pThread->lockWait, epicsTimeDiffInSeconds(&locked, &start));
+        addTime(&pThread->lockHold, epicsTimeDiffInSeconds(&unlocked, &locked));
+        epicsThreadSleep(0.);
+    }
+    epicsEventSignal(pThread->done);
+}
+
+static void readerThread(void *arg)
+{
+    benchThread *pThread = (benchThread *)arg;
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    asynInterface *pInt32Interface, *pFloat64Interface;
+    asynInt32 *pasynInt32;
+    asynFloat64 *pasynFloat64;
+    epicsTimeStamp start, end;
+    epicsInt32 ivalue;
+    epicsFloat64 dvalue;
+    int i;
+
+    pasynManager->connectDevice(pasynUser, pThread->portName, 0);
+    pInt32Interface = pasynManager->findInterface(pasynUser, asynInt32Type, 1);
+    pFloat64Interface = pasynManager->findInterface(pasynUser, asynFloat64Type, 1);
+    pasynInt32 = (asynInt32 *)pInt32Interface->pinterface;
+    pasynFloat64 = (asynFloat64 *)pFloat64Interface->pinterface;
+    for (i = 0; !*pThread->pStop; i = (i+2) % NUM_PARAMS) {
+        epicsTimeGetCurrent(&start);
+        pasynUser->reason = i;
+        pasynInt32->read(pInt32Interface->drvPvt, pasynUser, &ivalue);
+        pasynUser->reason = i+1;
+        pasynFloat64->read(pFloat64Interface->drvPvt, pasynUser, &dvalue);
+        epicsTimeGetCurrent(&end);
+        addTime(&pThread->read, epicsTimeDiffInSeconds(&end, &start)/2.);
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    epicsEventSignal(pThread->done);
+}
+
+static void bench(const char *portName, int asynFlags, int nReaders, double seconds)
+{
+    readBenchDriver *pDriver = new readBenchDriver(portName, asynFlags);
+    benchThread *pThreads = (benchThread *)calloc(nReaders+1, sizeof(benchThread));
+    volatile int stop = 0;
+    benchTimes read = {0., 0., 0};
+    char name[32];
+    int i, index;
+
+    for (i = 0; i < NUM_PARAMS; i += 2) {
+        sprintf(name, "INT32_%d", i);
+        pDriver->createParam(name, asynParamInt32, &index);
+        sprintf(name, "FLOAT64_%d", i+1);
+        pDriver->createParam(name, asynParamFloat64, &index);
+    }
+    for (i = 0; i <= nReaders; i++) {
+        pThreads[i].pDriver = pDriver;
+        pThreads[i].portName = portName;
+        pThreads[i].pStop = &stop;
+        pThreads[i].done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadCreate(i ? "paramReadBenchRead" : "paramReadBenchUpdate",
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          i ? readerThread : updateThread, &pThreads[i]);
+    }
+    epicsThreadSleep(seconds);
+    stop = 1;
+    for (i = 0; i <= nReaders; i++) {
+        epicsEventMustWait(pThreads[i].done);
+        epicsEventDestroy(pThreads[i].done);
+        if (i == 0) continue;
+        read.sum += pThreads[i].read.sum;
+        read.count += pThreads[i].read.count;
+        if (pThreads[i].read.max > read.max) read.max = pThreads[i].read.max;
+    }
+    printf("%s, %d readers:\n", (asynFlags & ASYN_LOCKFREE_READS) ? "ASYN_LOCKFREE_READS" : "locked reads",
+           nReaders);
+    printf("    update cycles %8.0f/s, lock wait mean %8.3f us max %9.3f us, lock hold mean %8.3f us\n",
+           pThreads[0].lockWait.count/seconds,
+           pThreads[0].lockWait.sum*1e6/pThreads[0].lockWait.count, pThreads[0].lockWait.max*1e6,
+           pThreads[0].lockHold.sum*1e6/pThreads[0].lockHold.count);
+    printf("    reads         %8.0f/s, read mean %8.3f us max %9.3f us\n",
+           read.count*2/seconds, read.sum*1e6/read.count, read.max*1e6);
+    free(pThreads);
+}
+
+int main(int argc, char *argv[])
+{
+    int nReaders = 4;
+    double seconds = 2.;
+
+    if (argc > 1) nReaders = atoi(argv[1]);
+    if (argc > 2) seconds = atof(argv[2]);
+    if (nReaders < 1) nReaders = 1;
+    if (seconds <= 0.) seconds = 2.;
+    bench("READBENCH_LOCKED", 0, nReaders, seconds);
+    bench("READBENCH_LOCKFREE", ASYN_LOCKFREE_READS, nReaders, seconds);
+    return 0;
+}
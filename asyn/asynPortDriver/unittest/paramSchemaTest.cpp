@@ -0,0 +1,136 @@
+/*************************************************************************\
+* Copyright (c) 2011 UChicago Argonne LLC, as Operator of Argonne
+ *     National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as
+ *     Operator of Los Alamos National Laboratory.
+ * EPICS BASE is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ \*************************************************************************/
+/*
+ * paramSchemaTest.cpp
+ *
+ * Tests of the parameter schema that the address lists of asynPortDriver
+ * share: parameters created in all lists, a list that diverges by creating
+ * its own parameter, and values that stay separate for each list.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <asynPortDriver.h>
+#include "../paramErrors.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define MAX_ADDR 4
+#define NUM_PARAMS 10
+#define STRING_SIZE 40
+
+class schemaDriver : public asynPortDriver {
+public:
+    schemaDriver(const char *portName)
+        : asynPortDriver(portName, MAX_ADDR, NUM_PARAMS,
+                         asynInt32Mask | asynFloat64Mask | asynOctetMask | asynDrvUserMask, 0,
+                         ASYN_MULTIDEVICE, 1, 0, 0) {}
+};
+
+schemaDriver *pDriver;
+int intIndex, doubleIndex, stringIndex, ownIndex, afterIndex;
+
+bool foundInLists(const char *name, int expectedIndex, int firstList, int lastList)
+{
+    int index, list;
+
+    for (list = firstList; list <= lastList; list++) {
+        if (pDriver->findParam(list, name, &index) != asynSuccess || index != expectedIndex)
+            return false;
+    }
+    return true;
+}
+
+bool nameIs(int list, int index, const char *name)
+{
+    const char *paramName;
+
+    return pDriver->getParamName(list, index, &paramName) == asynSuccess &&
+           strcmp(paramName, name) == 0;
+}
+
+void sharedTests()
+{
+    testDiag("Parameters of all lists");
+    pDriver->createParam("INT", asynParamInt32, &intIndex);
+    pDriver->createParam("DOUBLE", asynParamFloat64, &doubleIndex);
+    testOk(pDriver->createParam("STRING", asynParamOctet, &stringIndex) == asynSuccess &&
+           intIndex == 0 && doubleIndex == 1 && stringIndex == 2,
+           "createParam numbers the parameters of all lists in order");
+    testOk(foundInLists("STRING", stringIndex, 0, MAX_ADDR - 1),
+           "STRING is found with the same number in all lists");
+    testOk(nameIs(3, doubleIndex, "DOUBLE"), "getParamName of list 3 returns DOUBLE");
+}
+
+void divergeTests()
+{
+    int index;
+
+    testDiag("Parameters of single lists");
+    testOk(pDriver->createParam(2, "OWN2", asynParamInt32, &ownIndex) == asynSuccess &&
+           ownIndex == 3, "createParam OWN2 in list 2 gets the next number");
+    testOk(pDriver->findParam(0, "OWN2", &index) == asynParamNotFound,
+           "OWN2 is not found in list 0, which still shares the schema of list 2");
+    testOk(pDriver->createParam(1, "OWN1", asynParamFloat64, &index) == asynSuccess &&
+           index == ownIndex, "createParam OWN1 in list 1 gets the number of OWN2");
+    testOk(pDriver->findParam(1, "OWN2", &index) == asynParamNotFound &&
+           pDriver->findParam(2, "OWN1", &index) == asynParamNotFound,
+           "OWN1 is only in list 1 and OWN2 only in list 2");
+    testOk(nameIs(1, ownIndex, "OWN1") && nameIs(2, ownIndex, "OWN2"),
+           "getParamName returns the name of each list");
+    testOk(pDriver->createParam(3, "OWN2", asynParamInt32, &index) == asynSuccess &&
+           index == ownIndex && foundInLists("OWN2", ownIndex, 2, 3),
+           "List 3 can create the same parameter as list 2");
+    testOk(foundInLists("STRING", stringIndex, 0, MAX_ADDR - 1),
+           "The lists keep the parameters that they shared");
+
+    testDiag("Parameters of all lists after a list diverged");
+    testOk(pDriver->createParam(0, "AFTER", asynParamInt32, &afterIndex) == asynSuccess &&
+           afterIndex == ownIndex, "List 0 creates AFTER with the number that it has free");
+    testOk(pDriver->createParam(1, "AFTER", asynParamInt32, &index) == asynSuccess &&
+           index == ownIndex + 1, "List 1 creates AFTER with its next number");
+    testOk(pDriver->findParam(0, "OWN1", &index) == asynParamNotFound &&
+           pDriver->findParam(2, "AFTER", &index) == asynParamNotFound,
+           "Lists 0 and 2 still do not see the parameters of the other lists");
+}
+
+void valueTests()
+{
+    int intValue;
+    double doubleValue;
+    char stringValue[STRING_SIZE];
+
+    testDiag("Values of each list");
+    pDriver->setIntegerParam(2, ownIndex, 22);
+    pDriver->setDoubleParam(1, ownIndex, 1.5);
+    testOk(pDriver->getIntegerParam(2, ownIndex, &intValue) == asynSuccess && intValue == 22,
+           "OWN2 of list 2 is an integer");
+    testOk(pDriver->getDoubleParam(1, ownIndex, &doubleValue) == asynSuccess && doubleValue == 1.5,
+           "OWN1 of list 1 is a double");
+    testOk(pDriver->getIntegerParam(1, ownIndex, &intValue) == asynParamWrongType,
+           "getIntegerParam of OWN1 returns asynParamWrongType");
+    testOk(pDriver->getIntegerParam(3, ownIndex, &intValue) == asynParamUndefined,
+           "OWN2 of list 3 has its own value, which is still undefined");
+    pDriver->setStringParam(0, stringIndex, "list 0");
+    pDriver->setStringParam(3, stringIndex, "list 3");
+    testOk(pDriver->getStringParam(0, stringIndex, STRING_SIZE, stringValue) == asynSuccess &&
+           strcmp(stringValue, "list 0") == 0, "STRING of list 0 keeps its value");
+    testOk(pDriver->getStringParam(3, stringIndex, STRING_SIZE, stringValue) == asynSuccess &&
+           strcmp(stringValue, "list 3") == 0, "STRING of list 3 keeps its value");
+}
+
+MAIN(paramSchemaTest)
+{
+    testPlan(3 + 10 + 6);
+    pDriver = new schemaDriver("PARAMSCHEMATEST");
+    sharedTests();
+    divergeTests();
+    valueTests();
+    return testDone();
+}
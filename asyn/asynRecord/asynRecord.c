@@ -533,6 +533,8 @@ static long special(struct dbAddr * paddr, int after)
     switch (fieldIndex) {
     case asynRecordCNCT:
         pmsg->callbackType = callbackConnect;
+        /* A disconnect does not wait for I/O blocked on the device */
+        if(!pasynRec->cnct) pasynManager->abortRequest(pasynUser);
         break;
     case asynRecordBAUD:
     case asynRecordLBAUD:
@@ -88,6 +88,8 @@ static long getIoIntInfo(int cmd, dbCommon *pr, IOSCANPVT *iopvt);
 static long createRingBuffer(dbCommon *pr);
 static void processCallbackInput(asynUser *pasynUser);
 static void processCallbackOutput(asynUser *pasynUser);
+static void mergeCallbackInput(asynUser *pasynUser,asynUser *pprocessedUser);
+static void mergeCallbackOutput(asynUser *pasynUser,asynUser *pprocessedUser);
 static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
                 epicsFloat64 value);
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -224,6 +226,15 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
             }
         }
     }
+    /* A port that enables queue merging answers several pending reads
+     * of the parameter with one read and does only the newest write.*/
+    if (processCallback == processCallbackInput) {
+        pasynManager->setQueueMerge(pPvt->pasynUser,
+            asynQueueMergeRead, mergeCallbackInput);
+    } else if (processCallback == processCallbackOutput) {
+        pasynManager->setQueueMerge(pPvt->pasynUser,
+            asynQueueMergeWrite, mergeCallbackOutput);
+    }
     return INIT_OK;
 bad:
     recGblSetSevr(pr,LINK_ALARM,INVALID_ALARM);
@@ -331,6 +342,39 @@ static void processCallbackOutput(asynUser *pasynUser)
     if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
 }
 
+/* The read done for pprocessedUser answers this record too*/
+static void mergeCallbackInput(asynUser *pasynUser,asynUser *pprocessedUser)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    devPvt *pprocessedPvt = (devPvt *)pprocessedUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    pPvt->result = pprocessedPvt->result;
+    if (pPvt->result.status == asynSuccess) {
+        asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+            "%s devAsynFloat64 process value=%f from %s\n",
+            pr->name, pPvt->result.value, pprocessedPvt->pr->name);
+    }
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
+}
+
+/* The newer write of pprocessedUser replaced this one*/
+static void mergeCallbackOutput(asynUser *pasynUser,asynUser *pprocessedUser)
+{
+    devPvt *pPvt = (devPvt *)pasynUser->userPvt;
+    devPvt *pprocessedPvt = (devPvt *)pprocessedUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    pPvt->result.status = pprocessedPvt->result.status;
+    pPvt->result.time = pprocessedPvt->result.time;
+    pPvt->result.alarmStatus = pprocessedPvt->result.alarmStatus;
+    pPvt->result.alarmSeverity = pprocessedPvt->result.alarmSeverity;
+    asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+        "%s devAsynFloat64 process value %f superseded by %s\n",
+        pr->name, pPvt->result.value, pprocessedPvt->pr->name);
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
+}
+
 static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
                 epicsFloat64 value)
 {
@@ -116,6 +116,8 @@ static long convertAi(aiRecord *pai, int pass);
 static long convertAo(aoRecord *pao, int pass);
 static void processCallbackInput(asynUser *pasynUser);
 static void processCallbackOutput(asynUser *pasynUser);
+static void mergeCallbackInput(asynUser *pasynUser,asynUser *pprocessedUser);
+static void mergeCallbackOutput(asynUser *pasynUser,asynUser *pprocessedUser);
 static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser,
                 epicsInt32 value);
 static void interruptCallbackOutput(void *drvPvt, asynUser *pasynUser,
@@ -336,6 +338,16 @@ static long initCommon(dbCommon *pr, DBLINK *plink,
             }
         }
     }
+    /* A port that enables queue merging answers several pending reads
+     * of the parameter with one read. Not for masked reads since each
+     * record applies its own mask.*/
+    if (processCallback == processCallbackInput && !pPvt->mask) {
+        pasynManager->setQueueMerge(pPvt->pasynUser,
+            asynQueueMergeRead, mergeCallbackInput);
+    } else if (processCallback == processCallbackOutput) {
+        pasynManager->setQueueMerge(pPvt->pasynUser,
+            asynQueueMergeWrite, mergeCallbackOutput);
+    }
     return INIT_OK;
 bad:
     recGblSetSevr(pr,LINK_ALARM,INVALID_ALARM);
@@ -501,6 +513,39 @@ static void processCallbackOutput(asynUser *pasynUser)
     if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
 }
 
+/* The read done for pprocessedUser answers this record too*/
+static void mergeCallbackInput(asynUser *pasynUser,asynUser *pprocessedUser)
+{
+    devInt32Pvt *pPvt = (devInt32Pvt *)pasynUser->userPvt;
+    devInt32Pvt *pprocessedPvt = (devInt32Pvt *)pprocessedUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    pPvt->result = pprocessedPvt->result;
+    if (pPvt->result.status == asynSuccess) {
+        asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+            "%s devAsynInt32 process value=%d from %s\n",
+            pr->name, pPvt->result.value, pprocessedPvt->pr->name);
+    }
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
+}
+
+/* The newer write of pprocessedUser replaced this one*/
+static void mergeCallbackOutput(asynUser *pasynUser,asynUser *pprocessedUser)
+{
+    devInt32Pvt *pPvt = (devInt32Pvt *)pasynUser->userPvt;
+    devInt32Pvt *pprocessedPvt = (devInt32Pvt *)pprocessedUser->userPvt;
+    dbCommon *pr = pPvt->pr;
+
+    pPvt->result.status = pprocessedPvt->result.status;
+    pPvt->result.time = pprocessedPvt->result.time;
+    pPvt->result.alarmStatus = pprocessedPvt->result.alarmStatus;
+    pPvt->result.alarmSeverity = pprocessedPvt->result.alarmSeverity;
+    asynPrint(pasynUser, ASYN_TRACEIO_DEVICE,
+        "%s devAsynInt32 process value %d superseded by %s\n",
+        pr->name, pPvt->result.value, pprocessedPvt->pr->name);
+    if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
+}
+
 static void interruptCallbackInput(void *drvPvt, asynUser *pasynUser, 
                 epicsInt32 value)
 {
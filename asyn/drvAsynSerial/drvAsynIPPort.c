@@ -33,6 +33,21 @@
  * Since neither of these mechanisms was working as designed, the driver has been 
  * re-written to simplify it.  If one or both of these are to be implemented in the future
  * the code as of version 1.29 should be used as the starting point.
+ *
+ * asynManager now calls asynCommon:abort when a blocked request is canceled, the
+ * port is disabled or the device is disconnected.  abort uses epicsInterruptibleSyscall
+ * to get the thread out of poll() or recv(), and the I/O fails and closes the connection.
+ *
+ * On Linux drvAsynIPPortReactor(numberThreads) starts a few threads that wait in
+ * epoll_wait() for all sockets of the ports configured after it.  Each socket is
+ * registered once, edge triggered.  readIt and writeIt try the non-blocking recv() or
+ * send() first, and only if it would block wait on an event that the reactor thread
+ * signals when the socket becomes ready.  Together with asynSetThreadPool this allows
+ * thousands of ports without a thread and a poll() per port.
+ *
+ * Received data goes into a per-connection buffer that small reads are answered
+ * from.  Unless the COM protocol is used the input EOS is searched for with memchr()
+ * in that buffer, so asynInterposeEos only handles the output EOS.
  */
 
 #include <string.h>
@@ -46,7 +61,9 @@
 #include <errlog.h>
 #include <iocsh.h>
 #include <epicsAssert.h>
+#include <epicsEvent.h>
 #include <epicsExit.h>
+#include <epicsMutex.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
 #include <epicsThread.h>
@@ -57,6 +74,7 @@
 #include "asynDriver.h"
 #include "asynOctet.h"
 #include "asynOption.h"
+#include "epicsInterruptibleSyscall.h"
 #include "asynInterposeCom.h"
 #include "asynInterposeEos.h"
 #include "drvAsynIPPort.h"
@@ -86,6 +104,13 @@
 # endif
 #endif
 
+#if defined(__linux__)
+# define USE_EPOLL
+# define USE_RECVMMSG
+# include <errno.h>
+# include <sys/epoll.h>
+#endif
+
 
 /* This delay is needed in cleanup() else sockets are not always really closed cleanly */
 #define CLOSE_SOCKET_DELAY 0.02
@@ -95,6 +120,55 @@
 
 #define ISCOM_UNKNOWN (-1)
 
+/* Size of the receive buffer that small reads are answered from */
+#define RX_BUFFER_SIZE 4096
+
+/* Socket readiness as seen by the reactor */
+#define REACTOR_IN  0x1
+#define REACTOR_OUT 0x2
+#define REACTOR_MAX_EVENTS 64
+
+/* Limits of the datagramBatch option */
+#define DGRAM_BATCH_MAX 1024
+#define DGRAM_LENGTH_DEFAULT 9216
+#define DGRAM_LENGTH_MAX 65536
+
+/*
+ * One reactor thread and the epoll set of the sockets it owns
+ */
+typedef struct ipReactor {
+    char              *threadName;
+    int                epfd;
+    epicsMutexId       lock;
+    int                numberLinks;
+    unsigned long      numberEvents;
+    unsigned long      numberWakeups;
+} ipReactor;
+
+#ifdef USE_RECVMMSG
+/*
+ * Datagrams received by one recvmmsg() and not yet read
+ */
+typedef struct dgramRing {
+    int                size;         /* Datagrams per recvmmsg() */
+    int                maxLength;    /* Bytes per datagram */
+    int                count;        /* Received by the last recvmmsg() */
+    int                next;         /* The one readIt returns next */
+    unsigned long      numberCalls;
+    unsigned long      numberDatagrams;
+    struct mmsghdr    *msgs;
+    struct iovec      *iovs;
+    osiSockAddr       *from;
+    char              *control;      /* SCM_TIMESTAMPNS of each datagram */
+    char              *data;
+} dgramRing;
+
+#define DGRAM_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec))
+# define dgramPending(tty) ((tty)->dgram && ((tty)->dgram->next < (tty)->dgram->count))
+#else
+# define dgramPending(tty) 0
+#endif
+
 /*
  * This structure holds the hardware-specific information for a single
  * asyn link.  There is one for each IP socket.
@@ -109,6 +183,24 @@ typedef struct {
     int                isCom;
     int                disconnectOnReadTimeout;
     SOCKET             fd;
+    epicsInterruptibleSyscallContext *intr;
+    SOCKET             armedFd;
+    epicsThreadId      armedTid;
+    volatile int       aborting;
+    ipReactor         *preactor;     /* NULL if the port waits in poll() */
+    epicsEventId       reactorEvent;
+    int                readyEvents;  /* REACTOR_xxx seen since last wait */
+    int                waitEvents;   /* REACTOR_xxx readIt or writeIt waits for */
+    char              *rxBuf;        /* Received but not yet read */
+    size_t             rxHead;
+    size_t             rxTail;
+    int                pollFirst;    /* The last recv() found nothing */
+    char               eosIn[2];     /* Unless asynInterposeEos does it */
+    int                eosInLen;
+    int                eosInHalf;    /* The last read returned eosIn[0] */
+#ifdef USE_RECVMMSG
+    dgramRing         *dgram;        /* NULL unless datagramBatch is set */
+#endif
     unsigned long      nRead;
     unsigned long      nWritten;
     union {
@@ -209,6 +301,158 @@ static int setNonBlock(SOCKET fd, int nonBlockFlag)
     return 0;
 }
 
+#ifdef USE_POLL
+/*
+ * Wait in poll() until the socket is ready, msec expired or the I/O was aborted
+ */
+static int
+waitPoll(ttyController_t *tty, asynUser *pasynUser, short events, int msec)
+{
+    struct pollfd pollfd;
+    epicsTimeStamp startTime;
+    epicsTimeStamp endTime;
+
+    pollfd.fd = tty->fd;
+    pollfd.events = events;
+    epicsTimeGetCurrent(&startTime);
+    while (poll(&pollfd, 1, msec) < 0) {
+        if (errno != EINTR) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                      "Poll() failed: %s", strerror(errno));
+            return -1;
+        }
+        if (tty->aborting) break;
+        epicsTimeGetCurrent(&endTime);
+        if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000. > msec) break; 
+    }
+    return 0;
+}
+#endif
+
+#ifdef USE_EPOLL
+static ipReactor *reactors;
+static int numberReactors;
+static int nextReactor;
+
+/*
+ * Reactor thread
+ * Records which sockets became ready and wakes the threads waiting for them.
+ */
+static void
+reactorThread(void *arg)
+{
+    ipReactor *preactor = (ipReactor *)arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int i, n;
+
+    for (;;) {
+        n = epoll_wait(preactor->epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            errlogPrintf("%s epoll_wait failed: %s\n",
+                         preactor->threadName, strerror(errno));
+            epicsThreadSleep(1.0);
+            continue;
+        }
+        epicsMutexMustLock(preactor->lock);
+        preactor->numberEvents += n;
+        for (i = 0 ; i < n ; i++) {
+            ttyController_t *tty = (ttyController_t *)events[i].data.ptr;
+            unsigned int e = events[i].events;
+            int ready = 0;
+
+            if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                ready |= REACTOR_IN;
+            if (e & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                ready |= REACTOR_OUT;
+            tty->readyEvents |= ready;
+            if (tty->waitEvents & ready) {
+                tty->waitEvents = 0;
+                preactor->numberWakeups++;
+                epicsEventSignal(tty->reactorEvent);
+            }
+        }
+        epicsMutexUnlock(preactor->lock);
+    }
+}
+
+/*
+ * Give a newly connected socket to the reactor
+ * It stays registered, edge triggered, until closeConnection.
+ */
+static int
+reactorAdd(ttyController_t *tty, SOCKET fd)
+{
+    ipReactor *preactor = tty->preactor;
+    struct epoll_event event;
+    int status;
+
+    memset(&event, 0, sizeof event);
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = tty;
+    epicsMutexMustLock(preactor->lock);
+    tty->readyEvents = 0;
+    status = epoll_ctl(preactor->epfd, EPOLL_CTL_ADD, fd, &event);
+    if (status == 0)
+        preactor->numberLinks++;
+    epicsMutexUnlock(preactor->lock);
+    return status;
+}
+
+static void
+reactorRemove(ttyController_t *tty)
+{
+    ipReactor *preactor = tty->preactor;
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof event);
+    epicsMutexMustLock(preactor->lock);
+    if (epoll_ctl(preactor->epfd, EPOLL_CTL_DEL, tty->fd, &event) == 0)
+        preactor->numberLinks--;
+    tty->readyEvents = 0;
+    epicsMutexUnlock(preactor->lock);
+}
+
+/*
+ * Wait until the reactor has seen the socket ready for events since the last call.
+ * Called after recv() or send() would have blocked, so no edge can be missed.
+ * Returns nonzero if the socket is ready, 0 if msec (counted from startTime)
+ * expired or the I/O was aborted.  Keeps errno of the failed recv() or send().
+ */
+static int
+reactorWait(ttyController_t *tty, int events, const epicsTimeStamp *startTime, int msec)
+{
+    ipReactor *preactor = tty->preactor;
+    int savedErrno = errno;
+    int ready;
+
+    epicsMutexMustLock(preactor->lock);
+    while (!(ready = (tty->readyEvents & events)) && !tty->aborting) {
+        double remaining = -1.0;
+
+        if (msec >= 0) {
+            epicsTimeStamp now;
+
+            epicsTimeGetCurrent(&now);
+            remaining = msec / 1000.0 - epicsTimeDiffInSeconds(&now, startTime);
+            if (remaining <= 0.0) break;
+        }
+        tty->waitEvents = events;
+        epicsMutexUnlock(preactor->lock);
+        if (remaining < 0.0)
+            epicsEventMustWait(tty->reactorEvent);
+        else
+            epicsEventWaitWithTimeout(tty->reactorEvent, remaining);
+        epicsMutexMustLock(preactor->lock);
+    }
+    tty->waitEvents = 0;
+    tty->readyEvents &= ~ready;
+    epicsMutexUnlock(preactor->lock);
+    errno = savedErrno;
+    return ready && !tty->aborting;
+}
+#endif /* USE_EPOLL */
+
 /*
  * Close a connection
  */
@@ -218,7 +462,18 @@ closeConnection(asynUser *pasynUser,ttyController_t *tty,const char *why)
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
               "Close %s connection (fd %d): %s\n", tty->IPDeviceName, tty->fd, why);
     if (tty->fd != INVALID_SOCKET) {
-        epicsSocketDestroy(tty->fd);
+        /* Some systems close the socket to interrupt I/O */
+        int wasClosed = epicsInterruptibleSyscallWasClosed(tty->intr);
+
+        /* From now on abort must not touch the socket */
+        epicsInterruptibleSyscallArm(tty->intr, -1, tty->armedTid);
+        tty->armedFd = INVALID_SOCKET;
+#ifdef USE_EPOLL
+        if (tty->preactor && !wasClosed)
+            reactorRemove(tty);
+#endif
+        if (!wasClosed)
+            epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
     }
     if (!(tty->flags & FLAG_CONNECT_PER_TRANSACTION) ||
@@ -226,6 +481,38 @@ closeConnection(asynUser *pasynUser,ttyController_t *tty,const char *why)
         pasynManager->exceptionDisconnect(pasynUser);
 }
 
+/*
+ * Called before I/O that can block. Arms the interrupt mechanism for the
+ * calling thread if needed, and returns nonzero if the I/O was aborted.
+ */
+static int
+ioStart(ttyController_t *tty)
+{
+    epicsThreadId tid = epicsThreadGetIdSelf();
+
+    /* Reactor waits are ended by abort without a signal */
+    if (!tty->preactor &&
+        ((tty->armedFd != tty->fd) || (tty->armedTid != tid))) {
+        epicsInterruptibleSyscallArm(tty->intr, (int)tty->fd, tid);
+        tty->armedFd = tty->fd;
+        tty->armedTid = tid;
+    }
+    return tty->aborting;
+}
+
+/*
+ * Fail I/O that was aborted
+ * abort may already have broken the connection so always close it.
+ */
+static asynStatus
+ioAborted(asynUser *pasynUser,ttyController_t *tty)
+{
+    epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                  "%s I/O aborted", tty->IPDeviceName);
+    closeConnection(pasynUser,tty,"I/O aborted");
+    return asynError;
+}
+
 /*Beginning of asynCommon methods*/
 /*
  * Report link parameters
@@ -245,6 +532,16 @@ asynCommonReport(void *drvPvt, FILE *fp, int details)
         fprintf(fp, "                    fd: %d\n", tty->fd);
         fprintf(fp, "    Characters written: %lu\n", tty->nWritten);
         fprintf(fp, "       Characters read: %lu\n", tty->nRead);
+        if (tty->preactor)
+            fprintf(fp, "               Reactor: %s links %d events %lu wakeups %lu\n",
+                    tty->preactor->threadName, tty->preactor->numberLinks,
+                    tty->preactor->numberEvents, tty->preactor->numberWakeups);
+#ifdef USE_RECVMMSG
+        if (tty->dgram)
+            fprintf(fp, "     Datagram batches: %lu datagrams %lu (up to %d of %d bytes)\n",
+                    tty->dgram->numberCalls, tty->dgram->numberDatagrams,
+                    tty->dgram->size, tty->dgram->maxLength);
+#endif
     }
 }
 
@@ -266,6 +563,12 @@ cleanup (void *arg)
     if (tty->fd != INVALID_SOCKET) {
         asynPrint(tty->pasynUser, ASYN_TRACE_FLOW, "%s: shutdown socket\n", tty->portName);
         tty->flags |= FLAG_SHUTDOWN; /* prevent reconnect */
+        epicsInterruptibleSyscallArm(tty->intr, -1, tty->armedTid);
+        tty->armedFd = INVALID_SOCKET;
+#ifdef USE_EPOLL
+        if (tty->preactor)
+            reactorRemove(tty);
+#endif
         epicsSocketDestroy(tty->fd);
         tty->fd = INVALID_SOCKET;
         /* If this delay is not present then the sockets are not always really closed cleanly */
@@ -522,9 +825,33 @@ connectIt(void *drvPvt, asynUser *pasynUser)
         return asynError;
     }
 #endif
+#ifdef USE_RECVMMSG
+    i = 1;
+    if (tty->dgram
+     && (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (void *)&i, sizeof i) < 0)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "Can't set %s socket TIMESTAMPNS option: %s",
+                      tty->IPDeviceName, strerror(SOCKERRNO));
+        epicsSocketDestroy(fd);
+        return asynError;
+    }
+    if (tty->dgram)
+        tty->dgram->count = tty->dgram->next = 0;
+#endif
+#ifdef USE_EPOLL
+    if (tty->preactor && (reactorAdd(tty, fd) < 0)) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "Can't add %s to %s: %s", tty->IPDeviceName,
+                      tty->preactor->threadName, strerror(errno));
+        epicsSocketDestroy(fd);
+        return asynError;
+    }
+#endif
 
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
                           "Opened connection to %s\n", tty->IPDeviceName);
+    tty->rxHead = tty->rxTail = 0;
+    tty->eosInHalf = 0;
     tty->fd = fd;
     return asynSuccess;
 }
@@ -554,6 +881,26 @@ asynCommonDisconnect(void *drvPvt, asynUser *pasynUser)
     return asynSuccess;
 }
 
+/*
+ * Make blocked I/O return
+ * Called by asynManager with its locks held so must not block.
+ */
+static asynStatus
+asynCommonAbort(void *drvPvt, asynUser *pasynUser, int yesNo)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+
+    assert(tty);
+    tty->aborting = yesNo;
+    if (yesNo) {
+        if (tty->preactor)
+            epicsEventSignal(tty->reactorEvent);
+        else
+            epicsInterruptibleSyscallInterrupt(tty->intr);
+    }
+    return asynSuccess;
+}
+
 /*Beginning of asynOctet methods*/
 /*
  * Write to the TCP port
@@ -565,6 +912,7 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     int thisWrite;
     asynStatus status = asynSuccess;
     int writePollmsec;
+    int polled;
     int epicsTimeStatus;
     epicsTimeStamp startTime;
     epicsTimeStamp endTime;
@@ -589,6 +937,8 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     }
     if (numchars == 0)
         return asynSuccess;
+    if (ioStart(tty))
+        return ioAborted(pasynUser,tty);
     writePollmsec = (int) (pasynUser->timeout * 1000.0);
     if (writePollmsec == 0) writePollmsec = 1;
     if (writePollmsec < 0) writePollmsec = -1;
@@ -607,21 +957,8 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
 #endif
     haveStartTime = 0;
     for (;;) {
-#ifdef USE_POLL
-        struct pollfd pollfd;
-        pollfd.fd = tty->fd;
-        pollfd.events = POLLOUT;
-        epicsTimeGetCurrent(&startTime);
-        while (poll(&pollfd, 1, writePollmsec) < 0) {
-            if (errno != EINTR) {
-                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                          "Poll() failed: %s", strerror(errno));
-                return asynError;
-            }
-            epicsTimeGetCurrent(&endTime);
-            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000 > writePollmsec) break; 
-        }
-#endif
+        /* There is usually room in the socket so try send() before poll() */
+        polled = 0;
         for (;;) {
             if (tty->socketType == SOCK_DGRAM) {
                 thisWrite = sendto(tty->fd, (char *)data, (int)numchars, 0, &tty->farAddr.oa.sa, (int)tty->farAddrSize);
@@ -630,6 +967,28 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
             }
             if (thisWrite >= 0) break;
             if (SOCKERRNO == SOCK_EWOULDBLOCK || SOCKERRNO == SOCK_EINTR) {
+#ifdef USE_EPOLL
+                if (tty->preactor) {
+                    if (!haveStartTime) {
+                        epicsTimeGetCurrent(&startTime);
+                        haveStartTime = 1;
+                    }
+                    if (reactorWait(tty, REACTOR_OUT, &startTime, writePollmsec))
+                        continue;
+                    if (!tty->aborting)
+                        thisWrite = 0;
+                    break;
+                }
+#endif
+#ifdef USE_POLL
+                if (!polled) {
+                    if (waitPoll(tty, pasynUser, POLLOUT, writePollmsec) < 0)
+                        return asynError;
+                    polled = 1;
+                    if (tty->aborting) break;
+                    continue;
+                }
+#endif
                 if (!haveStartTime) {
                     epicsTimeStatus = epicsTimeGetCurrent(&startTime);
                     assert(epicsTimeStatus == epicsTimeOK);
@@ -643,9 +1002,14 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
                         break;
                     }
                 }
+                if (tty->aborting) break;
                 epicsThreadSleep(SEND_RETRY_DELAY);
             } else break;
         }
+        if (tty->aborting) {
+            status = ioAborted(pasynUser,tty);
+            break;
+        }
         if (thisWrite > 0) {
             tty->nWritten += (unsigned long)thisWrite;
             *nbytesTransfered += thisWrite;
@@ -711,39 +1075,128 @@ static void hexdump(char *data, int length)
 }
 #endif
 
+#ifdef USE_RECVMMSG
+static void
+dgramRingFree(dgramRing *ring)
+{
+    if (ring) {
+        free(ring->msgs);
+        free(ring->iovs);
+        free(ring->from);
+        free(ring->control);
+        free(ring->data);
+        free(ring);
+    }
+}
+
+static dgramRing *
+dgramRingCreate(int size, int maxLength)
+{
+    dgramRing *ring;
+    int i;
+
+    ring = (dgramRing *)callocMustSucceed(1, sizeof(dgramRing), "drvAsynIPPort");
+    ring->size = size;
+    ring->maxLength = maxLength;
+    ring->msgs = (struct mmsghdr *)callocMustSucceed(size, sizeof(struct mmsghdr), "drvAsynIPPort");
+    ring->iovs = (struct iovec *)callocMustSucceed(size, sizeof(struct iovec), "drvAsynIPPort");
+    ring->from = (osiSockAddr *)callocMustSucceed(size, sizeof(osiSockAddr), "drvAsynIPPort");
+    ring->control = (char *)callocMustSucceed(size, DGRAM_CONTROL_SIZE, "drvAsynIPPort");
+    ring->data = (char *)callocMustSucceed(size, maxLength, "drvAsynIPPort");
+    for (i = 0; i < size; i++) {
+        struct msghdr *msg = &ring->msgs[i].msg_hdr;
+
+        ring->iovs[i].iov_base = ring->data + (size_t)i * maxLength;
+        ring->iovs[i].iov_len = maxLength;
+        msg->msg_name = &ring->from[i];
+        msg->msg_iov = &ring->iovs[i];
+        msg->msg_iovlen = 1;
+        msg->msg_control = ring->control + (size_t)i * DGRAM_CONTROL_SIZE;
+    }
+    return ring;
+}
+
 /*
- * Read from the TCP port
+ * Read the next datagram from the ring
+ * When the ring is empty one recvmmsg() refills it with whatever is waiting.
+ * pasynUser->timestamp is set to when the kernel received the datagram.
+ * Returns -1 with errno set like recvfrom() if nothing is waiting.
  */
-static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
-    char *data, size_t maxchars,size_t *nbytesTransfered,int *gotEom)
+static int
+recvBatch(ttyController_t *tty, asynUser *pasynUser,
+    char *data, size_t maxchars, osiSockAddr *from)
+{
+    dgramRing *ring = tty->dgram;
+    struct msghdr *msg;
+    struct cmsghdr *cmsg;
+    int thisRead;
+    int gotTime = 0;
+    int i;
+
+    if (ring->next >= ring->count) {
+        for (i = 0; i < ring->size; i++) {
+            msg = &ring->msgs[i].msg_hdr;
+            msg->msg_namelen = sizeof(osiSockAddr);
+            msg->msg_controllen = DGRAM_CONTROL_SIZE;
+            msg->msg_flags = 0;
+        }
+        ring->count = ring->next = 0;
+        i = recvmmsg(tty->fd, ring->msgs, ring->size, MSG_DONTWAIT, NULL);
+        if (i <= 0)
+            return -1;
+        ring->count = i;
+        ring->numberCalls++;
+        ring->numberDatagrams += i;
+        /* A full ring means more are probably waiting */
+        if (i == ring->size)
+            tty->pollFirst = 0;
+    }
+    msg = &ring->msgs[ring->next].msg_hdr;
+    thisRead = (int)ring->msgs[ring->next].msg_len;
+    if (msg->msg_flags & MSG_TRUNC)
+        asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s datagram truncated to %d bytes\n", tty->IPDeviceName, thisRead);
+    if (thisRead > (int)maxchars)
+        thisRead = (int)maxchars;
+    memcpy(data, ring->iovs[ring->next].iov_base, thisRead);
+    memcpy(from, &ring->from[ring->next], sizeof(osiSockAddr));
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+            struct timespec ts;
+
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof ts);
+            epicsTimeFromTimespec(&pasynUser->timestamp, &ts);
+            gotTime = 1;
+        }
+    }
+    if (!gotTime)
+        epicsTimeGetCurrent(&pasynUser->timestamp);
+    ring->next++;
+    return thisRead;
+}
+#endif /* USE_RECVMMSG */
+
+/*
+ * Receive from the socket
+ * Waits up to pasynUser->timeout for at least one byte.  The socket is
+ * non-blocking so recv() is tried before poll(), which is then only needed
+ * when nothing has arrived yet.  Once that happens poll() comes first again
+ * until a recv() fills the whole buffer, so request/response devices do not
+ * pay for a recv() that finds nothing.
+ */
+static asynStatus recvIt(ttyController_t *tty, asynUser *pasynUser,
+    char *data, size_t maxchars,size_t *nbytesTransfered,int *eomReason)
 {
-    ttyController_t *tty = (ttyController_t *)drvPvt;
     int thisRead;
     int readPollmsec;
     int reason = 0;
+#ifdef USE_POLL
+    int polled = 0;
+#endif
     epicsTimeStamp startTime;
-    epicsTimeStamp endTime;
     asynStatus status = asynSuccess;
 
-    assert(tty);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s read.\n", tty->IPDeviceName);
-    if (tty->fd == INVALID_SOCKET) {
-        if (tty->flags & FLAG_CONNECT_PER_TRANSACTION) {
-            if ((status = connectIt(drvPvt, pasynUser)) != asynSuccess)
-                return status;
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", tty->IPDeviceName);
-            return asynError;
-        }
-    }
-    if (maxchars <= 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                  "%s maxchars %d. Why <=0?",tty->IPDeviceName,(int)maxchars);
-        return asynError;
-    }
+    *nbytesTransfered = 0;
     readPollmsec = (int) (pasynUser->timeout * 1000.0);
     if (readPollmsec == 0) readPollmsec = 1;
     if (readPollmsec < 0) readPollmsec = -1;
@@ -760,47 +1213,72 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     }
     }
 #endif
-    if (gotEom) *gotEom = 0;
 #ifdef USE_POLL
-    {
-        struct pollfd pollfd;
-        pollfd.fd = tty->fd;
-        pollfd.events = POLLIN;
-        epicsTimeGetCurrent(&startTime);
-        while (poll(&pollfd, 1, readPollmsec) < 0) {
-            if (errno != EINTR) {
-                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                          "Poll() failed: %s", strerror(errno));
-                return asynError;
-            }
-            epicsTimeGetCurrent(&endTime);
-            if (epicsTimeDiffInSeconds(&endTime, &startTime)*1000. > readPollmsec) break; 
-        }
+    epicsTimeGetCurrent(&startTime);
+    if (tty->pollFirst && !tty->preactor && !dgramPending(tty)) {
+        if (waitPoll(tty, pasynUser, POLLIN, readPollmsec) < 0)
+            return asynError;
+        polled = 1;
     }
 #endif
-    if (tty->socketType == SOCK_DGRAM) {
-        /* We use recvfrom() for SOCK_DRAM so we can print the source address with ASYN_TRACEIO_DRIVER */
-        osiSockAddr oa;
-        unsigned int addrlen = sizeof(oa.ia);
-        thisRead = recvfrom(tty->fd, data, (int)maxchars, 0, &oa.sa, &addrlen);
-        if (thisRead >= 0) {
-            if (pasynTrace->getTraceMask(pasynUser) & ASYN_TRACEIO_DRIVER) {
-                char inetBuff[32];
-                ipAddrToDottedIP(&oa.ia, inetBuff, sizeof(inetBuff));
+    for (;;) {
+        if (tty->socketType == SOCK_DGRAM) {
+            /* We use recvfrom() for SOCK_DRAM so we can print the source address with ASYN_TRACEIO_DRIVER */
+            osiSockAddr oa;
+            unsigned int addrlen = sizeof(oa.ia);
+#ifdef USE_RECVMMSG
+            if (tty->dgram)
+                thisRead = recvBatch(tty, pasynUser, data, maxchars, &oa);
+            else
+                thisRead = recvfrom(tty->fd, data, (int)maxchars, 0, &oa.sa, &addrlen);
+#else
+            thisRead = recvfrom(tty->fd, data, (int)maxchars, 0, &oa.sa, &addrlen);
+#endif
+            if (thisRead >= 0) {
+                if (pasynTrace->getTraceMask(pasynUser) & ASYN_TRACEIO_DRIVER) {
+                    char inetBuff[32];
+                    ipAddrToDottedIP(&oa.ia, inetBuff, sizeof(inetBuff));
+                    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
+                              "%s (from %s) read %d\n", 
+                              tty->IPDeviceName, inetBuff, thisRead);
+                }
+                tty->nRead += (unsigned long)thisRead;
+            }
+        } else {
+            thisRead = recv(tty->fd, data, (int)maxchars, 0);
+            if (thisRead >= 0) {
                 asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
-                          "%s (from %s) read %d\n", 
-                          tty->IPDeviceName, inetBuff, thisRead);
+                            "%s read %d\n", tty->IPDeviceName, thisRead);
+                tty->nRead += (unsigned long)thisRead;
             }
-            tty->nRead += (unsigned long)thisRead;
         }
-    } else {
-        thisRead = recv(tty->fd, data, (int)maxchars, 0);
-        if (thisRead >= 0) {
-            asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, thisRead,
-                        "%s read %d\n", tty->IPDeviceName, thisRead);
-            tty->nRead += (unsigned long)thisRead;
+        if ((thisRead >= 0) || tty->aborting
+         || ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR)))
+            break;
+#ifdef USE_EPOLL
+        /* The reactor wakes us when more arrives */
+        if (tty->preactor) {
+            if (reactorWait(tty, REACTOR_IN, &startTime, readPollmsec))
+                continue;
+            break;
+        }
+#endif
+#ifdef USE_POLL
+        if (!polled) {
+            tty->pollFirst = 1;
+            if (waitPoll(tty, pasynUser, POLLIN, readPollmsec) < 0)
+                return asynError;
+            polled = 1;
+            if (!tty->aborting)
+                continue;
         }
+#endif
+        break;
     }
+    if (thisRead == (int)maxchars)
+        tty->pollFirst = 0;
+    if (tty->aborting)
+        return ioAborted(pasynUser,tty);
     if (thisRead < 0) {
         int should_disconnect = (tty->disconnectOnReadTimeout) ||
                            ((SOCKERRNO != SOCK_EWOULDBLOCK) && (SOCKERRNO != SOCK_EINTR));
@@ -869,9 +1347,175 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
         tty->lecroy_length -= (thisRead - offset);
     }
 #endif /* LECROY */
+    *nbytesTransfered = thisRead;
+    *eomReason |= reason;
+    return status;
+}
+
+/*
+ * Refill the receive buffer
+ * What is left in it is moved to the start first.
+ */
+static asynStatus
+rxFill(ttyController_t *tty, asynUser *pasynUser, int *eomReason)
+{
+    size_t thisRead;
+    asynStatus status;
+
+    if (tty->rxTail > 0) {
+        memmove(tty->rxBuf, tty->rxBuf + tty->rxTail, tty->rxHead - tty->rxTail);
+        tty->rxHead -= tty->rxTail;
+        tty->rxTail = 0;
+    }
+    status = recvIt(tty, pasynUser, tty->rxBuf + tty->rxHead,
+                    RX_BUFFER_SIZE - tty->rxHead, &thisRead, eomReason);
+    tty->rxHead += thisRead;
+    return status;
+}
+
+/*
+ * Find the first complete input EOS in buf
+ */
+static const char *
+findEos(ttyController_t *tty, const char *buf, size_t len)
+{
+    const char *end = buf + len;
+    const char *cp = buf;
+
+    while ((cp = memchr(cp, tty->eosIn[0], end - cp)) != NULL) {
+        if (tty->eosInLen == 1)
+            return cp;
+        if (cp + 1 == end)
+            break;
+        if (cp[1] == tty->eosIn[1])
+            return cp;
+        cp++;
+    }
+    return NULL;
+}
+
+/*
+ * Read up to and without the input EOS
+ * Like asynInterposeEos the EOS counts against maxchars, and a read that
+ * fails returns what was received before.  The EOS is searched for in the
+ * receive buffer, and only the data before it is copied.
+ * If the last read ended with the first EOS character, because of maxchars
+ * or a failure, and the next character is the second one, that completes
+ * the EOS and the read returns no data.
+ */
+static asynStatus
+readEos(ttyController_t *tty, asynUser *pasynUser,
+    char *data, size_t maxchars,size_t *nbytesTransfered,int *gotEom)
+{
+    size_t nRead = 0;
+    int reason = 0;
+    asynStatus status = asynSuccess;
+
+    for (;;) {
+        const char *start = tty->rxBuf + tty->rxTail;
+        size_t avail = tty->rxHead - tty->rxTail;
+        size_t n = maxchars - nRead;
+        const char *eos;
+
+        if (n > avail)
+            n = avail;
+        if (tty->eosInHalf && (avail > 0)) {
+            tty->eosInHalf = 0;
+            if (start[0] == tty->eosIn[1]) {
+                tty->rxTail++;
+                reason |= ASYN_EOM_EOS;
+                break;
+            }
+        }
+        if ((eos = findEos(tty, start, n)) != NULL) {
+            n = eos - start;
+            memcpy(data + nRead, start, n);
+            nRead += n;
+            tty->rxTail += n + tty->eosInLen;
+            reason |= ASYN_EOM_EOS;
+            break;
+        }
+        /* Keep half of an EOS until we know what follows it */
+        if ((n > 0) && (n == avail) && (tty->eosInLen == 2)
+         && (nRead + n < maxchars) && (start[n-1] == tty->eosIn[0])
+         && (status == asynSuccess) && !(reason & ASYN_EOM_END))
+            n--;
+        memcpy(data + nRead, start, n);
+        nRead += n;
+        tty->rxTail += n;
+        if (nRead >= maxchars) {
+            reason |= ASYN_EOM_CNT;
+            break;
+        }
+        if ((status != asynSuccess) || (reason & ASYN_EOM_END))
+            break;
+        /* After a failure go round once more to return a kept EOS character */
+        status = rxFill(tty, pasynUser, &reason);
+    }
+    if ((nRead > 0) && !(reason & ASYN_EOM_EOS))
+        tty->eosInHalf = (tty->eosInLen == 2) && (data[nRead-1] == tty->eosIn[0]);
+    *nbytesTransfered = nRead;
+    if (nRead < maxchars)
+        data[nRead] = 0;
+    *gotEom = reason;
+    return status;
+}
+
+/*
+ * Read from the TCP port
+ * Small reads are answered from the receive buffer.
+ */
+static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars,size_t *nbytesTransfered,int *gotEom)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+    size_t thisRead;
+    int reason = 0;
+    asynStatus status = asynSuccess;
+
+    assert(tty);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s read.\n", tty->IPDeviceName);
+    if (tty->fd == INVALID_SOCKET) {
+        if (tty->flags & FLAG_CONNECT_PER_TRANSACTION) {
+            if ((status = connectIt(drvPvt, pasynUser)) != asynSuccess)
+                return status;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", tty->IPDeviceName);
+            return asynError;
+        }
+    }
+    if (maxchars <= 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                  "%s maxchars %d. Why <=0?",tty->IPDeviceName,(int)maxchars);
+        return asynError;
+    }
+    if (ioStart(tty))
+        return ioAborted(pasynUser,tty);
+    if (gotEom) *gotEom = 0;
+    if (tty->eosInLen > 0) {
+        status = readEos(tty, pasynUser, data, maxchars, nbytesTransfered, &reason);
+        if (gotEom) *gotEom = reason;
+        return status;
+    }
+    if ((tty->rxHead == tty->rxTail)
+     && ((tty->socketType == SOCK_DGRAM) || (maxchars >= RX_BUFFER_SIZE))) {
+        /* Large reads and datagrams go straight to the caller */
+        status = recvIt(tty, pasynUser, data, maxchars, &thisRead, &reason);
+    } else {
+        if (tty->rxHead == tty->rxTail)
+            status = rxFill(tty, pasynUser, &reason);
+        thisRead = tty->rxHead - tty->rxTail;
+        if (thisRead > maxchars)
+            thisRead = maxchars;
+        memcpy(data, tty->rxBuf + tty->rxTail, thisRead);
+        tty->rxTail += thisRead;
+    }
     *nbytesTransfered = thisRead;
     /* If there is room add a null byte */
-    if (thisRead < (int) maxchars)
+    if (thisRead < maxchars)
         data[thisRead] = 0;
     else
         reason |= ASYN_EOM_CNT;
@@ -891,6 +1535,15 @@ flushIt(void *drvPvt,asynUser *pasynUser)
 
     assert(tty);
     asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush\n", tty->IPDeviceName);
+    numTotal = (int)(tty->rxHead - tty->rxTail);
+    tty->rxHead = tty->rxTail = 0;
+    tty->eosInHalf = 0;
+#ifdef USE_RECVMMSG
+    if (tty->dgram) {
+        while (tty->dgram->next < tty->dgram->count)
+            numTotal += tty->dgram->msgs[tty->dgram->next++].msg_len;
+    }
+#endif
     if (tty->fd != INVALID_SOCKET) {
         /*
          * Toss characters until there are none left
@@ -913,6 +1566,50 @@ flushIt(void *drvPvt,asynUser *pasynUser)
     return asynSuccess;
 }
 
+/*
+ * Input EOS
+ * Used instead of asynInterposeEos for input unless the COM protocol is used.
+ */
+static asynStatus
+setInputEos(void *drvPvt, asynUser *pasynUser, const char *eos, int eoslen)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+
+    assert(tty);
+    asynPrintIO(pasynUser, ASYN_TRACE_FLOW, eos, eoslen,
+                "%s set Eos %d\n", tty->IPDeviceName, eoslen);
+    switch (eoslen) {
+    default:
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "%s illegal eoslen %d", tty->IPDeviceName, eoslen);
+        return asynError;
+    case 2: tty->eosIn[1] = eos[1]; /* fall through to case 1 */
+    case 1: tty->eosIn[0] = eos[0]; break;
+    case 0: break;
+    }
+    tty->eosInLen = eoslen;
+    tty->eosInHalf = 0;
+    return asynSuccess;
+}
+
+static asynStatus
+getInputEos(void *drvPvt, asynUser *pasynUser, char *eos, int eossize, int *eoslen)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+
+    assert(tty);
+    if (tty->eosInLen > eossize) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                      "%s eossize %d < eosInLen %d",
+                      tty->IPDeviceName, eossize, tty->eosInLen);
+        return asynError;
+    }
+    memcpy(eos, tty->eosIn, tty->eosInLen);
+    *eoslen = tty->eosInLen;
+    if (tty->eosInLen < eossize) eos[tty->eosInLen] = 0;
+    return asynSuccess;
+}
+
 /*
  * Clean up a ttyController
  */
@@ -922,8 +1619,16 @@ ttyCleanup(ttyController_t *tty)
     if (tty) {
         if (tty->fd != INVALID_SOCKET)
             epicsSocketDestroy(tty->fd);
+        if (tty->intr)
+            epicsInterruptibleSyscallDelete(tty->intr);
+        if (tty->reactorEvent)
+            epicsEventDestroy(tty->reactorEvent);
         free(tty->portName);
         free(tty->IPDeviceName);
+        free(tty->rxBuf);
+#ifdef USE_RECVMMSG
+        dgramRingFree(tty->dgram);
+#endif
         free(tty);
     }
 }
@@ -945,6 +1650,14 @@ getOption(void *drvPvt, asynUser *pasynUser,
     else if (epicsStrCaseCmp(key, "hostInfo") == 0) {
         l = epicsSnprintf(val, valSize, "%s", tty->IPDeviceName);
     }
+    else if (epicsStrCaseCmp(key, "datagramBatch") == 0) {
+#ifdef USE_RECVMMSG
+        if (tty->dgram)
+            l = epicsSnprintf(val, valSize, "%d %d", tty->dgram->size, tty->dgram->maxLength);
+        else
+#endif
+        l = epicsSnprintf(val, valSize, "0");
+    }
 #ifdef LECROY
     else if (epicsStrCaseCmp(key, "Lecroy") == 0) {
         l = epicsSnprintf(val, valSize, "%c", tty->lecroy ? 'Y' : 'N');
@@ -989,6 +1702,43 @@ setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
         int status = parseHostInfo(tty, val);
         if (status) return asynError;
     }
+    else if (epicsStrCaseCmp(key, "datagramBatch") == 0) {
+        int size, maxLength = DGRAM_LENGTH_DEFAULT;
+
+        if ((sscanf(val, "%d %d", &size, &maxLength) < 1)
+         || (size < 0) || (size > DGRAM_BATCH_MAX)
+         || (maxLength <= 0) || (maxLength > DGRAM_LENGTH_MAX)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid datagramBatch value.");
+            return asynError;
+        }
+        if ((size > 0) && (tty->socketType != SOCK_DGRAM)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                    "datagramBatch needs a UDP port.");
+            return asynError;
+        }
+#ifdef USE_RECVMMSG
+        /* Datagrams still in the old ring are dropped */
+        dgramRingFree(tty->dgram);
+        tty->dgram = NULL;
+        if (size > 0) {
+            int i = 1;
+
+            tty->dgram = dgramRingCreate(size, maxLength);
+            if ((tty->fd != INVALID_SOCKET)
+             && (setsockopt(tty->fd, SOL_SOCKET, SO_TIMESTAMPNS, (void *)&i, sizeof i) < 0))
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                          "%s can't set socket TIMESTAMPNS option: %s\n",
+                          tty->IPDeviceName, strerror(SOCKERRNO));
+        }
+#else
+        if (size > 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                    "datagramBatch is not supported on this platform.");
+            return asynError;
+        }
+#endif
+    }
 #ifdef LECROY
     else if (epicsStrCaseCmp(key, "Lecroy") == 0) {
         if (epicsStrCaseCmp(val, "Y") == 0) {
@@ -1023,7 +1773,8 @@ static const struct asynOption asynOptionMethods = { setOption, getOption };
 static const struct asynCommon drvAsynIPPortAsynCommon = {
     asynCommonReport,
     asynCommonConnect,
-    asynCommonDisconnect
+    asynCommonDisconnect,
+    asynCommonAbort
 };
 
 /*
@@ -1074,7 +1825,16 @@ drvAsynIPPortConfigure(const char *portName,
     pasynOctet = (asynOctet *)(tty+1);
     tty->portName = epicsStrDup(portName);
     tty->fd = INVALID_SOCKET;
+    tty->intr = epicsInterruptibleSyscallMustCreate("drvAsynIPPortConfigure()");
+    tty->armedFd = INVALID_SOCKET;
     tty->isCom =  ISCOM_UNKNOWN;
+    tty->rxBuf = callocMustSucceed(1, RX_BUFFER_SIZE, "drvAsynIPPortConfigure()");
+#ifdef USE_EPOLL
+    if (numberReactors > 0) {
+        tty->preactor = &reactors[nextReactor++ % numberReactors];
+        tty->reactorEvent = epicsEventMustCreate(epicsEventEmpty);
+    }
+#endif
 
     /*
      * Create socket from hostInfo
@@ -1119,6 +1879,11 @@ drvAsynIPPortConfigure(const char *portName,
     pasynOctet->read = readIt;
     pasynOctet->write = writeIt;
     pasynOctet->flush = flushIt;
+    /* The COM protocol must be decoded before looking for the input EOS */
+    if (!noProcessEos && !tty->isCom) {
+        pasynOctet->setInputEos = setInputEos;
+        pasynOctet->getInputEos = getInputEos;
+    }
     tty->octet.interfaceType = asynOctetType;
     tty->octet.pinterface  = pasynOctet;
     tty->octet.drvPvt = tty;
@@ -1133,7 +1898,7 @@ drvAsynIPPortConfigure(const char *portName,
         return -1;
     }
     if (!noProcessEos)
-        asynInterposeEosConfig(tty->portName, -1, 1, 1);
+        asynInterposeEosConfig(tty->portName, -1, tty->isCom, 1);
     tty->pasynUser = pasynManager->createAsynUser(0,0);
     status = pasynManager->connectDevice(tty->pasynUser,tty->portName,-1);
     if(status != asynSuccess) {
@@ -1149,6 +1914,54 @@ drvAsynIPPortConfigure(const char *portName,
     return 0;
 }
 
+/*
+ * Start the reactor threads used by ports configured from now on
+ */
+epicsShareFunc int
+drvAsynIPPortReactor(int numberThreads)
+{
+#ifdef USE_EPOLL
+    int i;
+
+    if (numberReactors > 0) {
+        printf("drvAsynIPPortReactor: %d reactor threads already started.\n", numberReactors);
+        return -1;
+    }
+    if (numberThreads <= 0) {
+        printf("drvAsynIPPortReactor: numberThreads must be positive.\n");
+        return -1;
+    }
+    reactors = (ipReactor *)callocMustSucceed(numberThreads, sizeof(ipReactor),
+                                              "drvAsynIPPortReactor()");
+    for (i = 0 ; i < numberThreads ; i++) {
+        ipReactor *preactor = &reactors[i];
+        char threadName[40];
+
+        epicsSnprintf(threadName, sizeof threadName, "drvAsynIPReactor%d", i);
+        if ((preactor->epfd = epoll_create(REACTOR_MAX_EVENTS)) < 0) {
+            printf("drvAsynIPPortReactor: epoll_create failed: %s\n", strerror(errno));
+            break;
+        }
+        preactor->threadName = epicsStrDup(threadName);
+        preactor->lock = epicsMutexMustCreate();
+        if (!epicsThreadCreate(threadName, epicsThreadPriorityHigh,
+                               epicsThreadGetStackSize(epicsThreadStackSmall),
+                               reactorThread, preactor)) {
+            printf("drvAsynIPPortReactor: epicsThreadCreate failed\n");
+            epicsMutexDestroy(preactor->lock);
+            free(preactor->threadName);
+            close(preactor->epfd);
+            break;
+        }
+    }
+    numberReactors = i;
+    return (i == numberThreads) ? 0 : -1;
+#else
+    printf("drvAsynIPPortReactor: epoll is not available on this platform.\n");
+    return -1;
+#endif
+}
+
 /*
  * IOC shell command registration
  */
@@ -1169,6 +1982,15 @@ static void drvAsynIPPortConfigureCallFunc(const iocshArgBuf *args)
                            args[3].ival, args[4].ival);
 }
 
+static const iocshArg drvAsynIPPortReactorArg0 = { "numberThreads",iocshArgInt};
+static const iocshArg *drvAsynIPPortReactorArgs[] = {&drvAsynIPPortReactorArg0};
+static const iocshFuncDef drvAsynIPPortReactorFuncDef =
+                      {"drvAsynIPPortReactor",1,drvAsynIPPortReactorArgs};
+static void drvAsynIPPortReactorCallFunc(const iocshArgBuf *args)
+{
+    drvAsynIPPortReactor(args[0].ival);
+}
+
 /*
  * This routine is called before multitasking has started, so there's
  * no race condition in the test/set of firstTime.
@@ -1179,6 +2001,7 @@ drvAsynIPPortRegisterCommands(void)
     static int firstTime = 1;
     if (firstTime) {
         iocshRegister(&drvAsynIPPortConfigureFuncDef,drvAsynIPPortConfigureCallFunc);
+        iocshRegister(&drvAsynIPPortReactorFuncDef,drvAsynIPPortReactorCallFunc);
         firstTime = 0;
     }
 }
@@ -24,6 +24,7 @@ epicsShareFunc int drvAsynIPPortConfigure(const char *portName,
                                           unsigned int priority,
                                           int noAutoConnect,
                                           int userFlags);
+epicsShareFunc int drvAsynIPPortReactor(int numberThreads);
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@
 #include "asynDriver.h"
 #include "asynOctet.h"
 #include "asynOption.h"
+#include "epicsInterruptibleSyscall.h"
 #include "asynInterposeEos.h"
 #include "drvAsynSerialPort.h"
 
@@ -82,6 +83,8 @@ typedef struct {
     double             writeTimeout;
     epicsTimerId       timer;
     volatile int       timeoutFlag;
+    epicsInterruptibleSyscallContext *intr;
+    volatile int       aborting;
     asynInterface      common;
     asynInterface      option;
     asynInterface      octet;
@@ -635,6 +638,17 @@ timeoutHandler(void *p)
 #endif
 }
 
+/*
+ * Arm the interrupt mechanism for the thread about to do I/O
+ * This is done for every I/O since arming also clears the state
+ * left by an earlier interrupt.
+ */
+static void
+ioStart(ttyController_t *tty)
+{
+    epicsInterruptibleSyscallArm(tty->intr, -1, epicsThreadGetIdSelf());
+}
+
 
 /*
  * Report link parameters
@@ -734,6 +748,27 @@ disconnect(void *drvPvt, asynUser *pasynUser)
     return asynSuccess;
 }
 
+/*
+ * Make blocked I/O return
+ * Unlike a timeout this does not flush output.  The line stays open.
+ */
+static asynStatus
+abortIt(void *drvPvt, asynUser *pasynUser, int yesNo)
+{
+    ttyController_t *tty = (ttyController_t *)drvPvt;
+
+    assert(tty);
+    tty->aborting = yesNo;
+    if (yesNo) {
+        epicsInterruptibleSyscallInterrupt(tty->intr);
+#ifdef vxWorks
+        if (tty->fd >= 0)
+            ioctl(tty->fd, FIOCANCEL, 0);
+#endif
+    }
+    return asynSuccess;
+}
+
 
 /*
  * Write to the serial line
@@ -791,7 +826,14 @@ static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
         epicsTimerStartDelay(tty->timer, tty->writeTimeout);
         timerStarted = 1;
         }
+    ioStart(tty);
     for (;;) {
+        if (tty->aborting) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                "%s I/O aborted", tty->serialDeviceName);
+            status = asynError;
+            break;
+        }
         thisWrite = write(tty->fd, (char *)data, nleft);
         if (thisWrite > 0) {
             tty->nWritten += thisWrite;
@@ -910,7 +952,14 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     }
     tty->timeoutFlag = 0;
     if (gotEom) *gotEom = 0;
+    ioStart(tty);
     for (;;) {
+        if (tty->aborting) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                "%s I/O aborted", tty->serialDeviceName);
+            status = asynError;
+            break;
+        }
 #ifdef vxWorks
         /*
          * vxWorks has neither poll() nor termios but does have the
@@ -1001,6 +1050,8 @@ ttyCleanup(ttyController_t *tty)
     if (tty) {
         if (tty->fd >= 0)
             close(tty->fd);
+        if (tty->intr)
+            epicsInterruptibleSyscallDelete(tty->intr);
         free(tty->portName);
         free(tty->serialDeviceName);
         free(tty);
@@ -1013,7 +1064,8 @@ ttyCleanup(ttyController_t *tty)
 static const struct asynCommon asynCommonMethods = {
     report,
     connectIt,
-    disconnect
+    disconnect,
+    abortIt
 };
 
 /*
@@ -1058,6 +1110,7 @@ drvAsynSerialPortConfigure(char *portName,
         return -1;
     }
     tty->fd = -1;
+    tty->intr = epicsInterruptibleSyscallMustCreate("drvAsynSerialPortConfigure()");
     tty->serialDeviceName = epicsStrDup(ttyName);
     tty->portName = epicsStrDup(portName);
 
@@ -153,6 +153,8 @@ static asynStatus disconnectDevice(asynUser *pasynUser)
     ioPvt      *pioPvt = (ioPvt *)pasynUser->userPvt;
 
     pioPvt->connect = 0;
+    /* Do not wait for I/O blocked on the device. Not all drivers can abort */
+    pasynManager->abortRequest(pasynUser);
     status = pasynManager->queueRequest(pasynUser, asynQueuePriorityConnect, 0.);
     if (status != asynSuccess) return(status);
     epicsEventMustWait(pioPvt->connectEvent);
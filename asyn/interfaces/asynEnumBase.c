@@ -33,6 +33,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
                                void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
                                void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 
 
 asynStatus initialize(const char *portName, asynInterface *pdriver)
@@ -116,6 +117,15 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynEnumInterrupt *pasynEnumInterrupt = (asynEnumInterrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pasynEnumInterrupt->pasynUser);
+    pasynManager->memFree(pasynEnumInterrupt, sizeof(asynEnumInterrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -133,7 +143,6 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pasynEnumInterrupt->pasynUser);
-    pasynManager->memFree(pasynEnumInterrupt, sizeof(asynEnumInterrupt));
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,pasynEnumInterrupt);
     return status;
 }
@@ -33,6 +33,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
        interruptCallbackFloat64 callback, void *userPvt, void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
        void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 
 static asynStatus initialize(const char *portName, asynInterface *pdriver)
 {
@@ -115,6 +116,15 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynFloat64Interrupt *pasynFloat64Interrupt = (asynFloat64Interrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pasynFloat64Interrupt->pasynUser);
+    pasynManager->memFree(pasynFloat64Interrupt, sizeof(asynFloat64Interrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -132,7 +142,6 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pasynFloat64Interrupt->pasynUser);
-    pasynManager->memFree(pasynFloat64Interrupt, sizeof(asynFloat64Interrupt));
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,pasynFloat64Interrupt);
     return status;
 }
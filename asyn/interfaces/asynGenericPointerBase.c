@@ -33,6 +33,7 @@ static asynStatus registerInterruptUser(void *drvPvt, asynUser *pasynUser,
                     interruptCallbackGenericPointer callback, void *userPvt, void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
                     void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 
 
 static asynStatus initialize(const char *portName, asynInterface *pdriver)
@@ -114,6 +115,15 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynGenericPointerInterrupt *pasynGenericPointerInterrupt = (asynGenericPointerInterrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pasynGenericPointerInterrupt->pasynUser);
+    pasynManager->memFree(pasynGenericPointerInterrupt, sizeof(asynGenericPointerInterrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -131,7 +141,7 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pasynGenericPointerInterrupt->pasynUser);
-    pasynManager->memFree(pasynGenericPointerInterrupt, sizeof(asynGenericPointerInterrupt));
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,
+                                     pasynGenericPointerInterrupt);
     return status;
 }
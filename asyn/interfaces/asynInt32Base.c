@@ -35,6 +35,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
                                void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
                                void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 
 
 asynStatus initialize(const char *portName, asynInterface *pdriver)
@@ -136,6 +137,15 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynInt32Interrupt *pasynInt32Interrupt = (asynInt32Interrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pasynInt32Interrupt->pasynUser);
+    pasynManager->memFree(pasynInt32Interrupt, sizeof(asynInt32Interrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -153,7 +163,6 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pasynInt32Interrupt->pasynUser);
-    pasynManager->memFree(pasynInt32Interrupt, sizeof(asynInt32Interrupt));
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,pasynInt32Interrupt);
     return status;
 }
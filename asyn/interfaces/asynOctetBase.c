@@ -63,6 +63,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
        interruptCallbackOctet callback, void *userPvt, void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
        void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 static asynStatus setInputEos(void *drvPvt,asynUser *pasynUser,
                         const char *eos,int eoslen);
 static asynStatus getInputEos(void *drvPvt,asynUser *pasynUser,
@@ -204,6 +205,8 @@ static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
     while (pnode) {
         pinterrupt = pnode->drvPvt;
         if(addr==pinterrupt->addr) {
+            /* Drivers that know when the data arrived set the timestamp */
+            pinterrupt->pasynUser->timestamp = pasynUser->timestamp;
             pinterrupt->callback(
                 pinterrupt->userPvt,pinterrupt->pasynUser,
                 data,*nbytesTransfered,*eomReason);
@@ -216,11 +219,17 @@ static void callInterruptUsers(asynUser *pasynUser,void *pasynPvt,
 static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
     const char *data,size_t numchars,size_t *nbytesTransfered)
 {
-    octetPvt  *poctetPvt = (octetPvt *)drvPvt;
-    asynOctet *pasynOctet = poctetPvt->pasynOctet;
+    octetPvt   *poctetPvt = (octetPvt *)drvPvt;
+    asynOctet  *pasynOctet = poctetPvt->pasynOctet;
+    asynStatus status;
 
-    return pasynOctet->write(poctetPvt->drvPvt,pasynUser,
+    /*Not every driver sets nbytesTransfered when it fails*/
+    *nbytesTransfered = 0;
+    status = pasynOctet->write(poctetPvt->drvPvt,pasynUser,
                       data,numchars,nbytesTransfered);
+    pasynTrace->captureIO(pasynUser,ASYN_CAPTURE_WRITE,status,0,
+        data,*nbytesTransfered);
+    return status;
 }
 
 static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
@@ -230,8 +239,11 @@ static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
     asynOctet  *pasynOctet = poctetPvt->pasynOctet;
     asynStatus status;
 
+    *nbytesTransfered = 0;
     status = pasynOctet->read(poctetPvt->drvPvt,pasynUser,
                                  data,maxchars,nbytesTransfered,eomReason);
+    pasynTrace->captureIO(pasynUser,ASYN_CAPTURE_READ,status,
+        eomReason ? *eomReason : 0,data,*nbytesTransfered);
     if(status!=asynSuccess) return status;
     if(poctetPvt->interruptProcess)
         callInterruptUsers(pasynUser,poctetPvt->pasynPvt,
@@ -302,6 +314,15 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynOctetInterrupt *pinterrupt = (asynOctetInterrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pinterrupt->pasynUser);
+    pasynManager->memFree(pinterrupt, sizeof(asynOctetInterrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -324,10 +345,9 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,pinterrupt);
     if(status==asynSuccess)
         pasynManager->freeInterruptNode(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pinterrupt->pasynUser);
-    pasynManager->memFree(pinterrupt,sizeof(asynOctetInterrupt));
     return status;
 }
 
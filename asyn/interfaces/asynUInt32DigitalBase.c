@@ -38,6 +38,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
        void **registrarPvt);
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
        void *registrarPvt);
+static void freeInterrupt(void *pfreePvt);
 
 
 static asynStatus initialize(const char *portName,asynInterface *pdriver)
@@ -185,6 +186,17 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser,
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode);
 }
 
+/* Called by asynManager once no interrupt callback pass can use it*/
+static void freeInterrupt(void *pfreePvt)
+{
+    asynUInt32DigitalInterrupt *pasynUInt32DigitalInterrupt =
+           (asynUInt32DigitalInterrupt *)pfreePvt;
+
+    pasynManager->freeAsynUser(pasynUInt32DigitalInterrupt->pasynUser);
+    pasynManager->memFree(pasynUInt32DigitalInterrupt,
+                          sizeof(asynUInt32DigitalInterrupt));
+}
+
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     void *registrarPvt)
 {
@@ -202,8 +214,7 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,
     asynPrint(pasynUser,ASYN_TRACE_FLOW,
         "%s %d cancelInterruptUser\n",portName,addr);
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode);
-    pasynManager->freeAsynUser(pasynUInt32DigitalInterrupt->pasynUser);
-    pasynManager->memFree(pasynUInt32DigitalInterrupt, 
-                          sizeof(asynUInt32DigitalInterrupt));
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,
+                                     pasynUInt32DigitalInterrupt);
     return status;
 }
@@ -28,6 +28,7 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser, \
                                void **registrarPvt); \
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser, \
                                void *registrarPvt); \
+static void freeInterrupt(void *pfreePvt); \
  \
  \
 asynStatus initialize(const char *portName, asynInterface *pdriver) \
@@ -113,6 +114,14 @@ static asynStatus registerInterruptUser(void *drvPvt,asynUser *pasynUser, \
     return pasynManager->addInterruptUser(pasynUser,pinterruptNode); \
 } \
  \
+static void freeInterrupt(void *pfreePvt) \
+{ \
+    INTERRUPT *pInterrupt = (INTERRUPT *)pfreePvt; \
+     \
+    pasynManager->freeAsynUser(pInterrupt->pasynUser); \
+    pasynManager->memFree(pInterrupt, sizeof(INTERRUPT)); \
+} \
+ \
 static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,void *registrarPvt) \
 { \
     interruptNode *pinterruptNode = (interruptNode *)registrarPvt; \
@@ -129,7 +138,6 @@ static asynStatus cancelInterruptUser(void *drvPvt, asynUser *pasynUser,void *re
     asynPrint(pasynUser,ASYN_TRACE_FLOW, \
         "%s %d cancelInterruptUser\n",portName,addr); \
     status = pasynManager->removeInterruptUser(pasynUser,pinterruptNode); \
-    pasynManager->freeAsynUser(pInterrupt->pasynUser); \
-    pasynManager->memFree(pInterrupt, sizeof(INTERRUPT)); \
+    pasynManager->deferInterruptFree(pinterruptNode,freeInterrupt,pInterrupt); \
     return status; \
 }
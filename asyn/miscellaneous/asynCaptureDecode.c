@@ -0,0 +1,343 @@
+/* asynCaptureDecode.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory, and
+* Berliner Elektronenspeicherring-Gesellschaft m.b.H. (BESSY).
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Host tool that prints or filters the files written by
+ * asynSetTraceCaptureFile. See usage() for the options.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "asynDriver.h"
+#include "asynTraceCapture.h"
+
+#define FORMAT_ESCAPE 0
+#define FORMAT_ASCII  1
+#define FORMAT_HEX    2
+#define FORMAT_NONE   3
+
+typedef struct filter {
+    const char *portName;
+    int        addr;
+    int        useAddr;
+    int        reason;
+    int        useReason;
+    int        direction; /*-1 means both*/
+    int        errorsOnly;
+    double     start;     /*seconds after the first record*/
+    double     end;       /*<0 means no end*/
+}filter;
+
+typedef struct captureFile {
+    const char            *name;
+    FILE                  *fp;
+    int                   swap;
+    asynCaptureFileHeader header;
+}captureFile;
+
+static const char *statusName[] = {
+    "asynSuccess","asynTimeout","asynOverflow",
+    "asynError","asynDisconnected","asynDisabled"
+};
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: asynCaptureDecode [options] file ...\n"
+        "  -p port     only transfers of port\n"
+        "  -a addr     only transfers of addr\n"
+        "  -r reason   only transfers with asynUser.reason\n"
+        "  -d read     only reads; -d write only writes\n"
+        "  -e          only transfers that did not return asynSuccess\n");
+    fprintf(stderr,
+        "  -s seconds  skip transfers earlier than seconds after the first\n"
+        "  -t seconds  skip transfers later than seconds after the first\n"
+        "  -x          show data in hex\n"
+        "  -A          show data as is\n"
+        "  -n          do not show data\n"
+        "  -o file     write the selected transfers to a capture file\n");
+    exit(1);
+}
+
+static epicsUInt32 swap32(epicsUInt32 value)
+{
+    return ((value&0xff)<<24) | ((value&0xff00)<<8)
+         | ((value>>8)&0xff00) | ((value>>24)&0xff);
+}
+
+static epicsUInt16 swap16(epicsUInt16 value)
+{
+    return (epicsUInt16)(((value&0xff)<<8) | ((value>>8)&0xff));
+}
+
+static void swapRecordHeader(asynCaptureRecordHeader *pheader)
+{
+    pheader->recordLength = swap32(pheader->recordLength);
+    pheader->secPastEpoch = swap32(pheader->secPastEpoch);
+    pheader->nsec = swap32(pheader->nsec);
+    pheader->addr = (epicsInt32)swap32((epicsUInt32)pheader->addr);
+    pheader->reason = (epicsInt32)swap32((epicsUInt32)pheader->reason);
+    pheader->direction = swap16(pheader->direction);
+    pheader->status = swap16(pheader->status);
+    pheader->eomReason = (epicsInt32)swap32((epicsUInt32)pheader->eomReason);
+    pheader->length = swap32(pheader->length);
+    pheader->capturedLength = swap32(pheader->capturedLength);
+    pheader->portNameLength = swap16(pheader->portNameLength);
+}
+
+static int openCapture(captureFile *pcaptureFile,const char *name)
+{
+    asynCaptureFileHeader *pheader = &pcaptureFile->header;
+
+    pcaptureFile->name = name;
+    pcaptureFile->swap = 0;
+    pcaptureFile->fp = fopen(name,"rb");
+    if(!pcaptureFile->fp) {
+        fprintf(stderr,"%s: can not open\n",name);
+        return -1;
+    }
+    if(fread(pheader,sizeof(*pheader),1,pcaptureFile->fp)!=1) {
+        fprintf(stderr,"%s: no file header\n",name);
+        fclose(pcaptureFile->fp);
+        return -1;
+    }
+    if(pheader->magic==swap32(ASYN_CAPTURE_MAGIC)) {
+        pcaptureFile->swap = 1;
+        pheader->magic = ASYN_CAPTURE_MAGIC;
+        pheader->versionMajor = swap16(pheader->versionMajor);
+        pheader->versionMinor = swap16(pheader->versionMinor);
+        pheader->snapLength = swap32(pheader->snapLength);
+    }
+    if(pheader->magic!=ASYN_CAPTURE_MAGIC) {
+        fprintf(stderr,"%s: not an asyn capture file\n",name);
+        fclose(pcaptureFile->fp);
+        return -1;
+    }
+    if(pheader->versionMajor!=ASYN_CAPTURE_VERSION_MAJOR) {
+        fprintf(stderr,"%s: unsupported version %d.%d\n",name,
+            pheader->versionMajor,pheader->versionMinor);
+        fclose(pcaptureFile->fp);
+        return -1;
+    }
+    return 0;
+}
+
+static int selected(const filter *pfilter,
+    const asynCaptureRecordHeader *pheader,const char *portName,
+    double seconds)
+{
+    if(pfilter->portName && strcmp(pfilter->portName,portName)!=0) return 0;
+    if(pfilter->useAddr && pfilter->addr!=pheader->addr) return 0;
+    if(pfilter->useReason && pfilter->reason!=pheader->reason) return 0;
+    if(pfilter->direction>=0 && pfilter->direction!=pheader->direction)
+        return 0;
+    if(pfilter->errorsOnly && pheader->status==asynSuccess) return 0;
+    if(seconds<pfilter->start) return 0;
+    if(pfilter->end>=0.0 && seconds>pfilter->end) return 0;
+    return 1;
+}
+
+static void showData(const char *data,size_t len,int format)
+{
+    size_t i;
+
+    switch(format) {
+    case FORMAT_ASCII:
+        fwrite(data,1,len,stdout);
+        printf("\n");
+        break;
+    case FORMAT_HEX:
+        for(i=0; i<len; i++) {
+            if(i>0 && i%20==0) printf("\n");
+            printf("%2.2x ",(unsigned char)data[i]);
+        }
+        printf("\n");
+        break;
+    case FORMAT_ESCAPE:
+        for(i=0; i<len; i++) {
+            unsigned char c = (unsigned char)data[i];
+
+            switch(c) {
+            case '\n': printf("\\n");  break;
+            case '\r': printf("\\r");  break;
+            case '\t': printf("\\t");  break;
+            case '\\': printf("\\\\"); break;
+            default:
+                if(isprint(c)) putchar(c);
+                else printf("\\%03o",c);
+            }
+        }
+        printf("\n");
+        break;
+    }
+}
+
+static void showRecord(const asynCaptureRecordHeader *pheader,
+    const char *portName,const char *data,int format)
+{
+    time_t    secs = (time_t)pheader->secPastEpoch;
+    char      timeText[40];
+    struct tm *ptm = localtime(&secs);
+
+    timeText[0] = 0;
+    if(ptm) strftime(timeText,sizeof(timeText),"%Y/%m/%d %H:%M:%S",ptm);
+    printf("%s.%06lu [%s,%d,%d] %s %lu",timeText,
+        (unsigned long)(pheader->nsec/1000),portName,
+        (int)pheader->addr,(int)pheader->reason,
+        (pheader->direction==ASYN_CAPTURE_READ) ? "read" : "write",
+        (unsigned long)pheader->length);
+    if(pheader->status!=asynSuccess) {
+        if(pheader->status<sizeof(statusName)/sizeof(statusName[0]))
+            printf(" %s",statusName[pheader->status]);
+        else
+            printf(" status %d",pheader->status);
+    }
+    if(pheader->direction==ASYN_CAPTURE_READ && pheader->eomReason)
+        printf(" eomReason 0x%x",(unsigned)pheader->eomReason);
+    if(pheader->capturedLength<pheader->length)
+        printf(" (%lu saved)",(unsigned long)pheader->capturedLength);
+    printf("\n");
+    if(pheader->capturedLength>0)
+        showData(data,pheader->capturedLength,format);
+}
+
+int main(int argc,char *argv[])
+{
+    filter      filter;
+    int         format = FORMAT_ESCAPE;
+    const char  *outName = 0;
+    FILE        *outFp = 0;
+    int         firstFile = 0;
+    int         nSelected = 0;
+    int         haveFirst = 0;
+    double      firstTime = 0.0;
+    char        *buffer = 0;
+    size_t      bufferSize = 0;
+    int         i;
+
+    memset(&filter,0,sizeof(filter));
+    filter.direction = -1;
+    filter.end = -1.0;
+    for(i=1; i<argc && argv[i][0]=='-'; i++) {
+        const char *opt = argv[i];
+        const char *arg = (i+1<argc) ? argv[i+1] : 0;
+
+        if(strcmp(opt,"-e")==0) { filter.errorsOnly = 1; continue; }
+        if(strcmp(opt,"-x")==0) { format = FORMAT_HEX; continue; }
+        if(strcmp(opt,"-A")==0) { format = FORMAT_ASCII; continue; }
+        if(strcmp(opt,"-n")==0) { format = FORMAT_NONE; continue; }
+        if(!arg) usage();
+        i++;
+        if(strcmp(opt,"-p")==0) {
+            filter.portName = arg;
+        } else if(strcmp(opt,"-a")==0) {
+            filter.addr = atoi(arg); filter.useAddr = 1;
+        } else if(strcmp(opt,"-r")==0) {
+            filter.reason = atoi(arg); filter.useReason = 1;
+        } else if(strcmp(opt,"-d")==0) {
+            if(strcmp(arg,"read")==0) filter.direction = ASYN_CAPTURE_READ;
+            else if(strcmp(arg,"write")==0) filter.direction = ASYN_CAPTURE_WRITE;
+            else usage();
+        } else if(strcmp(opt,"-s")==0) {
+            filter.start = atof(arg);
+        } else if(strcmp(opt,"-t")==0) {
+            filter.end = atof(arg);
+        } else if(strcmp(opt,"-o")==0) {
+            outName = arg;
+        } else {
+            usage();
+        }
+    }
+    firstFile = i;
+    if(firstFile>=argc) usage();
+    if(outName) {
+        outFp = fopen(outName,"wb");
+        if(!outFp) {
+            fprintf(stderr,"%s: can not create\n",outName);
+            return 1;
+        }
+    }
+    for(i=firstFile; i<argc; i++) {
+        captureFile captureFile;
+        asynCaptureRecordHeader header;
+
+        if(openCapture(&captureFile,argv[i])) continue;
+        if(outFp && nSelected==0 && ftell(outFp)==0) {
+            /*The output is written in the byte order of this host*/
+            captureFile.header.reserved = 0;
+            fwrite(&captureFile.header,sizeof(captureFile.header),1,outFp);
+        }
+        while(fread(&header,sizeof(header),1,captureFile.fp)==1) {
+            size_t length;
+            char   *portName;
+            char   *data;
+            double seconds;
+
+            if(captureFile.swap) swapRecordHeader(&header);
+            length = header.recordLength;
+            if(length<sizeof(header) + header.portNameLength
+                                     + header.capturedLength) {
+                fprintf(stderr,"%s: corrupt record\n",captureFile.name);
+                break;
+            }
+            length -= sizeof(header);
+            if(length + 1>bufferSize) {
+                free(buffer);
+                bufferSize = length + 1;
+                buffer = malloc(bufferSize);
+                if(!buffer) {
+                    fprintf(stderr,"out of memory\n");
+                    return 1;
+                }
+            }
+            if(length>0 && fread(buffer,length,1,captureFile.fp)!=1) {
+                fprintf(stderr,"%s: truncated record\n",captureFile.name);
+                break;
+            }
+            /*Make the port name a string; it is followed by the data*/
+            data = buffer + header.portNameLength;
+            portName = malloc(header.portNameLength + 1);
+            if(!portName) {
+                fprintf(stderr,"out of memory\n");
+                return 1;
+            }
+            memcpy(portName,buffer,header.portNameLength);
+            portName[header.portNameLength] = 0;
+            seconds = header.secPastEpoch + header.nsec*1e-9;
+            if(!haveFirst) {
+                firstTime = seconds;
+                haveFirst = 1;
+            }
+            if(selected(&filter,&header,portName,seconds - firstTime)) {
+                nSelected++;
+                if(outFp) {
+                    header.recordLength = (epicsUInt32)(sizeof(header)
+                        + header.portNameLength + header.capturedLength);
+                    fwrite(&header,sizeof(header),1,outFp);
+                    fwrite(buffer,1,
+                        header.portNameLength + header.capturedLength,outFp);
+                } else {
+                    showRecord(&header,portName,data,format);
+                }
+            }
+            free(portName);
+        }
+        fclose(captureFile.fp);
+    }
+    free(buffer);
+    if(outFp) {
+        fclose(outFp);
+        fprintf(stderr,"%d transfers written to %s\n",nSelected,outName);
+    }
+    return 0;
+}
@@ -199,10 +199,12 @@ static asynStatus readIt(void *ppvt,asynUser *pasynUser,
             if (peosPvt->eosInLen > 0) {
                 if (c == peosPvt->eosIn[peosPvt->eosInMatch]) {
                     if (++peosPvt->eosInMatch == peosPvt->eosInLen) {
+                        /* The previous read may have returned the first EOS character */
+                        size_t nEos = peosPvt->eosInLen;
+                        if (nEos > nRead) nEos = nRead;
                         peosPvt->eosInMatch = 0;
-                        nRead -= peosPvt->eosInLen;
-                        data -= peosPvt->eosInLen;
-                        *(data+1) = 0;
+                        nRead -= nEos;
+                        data -= nEos;
                         eom |= ASYN_EOM_EOS;
                         break;
                     }
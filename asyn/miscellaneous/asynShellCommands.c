@@ -807,6 +807,52 @@ static void asynSetTraceIOTruncateSizeCall(const iocshArgBuf * args) {
     int size = args[2].ival;
     asynSetTraceIOTruncateSize(portName,addr,size);
 }
+
+epicsShareFunc int
+ asynSetTraceCaptureFile(const char *portName,int addr,const char *filename)
+{
+    asynUser        *pasynUser;
+    asynStatus      status;
+    FILE            *fp = 0;
+
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser,portName,addr);
+    if((status!=asynSuccess) && (strlen(portName)!=0)) {
+        printf("%s\n",pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    /*No filename stops capturing*/
+    if(filename && strlen(filename)>0) {
+        fp = fopen(filename,"wb");
+        if(!fp) {
+            printf("fopen failed %s\n",strerror(errno));
+            goto done;
+        }
+    }
+    status = pasynTrace->setTraceCaptureFile(pasynUser,fp);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+    }
+done:
+    pasynManager->freeAsynUser(pasynUser);
+    return 0;
+}
+
+static const iocshArg asynSetTraceCaptureFileArg0 = {"portName", iocshArgString};
+static const iocshArg asynSetTraceCaptureFileArg1 = {"addr", iocshArgInt};
+static const iocshArg asynSetTraceCaptureFileArg2 = {"filename", iocshArgString};
+static const iocshArg *const asynSetTraceCaptureFileArgs[] = {
+    &asynSetTraceCaptureFileArg0,&asynSetTraceCaptureFileArg1,
+    &asynSetTraceCaptureFileArg2};
+static const iocshFuncDef asynSetTraceCaptureFileDef =
+    {"asynSetTraceCaptureFile", 3, asynSetTraceCaptureFileArgs};
+static void asynSetTraceCaptureFileCall(const iocshArgBuf * args) {
+    const char *portName = args[0].sval;
+    int addr = args[1].ival;
+    const char *filename = args[2].sval;
+    asynSetTraceCaptureFile(portName,addr,filename);
+}
 
 static const iocshArg asynEnableArg0 = {"portName", iocshArgString};
 static const iocshArg asynEnableArg1 = {"addr", iocshArgInt};
@@ -1019,6 +1065,87 @@ static void asynWaitConnectCall(const iocshArgBuf * args) {
     asynWaitConnect( portName, timeout);
 }
 
+static const iocshArg asynSetThreadPoolArg0 = {"numberThreads", iocshArgInt};
+static const iocshArg *const asynSetThreadPoolArgs[] = {
+    &asynSetThreadPoolArg0};
+static const iocshFuncDef asynSetThreadPoolDef =
+    {"asynSetThreadPool", 1, asynSetThreadPoolArgs};
+static void asynSetThreadPoolCall(const iocshArgBuf * args) {
+    int numberThreads = args[0].ival;
+    pasynManager->setThreadPool(numberThreads);
+}
+
+epicsShareFunc int
+ asynSetQueuePolicy(const char *portName,const char *policy,double param)
+{
+    static const char *policyNames[] = {ASYN_QUEUE_POLICY_STRINGS};
+    int        nPolicies = sizeof(policyNames)/sizeof(policyNames[0]);
+    asynUser   *pasynUser;
+    asynStatus status;
+    int        i;
+
+    for(i=0; i<nPolicies; i++) {
+        if(policy && epicsStrCaseCmp(policy,policyNames[i])==0) break;
+    }
+    if(i>=nPolicies) {
+        printf("policy must be one of");
+        for(i=0; i<nPolicies; i++) printf(" %s",policyNames[i]);
+        printf("\n");
+        return -1;
+    }
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser,portName,-1);
+    if(status==asynSuccess)
+        status = pasynManager->setQueuePolicy(pasynUser,(asynQueuePolicy)i,param);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return 0;
+}
+
+static const iocshArg asynSetQueuePolicyArg0 = {"portName", iocshArgString};
+static const iocshArg asynSetQueuePolicyArg1 = {"policy", iocshArgString};
+static const iocshArg asynSetQueuePolicyArg2 = {"param", iocshArgDouble};
+static const iocshArg *const asynSetQueuePolicyArgs[] = {
+    &asynSetQueuePolicyArg0,&asynSetQueuePolicyArg1,&asynSetQueuePolicyArg2};
+static const iocshFuncDef asynSetQueuePolicyDef =
+    {"asynSetQueuePolicy", 3, asynSetQueuePolicyArgs};
+static void asynSetQueuePolicyCall(const iocshArgBuf * args) {
+    asynSetQueuePolicy(args[0].sval,args[1].sval,args[2].dval);
+}
+
+epicsShareFunc int
+ asynEnableQueueMerge(const char *portName,int yesNo)
+{
+    asynUser   *pasynUser;
+    asynStatus status;
+
+    pasynUser = pasynManager->createAsynUser(0,0);
+    status = pasynManager->connectDevice(pasynUser,portName,-1);
+    if(status==asynSuccess)
+        status = pasynManager->enableQueueMerge(pasynUser,yesNo);
+    if(status!=asynSuccess) {
+        printf("%s\n",pasynUser->errorMessage);
+        pasynManager->freeAsynUser(pasynUser);
+        return -1;
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return 0;
+}
+
+static const iocshArg asynEnableQueueMergeArg0 = {"portName", iocshArgString};
+static const iocshArg asynEnableQueueMergeArg1 = {"yesNo", iocshArgInt};
+static const iocshArg *const asynEnableQueueMergeArgs[] = {
+    &asynEnableQueueMergeArg0,&asynEnableQueueMergeArg1};
+static const iocshFuncDef asynEnableQueueMergeDef =
+    {"asynEnableQueueMerge", 2, asynEnableQueueMergeArgs};
+static void asynEnableQueueMergeCall(const iocshArgBuf * args) {
+    asynEnableQueueMerge(args[0].sval,args[1].ival);
+}
+
 static const iocshArg asynSetAutoConnectTimeoutArg0 = {"timeout", iocshArgDouble};
 static const iocshArg *const asynSetAutoConnectTimeoutArgs[] = {
     &asynSetAutoConnectTimeoutArg0};
@@ -1157,6 +1284,7 @@ static void asynRegister(void)
     iocshRegister(&asynSetTraceInfoMaskDef,asynSetTraceInfoMaskCall);
     iocshRegister(&asynSetTraceFileDef,asynSetTraceFileCall);
     iocshRegister(&asynSetTraceIOTruncateSizeDef,asynSetTraceIOTruncateSizeCall);
+    iocshRegister(&asynSetTraceCaptureFileDef,asynSetTraceCaptureFileCall);
     iocshRegister(&asynEnableDef,asynEnableCall);
     iocshRegister(&asynAutoConnectDef,asynAutoConnectCall);
     iocshRegister(&asynOctetConnectDef,asynOctetConnectCall);
@@ -1171,6 +1299,9 @@ static void asynRegister(void)
     iocshRegister(&asynOctetGetOutputEosDef,asynOctetGetOutputEosCall);
     iocshRegister(&asynWaitConnectDef,asynWaitConnectCall);
     iocshRegister(&asynSetAutoConnectTimeoutDef,asynSetAutoConnectTimeoutCall);
+    iocshRegister(&asynSetThreadPoolDef,asynSetThreadPoolCall);
+    iocshRegister(&asynSetQueuePolicyDef,asynSetQueuePolicyCall);
+    iocshRegister(&asynEnableQueueMergeDef,asynEnableQueueMergeCall);
     iocshRegister(&asynRegisterTimeStampSourceDef, asynRegisterTimeStampSourceCall);
     iocshRegister(&asynUnregisterTimeStampSourceDef, asynUnregisterTimeStampSourceCall);
     iocshRegister(&asynSetMinTimerPeriodDef, asynSetMinTimerPeriodCall);
@@ -33,8 +33,14 @@ epicsShareFunc int
  asynSetTraceFile(const char *portName,int addr,const char *filename);
 epicsShareFunc int 
  asynSetTraceIOTruncateSize(const char *portName,int addr,int size);
+epicsShareFunc int 
+ asynSetTraceCaptureFile(const char *portName,int addr,const char *filename);
 epicsShareFunc int 
  asynAutoConnect(const char *portName,int addr,int yesNo);
+epicsShareFunc int 
+ asynSetQueuePolicy(const char *portName,const char *policy,double param);
+epicsShareFunc int 
+ asynEnableQueueMerge(const char *portName,int yesNo);
 epicsShareFunc int 
  asynEnable(const char *portName,int addr,int yesNo);
 
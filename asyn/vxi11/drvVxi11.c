@@ -98,6 +98,12 @@ typedef struct vxiPort {
     char          *srqThreadName;
     epicsInterruptibleSyscallContext *srqInterrupt;
     int           srqEnabled;
+    /* The following are for vxiAbort. See vxiAbortThread */
+    char          *abortThreadName;
+    epicsEventId  abortEvent;
+    volatile int  aborting;
+    Device_Link   abortLid;
+    CLIENT        *abortClient; /* abort channel. Only used by vxiAbortThread */
 }vxiPort;
 
 /* Local routines */
@@ -123,6 +129,7 @@ static asynStatus vxiBusStatus(vxiPort * pvxiPort, int request,
 static void vxiCreateIrqChannel(vxiPort *pvxiPort,asynUser *pasynUser);
 static void vxiDestroyIrqChannel(vxiPort *pvxiPort);
 static void vxiSrqThread(void *pvxiPort);
+static void vxiAbortThread(void *pvxiPort);
 static asynStatus vxiConnectPort(vxiPort *pvxiPort,asynUser *pasynUser);
 static asynStatus vxiDisconnectPort(vxiPort *pvxiPort);
 
@@ -150,6 +157,7 @@ static asynStatus vxiSerialPollBegin(void *drvPvt);
 static asynStatus vxiSerialPoll(void *drvPvt, int addr,
     double timeout,int *statusByte);
 static asynStatus vxiSerialPollEnd(void *drvPvt);
+static asynStatus vxiAbort(void *drvPvt,asynUser *pasynUser,int yesNo);
 
 static asynGpibPort vxi11 = {
     vxiReport,
@@ -168,7 +176,8 @@ static asynGpibPort vxi11 = {
     vxiSrqEnable,
     vxiSerialPollBegin,
     vxiSerialPoll,
-    vxiSerialPollEnd
+    vxiSerialPollEnd,
+    vxiAbort
 };
 
 static asynStatus vxiSetPortOption(void *drvPvt,
@@ -562,7 +571,7 @@ static enum clnt_stat clientIoCall(vxiPort * pvxiPort,asynUser *pasynUser,
     while(TRUE) {
         stat = clnt_call(pvxiPort->rpcClient,
             req, proc1, addr1, proc2, addr2, rpcTimeout);
-        if(timeout>=0.0 || stat!=RPC_TIMEDOUT) break;
+        if(timeout>=0.0 || stat!=RPC_TIMEDOUT || pvxiPort->aborting) break;
     }
     if(stat!=RPC_SUCCESS) {
         asynPrint(pasynUser,ASYN_TRACE_ERROR,
@@ -846,6 +855,63 @@ static void vxiSrqThread(void *arg)
     epicsEventSignal(pvxiPort->srqThreadDone);
 }
 
+/*
+ * VXI-11 has an abort channel, a second TCP connection to the server.
+ * device_abort on it makes a device_read or device_write in progress on
+ * the core channel return with error VXI_ABORT. vxiAbort is called with
+ * asynManager locks held so the RPC is done by this thread.
+ */
+static void vxiAbortThread(void *arg)
+{
+    vxiPort        *pvxiPort = arg;
+    enum clnt_stat clntStat;
+    Device_Link    lid;
+    Device_Error   devErr;
+
+    while(1) {
+        epicsEventMustWait(pvxiPort->abortEvent);
+        if(!pvxiPort->aborting || pvxiPort->abortPort==0) continue;
+        lid = pvxiPort->abortLid;
+        if(!pvxiPort->abortClient) {
+            struct sockaddr_in abortServer;
+            int                sock = -1;
+
+            memset((void *)&abortServer, 0, sizeof abortServer);
+            abortServer.sin_family = AF_INET;
+            abortServer.sin_port = htons(pvxiPort->abortPort);
+            abortServer.sin_addr = pvxiPort->inAddr;
+            pvxiPort->abortClient = clnttcp_create(&abortServer,
+                DEVICE_ASYNC, DEVICE_ASYNC_VERSION, &sock, 0, 0);
+            if(!pvxiPort->abortClient) {
+                asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+                    "%s vxiAbortThread error %s\n",pvxiPort->portName,
+                    clnt_spcreateerror(pvxiPort->hostName));
+                continue;
+            }
+        }
+        memset((char *) &devErr, 0, sizeof(Device_Error));
+        clntStat = clnt_call(pvxiPort->abortClient, device_abort,
+            (const xdrproc_t) xdr_Device_Link, (void *) &lid,
+            (const xdrproc_t) xdr_Device_Error, (void *) &devErr,
+            pvxiPort->vxiRpcTimeout);
+        if(clntStat != RPC_SUCCESS) {
+            /* The server may have restarted. Connect again next time */
+            asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+                "%s vxiAbortThread RPC error %s\n",pvxiPort->portName,
+                clnt_sperror(pvxiPort->abortClient,""));
+            clnt_destroy(pvxiPort->abortClient);
+            pvxiPort->abortClient = 0;
+        } else if(devErr.error != VXI_OK) {
+            asynPrint(pvxiPort->pasynUser,ASYN_TRACE_ERROR,
+                "%s vxiAbortThread device_abort error %s\n",
+                pvxiPort->portName,vxiError(devErr.error));
+        } else {
+            asynPrint(pvxiPort->pasynUser,ASYN_TRACE_FLOW,
+                "%s vxiAbortThread device_abort\n",pvxiPort->portName);
+        }
+    }
+}
+
 static asynStatus vxiConnectPort(vxiPort *pvxiPort,asynUser *pasynUser)
 {
     int         isController;
@@ -1121,6 +1187,11 @@ static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
             "%s port is not connected",pvxiPort->portName);
         return asynError;
     }
+    if(pvxiPort->aborting) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s I/O aborted",pvxiPort->portName);
+        return asynError;
+    }
     devReadP.lid = pdevLink->lid;
     /* device link is created; do the read */
     do {
@@ -1142,7 +1213,7 @@ static asynStatus vxiRead(void *drvPvt,asynUser *pasynUser,
                 (const xdrproc_t) xdr_Device_ReadResp,(void *) &devReadR);
             if(devReadP.io_timeout!=UINT_MAX
             || devReadR.error!=VXI_IOTIMEOUT
-            || devReadR.data.data_len>0) break;
+            || devReadR.data.data_len>0 || pvxiPort->aborting) break;
         }
         if(clntStat != RPC_SUCCESS) {
             epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
@@ -1208,6 +1279,11 @@ static asynStatus vxiWrite(void *drvPvt,asynUser *pasynUser,
             "%s port is not connected",pvxiPort->portName);
         return asynError;
     }
+    if(pvxiPort->aborting) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+            "%s I/O aborted",pvxiPort->portName);
+        return asynError;
+    }
     devWriteP.lid = pdevLink->lid;;
     devWriteP.io_timeout = getIoTimeout(pasynUser,pvxiPort);
     devWriteP.lock_timeout = 0;
@@ -1617,6 +1693,29 @@ static asynStatus vxiSerialPollEnd(void *drvPvt)
     return asynSuccess;
 }
 
+static asynStatus vxiAbort(void *drvPvt,asynUser *pasynUser,int yesNo)
+{
+    vxiPort    *pvxiPort = (vxiPort *)drvPvt;
+    int        addr;
+    devLink    *pdevLink;
+    asynStatus status;
+
+    if(!yesNo) {
+        pvxiPort->aborting = 0;
+        return asynSuccess;
+    }
+    status = pasynManager->getAddr(pasynUser,&addr);
+    if(status!=asynSuccess) return status;
+    pdevLink = vxiGetDevLink(pvxiPort,pasynUser,addr);
+    if(!pdevLink) return asynError;
+    pvxiPort->aborting = 1;
+    if(pdevLink->connected) {
+        pvxiPort->abortLid = pdevLink->lid;
+        epicsEventSignal(pvxiPort->abortEvent);
+    }
+    return asynSuccess;
+}
+
 static asynStatus vxiSetPortOption(void *drvPvt,
     asynUser *pasynUser,const char *key, const char *val)
 {
@@ -1688,6 +1787,7 @@ int vxi11Configure(char *dn, char *hostName, int flags,
     len = sizeof(vxiPort); /*for vxiPort*/
     len += strlen(dn) + 1; /*for portName*/
     len += strlen(dn) + 4; /*for <portName>SRQ*/
+    len += strlen(dn) + 6; /*for <portName>Abort*/
     pvxiPort = callocMustSucceed(len,sizeof(char),"vxi11Configure");
     pvxiPort->vxiRpcTimeout.tv_sec = DEFAULT_RPC_TIMEOUT;
     pvxiPort->portName = portName = (char *)(pvxiPort+1);
@@ -1695,6 +1795,13 @@ int vxi11Configure(char *dn, char *hostName, int flags,
     pvxiPort->srqThreadName = srqThreadName = portName + strlen(dn) + 1;
     strcpy(srqThreadName,dn);
     strcat(srqThreadName,"SRQ");
+    pvxiPort->abortThreadName = srqThreadName + strlen(srqThreadName) + 1;
+    strcpy(pvxiPort->abortThreadName,dn);
+    strcat(pvxiPort->abortThreadName,"Abort");
+    pvxiPort->abortEvent = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate(pvxiPort->abortThreadName, 46,
+          epicsThreadGetStackSize(epicsThreadStackMedium),
+          vxiAbortThread,pvxiPort);
     pvxiPort->srqEnabled = -1;
     pvxiPort->server.eos = -1;
     for(addr = 0; addr < NUM_GPIB_ADDRESSES; addr++) {
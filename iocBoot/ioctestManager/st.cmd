@@ -16,5 +16,11 @@ testManagerDriverInit("canBlockMulti",1,0,1)
 #asynSetTraceMask("canBlockSingle",-1,0xff)
 #asynSetTraceMask("canBlockSingle",1,0xff)
 
+# queueRequest throughput and latency: port nThreads nRequests nAddr priority
+#testQueueBench("canBlockMulti",16,10000,2,0)
+
+# memMalloc/memFree scaling: nThreads nIterations size
+#testMemBench(8,100000,64)
+
 dbLoadRecords("../../db/asynRecord.db","P=asyn,R=Record,PORT=cantBlockSingle,ADDR=0,OMAX=0,IMAX=0")
 iocInit()
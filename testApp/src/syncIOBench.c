@@ -0,0 +1,105 @@
+/* syncIOBench.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Measures the round trip time of asynOctetSyncIO writeRead calls.
+ * Each call goes through queueLockPort and queueUnlockPort, so on an
+ * idle echoDriver port this shows their overhead. For example
+ *     echoDriverInit("echo",0.000001,0,0)
+ *     syncIOBench("echo",0,100000)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+
+#include <asynDriver.h>
+#include <asynOctetSyncIO.h>
+
+#include <epicsExport.h>
+
+static int compareDouble(const void *p1,const void *p2)
+{
+    double d1 = *(const double *)p1;
+    double d2 = *(const double *)p2;
+
+    return (d1<d2) ? -1 : ((d1>d2) ? 1 : 0);
+}
+
+static void syncIOBench(const char *portName,int addr,int nRequests)
+{
+    static const char message[] = "syncIOBench";
+    asynUser       *pasynUser;
+    asynStatus     status;
+    double         *latency;
+    char           buffer[sizeof(message)];
+    size_t         nwrite,nread;
+    int            eomReason;
+    epicsTimeStamp startTime,endTime;
+    double         elapsed;
+    int            n;
+
+    if(nRequests<=0) nRequests = 10000;
+    status = pasynOctetSyncIO->connect(portName,addr,&pasynUser,0);
+    if(status!=asynSuccess) {
+        printf("syncIOBench connect failed %s\n",pasynUser->errorMessage);
+        return;
+    }
+    latency = callocMustSucceed(nRequests,sizeof(double),"syncIOBench");
+    epicsTimeGetCurrent(&startTime);
+    for(n=0; n<nRequests; n++) {
+        epicsTimeStamp before,after;
+
+        epicsTimeGetCurrent(&before);
+        status = pasynOctetSyncIO->writeRead(pasynUser,
+            message,strlen(message),buffer,sizeof(buffer),
+            1.0,&nwrite,&nread,&eomReason);
+        epicsTimeGetCurrent(&after);
+        if(status!=asynSuccess) {
+            printf("syncIOBench writeRead failed %s\n",pasynUser->errorMessage);
+            break;
+        }
+        latency[n] = epicsTimeDiffInSeconds(&after,&before);
+    }
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime,&startTime);
+    printf("%s addr %d writeRead %d elapsed %.3f seconds\n",
+        portName,addr,n,elapsed);
+    if(n>0 && elapsed>0.0) {
+        qsort(latency,n,sizeof(double),compareDouble);
+        printf("    %.0f calls/second\n",n/elapsed);
+        printf("    round trip microseconds p50 %.1f p99 %.1f max %.1f\n",
+            latency[n/2]*1e6,latency[(int)(n*0.99)]*1e6,latency[n-1]*1e6);
+    }
+    free(latency);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+static const iocshArg syncIOBenchArg0 = {"port", iocshArgString};
+static const iocshArg syncIOBenchArg1 = {"addr", iocshArgInt};
+static const iocshArg syncIOBenchArg2 = {"nRequests", iocshArgInt};
+static const iocshArg *const syncIOBenchArgs[] = {
+    &syncIOBenchArg0,&syncIOBenchArg1,&syncIOBenchArg2};
+static const iocshFuncDef syncIOBenchDef = {"syncIOBench", 3, syncIOBenchArgs};
+static void syncIOBenchCall(const iocshArgBuf * args)
+{
+    syncIOBench(args[0].sval,args[1].ival,args[2].ival);
+}
+
+static void syncIOBenchRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&syncIOBenchDef,syncIOBenchCall);
+}
+epicsExportRegistrar(syncIOBenchRegister);
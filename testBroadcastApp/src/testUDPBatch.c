@@ -0,0 +1,176 @@
+/*
+ * testUDPBatch.c
+ *
+ * Program to measure how fast a drvAsynIPPort UDP port reads bursts of datagrams.
+ * Usage: testUDPBatch udpPort numBurst numLoops delayTime batchSize
+ *
+ * A thread sends numLoops bursts of numBurst datagrams to 127.0.0.1:udpPort,
+ * sleeping delayTime seconds after each burst, like testBroadcastBurst.
+ * The main thread reads them with asynOctetSyncIO from a port bound to udpPort.
+ * If batchSize > 0 the port is given the option datagramBatch=batchSize.
+ * An asynOctet interrupt callback measures the time from the receive timestamp
+ * in pasynUser->timestamp to the callback.
+ * Run it once with batchSize 0 and once with for example 64 and compare.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <epicsThread.h>
+#include <epicsTime.h>
+
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynOctetSyncIO.h>
+#include <drvAsynIPPort.h>
+#include <asynShellCommands.h>
+
+#define PORT_NAME "UDPBATCH"
+
+typedef struct {
+    int    port;
+    int    numBurst;
+    int    numLoops;
+    double delayTime;
+    int    numSent;
+} sender_t;
+
+typedef struct {
+    int    numCallbacks;
+    int    numStamped;
+    double sumLatency;
+    double maxLatency;
+} latency_t;
+
+static void senderThread(void *arg)
+{
+    sender_t *psender = (sender_t *)arg;
+    struct sockaddr_in rem;
+    struct timespec ts, tsrem;
+    char buffer[64];
+    int usock;
+    int i, j;
+
+    ts.tv_sec = (time_t)(int)psender->delayTime;
+    ts.tv_nsec = (psender->delayTime - (int)psender->delayTime)*1.e9;
+    usock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&rem, 0, sizeof(rem));
+    rem.sin_family = AF_INET;
+    rem.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    rem.sin_port = htons((uint16_t)psender->port);
+    for (i=0; i<psender->numLoops; i++) {
+        for (j=0; j<psender->numBurst; j++) {
+            int len = sprintf(buffer, "datagram %d %d", i, j);
+            if (sendto(usock, buffer, len, 0, (struct sockaddr *)&rem, sizeof(rem)) == len)
+                psender->numSent++;
+        }
+        nanosleep(&ts, &tsrem);
+    }
+    close(usock);
+}
+
+static void latencyCallback(void *userPvt, asynUser *pasynUser,
+                            char *data, size_t numchars, int eomReason)
+{
+    latency_t *platency = (latency_t *)userPvt;
+    epicsTimeStamp now;
+    double latency;
+
+    platency->numCallbacks++;
+    if (pasynUser->timestamp.secPastEpoch == 0) return;
+    epicsTimeGetCurrent(&now);
+    latency = epicsTimeDiffInSeconds(&now, &pasynUser->timestamp);
+    platency->numStamped++;
+    platency->sumLatency += latency;
+    if (latency > platency->maxLatency) platency->maxLatency = latency;
+}
+
+int main(int argc, char *argv[])
+{
+    char hostInfo[64];
+    char buffer[256];
+    asynStatus status;
+    size_t nread;
+    int eomReason;
+    int batchSize;
+    int numRead = 0;
+    asynUser *pasynUser, *pasynUserInterrupt;
+    asynInterface *pasynInterface;
+    asynOctet *pasynOctet;
+    void *interruptPvt;
+    sender_t sender;
+    latency_t latency;
+    epicsTimeStamp startTime, endTime;
+    double elapsed;
+
+    if (argc != 6) {
+        printf("Usage: testUDPBatch udpPort numBurst numLoops delayTime batchSize\n");
+        return -1;
+    }
+    memset(&sender, 0, sizeof(sender));
+    memset(&latency, 0, sizeof(latency));
+    sender.port = atoi(argv[1]);
+    sender.numBurst = atoi(argv[2]);
+    sender.numLoops = atoi(argv[3]);
+    sender.delayTime = atof(argv[4]);
+    batchSize = atoi(argv[5]);
+
+    sprintf(hostInfo, "127.0.0.1:%d:%d UDP", sender.port, sender.port);
+    status = (asynStatus)drvAsynIPPortConfigure(PORT_NAME, hostInfo, 0, 0, 0);
+    if (status) {
+        printf("drvAsynIPPortConfigure failed for %s\n", hostInfo);
+        return -1;
+    }
+    if (batchSize > 0) {
+        sprintf(buffer, "%d", batchSize);
+        asynSetOption(PORT_NAME, 0, "datagramBatch", buffer);
+    }
+    status = pasynOctetSyncIO->connect(PORT_NAME, 0, &pasynUser, NULL);
+    if (status) {
+        printf("Can't connect to %s: %s\n", PORT_NAME, pasynUser->errorMessage);
+        return -1;
+    }
+
+    pasynUserInterrupt = pasynManager->createAsynUser(0, 0);
+    pasynManager->connectDevice(pasynUserInterrupt, PORT_NAME, 0);
+    pasynInterface = pasynManager->findInterface(pasynUserInterrupt, asynOctetType, 1);
+    if (!pasynInterface) {
+        printf("%s has no asynOctet interface\n", PORT_NAME);
+        return -1;
+    }
+    pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    pasynOctet->registerInterruptUser(pasynInterface->drvPvt, pasynUserInterrupt,
+                                      latencyCallback, &latency, &interruptPvt);
+
+    epicsThreadCreate("testUDPBatchSender", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      senderThread, &sender);
+    /* The first read waits for the sender to start */
+    status = pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer), 5.0, &nread, &eomReason);
+    epicsTimeGetCurrent(&startTime);
+    endTime = startTime;
+    while (status == asynSuccess) {
+        numRead++;
+        epicsTimeGetCurrent(&endTime);
+        status = pasynOctetSyncIO->read(pasynUser, buffer, sizeof(buffer), 1.0, &nread, &eomReason);
+    }
+    elapsed = epicsTimeDiffInSeconds(&endTime, &startTime);
+
+    printf("batchSize %d: sent %d datagrams, read %d in %.3f seconds\n",
+           batchSize, sender.numSent, numRead, elapsed);
+    if (elapsed > 0.)
+        printf("    %.0f datagrams/second\n", (numRead - 1) / elapsed);
+    if (latency.numStamped > 0)
+        printf("    %d of %d callbacks timestamped, receive to callback mean %.1f max %.1f microseconds\n",
+               latency.numStamped, latency.numCallbacks,
+               latency.sumLatency / latency.numStamped * 1e6, latency.maxLatency * 1e6);
+    asynReport(2, PORT_NAME);
+    return 0;
+}
@@ -0,0 +1,381 @@
+/* ipEosCompare.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Checks that the input EOS processing of drvAsynIPPort gives the same
+ * read results as asynInterposeEos.  Two ports connect to a listening
+ * socket on localhost.  The driver port finds the input EOS itself
+ * (noProcessEos=0).  The reference port has noProcessEos=1 and
+ * asynInterposeEos for input.  The same bytes are sent to both and every
+ * read must return the same status, nbytes, eomReason and data.
+ *     ipEosCompare(seed,iterations)
+ * sends iterations random streams and then checks
+ *     a two character EOS split across packets while a read is waiting
+ *     maxchars that ends before, inside or after the EOS
+ *     a timeout with the first EOS character held, then the rest
+ *     a peer close after data, which must return ASYN_EOM_END
+ * seed 0 uses the current time.
+ * Only available on Linux.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <cantProceed.h>
+#include <epicsEvent.h>
+#include <epicsStdio.h>
+#include <epicsString.h>
+#include <epicsThread.h>
+#include <iocsh.h>
+
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <asynInterposeEos.h>
+#include <drvAsynIPPort.h>
+
+#include <epicsExport.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define COMPARE_TIMEOUT 0.02
+#define COMPARE_WAIT 0.5
+#define COMPARE_CONNECT_TIMEOUT 2.0
+#define COMPARE_BUFFER_SIZE 400
+#define COMPARE_MAX_STREAM 300
+#define COMPARE_MAX_READS 1000
+
+typedef struct comparePort {
+    const char *name;
+    asynUser   *pasynUser;
+    asynOctet  *pasynOctet;
+    void       *octetPvt;
+    int        fd;
+} comparePort;
+
+typedef struct readResult {
+    asynStatus status;
+    size_t     nbytes;
+    int        eomReason;
+    char       data[COMPARE_BUFFER_SIZE];
+} readResult;
+
+typedef struct delayedWrite {
+    int          fd;
+    const char   *data;
+    double       delay;
+    epicsEventId done;
+} delayedWrite;
+
+static int nPairs;
+
+static int listenLocal(char *hostInfo, size_t size)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof addr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) < 0
+     || listen(fd, 2) < 0
+     || getsockname(fd, (struct sockaddr *)&addr, &addrlen) < 0) {
+        close(fd);
+        return -1;
+    }
+    epicsSnprintf(hostInfo, size, "127.0.0.1:%d", ntohs(addr.sin_port));
+    return fd;
+}
+
+static int openPort(comparePort *pport, const char *portName,
+                    const char *hostInfo, int listenFd, int driverEos)
+{
+    asynInterface *pasynInterface;
+
+    pport->name = epicsStrDup(portName);
+    if (drvAsynIPPortConfigure(portName, hostInfo, 0, 0, driverEos ? 0 : 1) != 0)
+        return -1;
+    if (!driverEos && asynInterposeEosConfig(portName, -1, 1, 1) != 0)
+        return -1;
+    pport->pasynUser = pasynManager->createAsynUser(0, 0);
+    pport->pasynUser->timeout = COMPARE_TIMEOUT;
+    if (pasynManager->connectDevice(pport->pasynUser, portName, 0) != asynSuccess
+     || !(pasynInterface = pasynManager->findInterface(
+            pport->pasynUser, asynOctetType, 1))
+     || pasynManager->waitConnect(pport->pasynUser, COMPARE_CONNECT_TIMEOUT)
+            != asynSuccess) {
+        printf("ipEosCompare %s %s\n", portName, pport->pasynUser->errorMessage);
+        return -1;
+    }
+    pport->pasynOctet = (asynOctet *)pasynInterface->pinterface;
+    pport->octetPvt = pasynInterface->drvPvt;
+    pport->fd = accept(listenFd, NULL, NULL);
+    return (pport->fd < 0) ? -1 : 0;
+}
+
+static void setEos(comparePort *pport, const char *eos, int eoslen)
+{
+    pport->pasynOctet->setInputEos(pport->octetPvt, pport->pasynUser, eos, eoslen);
+    pport->pasynOctet->flush(pport->octetPvt, pport->pasynUser);
+}
+
+static void sendBoth(comparePort *pports, const char *data, size_t len)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+        if (write(pports[i].fd, data, len) != (ssize_t)len)
+            printf("ipEosCompare write %s %s\n", pports[i].name, strerror(errno));
+    epicsThreadSleep(0.002);
+}
+
+static void readOne(comparePort *pport, size_t maxchars, readResult *presult)
+{
+    memset(presult->data, '#', sizeof presult->data);
+    presult->nbytes = 0;
+    presult->eomReason = 0;
+    presult->status = pport->pasynOctet->read(pport->octetPvt, pport->pasynUser,
+        presult->data, maxchars, &presult->nbytes, &presult->eomReason);
+}
+
+/* Returns 1 and prints both results if they differ */
+static int compareResults(const char *what, size_t maxchars,
+                          const readResult *pdriver, const readResult *preference)
+{
+    if (pdriver->status == preference->status
+     && pdriver->nbytes == preference->nbytes
+     && pdriver->eomReason == preference->eomReason
+     && memcmp(pdriver->data, preference->data, pdriver->nbytes) == 0)
+        return 0;
+    printf("ipEosCompare %s maxchars %d\n", what, (int)maxchars);
+    printf("    driver    status %d nbytes %d eomReason %d \"%.*s\"\n",
+           pdriver->status, (int)pdriver->nbytes, pdriver->eomReason,
+           (int)pdriver->nbytes, pdriver->data);
+    printf("    reference status %d nbytes %d eomReason %d \"%.*s\"\n",
+           preference->status, (int)preference->nbytes, preference->eomReason,
+           (int)preference->nbytes, preference->data);
+    return 1;
+}
+
+/* Reads both ports until one of them does not return asynSuccess */
+static int readUntilTimeout(comparePort *pports, const char *what,
+                            size_t maxchars, int *pnReads)
+{
+    readResult driver, reference;
+    int nMismatch = 0, n;
+
+    for (n = 0; n < COMPARE_MAX_READS; n++) {
+        readOne(&pports[0], maxchars, &driver);
+        readOne(&pports[1], maxchars, &reference);
+        (*pnReads)++;
+        nMismatch += compareResults(what, maxchars, &driver, &reference);
+        if (driver.status != asynSuccess || reference.status != asynSuccess)
+            break;
+    }
+    return nMismatch;
+}
+
+static int randomStreams(comparePort *pports, int iterations, int *pnReads)
+{
+    char stream[COMPARE_MAX_STREAM];
+    char what[40];
+    int  nMismatch = 0, iter, i;
+
+    for (iter = 0; iter < iterations; iter++) {
+        char   eos[2] = {'\r', '\n'};
+        int    eoslen = 1 + rand() % 2;
+        int    n = rand() % COMPARE_MAX_STREAM;
+        size_t maxchars;
+
+        if (eoslen == 1) eos[0] = "\n\r"[rand() % 2];
+        for (i = 0; i < 2; i++) setEos(&pports[i], eos, eoslen);
+        for (i = 0; i < n; i++) stream[i] = "ab\r\n"[rand() % 4];
+        sendBoth(pports, stream, n);
+        maxchars = 1 + rand() % 40;
+        epicsSnprintf(what, sizeof what, "random stream %d", iter);
+        nMismatch += readUntilTimeout(pports, what, maxchars, pnReads);
+    }
+    return nMismatch;
+}
+
+static void delayedWriteThread(delayedWrite *pwrite)
+{
+    epicsThreadSleep(pwrite->delay);
+    if (write(pwrite->fd, pwrite->data, strlen(pwrite->data))
+            != (ssize_t)strlen(pwrite->data))
+        printf("ipEosCompare delayed write %s\n", strerror(errno));
+    epicsEventSignal(pwrite->done);
+}
+
+/* "\r" arrives with the data, "\n" only while the read is waiting */
+static int splitEos(comparePort *pports)
+{
+    readResult   first[2], rest[2];
+    delayedWrite dwrite;
+    int          i, nMismatch;
+
+    dwrite.done = epicsEventMustCreate(epicsEventEmpty);
+    for (i = 0; i < 2; i++) {
+        comparePort *pport = &pports[i];
+
+        setEos(pport, "\r\n", 2);
+        pport->pasynUser->timeout = COMPARE_WAIT;
+        if (write(pport->fd, "ab\r", 3) != 3)
+            printf("ipEosCompare write %s %s\n", pport->name, strerror(errno));
+        dwrite.fd = pport->fd;
+        dwrite.data = "\ncd";
+        dwrite.delay = 0.05;
+        epicsThreadCreate("ipEosCompareWrite", epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackSmall),
+                          (EPICSTHREADFUNC)delayedWriteThread, &dwrite);
+        readOne(pport, COMPARE_BUFFER_SIZE, &first[i]);
+        epicsEventMustWait(dwrite.done);
+        pport->pasynUser->timeout = COMPARE_TIMEOUT;
+        readOne(pport, COMPARE_BUFFER_SIZE, &rest[i]);
+    }
+    epicsEventDestroy(dwrite.done);
+    nMismatch = compareResults("split EOS", COMPARE_BUFFER_SIZE, &first[0], &first[1]);
+    nMismatch += compareResults("split EOS rest", COMPARE_BUFFER_SIZE, &rest[0], &rest[1]);
+    if (first[0].status != asynSuccess || !(first[0].eomReason & ASYN_EOM_EOS)
+     || first[0].nbytes != 2) {
+        printf("ipEosCompare split EOS did not end the read at the EOS\n");
+        nMismatch++;
+    }
+    return nMismatch;
+}
+
+static int maxcharsBoundary(comparePort *pports, int *pnReads)
+{
+    static const char stream[] = "abc\r\nd\r\n";
+    int    nMismatch = 0, i;
+    size_t maxchars;
+
+    for (maxchars = 3; maxchars <= 5; maxchars++) {
+        for (i = 0; i < 2; i++) setEos(&pports[i], "\r\n", 2);
+        sendBoth(pports, stream, strlen(stream));
+        nMismatch += readUntilTimeout(pports, "EOS boundary", maxchars, pnReads);
+    }
+    return nMismatch;
+}
+
+/* The first read times out holding "\r", the second gets the EOS */
+static int heldEos(comparePort *pports, int *pnReads)
+{
+    readResult driver, reference;
+    int        nMismatch, i;
+
+    for (i = 0; i < 2; i++) setEos(&pports[i], "\r\n", 2);
+    sendBoth(pports, "ab\r", 3);
+    readOne(&pports[0], COMPARE_BUFFER_SIZE, &driver);
+    readOne(&pports[1], COMPARE_BUFFER_SIZE, &reference);
+    (*pnReads)++;
+    nMismatch = compareResults("held EOS timeout", COMPARE_BUFFER_SIZE,
+                               &driver, &reference);
+    sendBoth(pports, "\ncd\r\n", 5);
+    nMismatch += readUntilTimeout(pports, "held EOS rest", COMPARE_BUFFER_SIZE,
+                                  pnReads);
+    return nMismatch;
+}
+
+/* Must be the last check because the connections are closed */
+static int peerClose(comparePort *pports)
+{
+    readResult driver, reference;
+    int        nMismatch, i;
+
+    for (i = 0; i < 2; i++) setEos(&pports[i], "\r\n", 2);
+    sendBoth(pports, "xy\r", 3);
+    for (i = 0; i < 2; i++) {
+        close(pports[i].fd);
+        pports[i].fd = -1;
+    }
+    epicsThreadSleep(0.002);
+    readOne(&pports[0], COMPARE_BUFFER_SIZE, &driver);
+    readOne(&pports[1], COMPARE_BUFFER_SIZE, &reference);
+    nMismatch = compareResults("peer close", COMPARE_BUFFER_SIZE, &driver, &reference);
+    if (driver.status != asynSuccess || !(driver.eomReason & ASYN_EOM_END)) {
+        printf("ipEosCompare peer close did not return ASYN_EOM_END\n");
+        nMismatch++;
+    }
+    return nMismatch;
+}
+
+static void reportCheck(const char *name, int nMismatch, int *pnFailed)
+{
+    printf("ipEosCompare %-16s %s\n", name, nMismatch ? "FAILED" : "OK");
+    if (nMismatch) (*pnFailed)++;
+}
+
+static void ipEosCompare(int seed, int iterations)
+{
+    comparePort ports[2];
+    char        hostInfo[40], portName[40];
+    int         listenFd, nReads = 0, nFailed = 0, i;
+
+    if (seed == 0) seed = (int)time(NULL);
+    if (iterations <= 0) iterations = 200;
+    memset(ports, 0, sizeof ports);
+    listenFd = listenLocal(hostInfo, sizeof hostInfo);
+    if (listenFd < 0) {
+        printf("ipEosCompare can't listen: %s\n", strerror(errno));
+        return;
+    }
+    for (i = 0; i < 2; i++) {
+        epicsSnprintf(portName, sizeof portName, "ipEosCompare%s%d",
+                      i == 0 ? "Driver" : "Reference", nPairs);
+        if (openPort(&ports[i], portName, hostInfo, listenFd, i == 0) != 0) {
+            printf("ipEosCompare can't connect %s\n", portName);
+            close(listenFd);
+            return;
+        }
+    }
+    nPairs++;
+    printf("ipEosCompare seed %d iterations %d\n", seed, iterations);
+    srand(seed);
+    reportCheck("random streams", randomStreams(ports, iterations, &nReads), &nFailed);
+    reportCheck("split EOS", splitEos(ports), &nFailed);
+    reportCheck("EOS boundary", maxcharsBoundary(ports, &nReads), &nFailed);
+    reportCheck("held EOS", heldEos(ports, &nReads), &nFailed);
+    reportCheck("peer close", peerClose(ports), &nFailed);
+    close(listenFd);
+    printf("ipEosCompare %d reads, %d of 5 checks failed\n", nReads, nFailed);
+}
+#else
+static void ipEosCompare(int seed, int iterations)
+{
+    printf("ipEosCompare is only available on Linux\n");
+}
+#endif
+
+static const iocshArg ipEosCompareArg0 = {"seed", iocshArgInt};
+static const iocshArg ipEosCompareArg1 = {"iterations", iocshArgInt};
+static const iocshArg *const ipEosCompareArgs[] = {
+    &ipEosCompareArg0, &ipEosCompareArg1};
+static const iocshFuncDef ipEosCompareDef = {"ipEosCompare", 2, ipEosCompareArgs};
+static void ipEosCompareCall(const iocshArgBuf * args)
+{
+    ipEosCompare(args[0].ival, args[1].ival);
+}
+
+static void ipEosCompareRegister(void)
+{
+    static int firstTime = 1;
+    if (!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&ipEosCompareDef, ipEosCompareCall);
+}
+epicsExportRegistrar(ipEosCompareRegister);
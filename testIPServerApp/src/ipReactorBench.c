@@ -0,0 +1,312 @@
+/* ipReactorBench.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Measures aggregate transactions/second and memory for many drvAsynIPPort
+ * ports talking to simulated devices on localhost.  A single thread echoes
+ * every line it receives on nDevices TCP connections.  Each port keeps one
+ * request queued whose callback writes a line and reads the reply through
+ * asynInterposeEos.  Compare for example
+ *     asynSetThreadPool(32)
+ *     ipReactorBench(2000,10)
+ * with
+ *     asynSetThreadPool(32)
+ *     drvAsynIPPortReactor(2)
+ *     ipReactorBench(2000,10)
+ * Only available on Linux.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+
+#include <asynDriver.h>
+#include <asynOctet.h>
+#include <drvAsynIPPort.h>
+
+#include <epicsExport.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BENCH_TIMEOUT 2.0
+#define BENCH_BUFFER_SIZE 80
+
+typedef struct benchDevice {
+    struct bench  *pbench;
+    asynUser      *pasynUser;
+    asynOctet     *pasynOctet;
+    void          *octetPvt;
+    char          message[BENCH_BUFFER_SIZE];
+    unsigned long nTransactions;
+    unsigned long nErrors;
+} benchDevice;
+
+typedef struct bench {
+    epicsMutexId  lock;
+    epicsEventId  done;
+    volatile int  stop;
+    int           nRunning;
+    int           listenFd;
+    int           epfd;
+} bench;
+
+typedef struct procStatus {
+    long vmSizeKB;
+    long vmRSSKB;
+    long threads;
+} procStatus;
+
+static void readProcStatus(procStatus *pstatus)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[128];
+
+    memset(pstatus, 0, sizeof(*pstatus));
+    if (!fp) return;
+    while (fgets(line, sizeof line, fp)) {
+        sscanf(line, "VmSize: %ld", &pstatus->vmSizeKB);
+        sscanf(line, "VmRSS: %ld", &pstatus->vmRSSKB);
+        sscanf(line, "Threads: %ld", &pstatus->threads);
+    }
+    fclose(fp);
+}
+
+/* The simulated devices: echo whatever arrives */
+static void echoThread(bench *pbench)
+{
+    struct epoll_event events[64];
+    char buffer[4096];
+    int i, n;
+
+    for (;;) {
+        n = epoll_wait(pbench->epfd, events, 64, -1);
+        for (i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            ssize_t nread;
+
+            if (fd == pbench->listenFd) {
+                struct epoll_event event;
+                int newFd = accept(pbench->listenFd, NULL, NULL);
+
+                if (newFd < 0) continue;
+                memset(&event, 0, sizeof event);
+                event.events = EPOLLIN;
+                event.data.fd = newFd;
+                epoll_ctl(pbench->epfd, EPOLL_CTL_ADD, newFd, &event);
+                continue;
+            }
+            nread = read(fd, buffer, sizeof buffer);
+            if (nread <= 0) {
+                close(fd);
+                continue;
+            }
+            if (write(fd, buffer, nread) != nread)
+                close(fd);
+        }
+    }
+}
+
+static int startEchoServer(bench *pbench, int nDevices)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof addr;
+    struct epoll_event event;
+
+    pbench->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (pbench->listenFd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(pbench->listenFd, (struct sockaddr *)&addr, sizeof addr) < 0
+     || listen(pbench->listenFd, nDevices) < 0
+     || getsockname(pbench->listenFd, (struct sockaddr *)&addr, &addrlen) < 0) {
+        close(pbench->listenFd);
+        return -1;
+    }
+    pbench->epfd = epoll_create(64);
+    memset(&event, 0, sizeof event);
+    event.events = EPOLLIN;
+    event.data.fd = pbench->listenFd;
+    epoll_ctl(pbench->epfd, EPOLL_CTL_ADD, pbench->listenFd, &event);
+    epicsThreadCreate("ipReactorBenchEcho", epicsThreadPriorityHigh,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      (EPICSTHREADFUNC)echoThread, pbench);
+    return ntohs(addr.sin_port);
+}
+
+static void benchCallback(asynUser *pasynUser)
+{
+    benchDevice *pdev = (benchDevice *)pasynUser->userPvt;
+    bench       *pbench = pdev->pbench;
+    char        buffer[BENCH_BUFFER_SIZE];
+    size_t      nbytes;
+    int         eomReason;
+    asynStatus  status;
+
+    status = pdev->pasynOctet->write(pdev->octetPvt, pasynUser,
+        pdev->message, strlen(pdev->message), &nbytes);
+    if (status == asynSuccess)
+        status = pdev->pasynOctet->read(pdev->octetPvt, pasynUser,
+            buffer, sizeof buffer, &nbytes, &eomReason);
+    if (status == asynSuccess && (eomReason & ASYN_EOM_EOS)
+     && nbytes == strlen(pdev->message)
+     && memcmp(buffer, pdev->message, nbytes) == 0)
+        pdev->nTransactions++;
+    else
+        pdev->nErrors++;
+    if (!pbench->stop
+     && pasynManager->queueRequest(pasynUser, asynQueuePriorityLow, 0)
+            == asynSuccess)
+        return;
+    epicsMutexMustLock(pbench->lock);
+    if (--pbench->nRunning == 0)
+        epicsEventSignal(pbench->done);
+    epicsMutexUnlock(pbench->lock);
+}
+
+static void ipReactorBench(int nDevices, double seconds)
+{
+    bench          *pbench;
+    benchDevice    *pdevs;
+    procStatus     before, after;
+    struct rlimit  rlim;
+    char           portName[40], hostInfo[40];
+    epicsTimeStamp startTime, endTime;
+    double         elapsed;
+    unsigned long  nTransactions = 0, nErrors = 0;
+    int            port, n, nStarted = 0;
+
+    if (nDevices <= 0) nDevices = 2000;
+    if (seconds <= 0.0) seconds = 10.0;
+    /* Two sockets per device */
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+        rlim.rlim_cur < (rlim_t)(2 * nDevices + 100)) {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+    readProcStatus(&before);
+    pbench = callocMustSucceed(1, sizeof(bench), "ipReactorBench");
+    pbench->lock = epicsMutexMustCreate();
+    pbench->done = epicsEventMustCreate(epicsEventEmpty);
+    port = startEchoServer(pbench, nDevices);
+    if (port < 0) {
+        printf("ipReactorBench can't start echo server: %s\n", strerror(errno));
+        return;
+    }
+    epicsSnprintf(hostInfo, sizeof hostInfo, "127.0.0.1:%d", port);
+    pdevs = callocMustSucceed(nDevices, sizeof(benchDevice), "ipReactorBench");
+    for (n = 0; n < nDevices; n++) {
+        benchDevice   *pdev = &pdevs[n];
+        asynInterface *pasynInterface;
+
+        epicsSnprintf(portName, sizeof portName, "ipReactorBench%d", n);
+        if (drvAsynIPPortConfigure(portName, hostInfo, 0, 0, 0) != 0) break;
+        pdev->pbench = pbench;
+        epicsSnprintf(pdev->message, sizeof pdev->message,
+                      "ipReactorBench device %d", n);
+        pdev->pasynUser = pasynManager->createAsynUser(benchCallback, 0);
+        pdev->pasynUser->userPvt = pdev;
+        pdev->pasynUser->timeout = BENCH_TIMEOUT;
+        if (pasynManager->connectDevice(pdev->pasynUser, portName, 0)
+                != asynSuccess
+         || !(pasynInterface = pasynManager->findInterface(
+                pdev->pasynUser, asynOctetType, 1))) {
+            printf("ipReactorBench %s %s\n",
+                   portName, pdev->pasynUser->errorMessage);
+            break;
+        }
+        pdev->pasynOctet = (asynOctet *)pasynInterface->pinterface;
+        pdev->octetPvt = pasynInterface->drvPvt;
+        pdev->pasynOctet->setInputEos(pdev->octetPvt, pdev->pasynUser, "\n", 1);
+        pdev->pasynOctet->setOutputEos(pdev->octetPvt, pdev->pasynUser, "\n", 1);
+        if (pasynManager->waitConnect(pdev->pasynUser, BENCH_TIMEOUT)
+                != asynSuccess) {
+            printf("ipReactorBench %s %s\n",
+                   portName, pdev->pasynUser->errorMessage);
+            break;
+        }
+    }
+    nDevices = n;
+    printf("ipReactorBench %d devices connected\n", nDevices);
+    epicsTimeGetCurrent(&startTime);
+    for (n = 0; n < nDevices; n++) {
+        epicsMutexMustLock(pbench->lock);
+        pbench->nRunning++;
+        epicsMutexUnlock(pbench->lock);
+        if (pasynManager->queueRequest(pdevs[n].pasynUser,
+                asynQueuePriorityLow, 0) != asynSuccess) {
+            epicsMutexMustLock(pbench->lock);
+            pbench->nRunning--;
+            epicsMutexUnlock(pbench->lock);
+            continue;
+        }
+        nStarted++;
+    }
+    epicsThreadSleep(seconds);
+    readProcStatus(&after);
+    pbench->stop = 1;
+    if (nStarted > 0)
+        epicsEventMustWait(pbench->done);
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime, &startTime);
+    for (n = 0; n < nDevices; n++) {
+        nTransactions += pdevs[n].nTransactions;
+        nErrors += pdevs[n].nErrors;
+    }
+    printf("ipReactorBench %d devices %lu transactions %lu errors in %.3f seconds\n",
+           nDevices, nTransactions, nErrors, elapsed);
+    if (elapsed > 0.0)
+        printf("    %.0f transactions/second\n", nTransactions / elapsed);
+    printf("    threads %ld VmRSS %ld kB VmSize %ld kB\n",
+           after.threads - before.threads, after.vmRSSKB - before.vmRSSKB,
+           after.vmSizeKB - before.vmSizeKB);
+    if (nDevices > 0)
+        printf("    per device VmRSS %.1f kB VmSize %.1f kB\n",
+               (double)(after.vmRSSKB - before.vmRSSKB) / nDevices,
+               (double)(after.vmSizeKB - before.vmSizeKB) / nDevices);
+}
+#else
+static void ipReactorBench(int nDevices, double seconds)
+{
+    printf("ipReactorBench is only available on Linux\n");
+}
+#endif
+
+static const iocshArg ipReactorBenchArg0 = {"nDevices", iocshArgInt};
+static const iocshArg ipReactorBenchArg1 = {"seconds", iocshArgDouble};
+static const iocshArg *const ipReactorBenchArgs[] = {
+    &ipReactorBenchArg0, &ipReactorBenchArg1};
+static const iocshFuncDef ipReactorBenchDef = {"ipReactorBench", 2, ipReactorBenchArgs};
+static void ipReactorBenchCall(const iocshArgBuf * args)
+{
+    ipReactorBench(args[0].ival, args[1].dval);
+}
+
+static void ipReactorBenchRegister(void)
+{
+    static int firstTime = 1;
+    if (!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&ipReactorBenchDef, ipReactorBenchCall);
+}
+epicsExportRegistrar(ipReactorBenchRegister);
@@ -0,0 +1,127 @@
+/* testMemBench.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Measures how memMalloc/memFree scale with the number of threads.
+ * Each thread repeatedly allocates a few blocks and frees them again,
+ * the way a driver or interpose layer does for every transaction.
+ * The run is repeated for 1,2,4,... up to nThreads threads.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define BLOCKS_PER_ITERATION 4
+
+typedef struct benchThread {
+    int          nIterations;
+    size_t       size;
+    epicsEventId start;
+    epicsEventId done;
+}benchThread;
+
+static void benchWorker(benchThread *pbenchThread)
+{
+    void *pmem[BLOCKS_PER_ITERATION];
+    int  n,i;
+
+    epicsEventMustWait(pbenchThread->start);
+    for(n=0; n<pbenchThread->nIterations; n++) {
+        for(i=0; i<BLOCKS_PER_ITERATION; i++) {
+            pmem[i] = pasynManager->memMalloc(pbenchThread->size);
+            memset(pmem[i],0,sizeof(int));
+        }
+        for(i=0; i<BLOCKS_PER_ITERATION; i++)
+            pasynManager->memFree(pmem[i],pbenchThread->size);
+    }
+    epicsEventSignal(pbenchThread->done);
+}
+
+static double benchRun(int nThreads,int nIterations,size_t size)
+{
+    benchThread    *pbenchThreads;
+    epicsTimeStamp startTime,endTime;
+    int            i;
+
+    pbenchThreads = callocMustSucceed(nThreads,sizeof(benchThread),
+        "testMemBench");
+    for(i=0; i<nThreads; i++) {
+        benchThread *pbenchThread = &pbenchThreads[i];
+
+        pbenchThread->nIterations = nIterations;
+        pbenchThread->size = size;
+        pbenchThread->start = epicsEventMustCreate(epicsEventEmpty);
+        pbenchThread->done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadMustCreate("memBench",epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            (EPICSTHREADFUNC)benchWorker,pbenchThread);
+    }
+    epicsTimeGetCurrent(&startTime);
+    for(i=0; i<nThreads; i++) epicsEventSignal(pbenchThreads[i].start);
+    for(i=0; i<nThreads; i++) epicsEventMustWait(pbenchThreads[i].done);
+    epicsTimeGetCurrent(&endTime);
+    for(i=0; i<nThreads; i++) {
+        epicsEventDestroy(pbenchThreads[i].start);
+        epicsEventDestroy(pbenchThreads[i].done);
+    }
+    free(pbenchThreads);
+    return epicsTimeDiffInSeconds(&endTime,&startTime);
+}
+
+static void testMemBench(int nThreads,int nIterations,int size)
+{
+    int    n;
+
+    if(nThreads<=0) nThreads = 8;
+    if(nIterations<=0) nIterations = 100000;
+    if(size<=0) size = 64;
+    printf("memMalloc/memFree size %d blocks per iteration %d\n",
+        size,BLOCKS_PER_ITERATION);
+    for(n=1; ; n*=2) {
+        double elapsed;
+        double nCalls;
+
+        if(n>nThreads) n = nThreads;
+        elapsed = benchRun(n,nIterations,(size_t)size);
+        nCalls = 2.0*BLOCKS_PER_ITERATION*nIterations*n;
+        printf("    threads %2d elapsed %.3f seconds %.0f calls/second "
+            "%.1f ns/call/thread\n",
+            n,elapsed,(elapsed>0.0) ? nCalls/elapsed : 0.0,
+            (nCalls>0.0) ? elapsed*1e9*n/nCalls : 0.0);
+        if(n==nThreads) break;
+    }
+}
+
+static const iocshArg testMemBenchArg0 = {"nThreads", iocshArgInt};
+static const iocshArg testMemBenchArg1 = {"nIterations", iocshArgInt};
+static const iocshArg testMemBenchArg2 = {"size", iocshArgInt};
+static const iocshArg *const testMemBenchArgs[] = {
+    &testMemBenchArg0,&testMemBenchArg1,&testMemBenchArg2};
+static const iocshFuncDef testMemBenchDef = {"testMemBench", 3, testMemBenchArgs};
+static void testMemBenchCall(const iocshArgBuf * args)
+{
+    testMemBench(args[0].ival,args[1].ival,args[2].ival);
+}
+
+static void testMemBenchRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testMemBenchDef,testMemBenchCall);
+}
+epicsExportRegistrar(testMemBenchRegister);
@@ -0,0 +1,175 @@
+/* testQueueBench.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Measures queueRequest to processCallback throughput and latency.
+ * Each producer thread owns one asynUser, queues it, and waits for the
+ * callback before queueing again.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+typedef struct benchThread {
+    const char     *portName;
+    int            addr;
+    int            priority;
+    int            nRequests;
+    double         *latency;
+    epicsTimeStamp queued;
+    epicsEventId   callbackDone;
+    epicsEventId   start;
+    epicsEventId   done;
+    int            nErrors;
+}benchThread;
+
+static void benchCallback(asynUser *pasynUser)
+{
+    benchThread    *pbenchThread = (benchThread *)pasynUser->userPvt;
+    epicsTimeStamp now;
+    int            n = (int)pasynUser->reason;
+
+    epicsTimeGetCurrent(&now);
+    pbenchThread->latency[n] = epicsTimeDiffInSeconds(&now,&pbenchThread->queued);
+    epicsEventSignal(pbenchThread->callbackDone);
+}
+
+static void benchProducer(benchThread *pbenchThread)
+{
+    asynUser   *pasynUser;
+    asynStatus status;
+    int        n;
+
+    pasynUser = pasynManager->createAsynUser(benchCallback,0);
+    pasynUser->userPvt = pbenchThread;
+    status = pasynManager->connectDevice(pasynUser,
+        pbenchThread->portName,pbenchThread->addr);
+    if(status!=asynSuccess) {
+        printf("connectDevice failed %s\n",pasynUser->errorMessage);
+        pbenchThread->nErrors++;
+    }
+    epicsEventMustWait(pbenchThread->start);
+    for(n=0; status==asynSuccess && n<pbenchThread->nRequests; n++) {
+        pasynUser->reason = n;
+        epicsTimeGetCurrent(&pbenchThread->queued);
+        status = pasynManager->queueRequest(pasynUser,
+            (asynQueuePriority)pbenchThread->priority,0.0);
+        if(status!=asynSuccess) {
+            printf("queueRequest failed %s\n",pasynUser->errorMessage);
+            pbenchThread->nErrors++;
+            break;
+        }
+        epicsEventMustWait(pbenchThread->callbackDone);
+    }
+    pbenchThread->nRequests = n;
+    pasynManager->freeAsynUser(pasynUser);
+    epicsEventSignal(pbenchThread->done);
+}
+
+static int compareDouble(const void *p1,const void *p2)
+{
+    double d1 = *(const double *)p1;
+    double d2 = *(const double *)p2;
+
+    return (d1<d2) ? -1 : ((d1>d2) ? 1 : 0);
+}
+
+static void testQueueBench(const char *portName,int nThreads,
+    int nRequests,int nAddr,int priority)
+{
+    benchThread    *pbenchThreads;
+    double         *latency;
+    epicsTimeStamp startTime,endTime;
+    double         elapsed;
+    int            nTotal = 0;
+    int            i,n;
+
+    if(nThreads<=0) nThreads = 8;
+    if(nRequests<=0) nRequests = 10000;
+    if(priority<asynQueuePriorityLow || priority>asynQueuePriorityHigh)
+        priority = asynQueuePriorityLow;
+    pbenchThreads = callocMustSucceed(nThreads,sizeof(benchThread),
+        "testQueueBench");
+    latency = callocMustSucceed(nThreads*nRequests,sizeof(double),
+        "testQueueBench");
+    for(i=0; i<nThreads; i++) {
+        benchThread *pbenchThread = &pbenchThreads[i];
+
+        pbenchThread->portName = portName;
+        pbenchThread->addr = (nAddr>0) ? i%nAddr : -1;
+        pbenchThread->priority = priority;
+        pbenchThread->nRequests = nRequests;
+        pbenchThread->latency = &latency[i*nRequests];
+        pbenchThread->callbackDone = epicsEventMustCreate(epicsEventEmpty);
+        pbenchThread->start = epicsEventMustCreate(epicsEventEmpty);
+        pbenchThread->done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadMustCreate("queueBench",epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            (EPICSTHREADFUNC)benchProducer,pbenchThread);
+    }
+    epicsTimeGetCurrent(&startTime);
+    for(i=0; i<nThreads; i++) epicsEventSignal(pbenchThreads[i].start);
+    for(i=0; i<nThreads; i++) epicsEventMustWait(pbenchThreads[i].done);
+    epicsTimeGetCurrent(&endTime);
+    elapsed = epicsTimeDiffInSeconds(&endTime,&startTime);
+    /* Pack the latencies of all threads together and sort them*/
+    for(i=0; i<nThreads; i++) {
+        benchThread *pbenchThread = &pbenchThreads[i];
+
+        for(n=0; n<pbenchThread->nRequests; n++)
+            latency[nTotal++] = pbenchThread->latency[n];
+        epicsEventDestroy(pbenchThread->callbackDone);
+        epicsEventDestroy(pbenchThread->start);
+        epicsEventDestroy(pbenchThread->done);
+    }
+    printf("%s threads %d requests %d elapsed %.3f seconds\n",
+        portName,nThreads,nTotal,elapsed);
+    if(nTotal>0 && elapsed>0.0) {
+        qsort(latency,nTotal,sizeof(double),compareDouble);
+        printf("    throughput %.0f requests/second\n",nTotal/elapsed);
+        printf("    latency microseconds p50 %.1f p99 %.1f max %.1f\n",
+            latency[nTotal/2]*1e6,
+            latency[(int)(nTotal*0.99)]*1e6,
+            latency[nTotal-1]*1e6);
+    }
+    free(latency);
+    free(pbenchThreads);
+}
+
+static const iocshArg testQueueBenchArg0 = {"port", iocshArgString};
+static const iocshArg testQueueBenchArg1 = {"nThreads", iocshArgInt};
+static const iocshArg testQueueBenchArg2 = {"nRequests", iocshArgInt};
+static const iocshArg testQueueBenchArg3 = {"nAddr", iocshArgInt};
+static const iocshArg testQueueBenchArg4 = {"priority", iocshArgInt};
+static const iocshArg *const testQueueBenchArgs[] = {
+    &testQueueBenchArg0,&testQueueBenchArg1,&testQueueBenchArg2,
+    &testQueueBenchArg3,&testQueueBenchArg4};
+static const iocshFuncDef testQueueBenchDef = {"testQueueBench", 5, testQueueBenchArgs};
+static void testQueueBenchCall(const iocshArgBuf * args)
+{
+    testQueueBench(args[0].sval,args[1].ival,args[2].ival,
+        args[3].ival,args[4].ival);
+}
+
+static void testQueueBenchRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testQueueBenchDef,testQueueBenchCall);
+}
+epicsExportRegistrar(testQueueBenchRegister);
@@ -0,0 +1,227 @@
+/* testQueueMerge.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Checks that asynManager:enableQueueMerge keeps the order of writes.
+ * A gate request holds the port thread while a sequence of writes is
+ * queued. When the gate opens, the port thread runs them. Each callback
+ * appends W(reason,value) to a log, and each merge callback appends
+ * W(reason,value)>W(reason,value) for the write that answered it.
+ * The log must match the expected one.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define PORT_NAME "queueMerge"
+#define MAX_WRITES 8
+#define LOG_SIZE 256
+
+typedef struct mergeCase {
+    const char *writes;   /*reason letter and value digit for each write*/
+    const char *expected;
+}mergeCase;
+
+static const mergeCase mergeCases[] = {
+    {"a1b1a2","W(a,1) W(b,1) W(a,2)"},
+    {"a1a2b1","W(a,2) W(a,1)>W(a,2) W(b,1)"},
+    {"a1a2a3","W(a,3) W(a,1)>W(a,3) W(a,2)>W(a,3)"},
+    {"a1b1a2b2","W(a,1) W(b,1) W(a,2) W(b,2)"}
+};
+#define NUMBER_CASES (sizeof(mergeCases)/sizeof(mergeCases[0]))
+
+typedef struct mergeWrite {
+    char reason;
+    char value;
+}mergeWrite;
+
+static char         mergeLog[LOG_SIZE];
+static int          nOutstanding;
+static epicsMutexId logLock;
+static epicsEventId allDone;
+static epicsEventId gateEntered;
+static epicsEventId gateOpen;
+
+static void logAppend(const char *text)
+{
+    size_t n = strlen(mergeLog);
+
+    if(n>0 && n<LOG_SIZE-1) mergeLog[n++] = ' ';
+    strncpy(mergeLog + n,text,LOG_SIZE - 1 - n);
+}
+
+static void writeDone(void)
+{
+    int last;
+
+    epicsMutexMustLock(logLock);
+    last = (--nOutstanding==0);
+    epicsMutexUnlock(logLock);
+    if(last) epicsEventSignal(allDone);
+}
+
+static void writeCallback(asynUser *pasynUser)
+{
+    mergeWrite *pmergeWrite = (mergeWrite *)pasynUser->userPvt;
+    char       text[16];
+
+    sprintf(text,"W(%c,%c)",pmergeWrite->reason,pmergeWrite->value);
+    epicsMutexMustLock(logLock);
+    logAppend(text);
+    epicsMutexUnlock(logLock);
+    writeDone();
+}
+
+static void writeMerged(asynUser *pasynUser,asynUser *pprocessedUser)
+{
+    mergeWrite *pmergeWrite = (mergeWrite *)pasynUser->userPvt;
+    mergeWrite *pprocessed = (mergeWrite *)pprocessedUser->userPvt;
+    char       text[32];
+
+    sprintf(text,"W(%c,%c)>W(%c,%c)",pmergeWrite->reason,pmergeWrite->value,
+        pprocessed->reason,pprocessed->value);
+    epicsMutexMustLock(logLock);
+    logAppend(text);
+    epicsMutexUnlock(logLock);
+    writeDone();
+}
+
+static void writeTimeout(asynUser *pasynUser)
+{
+    epicsMutexMustLock(logLock);
+    logAppend("timeout");
+    epicsMutexUnlock(logLock);
+    writeDone();
+}
+
+static void gateCallback(asynUser *pasynUser)
+{
+    epicsEventSignal(gateEntered);
+    epicsEventMustWait(gateOpen);
+}
+
+static asynStatus mergeConnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynStatus mergeDisconnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+static void mergeReport(void *drvPvt,FILE *fp,int details)
+{
+    fprintf(fp,"    testQueueMerge port\n");
+}
+
+static asynCommon mergeCommon = {mergeReport,mergeConnect,mergeDisconnect};
+static asynInterface mergeCommonInterface = {asynCommonType,&mergeCommon,0};
+
+static int mergePortInit(void)
+{
+    static int initialized = 0;
+
+    if(initialized) return 0;
+    if(pasynManager->registerPort(PORT_NAME,ASYN_CANBLOCK,1,0,0)!=asynSuccess)
+        return -1;
+    if(pasynManager->registerInterface(PORT_NAME,
+        &mergeCommonInterface)!=asynSuccess) return -1;
+    logLock = epicsMutexMustCreate();
+    allDone = epicsEventMustCreate(epicsEventEmpty);
+    gateEntered = epicsEventMustCreate(epicsEventEmpty);
+    gateOpen = epicsEventMustCreate(epicsEventEmpty);
+    initialized = 1;
+    return 0;
+}
+
+/*Returns 0 if the log matches*/
+static int mergeRun(const mergeCase *pmergeCase)
+{
+    mergeWrite mergeWrites[MAX_WRITES];
+    asynUser   *pasynUsers[MAX_WRITES];
+    asynUser   *pgateUser;
+    int        nWrites = (int)strlen(pmergeCase->writes)/2;
+    int        i,failed;
+
+    if(nWrites>MAX_WRITES) nWrites = MAX_WRITES;
+    mergeLog[0] = 0;
+    nOutstanding = nWrites;
+    pgateUser = pasynManager->createAsynUser(gateCallback,0);
+    pasynManager->connectDevice(pgateUser,PORT_NAME,0);
+    pasynManager->enableQueueMerge(pgateUser,1);
+    for(i=0; i<nWrites; i++) {
+        asynUser *pasynUser;
+
+        mergeWrites[i].reason = pmergeCase->writes[2*i];
+        mergeWrites[i].value = pmergeCase->writes[2*i+1];
+        pasynUser = pasynManager->createAsynUser(writeCallback,writeTimeout);
+        pasynUser->userPvt = &mergeWrites[i];
+        pasynUser->reason = mergeWrites[i].reason;
+        pasynManager->connectDevice(pasynUser,PORT_NAME,0);
+        pasynManager->setQueueMerge(pasynUser,asynQueueMergeWrite,writeMerged);
+        pasynUsers[i] = pasynUser;
+    }
+    pasynManager->queueRequest(pgateUser,asynQueuePriorityMedium,0.0);
+    epicsEventMustWait(gateEntered);
+    for(i=0; i<nWrites; i++) {
+        if(pasynManager->queueRequest(pasynUsers[i],
+            asynQueuePriorityMedium,0.0)!=asynSuccess) {
+            printf("queueRequest failed %s\n",pasynUsers[i]->errorMessage);
+            writeDone();
+        }
+    }
+    epicsEventSignal(gateOpen);
+    epicsEventMustWait(allDone);
+    failed = (strcmp(mergeLog,pmergeCase->expected)!=0);
+    printf("%s %-10s %s",PORT_NAME,pmergeCase->writes,failed ? "FAILED" : "OK");
+    if(failed) printf(" got \"%s\" expected \"%s\"",
+        mergeLog,pmergeCase->expected);
+    printf("\n");
+    for(i=0; i<nWrites; i++) pasynManager->freeAsynUser(pasynUsers[i]);
+    pasynManager->freeAsynUser(pgateUser);
+    return failed;
+}
+
+static void testQueueMerge(void)
+{
+    int nFailed = 0;
+    int i;
+
+    if(mergePortInit()) {
+        printf("testQueueMerge could not create port %s\n",PORT_NAME);
+        return;
+    }
+    for(i=0; i<(int)NUMBER_CASES; i++) nFailed += mergeRun(&mergeCases[i]);
+    printf("testQueueMerge %d of %d cases failed\n",nFailed,(int)NUMBER_CASES);
+}
+
+static const iocshFuncDef testQueueMergeDef = {"testQueueMerge", 0, 0};
+static void testQueueMergeCall(const iocshArgBuf * args)
+{
+    testQueueMerge();
+}
+
+static void testQueueMergeRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testQueueMergeDef,testQueueMergeCall);
+}
+epicsExportRegistrar(testQueueMergeRegister);
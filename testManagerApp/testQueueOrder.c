@@ -0,0 +1,218 @@
+/* testQueueOrder.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Checks the order in which a multi-device port runs queued requests.
+ * A gate request holds the port thread while requests for several devices
+ * are queued. When the gate opens, the port thread runs them. Each callback
+ * appends R(addr,priority) to a log, which must match the expected one.
+ * The strict policy runs a priority in the order the requests were queued,
+ * whatever the device. The fair policy lets the devices take turns.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define PORT_NAME "queueOrder"
+#define GATE_ADDR 9
+#define MAX_REQUESTS 8
+#define LOG_SIZE 256
+
+typedef struct orderCase {
+    asynQueuePolicy policy;
+    double          param;
+    const char      *requests; /*addr digit and priority letter l,m,h*/
+    const char      *expected;
+}orderCase;
+
+/* A tiny fair param makes each callback use up the share of its device*/
+static const orderCase orderCases[] = {
+    {asynQueuePolicyStrict,0.0,"0m0m0m1m","R(0,m) R(0,m) R(0,m) R(1,m)"},
+    {asynQueuePolicyStrict,0.0,"0m1m0m2h1m","R(2,h) R(0,m) R(1,m) R(0,m) R(1,m)"},
+    {asynQueuePolicyStrict,0.0,"1l0m1m0l","R(0,m) R(1,m) R(1,l) R(0,l)"},
+    {asynQueuePolicyFair,1e-9,"0m0m0m1m","R(0,m) R(1,m) R(0,m) R(0,m)"}
+};
+#define NUMBER_CASES (sizeof(orderCases)/sizeof(orderCases[0]))
+
+typedef struct orderRequest {
+    char addr;
+    char priority;
+}orderRequest;
+
+static char         orderLog[LOG_SIZE];
+static int          nOutstanding;
+static epicsMutexId logLock;
+static epicsEventId allDone;
+static epicsEventId gateEntered;
+static epicsEventId gateOpen;
+
+static void logAppend(const char *text)
+{
+    size_t n = strlen(orderLog);
+
+    if(n>0 && n<LOG_SIZE-1) orderLog[n++] = ' ';
+    strncpy(orderLog + n,text,LOG_SIZE - 1 - n);
+}
+
+static void requestDone(void)
+{
+    int last;
+
+    epicsMutexMustLock(logLock);
+    last = (--nOutstanding==0);
+    epicsMutexUnlock(logLock);
+    if(last) epicsEventSignal(allDone);
+}
+
+static void requestCallback(asynUser *pasynUser)
+{
+    orderRequest *porderRequest = (orderRequest *)pasynUser->userPvt;
+    char         text[16];
+
+    sprintf(text,"R(%c,%c)",porderRequest->addr,porderRequest->priority);
+    epicsMutexMustLock(logLock);
+    logAppend(text);
+    epicsMutexUnlock(logLock);
+    requestDone();
+}
+
+static void gateCallback(asynUser *pasynUser)
+{
+    epicsEventSignal(gateEntered);
+    epicsEventMustWait(gateOpen);
+}
+
+static asynStatus orderConnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynStatus orderDisconnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+static void orderReport(void *drvPvt,FILE *fp,int details)
+{
+    fprintf(fp,"    testQueueOrder port\n");
+}
+
+static asynCommon orderCommon = {orderReport,orderConnect,orderDisconnect};
+static asynInterface orderCommonInterface = {asynCommonType,&orderCommon,0};
+
+static int orderPortInit(void)
+{
+    static int initialized = 0;
+
+    if(initialized) return 0;
+    if(pasynManager->registerPort(PORT_NAME,
+        ASYN_CANBLOCK|ASYN_MULTIDEVICE,1,0,0)!=asynSuccess) return -1;
+    if(pasynManager->registerInterface(PORT_NAME,
+        &orderCommonInterface)!=asynSuccess) return -1;
+    logLock = epicsMutexMustCreate();
+    allDone = epicsEventMustCreate(epicsEventEmpty);
+    gateEntered = epicsEventMustCreate(epicsEventEmpty);
+    gateOpen = epicsEventMustCreate(epicsEventEmpty);
+    initialized = 1;
+    return 0;
+}
+
+static asynQueuePriority orderPriority(char priority)
+{
+    if(priority=='h') return asynQueuePriorityHigh;
+    if(priority=='l') return asynQueuePriorityLow;
+    return asynQueuePriorityMedium;
+}
+
+/*Returns 0 if the log matches*/
+static int orderRun(const orderCase *porderCase)
+{
+    orderRequest orderRequests[MAX_REQUESTS];
+    asynUser     *pasynUsers[MAX_REQUESTS];
+    asynUser     *pgateUser;
+    int          nRequests = (int)strlen(porderCase->requests)/2;
+    int          i,failed;
+
+    if(nRequests>MAX_REQUESTS) nRequests = MAX_REQUESTS;
+    orderLog[0] = 0;
+    nOutstanding = nRequests;
+    pgateUser = pasynManager->createAsynUser(gateCallback,0);
+    pasynManager->connectDevice(pgateUser,PORT_NAME,GATE_ADDR);
+    for(i=0; i<nRequests; i++) {
+        asynUser *pasynUser;
+
+        orderRequests[i].addr = porderCase->requests[2*i];
+        orderRequests[i].priority = porderCase->requests[2*i+1];
+        pasynUser = pasynManager->createAsynUser(requestCallback,0);
+        pasynUser->userPvt = &orderRequests[i];
+        pasynManager->connectDevice(pasynUser,PORT_NAME,
+            orderRequests[i].addr - '0');
+        pasynUsers[i] = pasynUser;
+    }
+    pasynManager->queueRequest(pgateUser,asynQueuePriorityHigh,0.0);
+    epicsEventMustWait(gateEntered);
+    pasynManager->setQueuePolicy(pgateUser,porderCase->policy,porderCase->param);
+    for(i=0; i<nRequests; i++) {
+        if(pasynManager->queueRequest(pasynUsers[i],
+            orderPriority(orderRequests[i].priority),0.0)!=asynSuccess) {
+            printf("queueRequest failed %s\n",pasynUsers[i]->errorMessage);
+            requestDone();
+        }
+    }
+    epicsEventSignal(gateOpen);
+    epicsEventMustWait(allDone);
+    failed = (strcmp(orderLog,porderCase->expected)!=0);
+    printf("%s %-6s %-10s %s",PORT_NAME,
+        porderCase->policy==asynQueuePolicyStrict ? "strict" : "fair",
+        porderCase->requests,failed ? "FAILED" : "OK");
+    if(failed) printf(" got \"%s\" expected \"%s\"",
+        orderLog,porderCase->expected);
+    printf("\n");
+    pasynManager->setQueuePolicy(pgateUser,asynQueuePolicyStrict,0.0);
+    for(i=0; i<nRequests; i++) pasynManager->freeAsynUser(pasynUsers[i]);
+    pasynManager->freeAsynUser(pgateUser);
+    return failed;
+}
+
+static void testQueueOrder(void)
+{
+    int nFailed = 0;
+    int i;
+
+    if(orderPortInit()) {
+        printf("testQueueOrder could not create port %s\n",PORT_NAME);
+        return;
+    }
+    for(i=0; i<(int)NUMBER_CASES; i++) nFailed += orderRun(&orderCases[i]);
+    printf("testQueueOrder %d of %d cases failed\n",nFailed,(int)NUMBER_CASES);
+}
+
+static const iocshFuncDef testQueueOrderDef = {"testQueueOrder", 0, 0};
+static void testQueueOrderCall(const iocshArgBuf * args)
+{
+    testQueueOrder();
+}
+
+static void testQueueOrderRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testQueueOrderDef,testQueueOrderCall);
+}
+epicsExportRegistrar(testQueueOrderRegister);
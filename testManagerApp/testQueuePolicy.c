@@ -0,0 +1,333 @@
+/* testQueuePolicy.c */
+/***********************************************************************
+* Copyright (c) 2002 The University of Chicago, as Operator of Argonne
+* National Laboratory, and the Regents of the University of
+* California, as Operator of Los Alamos National Laboratory
+* asynDriver is distributed subject to a Software License Agreement
+* found in file LICENSE that is included with this distribution.
+***********************************************************************/
+
+/* Compares the queue policies of asynManager:setQueuePolicy.
+ * A port with four addresses gets a mixed load:
+ *   chatty  addr 0, high priority, 4 asynUsers that queue again from the
+ *           callback, each request takes 4 service times
+ *   busy    addr 1, high priority, 1 asynUser that queues again from the
+ *           callback
+ *   quiet   addr 2, high priority, one request every 10 milliseconds
+ *   low     addr 3, low priority, one request every 10 milliseconds with
+ *           a queueRequest timeout of 0.5 seconds
+ * For each class it prints the share of the port, the queue latency
+ * percentiles and the number of queueRequest timeouts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <asynDriver.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#define PORT_NAME "queuePolicy"
+#define MAX_SAMPLES 100000
+
+typedef struct policyClass {
+    const char *name;
+    int        addr;
+    int        priority;
+    int        nUsers;
+    int        serviceFactor;
+    int        closedLoop;  /*queue again from the callback*/
+    double     timeout;
+    /*The following are reset for every policy*/
+    double     *latency;
+    int        nSamples;
+    int        nRequests;
+    int        nTimeouts;
+    double     serviceSeconds;
+}policyClass;
+
+static policyClass policyClasses[] = {
+    {"chatty",0,asynQueuePriorityHigh,4,4,1,0.0},
+    {"busy",  1,asynQueuePriorityHigh,1,1,1,0.0},
+    {"quiet", 2,asynQueuePriorityHigh,1,1,0,0.0},
+    {"low",   3,asynQueuePriorityLow, 1,1,0,0.5}
+};
+#define NUMBER_CLASSES (sizeof(policyClasses)/sizeof(policyClasses[0]))
+
+typedef struct policyUser {
+    policyClass    *pclass;
+    epicsTimeStamp queued;
+    epicsEventId   callbackDone;
+}policyUser;
+
+static double       serviceTime;
+static volatile int stopping;
+static int          nOutstanding;
+static epicsMutexId outstandingLock;
+static epicsEventId allDone;
+
+static void policyUserDone(void)
+{
+    int last;
+
+    epicsMutexMustLock(outstandingLock);
+    last = (--nOutstanding==0);
+    epicsMutexUnlock(outstandingLock);
+    if(last) epicsEventSignal(allDone);
+}
+
+static void spin(double seconds)
+{
+    epicsTimeStamp start,now;
+
+    epicsTimeGetCurrent(&start);
+    do {
+        epicsTimeGetCurrent(&now);
+    } while(epicsTimeDiffInSeconds(&now,&start)<seconds);
+}
+
+static void policyCallback(asynUser *pasynUser)
+{
+    policyUser     *ppolicyUser = (policyUser *)pasynUser->userPvt;
+    policyClass    *pclass = ppolicyUser->pclass;
+    epicsTimeStamp now;
+    double         service = serviceTime*pclass->serviceFactor;
+
+    epicsTimeGetCurrent(&now);
+    if(pclass->nSamples<MAX_SAMPLES)
+        pclass->latency[pclass->nSamples++] =
+            epicsTimeDiffInSeconds(&now,&ppolicyUser->queued);
+    pclass->nRequests++;
+    spin(service);
+    pclass->serviceSeconds += service;
+    if(!pclass->closedLoop) {
+        epicsEventSignal(ppolicyUser->callbackDone);
+        return;
+    }
+    if(stopping) {
+        policyUserDone();
+        return;
+    }
+    epicsTimeGetCurrent(&ppolicyUser->queued);
+    if(pasynManager->queueRequest(pasynUser,
+        (asynQueuePriority)pclass->priority,pclass->timeout)!=asynSuccess) {
+        printf("queueRequest failed %s\n",pasynUser->errorMessage);
+        policyUserDone();
+    }
+}
+
+static void policyTimeout(asynUser *pasynUser)
+{
+    policyUser *ppolicyUser = (policyUser *)pasynUser->userPvt;
+
+    ppolicyUser->pclass->nTimeouts++;
+    if(ppolicyUser->pclass->closedLoop) {
+        policyUserDone();
+    } else {
+        epicsEventSignal(ppolicyUser->callbackDone);
+    }
+}
+
+static void policyProducer(asynUser *pasynUser)
+{
+    policyUser  *ppolicyUser = (policyUser *)pasynUser->userPvt;
+    policyClass *pclass = ppolicyUser->pclass;
+
+    while(!stopping) {
+        epicsTimeGetCurrent(&ppolicyUser->queued);
+        if(pasynManager->queueRequest(pasynUser,
+            (asynQueuePriority)pclass->priority,pclass->timeout)!=asynSuccess) {
+            printf("queueRequest failed %s\n",pasynUser->errorMessage);
+            break;
+        }
+        epicsEventMustWait(ppolicyUser->callbackDone);
+        epicsThreadSleep(0.01);
+    }
+    policyUserDone();
+}
+
+static int compareDouble(const void *p1,const void *p2)
+{
+    double d1 = *(const double *)p1;
+    double d2 = *(const double *)p2;
+
+    return (d1<d2) ? -1 : ((d1>d2) ? 1 : 0);
+}
+
+static asynStatus policyConnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionConnect(pasynUser);
+    return asynSuccess;
+}
+
+static asynStatus policyDisconnect(void *drvPvt,asynUser *pasynUser)
+{
+    pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+static void policyReport(void *drvPvt,FILE *fp,int details)
+{
+    fprintf(fp,"    testQueuePolicy port\n");
+}
+
+static asynCommon policyCommon = {policyReport,policyConnect,policyDisconnect};
+static asynInterface policyCommonInterface = {asynCommonType,&policyCommon,0};
+
+static int policyPortInit(void)
+{
+    static int initialized = 0;
+
+    if(initialized) return 0;
+    if(pasynManager->registerPort(PORT_NAME,ASYN_MULTIDEVICE|ASYN_CANBLOCK,
+        1,0,0)!=asynSuccess) return -1;
+    if(pasynManager->registerInterface(PORT_NAME,
+        &policyCommonInterface)!=asynSuccess) return -1;
+    outstandingLock = epicsMutexMustCreate();
+    allDone = epicsEventMustCreate(epicsEventEmpty);
+    initialized = 1;
+    return 0;
+}
+
+static void policyRun(asynQueuePolicy policy,const char *policyName,
+    double param,double seconds)
+{
+    policyUser *ppolicyUsers;
+    asynUser   **pasynUsers;
+    asynUser   *pasynUser;
+    double     total = 0.0;
+    int        nUsers = 0;
+    int        i,j,n;
+
+    for(i=0; i<(int)NUMBER_CLASSES; i++) nUsers += policyClasses[i].nUsers;
+    ppolicyUsers = callocMustSucceed(nUsers,sizeof(policyUser),
+        "testQueuePolicy");
+    pasynUsers = callocMustSucceed(nUsers,sizeof(asynUser *),
+        "testQueuePolicy");
+    pasynUser = pasynManager->createAsynUser(0,0);
+    pasynManager->connectDevice(pasynUser,PORT_NAME,0);
+    if(pasynManager->setQueuePolicy(pasynUser,policy,param)!=asynSuccess) {
+        printf("setQueuePolicy failed %s\n",pasynUser->errorMessage);
+        goto done;
+    }
+    pasynManager->resetQueueStatistics(pasynUser);
+    stopping = 0;
+    nOutstanding = nUsers;
+    for(i=0, n=0; i<(int)NUMBER_CLASSES; i++) {
+        policyClass *pclass = &policyClasses[i];
+
+        pclass->latency = callocMustSucceed(MAX_SAMPLES,sizeof(double),
+            "testQueuePolicy");
+        pclass->nSamples = pclass->nRequests = pclass->nTimeouts = 0;
+        pclass->serviceSeconds = 0.0;
+        for(j=0; j<pclass->nUsers; j++, n++) {
+            policyUser *ppolicyUser = &ppolicyUsers[n];
+            asynUser   *puser;
+
+            ppolicyUser->pclass = pclass;
+            ppolicyUser->callbackDone = epicsEventMustCreate(epicsEventEmpty);
+            puser = pasynManager->createAsynUser(policyCallback,policyTimeout);
+            puser->userPvt = ppolicyUser;
+            pasynManager->connectDevice(puser,PORT_NAME,pclass->addr);
+            pasynUsers[n] = puser;
+        }
+    }
+    for(n=0; n<nUsers; n++) {
+        policyUser  *ppolicyUser = &ppolicyUsers[n];
+        policyClass *pclass = ppolicyUser->pclass;
+
+        if(pclass->closedLoop) {
+            epicsTimeGetCurrent(&ppolicyUser->queued);
+            pasynManager->queueRequest(pasynUsers[n],
+                (asynQueuePriority)pclass->priority,pclass->timeout);
+        } else {
+            epicsThreadMustCreate("queuePolicy",epicsThreadPriorityMedium,
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                (EPICSTHREADFUNC)policyProducer,pasynUsers[n]);
+        }
+    }
+    epicsThreadSleep(seconds);
+    stopping = 1;
+    epicsEventMustWait(allDone);
+    printf("%s policy %s\n",PORT_NAME,policyName);
+    for(i=0; i<(int)NUMBER_CLASSES; i++)
+        total += policyClasses[i].serviceSeconds;
+    for(i=0; i<(int)NUMBER_CLASSES; i++) {
+        policyClass *pclass = &policyClasses[i];
+        int         ns = pclass->nSamples;
+
+        printf("    %-6s requests %7d port %5.1f%% timeouts %5d",
+            pclass->name,pclass->nRequests,
+            (total>0.0) ? 100.0*pclass->serviceSeconds/total : 0.0,
+            pclass->nTimeouts);
+        if(ns>0) {
+            qsort(pclass->latency,ns,sizeof(double),compareDouble);
+            printf(" latency ms p50 %.3f p99 %.3f max %.3f",
+                pclass->latency[ns/2]*1e3,
+                pclass->latency[(int)(ns*0.99)]*1e3,
+                pclass->latency[ns-1]*1e3);
+        }
+        printf("\n");
+        free(pclass->latency);
+        pclass->latency = 0;
+    }
+    for(n=0; n<nUsers; n++) {
+        pasynManager->freeAsynUser(pasynUsers[n]);
+        epicsEventDestroy(ppolicyUsers[n].callbackDone);
+    }
+done:
+    pasynManager->freeAsynUser(pasynUser);
+    free(pasynUsers);
+    free(ppolicyUsers);
+}
+
+static void testQueuePolicy(const char *policyName,double param,
+    double seconds,double serviceMicroseconds)
+{
+    static const char *policyNames[] = {ASYN_QUEUE_POLICY_STRINGS};
+    int  nPolicies = sizeof(policyNames)/sizeof(policyNames[0]);
+    int  all = (!policyName || !policyName[0] || strcmp(policyName,"all")==0);
+    int  i;
+
+    if(seconds<=0.0) seconds = 5.0;
+    if(serviceMicroseconds<=0.0) serviceMicroseconds = 100.0;
+    serviceTime = serviceMicroseconds*1e-6;
+    if(policyPortInit()) {
+        printf("testQueuePolicy could not create port %s\n",PORT_NAME);
+        return;
+    }
+    for(i=0; i<nPolicies; i++) {
+        if(!all && strcmp(policyName,policyNames[i])!=0) continue;
+        policyRun((asynQueuePolicy)i,policyNames[i],param,seconds);
+        if(!all) return;
+    }
+    if(!all) printf("testQueuePolicy unknown policy %s\n",policyName);
+}
+
+static const iocshArg testQueuePolicyArg0 = {"policy", iocshArgString};
+static const iocshArg testQueuePolicyArg1 = {"param", iocshArgDouble};
+static const iocshArg testQueuePolicyArg2 = {"seconds", iocshArgDouble};
+static const iocshArg testQueuePolicyArg3 = {"serviceMicroseconds", iocshArgDouble};
+static const iocshArg *const testQueuePolicyArgs[] = {
+    &testQueuePolicyArg0,&testQueuePolicyArg1,&testQueuePolicyArg2,
+    &testQueuePolicyArg3};
+static const iocshFuncDef testQueuePolicyDef = {"testQueuePolicy", 4, testQueuePolicyArgs};
+static void testQueuePolicyCall(const iocshArgBuf * args)
+{
+    testQueuePolicy(args[0].sval,args[1].dval,args[2].dval,args[3].dval);
+}
+
+static void testQueuePolicyRegister(void)
+{
+    static int firstTime = 1;
+    if(!firstTime) return;
+    firstTime = 0;
+    iocshRegister(&testQueuePolicyDef,testQueuePolicyCall);
+}
+epicsExportRegistrar(testQueuePolicyRegister);